@@ -1,22 +1,138 @@
 #include "soundio/soundio.h"
+#include "block_index.h"
+#include "capture_session.h"
+#include "channel_split_writer.h"
+#include "device_supervisor.h"
+#include "rate_split_writer.h"
+#include "dsp/convert.h++"
+#include "energy_gate.h"
+#include "flac_encoder.h"
+#include "levels.h"
+#include "load_shedder.h"
+#include "pipe_writer.h"
+#include "rt_thread.h"
+#include "segment_writer.h"
+#include "wav_header.h"
 
 #include <iostream>
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <math.h>
+#include <signal.h>
 #include <unistd.h>
+#include <atomic>
+#include <functional>
 #include <future>
+#include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
 
+// options shared by every recording started from the command line
+struct RecordOptions {
+    double segment_seconds = 0;
+    int64_t segment_bytes = 0;
+    OutputContainer container = ContainerRaw;
+    int compress_threads = 2;
 
-// TODO - use ring buffer w/o wrapper
-struct RecordContext {
-    struct SoundIoRingBuffer *ring_buffer;
+    // Pre-roll mode: keep the last `preroll_seconds` in the ring buffer
+    // without writing anything until a trigger (SIGUSR1, a "trigger" line
+    // on stdin, or a block peak at or above `trigger_level`) fires, then
+    // write the pre-roll and `postroll_seconds` of what follows.
+    double preroll_seconds = 0;
+    double postroll_seconds = 10;
+    double trigger_level = 0;     // linear full scale; 0 = no level trigger
+
+    // Energy gate: blocks below the gate level are not written (see
+    // EnergyGate); the gaps are logged next to the output.
+    GateConfig gate;
+
+    // Publish the capture to a POSIX shared-memory ring for local readers
+    // (see shm_ring.h); empty = off.
+    string shm_name;
+    double shm_seconds = 4;
+
+    // Output path: "-" or a FIFO streams raw frames (see PipeWriter), any
+    // other path replaces the /tmp/recordconv-<device name> file base.
+    string out_path;
+    double pipe_backlog_seconds = 2;   // held for a slow reader before dropping
+
+    // Planar output: one file per channel (see ChannelSplitWriter), only
+    // for the channels listed (empty = all).
+    bool planar = false;
+    vector<int> channel_select;
+
+    // TPDF dither when the capture is converted to fewer bits for the file
+    bool dither = false;
+
+    // extra copies at these sample rates: <base>.<rate>hz (see RateSplitWriter)
+    vector<int> rates;
+
+    // timing marks every this many frames: <base>.blocks (see block_index.h); 0 = off
+    int index_frames = 0;
+
+    // Placement and realtime priority of the writer (this drain loop) and
+    // of libsoundio's callback thread (see rt_thread.h); lock_memory also
+    // mlocks the capture and shared-memory rings.
+    ThreadTuning writer_thread;
+    ThreadTuning callback_thread;
+    bool lock_memory = false;
+
+    // What to give up when the disk falls behind the capture (see
+    // LoadShedder); an empty ladder only keeps a full ring from ending
+    // the recording.
+    ShedConfig shed;
 };
 
+// where record_in sends frames; exactly one of writer and planar is set
+struct RecordOutput {
+    FlacEncoderPool *encoder = nullptr;   // FLAC container only, feeds writer
+    SegmentWriter *writer = nullptr;
+    ChannelSplitWriter *planar = nullptr;
+    RateSplitWriter *rates = nullptr;     // --rates, beside writer
+
+    // set when the container cannot hold the device format (see
+    // container_format_for); frames are converted before they are written
+    SoundIoFormat device_format = SoundIoFormatInvalid;
+    SoundIoFormat file_format = SoundIoFormatInvalid;
+    int channels = 0;
+    Dither *dither = nullptr;
+    vector<char> converted;
+
+    // --shed: the policy and one cheaper series per count of channel,
+    // format and rate steps, opened when first needed
+    LoadShedder *shedder = nullptr;
+    vector<ShedSeries*> shed;
+    int64_t capture_start_ns = 0;
+
+    // the passes after capture stopped wait for the encoder instead of
+    // leaving audio in the ring
+    bool final_pass = false;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+static atomic<unsigned> trigger_count(0);
+
+static void on_stop_signal(int) {
+    stop_requested = 1;
+}
+
+static void on_trigger_signal(int) {
+    trigger_count++;
+}
+
+static void watch_stdin_triggers() {
+    string line;
+    while (getline(cin, line)) {
+        if (line.empty() || line == "trigger")
+            trigger_count++;
+    }
+}
+
 static enum SoundIoFormat prioritized_formats[] = {
     SoundIoFormatFloat32NE,
     SoundIoFormatFloat32FE,
@@ -47,16 +163,47 @@ static int prioritized_sample_rates[] = {
     0,
 };
 
-static int min_int(int a, int b) {
-    return (a < b) ? a : b;
-}
-
 static int usage(char *exe) {
     fprintf(stderr, "Usage: %s [options]\n"
             "Options:\n"
             "  [--listdevices]\n"
+            "  [--json]                     # with --listdevices, print the devices as JSON on stdout\n"
+            "  [--backend $name]            # jack, pulseaudio, alsa, coreaudio, wasapi or dummy\n"
+            "                               #   instead of trying each in turn\n"
             "  [--record {--deviceid $deviceid}] # uses default input device if --deviceid is not passed]\n"
+            "                               #   $deviceid may also be a device name\n"
             "  [--recordconv --deviceid-ch0 $deviceid-ch0 --deviceid-ch1 $deviceid-ch1]\n"
+            "  [--segment-seconds $seconds] # rotate output files after this much audio\n"
+            "  [--segment-bytes $bytes]     # rotate output files after this many bytes\n"
+            "  [--container raw|wav|flac]   # wav writes RIFF/RF64 headers, flac compresses\n"
+            "  [--compress-threads $n]      # flac encoder threads per device (default 2)\n"
+            "  [--preroll $seconds]         # only write around triggers (SIGUSR1, stdin \"trigger\")\n"
+            "  [--postroll $seconds]        # audio kept after a trigger (default 10)\n"
+            "  [--trigger-level $dbfs]      # also trigger when the peak reaches this level\n"
+            "  [--gate $dbfs]               # skip blocks whose RMS stays below this level\n"
+            "  [--gate-hysteresis $db]      # gate closes this far below --gate (default 6)\n"
+            "  [--gate-hangover $seconds]   # quiet audio kept before closing (default 0.5)\n"
+            "  [--shm $name]                # publish the capture to shared memory ring $name\n"
+            "  [--shm-seconds $seconds]     # shared memory ring size (default 4)\n"
+            "  [--shm-read $name]           # attach to ring $name and copy it to stdout\n"
+            "  [--out $path]                # output file base; \"-\" or a FIFO streams raw frames\n"
+            "  [--pipe-backlog $seconds]    # held for a slow pipe reader before dropping (default 2)\n"
+            "  [--planar]                   # one file per channel: <base>.ch<N>\n"
+            "  [--channels $n,$m,...]       # with --planar, only write these channels\n"
+            "  [--dither]                   # TPDF dither when converting to fewer bits for the file\n"
+            "  [--rates $r,$s,...]          # also write the capture resampled to each rate: <base>.<rate>hz\n"
+            "  [--index-frames $n]          # log clocks and latency every $n frames: <base>.blocks\n"
+            "  [--cpus-callback $list]      # pin the audio callback thread, e.g. 2 or 2,3 or 0-3\n"
+            "  [--cpus-loop $list]          # pin the device event loop thread\n"
+            "  [--cpus-writer $list]        # pin the thread(s) draining the capture to files\n"
+            "  [--rt fifo|rr]               # realtime scheduling for those three threads\n"
+            "  [--rt-priority $n]           # callback priority (default 70), the others run 10 below\n"
+            "  [--mlock]                    # lock the capture rings into memory\n"
+            "  [--shed $step,$step,...]     # when the disk falls behind, in this order: drop-oldest,\n"
+            "                               #   channels, s16, rate, spill; undone once it catches up\n"
+            "  [--shed-channels $n,$m,...]  # channels the channels step keeps (default 0)\n"
+            "  [--shed-rate $hz]            # rate of the rate step (default 16000)\n"
+            "  [--spill-dir $dir]           # where the spill step opens new segments\n"
             "  [--verbose]\n", exe);
     return 1;
 }
@@ -118,55 +265,236 @@ static void print_device(struct SoundIoDevice *device, bool is_default, bool ver
     fprintf(stderr, "\n");
 }
 
-static void read_callback(struct SoundIoInStream *instream, int frame_count_min, int frame_count_max) {
-    struct RecordContext *rc = (RecordContext*) instream->userdata;
-    struct SoundIoChannelArea *areas;
-    int err;
-    char *write_ptr = soundio_ring_buffer_write_ptr(rc->ring_buffer);
-    int free_bytes = soundio_ring_buffer_free_count(rc->ring_buffer);
-    int free_count = free_bytes / instream->bytes_per_frame;
-    if (free_count < frame_count_min) {
-        fprintf(stderr, "ring buffer overflow\n");
-        exit(1);
-    }
-    int write_frames = min_int(free_count, frame_count_max);
-    int frames_left = write_frames;
-    for (;;) {
-        int frame_count = frames_left;
-        if ((err = soundio_instream_begin_read(instream, &areas, &frame_count))) {
-            fprintf(stderr, "begin read error: %s", soundio_strerror(err));
-            exit(1);
-        }
-        if (!frame_count)
-            break;
-        if (!areas) {
-            // Due to an overflow there is a hole. Fill the ring buffer with
-            // silence for the size of the hole.
-            memset(write_ptr, 0, frame_count * instream->bytes_per_frame);
-        } else {
-            for (int frame = 0; frame < frame_count; frame += 1) {
-                for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
-                    memcpy(write_ptr, areas[ch].ptr, instream->bytes_per_sample);
-                    areas[ch].ptr += areas[ch].step;
-                    write_ptr += instream->bytes_per_sample;
-                }
+// Formats the output container can represent, best first (by
+// prioritized_formats). Empty for raw output: any device format will do.
+static vector<enum SoundIoFormat> container_formats(OutputContainer container) {
+    vector<enum SoundIoFormat> formats;
+    if (container == ContainerRaw)
+        return formats;
+    for (enum SoundIoFormat *f = prioritized_formats; *f != SoundIoFormatInvalid; f += 1) {
+        WavFormat probe;
+        if (container == ContainerWav && wav_format_from_soundio(*f, 1, 48000, &probe) == 0)
+            formats.push_back(*f);
+        if (container == ContainerFlac && flac_bits_for_format(*f) > 0)
+            formats.push_back(*f);
+    }
+    return formats;
+}
+
+// The format a container stores a device format in: the format itself when
+// the container takes it, otherwise the nearest one it does take (FLAC
+// tops out at 24 bit integers).
+static enum SoundIoFormat container_format_for(enum SoundIoFormat fmt, OutputContainer container) {
+    WavFormat probe;
+    if (container == ContainerRaw ||
+        (container == ContainerWav && wav_format_from_soundio(fmt, 1, 48000, &probe) == 0) ||
+        (container == ContainerFlac && flac_bits_for_format(fmt) > 0))
+        return fmt;
+
+    int bits = sample_format_bits(fmt);
+    bool is_float = fmt == SoundIoFormatFloat32LE || fmt == SoundIoFormatFloat32BE ||
+                    fmt == SoundIoFormatFloat64LE || fmt == SoundIoFormatFloat64BE;
+    if (container == ContainerWav) {
+        if (is_float)
+            return bits > 24 ? SoundIoFormatFloat64LE : SoundIoFormatFloat32LE;
+        if (bits <= 8)
+            return SoundIoFormatU8;
+        // 24 bit samples move to the top of their word
+        return bits <= 16 ? SoundIoFormatS16LE : SoundIoFormatS32LE;
+    }
+    if (bits <= 8)
+        return SoundIoFormatS8;
+    return bits <= 16 ? SoundIoFormatS16LE : SoundIoFormatS24LE;
+}
+
+// Write every encoded block that is ready (or all of them when `wait`)
+static int write_encoded(FlacEncoderPool *pool, SegmentWriter *writer, bool wait) {
+    FlacEncoderPool::Block block;
+    while (pool->next(block, wait)) {
+        if (writer->write_flac_frame(block.encoded.data(), block.encoded.size(),
+                                     block.frames, block.channel_assignment))
+            return 1;
+    }
+    return 0;
+}
+
+// How many of `bytes` the output takes this pass: all of them, unless the
+// FLAC encoder's backlog is full. The rest stays in the ring buffer, where
+// its fill level (and the load shedder) see an encoder that fell behind.
+static int64_t output_room(RecordOutput *out, int64_t bytes, int bytes_per_frame, int *err) {
+    *err = 0;
+    if (!out->encoder) {
+        return bytes;
+    }
+    // finished blocks free their slots
+    if ((*err = write_encoded(out->encoder, out->writer, out->final_pass))) {
+        return 0;
+    }
+    return min(bytes / bytes_per_frame, out->encoder->room()) * bytes_per_frame;
+}
+
+// `bytes` must fit output_room()
+static int write_frames(RecordOutput *out, const char *buf, int64_t bytes, int bytes_per_frame) {
+    if (out->file_format != out->device_format) {
+        int64_t frames = bytes / bytes_per_frame;
+        int64_t samples = frames * out->channels;
+        int file_frame = sample_format_bytes(out->file_format) * out->channels;
+        out->converted.resize((size_t)(frames * file_frame));
+        samples_convert(buf, out->device_format, samples, out->converted.data(),
+                        out->file_format, out->dither);
+        buf = out->converted.data();
+        bytes = frames * file_frame;
+        bytes_per_frame = file_frame;
+    }
+    if (out->rates && out->rates->write(buf, bytes)) {
+        return 1;
+    }
+    if (out->planar) {
+        return out->planar->write(buf, bytes);
+    }
+    if (out->encoder) {
+        // the copy into the encoder queue is all the drain loop pays for
+        out->encoder->push(buf, bytes / bytes_per_frame);
+        return write_encoded(out->encoder, out->writer, false);
+    }
+    return out->writer->write(buf, bytes);
+}
+
+// move the callback's timing marks to the .blocks file
+static int write_marks(CaptureSession *session, BlockIndexWriter *index) {
+    BlockIndexEntry marks[256];
+    int count;
+    while ((count = session->take_marks(marks, 256)) > 0) {
+        if (index->write(marks, count))
+            return 1;
+    }
+    return 0;
+}
+
+static int skip_frames(RecordOutput *out, int64_t frames, bool new_segment) {
+    if (out->rates && out->rates->skip(frames, new_segment)) {
+        return 1;
+    }
+    if (out->planar) {
+        return out->planar->skip(frames, new_segment);
+    }
+    if (out->encoder && out->encoder->pending() > 0) {
+        // everything before the gap must reach the file first; back to
+        // back skips have nothing left to flush
+        out->encoder->flush();
+        if (write_encoded(out->encoder, out->writer, true))
+            return 1;
+    }
+    return out->writer->skip(frames, new_segment);
+}
+
+// One drain pass with load shedding: let the shedder look at the backlog,
+// carry out a change of level, then write the backlog to the native files
+// or to the series of the level in force. Every file set that does not get
+// the frames logs them as a gap. Returns the bytes consumed.
+static int64_t drain_shedding(RecordOutput *out, const char *device, const char *buf,
+                              int64_t fill_bytes, int64_t ring_bytes, int bytes_per_frame,
+                              int *err) {
+    LoadShedder *shedder = out->shedder;
+    const ShedConfig& config = shedder->config();
+    int64_t capture_frame = out->writer->frames_written() + out->writer->frames_skipped();
+    double fill = (double)fill_bytes / ring_bytes;
+    int64_t used = 0;
+    *err = 0;
+
+    int direction = shedder->update(fill, capture_frame, monotonic_ns());
+    if (direction) {
+        ShedStep step = config.ladder[direction > 0 ? shedder->level() - 1 : shedder->level()];
+        fprintf(stderr, "%s: %s %s with the ring %.0f%% full (level %d)\n", device,
+                direction > 0 ? "shedding" : "restoring", shed_step_name(step), fill * 100,
+                shedder->level());
+        if (step == ShedSpill) {
+            string dir = direction > 0 ? config.spill_dir : string();
+            if ((*err = out->writer->spill(dir)))
+                return 0;
+            for (ShedSeries *series : out->shed) {
+                if (series->is_open() && (*err = series->spill(dir)))
+                    return 0;
             }
         }
-        if ((err = soundio_instream_end_read(instream))) {
-            fprintf(stderr, "end read error: %s", soundio_strerror(err));
-            exit(1);
+    }
+
+    if (shedder->active(ShedDropOldest) && fill > config.high_water) {
+        // keep the newest audio; what is dropped is logged as a gap
+        int64_t frames = (fill_bytes - (int64_t)(config.low_water * ring_bytes)) / bytes_per_frame;
+        if ((*err = skip_frames(out, frames, false)))
+            return 0;
+        for (ShedSeries *series : out->shed) {
+            if (series->is_open() && (*err = series->skip(frames, false)))
+                return 0;
         }
-        frames_left -= frame_count;
-        if (frames_left <= 0)
-            break;
+        shedder->count_dropped(frames);
+        capture_frame += frames;
+        used = frames * bytes_per_frame;
+    }
+
+    int64_t bytes = (fill_bytes - used) / bytes_per_frame * bytes_per_frame;
+    int n = shedder->reductions(shedder->level());
+    ShedSeries *target = n > 0 ? out->shed[n - 1] : nullptr;
+    if (!target) {
+        bytes = output_room(out, bytes, bytes_per_frame, err);
+        if (*err)
+            return used;
+    }
+    int64_t frames = bytes / bytes_per_frame;
+    if (target && !target->is_open()) {
+        cerr << device << ": writing " << target->describe() << endl;
+        if ((*err = target->open(out->capture_start_ns, capture_frame)))
+            return used;
+        if (shedder->active(ShedSpill) && (*err = target->spill(config.spill_dir)))
+            return used;
+    }
+    if (target) {
+        if ((*err = target->write(buf + used, bytes)) || (*err = skip_frames(out, frames, false)))
+            return used;
+    } else if ((*err = write_frames(out, buf + used, bytes, bytes_per_frame))) {
+        return used;
     }
-    int advance_bytes = write_frames * instream->bytes_per_frame;
-    soundio_ring_buffer_advance_write_ptr(rc->ring_buffer, advance_bytes);
+    for (ShedSeries *series : out->shed) {
+        if (series != target && series->is_open() && (*err = series->skip(frames, false)))
+            return used;
+    }
+    return used + bytes;
 }
 
-static void overflow_callback(struct SoundIoInStream *instream) {
-    static int count = 0;
-    cerr << "overflow "  << ++count << endl;
+// Pass whole gate blocks from the ring buffer to the writer, writing open
+// runs and skipping closed ones. Returns the number of bytes consumed; a
+// partial block stays in the ring for the next pass.
+static int64_t drain_gated(EnergyGate *gate, RecordOutput *out, const char *buf,
+                           int64_t fill_bytes, int bytes_per_frame, int *err) {
+    int64_t block_bytes = (int64_t)gate->block_frames() * bytes_per_frame;
+    int64_t pos = 0;
+    int64_t run_start = 0;
+    bool run_open = gate->is_open();
+    // blocks past what the output takes are left for a later pass
+    fill_bytes = output_room(out, fill_bytes, bytes_per_frame, err);
+    if (*err)
+        return 0;
+    for (;;) {
+        bool more = pos + block_bytes <= fill_bytes;
+        bool open = more ? gate->process(buf + pos) : !run_open;
+        if (open != run_open && pos > run_start) {
+            int64_t len = pos - run_start;
+            if (run_open) {
+                *err = write_frames(out, buf + run_start, len, bytes_per_frame);
+            } else {
+                *err = skip_frames(out, len / bytes_per_frame, false);
+            }
+            if (*err)
+                return run_start;
+            run_start = pos;
+        }
+        if (!more)
+            break;
+        run_open = open;
+        pos += block_bytes;
+    }
+    return pos;
 }
 
 static int list_devices(struct SoundIo *soundio, bool verbose = false) {
@@ -190,125 +518,615 @@ static int list_devices(struct SoundIo *soundio, bool verbose = false) {
     return 0;
 }
 
-int record_in(SoundIo* soundio, char* device_id = nullptr) {
+// JSON string literal for `s`
+static string json_string(const char *s) {
+    string out = "\"";
+    for (const unsigned char *p = (const unsigned char *)s; *p; p += 1) {
+        char buf[8];
+        switch (*p) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (*p < 0x20) {
+                    snprintf(buf, sizeof(buf), "\\u%04x", *p);
+                    out += buf;
+                } else {
+                    out += (char)*p;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+static string json_channel_layout(const struct SoundIoChannelLayout *layout) {
+    string out = "{\"name\": ";
+    out += layout->name ? json_string(layout->name) : "null";
+    out += ", \"channels\": [";
+    for (int i = 0; i < layout->channel_count; i += 1) {
+        out += i ? ", " : "";
+        out += json_string(soundio_get_channel_name(layout->channels[i]));
+    }
+    return out + "]}";
+}
+
+static void print_device_json(struct SoundIoDevice *device, bool is_default, bool last) {
+    printf("    {\"id\": %s, \"name\": %s, \"default\": %s, \"raw\": %s",
+           json_string(device->id).c_str(), json_string(device->name).c_str(),
+           is_default ? "true" : "false", device->is_raw ? "true" : "false");
+    if (device->probe_error) {
+        printf(", \"probe_error\": %s}%s\n", json_string(soundio_strerror(device->probe_error)).c_str(),
+               last ? "" : ",");
+        return;
+    }
+    printf(", \"layouts\": [");
+    for (int i = 0; i < device->layout_count; i += 1)
+        printf("%s%s", i ? ", " : "", json_channel_layout(&device->layouts[i]).c_str());
+    printf("], \"current_layout\": %s",
+           device->current_layout.channel_count > 0 ? json_channel_layout(&device->current_layout).c_str() : "null");
+    printf(", \"sample_rates\": [");
+    for (int i = 0; i < device->sample_rate_count; i += 1) {
+        printf("%s{\"min\": %d, \"max\": %d}", i ? ", " : "",
+               device->sample_rates[i].min, device->sample_rates[i].max);
+    }
+    printf("], \"current_sample_rate\": %d, \"formats\": [", device->sample_rate_current);
+    for (int i = 0; i < device->format_count; i += 1)
+        printf("%s%s", i ? ", " : "", json_string(soundio_format_string(device->formats[i])).c_str());
+    printf("], \"current_format\": %s",
+           device->current_format != SoundIoFormatInvalid ?
+           json_string(soundio_format_string(device->current_format)).c_str() : "null");
+    printf(", \"software_latency\": {\"min\": %.8f, \"max\": %.8f, \"current\": %.8f}}%s\n",
+           device->software_latency_min, device->software_latency_max, device->software_latency_current,
+           last ? "" : ",");
+}
+
+// For orchestration: every device, always in full, as one JSON object on
+// stdout: {"backend": ..., "inputs": [...], "outputs": [...]}
+static int list_devices_json(struct SoundIo *soundio) {
+    int output_count = soundio_output_device_count(soundio);
+    int input_count = soundio_input_device_count(soundio);
+    int default_output = soundio_default_output_device_index(soundio);
+    int default_input = soundio_default_input_device_index(soundio);
+    printf("{\"backend\": %s,\n  \"inputs\": [\n", json_string(soundio_backend_name(soundio->current_backend)).c_str());
+    for (int i = 0; i < input_count; i += 1) {
+        struct SoundIoDevice *device = soundio_get_input_device(soundio, i);
+        print_device_json(device, default_input == i, i == input_count - 1);
+        soundio_device_unref(device);
+    }
+    printf("  ],\n  \"outputs\": [\n");
+    for (int i = 0; i < output_count; i += 1) {
+        struct SoundIoDevice *device = soundio_get_output_device(soundio, i);
+        print_device_json(device, default_output == i, i == output_count - 1);
+        soundio_device_unref(device);
+    }
+    printf("  ]\n}\n");
+    fflush(stdout);
+    return ferror(stdout) ? 1 : 0;
+}
+
+// Print what the callback thread got from CaptureConfig::callback_thread,
+// once, as soon as a callback has run.
+static void report_callback_tuning(CaptureSession *session, const RecordOptions& options,
+                                   bool *reported) {
+    ThreadTuningResult result;
+    if (*reported || !session->callback_tuning(&result))
+        return;
+    *reported = true;
+    cerr << session->device_name() << " callback: "
+         << describe_tuning(options.callback_thread, result) << endl;
+}
+
+// Stream the capture to a pipe in batches of about half the pipe buffer.
+// Whatever the reader does not take stays in the capture ring and is
+// offered again; past `pipe_backlog_seconds` the oldest frames are dropped.
+static int stream_to_pipe(CaptureSession *session, PipeWriter *pipe,
+                          const RecordOptions& options) {
+    int bytes_per_frame = session->bytes_per_frame();
+    int64_t batch_bytes = pipe->pipe_bytes() / 2 / bytes_per_frame * bytes_per_frame;
+    int64_t max_backlog = (int64_t)(options.pipe_backlog_seconds * session->sample_rate()) * bytes_per_frame;
+    bool tuning_reported = false;
+    if (batch_bytes < bytes_per_frame)
+        batch_bytes = bytes_per_frame;
+    cerr << "Streaming to " << options.out_path << " in "
+         << batch_bytes << " byte batches" << endl;
+
+    while (!stop_requested) {
+        session->wait(batch_bytes, 50);
+        report_callback_tuning(session, options, &tuning_reported);
+        CaptureSpan span = session->peek();
+        int64_t written = pipe->write(span.data, span.bytes);
+        if (written < 0) {
+            cerr << "output reader went away" << endl;
+            return 1;
+        }
+        session->consume(written);
+        int64_t backlog = span.bytes - written;
+        if (backlog > max_backlog) {
+            session->consume(pipe->drop(span.data + written, backlog - max_backlog));
+        }
+    }
+    CaptureSpan rest = session->peek();
+    pipe->close(rest.data, rest.bytes);
+    session->consume(rest.bytes);
+    return 0;
+}
+
+// `supervisor` owns the SoundIo's events and reopens the device if it goes away
+int record_in(SoundIo* soundio, DeviceSupervisor* supervisor, char* device_id,
+              const RecordOptions& options) {
     const int RING_BUFFER_DURATION_SECONDS = 30;
     int ret = 0;
-    int capacity = 0;
-    struct RecordContext rc;
-    struct SoundIoDevice* input_device = nullptr;
+    int bytes_per_frame = 0;
+    int channels = 0;
     int sample_rate = 0;
+    int64_t preroll_bytes = 0;
+    int64_t postroll_bytes = 0;
+    int64_t postroll_left = 0;
+    int64_t scanned = 0;
+    unsigned seen_triggers = 0;
     SoundIoFormat fmt = SoundIoFormatInvalid;
-    FILE* out_f = nullptr;
-    struct SoundIoInStream *instream = nullptr;
+    SoundIoFormat file_fmt = SoundIoFormatInvalid;
+    int file_sample_bytes = 0;
+    Dither dither;
+    ShmRingWriter shm;                 // outlives the session's callback
+    CaptureSession session(soundio);
+    PipeWriter pipe;
+    CaptureConfig capture_config;
+    SegmentWriter* writer = nullptr;
+    SegmentConfig segment_config;
+    FlacEncoderPool* encoder = nullptr;
+    ChannelSplitWriter* planar = nullptr;
+    RateSplitWriter* rates = nullptr;
+    BlockIndexWriter* block_index = nullptr;
+    int64_t capture_start_ns = 0;
+    RecordOutput output;
+    vector<int> select = options.channel_select;
+    EnergyGate* gate = nullptr;
+    LoadShedder* shedder = nullptr;
+    int64_t ring_bytes = 0;
+    int64_t pass_bytes = 0;
+    bool tuning_reported = false;
+    bool last_pass = false;
+
+    if (options.writer_thread.requested()) {
+        ThreadTuningResult result = tune_this_thread(options.writer_thread);
+        cerr << "writer: " << describe_tuning(options.writer_thread, result) << endl;
+    }
 
-    // get input device
     if (device_id) {
-        for (int i = 0; i < soundio_input_device_count(soundio); i += 1) {
-            struct SoundIoDevice *device = soundio_get_input_device(soundio, i);
-            if (strcmp(device->id, device_id) == 0) {
-                input_device = device;
-                break;
-            }
-            soundio_device_unref(device);
+        capture_config.device_id = device_id;
+    }
+    capture_config.formats = container_formats(options.container);
+    if (!capture_config.formats.empty()) {
+        // anything else the device offers is converted for the container
+        for (enum SoundIoFormat *f = prioritized_formats; *f != SoundIoFormatInvalid; f += 1) {
+            if (container_format_for(*f, options.container) != *f)
+                capture_config.formats.push_back(*f);
         }
-        if (!input_device) {
-            cerr << "Input Device '" << device_id << "' not available" << endl;
+    }
+    capture_config.ring_seconds = RING_BUFFER_DURATION_SECONDS;
+    if (options.preroll_seconds + 5 > capture_config.ring_seconds) {
+        // room for the whole window plus a few drain intervals
+        capture_config.ring_seconds = ceil(options.preroll_seconds) + 5;
+    }
+    capture_config.callback_thread = options.callback_thread;
+    capture_config.lock_memory = options.lock_memory;
+
+    if ((ret = supervisor->open(&session, capture_config))) {
+        goto finally;
+    }
+    fmt = session.format();
+    sample_rate = session.sample_rate();
+    channels = session.channels();
+    bytes_per_frame = session.bytes_per_frame();
+    ring_bytes = session.stats().ring_capacity_bytes;
+
+    if (!options.shm_name.empty()) {
+        int64_t shm_bytes = (int64_t)(options.shm_seconds * sample_rate) * bytes_per_frame;
+        if ((ret = shm.create(options.shm_name, shm_bytes, sample_rate, channels, fmt, bytes_per_frame))) {
             goto finally;
         }
-    } else {
-        int device_index = soundio_default_input_device_index(soundio);
-        input_device = soundio_get_input_device(soundio, device_index);
-        if (!input_device) {
-            cerr << "No Input Device Available" << endl;
-            ret = 1;
-            goto finally;
+        if (options.lock_memory && (ret = shm.lock_memory())) {
+            cerr << "unable to lock shared memory " << options.shm_name << ": " << strerror(ret) << endl;
+            ret = 0;
         }
+        session.publish(&shm);
+        cerr << "publishing to shared memory " << options.shm_name << endl;
     }
 
-    cerr << "Input Device: " << input_device->name << endl;
-
-    if (input_device->probe_error) {
-        cerr << "Unable to probe device: "<< soundio_strerror(input_device->probe_error) << endl;
-        return ret;
+    if (is_stream_path(options.out_path)) {
+        // 1 MiB is the default pipe-max-size on Linux
+        if ((ret = pipe.open(options.out_path, bytes_per_frame, 1 << 20)) ||
+            (ret = supervisor->start(&session))) {
+            goto finally;
+        }
+        ret = stream_to_pipe(&session, &pipe, options);
+        goto finally;
     }
 
-    soundio_device_sort_channel_layouts(input_device);
+    segment_config.base_path = options.out_path.empty() ?
+        string("/tmp/recordconv-") + session.device_name() : options.out_path;
+    segment_config.extension = options.container == ContainerWav ? ".wav" :
+                               options.container == ContainerFlac ? ".flac" : ".raw";
+    segment_config.segment_seconds = options.segment_seconds;
+    segment_config.segment_bytes = options.segment_bytes;
+    file_fmt = container_format_for(fmt, options.container);
+    file_sample_bytes = file_fmt == fmt ? session.bytes_per_sample() : sample_format_bytes(file_fmt);
+    if (file_fmt != fmt) {
+        cerr << "converting " << soundio_format_string(fmt) << " to "
+             << soundio_format_string(file_fmt) << (options.dither ? " with dither" : "") << endl;
+    }
+    output.device_format = fmt;
+    output.file_format = file_fmt;
+    output.channels = channels;
+    output.dither = options.dither ? &dither : nullptr;
 
-    sample_rate = input_device->sample_rates[0].max;
-    fmt = input_device->formats[0];
+    segment_config.bytes_per_frame = file_sample_bytes * (options.planar ? 1 : channels);
+    segment_config.sample_rate = sample_rate;
+    segment_config.container = options.container;
+    if (options.container == ContainerWav) {
+        wav_format_from_soundio(file_fmt, options.planar ? 1 : channels, sample_rate,
+                                &segment_config.wav_format);
+    } else if (options.container == ContainerFlac) {
+        if (channels > FLAC_MAX_CHANNELS) {
+            cerr << "FLAC supports at most " << FLAC_MAX_CHANNELS << " channels" << endl;
+            ret = 1;
+            goto finally;
+        }
+        segment_config.flac_info.sample_rate = sample_rate;
+        segment_config.flac_info.channels = channels;
+        segment_config.flac_info.bits_per_sample = flac_bits_for_format(file_fmt);
+        encoder = new FlacEncoderPool(segment_config.flac_info, file_fmt, options.compress_threads);
+    }
+    if (options.planar) {
+        if (select.empty()) {
+            for (int ch = 0; ch < channels; ch += 1)
+                select.push_back(ch);
+        }
+        for (int ch : select) {
+            if (ch < 0 || ch >= channels) {
+                cerr << "channel " << ch << " not in 0.." << channels - 1 << endl;
+                ret = 1;
+                goto finally;
+            }
+        }
+        planar = new ChannelSplitWriter(segment_config, channels, select);
+    } else {
+        writer = new SegmentWriter(segment_config);
+    }
+    if (!options.rates.empty()) {
+        rates = new RateSplitWriter(segment_config, file_fmt, channels, options.rates,
+                                    output.dither);
+    }
+    output.encoder = encoder;
+    output.writer = writer;
+    output.planar = planar;
+    output.rates = rates;
+    if (options.gate.open_level > 0) {
+        gate = new EnergyGate(options.gate, sample_rate, channels, fmt);
+    }
 
-    out_f = fopen(string(string("/tmp/recordconv-") + input_device->name + ".raw").c_str(), "wb");
-    if (!out_f) {
-        cerr << "unable to open file: " << strerror(errno) << endl;
-        ret = 1;
+    capture_start_ns = realtime_ns();
+    if ((ret = planar ? planar->open(capture_start_ns) : writer->open(capture_start_ns))) {
         goto finally;
     }
-
-    instream = soundio_instream_create(input_device);
-    if (!instream) {
-        cerr <<  "out of memory" << endl;
-        ret = 1;
+    if (rates && (ret = rates->open(capture_start_ns))) {
         goto finally;
     }
-    instream->format = fmt;
-    instream->sample_rate = sample_rate;
-    instream->read_callback = read_callback;
-    instream->overflow_callback = overflow_callback;
-    instream->userdata = &rc;
+    output.capture_start_ns = capture_start_ns;
+    if (!options.shed.ladder.empty()) {
+        for (int ch : options.shed.keep_channels) {
+            if (ch < 0 || ch >= channels) {
+                cerr << "channel " << ch << " not in 0.." << channels - 1 << endl;
+                ret = 1;
+                goto finally;
+            }
+        }
+        shedder = new LoadShedder(options.shed);
+        if ((ret = shedder->open_log(segment_config.base_path + ".shed"))) {
+            goto finally;
+        }
+        int series = shedder->reductions((int)options.shed.ladder.size());
+        for (int n = 1; n <= series; n += 1) {
+            output.shed.push_back(new ShedSeries(segment_config, fmt, file_fmt, channels,
+                                                 shedder->reduction(n), n, output.dither));
+        }
+        output.shedder = shedder;
+    }
+    if (options.index_frames > 0) {
+        block_index = new BlockIndexWriter();
+        if ((ret = block_index->open(segment_config.base_path + ".blocks", sample_rate, channels,
+                                     fmt, options.index_frames))) {
+            goto finally;
+        }
+        session.index_blocks(options.index_frames);
+    }
 
-    if ((ret = soundio_instream_open(instream))) {
-        cerr <<  "unable to open input stream: " << soundio_strerror(ret) << endl;
+    if ((ret = supervisor->start(&session))) {
         goto finally;
     }
 
-    cerr << instream->layout.name << " " << sample_rate << "Hz "
-         << soundio_format_string(fmt) << " interleaved " << endl;
+    cout << "Recording... " << endl;
 
+    preroll_bytes = (int64_t)(options.preroll_seconds * sample_rate) * bytes_per_frame;
+    postroll_bytes = (int64_t)(options.postroll_seconds * sample_rate) * bytes_per_frame;
+    seen_triggers = trigger_count;
 
-    capacity = RING_BUFFER_DURATION_SECONDS * instream->sample_rate * instream->bytes_per_frame;
-    rc.ring_buffer = soundio_ring_buffer_create(soundio, capacity);
-    if (!rc.ring_buffer) {
-        cerr << "out of memory" << endl;
-        ret = 1;
-        goto finally;
-    }
+    // Read from ring_buffer and write to file. Once a stop is requested the
+    // stream is closed first, so the ring holds everything captured, and
+    // passes run until one writes nothing more.
+    do {
+        if (stop_requested && !last_pass) {
+            supervisor->close(&session);
+            last_pass = true;
+            output.final_pass = true;
+        } else if (!last_pass) {
+            sleep(1);
+        }
+        report_callback_tuning(&session, options, &tuning_reported);
+        if (block_index && (ret = write_marks(&session, block_index))) {
+            goto finally;
+        }
+        CaptureSpan span = session.peek();
+        int64_t fill_bytes = span.bytes;
+        const char *read_buf = span.data;
+        pass_bytes = fill_bytes;
 
-    if ((ret = soundio_instream_start(instream))) {
-        cerr << "unable to start input device: " << soundio_strerror(ret) << endl;
-         goto finally;
-    }
+        if (gate) {
+            int64_t used = drain_gated(gate, &output, read_buf, fill_bytes,
+                                       bytes_per_frame, &ret);
+            session.consume(used);
+            if (ret) {
+                goto finally;
+            }
+            continue;
+        }
 
-    cout << "Recording... " << endl;
+        if (shedder) {
+            int64_t used = drain_shedding(&output, session.device_name(), read_buf, fill_bytes,
+                                          ring_bytes, bytes_per_frame, &ret);
+            session.consume(used);
+            if (ret) {
+                goto finally;
+            }
+            continue;
+        }
 
-    // Read from ring_buffer and write to file
-    while (true) {
-        soundio_flush_events(soundio);
-        sleep(1);
-        int fill_bytes = soundio_ring_buffer_fill_count(rc.ring_buffer);
-        char *read_buf = soundio_ring_buffer_read_ptr(rc.ring_buffer);
-        size_t amt = fwrite(read_buf, 1, fill_bytes, out_f);
-        if ((int)amt != fill_bytes) {
-            fprintf(stderr, "write error: %s\n", strerror(errno));
-            return 1;
+        if (preroll_bytes == 0) {
+            int64_t take = output_room(&output, fill_bytes, bytes_per_frame, &ret);
+            if (ret || (ret = write_frames(&output, read_buf, take, bytes_per_frame))) {
+                goto finally;
+            }
+            session.consume(take);
+            continue;
+        }
+
+        // only look at what arrived since the last pass
+        bool fired = false;
+        if (trigger_count != seen_triggers) {
+            seen_triggers = trigger_count;
+            fired = true;
         }
-        soundio_ring_buffer_advance_read_ptr(rc.ring_buffer, fill_bytes);
+        if (options.trigger_level > 0 && fill_bytes > scanned) {
+            double peak = block_peak(read_buf + scanned, (fill_bytes - scanned) / session.bytes_per_sample(), fmt);
+            if (peak >= options.trigger_level) {
+                fired = true;
+            }
+        }
+        scanned = fill_bytes;
+
+        int64_t write_bytes = 0;
+        if (fired) {
+            if (postroll_left == 0) {
+                cerr << "trigger: writing " << (double)fill_bytes / bytes_per_frame / sample_rate
+                     << "s of pre-roll" << endl;
+            }
+            write_bytes = fill_bytes;
+            postroll_left = postroll_bytes;
+        } else if (postroll_left > 0) {
+            write_bytes = min(fill_bytes, postroll_left);
+        }
+        if (write_bytes > 0) {
+            write_bytes = output_room(&output, write_bytes, bytes_per_frame, &ret);
+            if (ret) {
+                goto finally;
+            }
+            if (!fired) {
+                postroll_left -= write_bytes;
+            }
+        }
+        if (write_bytes > 0) {
+            if ((ret = write_frames(&output, read_buf, write_bytes, bytes_per_frame))) {
+                goto finally;
+            }
+            session.consume(write_bytes);
+            fill_bytes -= write_bytes;
+            scanned -= write_bytes;
+        }
+
+        // idle: let the oldest audio fall out of the pre-roll window
+        if (postroll_left == 0 && fill_bytes > preroll_bytes) {
+            int64_t discard = fill_bytes - preroll_bytes;
+            if ((ret = skip_frames(&output, discard / bytes_per_frame, true))) {
+                goto finally;
+            }
+            session.consume(discard);
+            scanned -= discard;
+        }
+    } while (!last_pass || session.peek().bytes < pass_bytes);
+
+    if (gate) {
+        // the gate only takes whole blocks; the tail follows the last one
+        CaptureSpan rest = session.peek();
+        int64_t tail = rest.bytes / bytes_per_frame * bytes_per_frame;
+        if (gate->is_open()) {
+            tail = output_room(&output, tail, bytes_per_frame, &ret);
+            if (!ret) {
+                ret = write_frames(&output, rest.data, tail, bytes_per_frame);
+            }
+        } else {
+            ret = skip_frames(&output, tail / bytes_per_frame, false);
+        }
+        if (ret) {
+            goto finally;
+        }
+        session.consume(tail);
     }
 
 finally:
-    soundio_instream_destroy(instream);
-    soundio_device_unref(input_device);
+    supervisor->close(&session);
+    if (block_index) {
+        write_marks(&session, block_index);
+        block_index->close();
+        if (session.stats().marks_dropped > 0) {
+            fprintf(stderr, "block index: %llu marks dropped\n",
+                    (unsigned long long)session.stats().marks_dropped);
+        }
+        delete block_index;
+    }
+    if (session.stats().overruns > 0) {
+        CaptureStats stats = session.stats();
+        fprintf(stderr, "%s: ring full %llu time(s), %llu frames lost and replaced by silence\n",
+                session.device_name(), (unsigned long long)stats.overruns,
+                (unsigned long long)stats.overrun_frames);
+    }
+    if (session.stats().recoveries > 0) {
+        CaptureStats stats = session.stats();
+        fprintf(stderr, "%s: recovered %llu time(s), %llu frames of silence\n",
+                session.device_name(), (unsigned long long)stats.recoveries,
+                (unsigned long long)stats.gap_frames);
+    }
+    pipe.close();
+    if (pipe.bytes_written() > 0 || pipe.frames_dropped() > 0) {
+        fprintf(stderr, "pipe: wrote %llu bytes, dropped %llu frames in %llu stall(s)\n",
+                (unsigned long long)pipe.bytes_written(),
+                (unsigned long long)pipe.frames_dropped(),
+                (unsigned long long)pipe.drop_events());
+    }
+    if (encoder && writer) {
+        encoder->flush();
+        write_encoded(encoder, writer, true);
+        if (encoder->bytes_out() > 0 && encoder->encode_seconds() > 0) {
+            fprintf(stderr, "flac: ratio %.3f (%.1f%% of pcm), encode speed %.1fx realtime\n",
+                    (double)encoder->bytes_in() / encoder->bytes_out(),
+                    100.0 * encoder->bytes_out() / encoder->bytes_in(),
+                    encoder->frames_out() / encoder->encode_seconds() / sample_rate);
+        }
+    }
+    if (writer) {
+        writer->close();
+        cerr << "wrote " << writer->frames_written() << " frames in "
+             << writer->segment_count() << " segment(s)";
+        if (writer->frames_skipped() > 0) {
+            cerr << ", skipped " << writer->frames_skipped() << " frames";
+        }
+        cerr << endl;
+        delete writer;
+    }
+    if (planar) {
+        planar->close();
+        cerr << "wrote " << planar->frames_written() << " frames of " << planar->channel_count()
+             << " channel(s) in " << planar->segment_count() << " segment(s) each";
+        if (planar->frames_skipped() > 0) {
+            cerr << ", skipped " << planar->frames_skipped() << " frames";
+        }
+        cerr << endl;
+        delete planar;
+    }
+    if (rates) {
+        rates->close();
+        for (int i = 0; i < rates->rate_count(); i += 1) {
+            cerr << "wrote " << rates->frames_written(i) << " frames at " << rates->rate(i) << " Hz" << endl;
+        }
+        delete rates;
+    }
+    for (ShedSeries* series : output.shed) {
+        if (series->is_open()) {
+            series->close();
+            cerr << "wrote " << series->frames_written() << " frames as " << series->describe() << endl;
+        }
+        delete series;
+    }
+    if (shedder) {
+        fprintf(stderr, "shed: %llu step(s) up, %llu down, highest level %d, %lld oldest frames dropped\n",
+                (unsigned long long)shedder->steps_up(), (unsigned long long)shedder->steps_down(),
+                shedder->max_level(), (long long)shedder->frames_dropped());
+        delete shedder;
+    }
+    if (gate) {
+        int64_t blocks = gate->blocks_open() + gate->blocks_closed();
+        fprintf(stderr, "gate: open for %lld of %lld blocks (%.1f%%)\n",
+                (long long)gate->blocks_open(), (long long)blocks,
+                blocks ? 100.0 * gate->blocks_open() / blocks : 0.0);
+    }
+    if (shm.bytes_written() > 0) {
+        fprintf(stderr, "shm: %d reader(s), max lag %.3fs, %llu reader overrun(s)\n",
+                shm.readers(), (double)shm.max_lag_bytes() / bytes_per_frame / sample_rate,
+                (unsigned long long)shm.reader_overruns());
+    }
+    delete gate;
+    delete encoder;
+    return ret;
+}
+
+// Copy a shared-memory ring published by another audiocapture to stdout
+// until it closes or we are stopped.
+static int read_shm(const char* name) {
+    ShmRingReader reader;
+    if (reader.attach(name))
+        return 1;
+    cerr << "reading " << name << ": " << reader.sample_rate() << "Hz "
+         << reader.channels() << "ch "
+         << soundio_format_string((enum SoundIoFormat)reader.format()) << endl;
+
+    int ret = 0;
+    uint64_t torn = 0;
+    vector<char> copy;
+    while (!stop_requested && !reader.finished()) {
+        const char* data;
+        int64_t bytes;
+        if (!reader.peek(&data, &bytes)) {
+            usleep(10000);
+            continue;
+        }
+        // the writer may lap us while we copy; only a span consume()
+        // vouches for goes out, a torn one is dropped and the next peek()
+        // resyncs behind the writer
+        copy.assign(data, data + bytes);
+        if (!reader.consume(bytes)) {
+            torn += 1;
+            continue;
+        }
+        if (fwrite(copy.data(), 1, bytes, stdout) != (size_t)bytes) {
+            ret = 1;
+            break;
+        }
+    }
+    fflush(stdout);
+    fprintf(stderr, "shm: %llu overrun(s), %llu torn block(s)\n",
+            (unsigned long long)reader.overruns(), (unsigned long long)torn);
     return ret;
 }
 
 int main(int argc, char **argv) {
     char* exe = argv[0];
     bool listdevices = false;
+    bool json = false;
     bool verbose = false;
     bool record = false;
     bool recordconv = false;
     char* deviceid_in = nullptr;
     char* deviceid_ch0 = nullptr;
     char* deviceid_ch1 = nullptr;
+    char* shm_read = nullptr;
+    RecordOptions options;
+    ThreadTuning loop_thread;
+    int rt_policy = SCHED_OTHER;
+    int rt_priority = 70;
+    enum SoundIoBackend backend = SoundIoBackendNone;
+    int64_t connect_start_ns = 0;
 
     // sidster: this cmd line argument parsing code is way too clever
     // a.k.a annoying a.k.a complex; handle with care
@@ -317,12 +1135,29 @@ int main(int argc, char **argv) {
         if (arg[0] == '-' && arg[1] == '-') {
             if (strcmp(arg, "--listdevices") == 0) {
                 listdevices = true;
+            } else if (strcmp(arg, "--json") == 0) {
+                json = true;
+            } else if (strcmp(arg, "--backend") == 0 && i+1 < argc) {
+                const char* name = argv[++i];
+                for (int b = SoundIoBackendJack; b <= SoundIoBackendDummy; b += 1) {
+                    if (strcasecmp(name, soundio_backend_name((enum SoundIoBackend)b)) == 0) {
+                        backend = (enum SoundIoBackend)b;
+                    }
+                }
+                if (backend == SoundIoBackendNone) {
+                    return usage(exe);
+                }
+                if (!soundio_have_backend(backend)) {
+                    fprintf(stderr, "%s support is not built into libsoundio\n", soundio_backend_name(backend));
+                    return 1;
+                }
             } else if (strcmp(arg, "--record") == 0) {
                 record = true;
                 // find if the optional '--deviceid $deviceid'
                 // argument was passed
-                if(argc >= i+2 && strcmp(argv[++i], "--deviceid") == 0) {
-                    deviceid_in = argv[++i];
+                if (argc >= i+3 && strcmp(argv[i+1], "--deviceid") == 0) {
+                    deviceid_in = argv[i+2];
+                    i += 2;
                 }
             } else if (strcmp(arg, "--recordconv") == 0) {
                 recordconv = true;
@@ -343,6 +1178,120 @@ int main(int argc, char **argv) {
                         return usage(exe);
                     }
                 }
+            } else if (strcmp(arg, "--segment-seconds") == 0 && i+1 < argc) {
+                options.segment_seconds = atof(argv[++i]);
+            } else if (strcmp(arg, "--segment-bytes") == 0 && i+1 < argc) {
+                options.segment_bytes = atoll(argv[++i]);
+            } else if (strcmp(arg, "--container") == 0 && i+1 < argc) {
+                const char* container = argv[++i];
+                if (strcmp(container, "wav") == 0) {
+                    options.container = ContainerWav;
+                } else if (strcmp(container, "flac") == 0) {
+                    options.container = ContainerFlac;
+                } else if (strcmp(container, "raw") == 0) {
+                    options.container = ContainerRaw;
+                } else {
+                    return usage(exe);
+                }
+            } else if (strcmp(arg, "--compress-threads") == 0 && i+1 < argc) {
+                options.compress_threads = atoi(argv[++i]);
+            } else if (strcmp(arg, "--preroll") == 0 && i+1 < argc) {
+                options.preroll_seconds = atof(argv[++i]);
+            } else if (strcmp(arg, "--postroll") == 0 && i+1 < argc) {
+                options.postroll_seconds = atof(argv[++i]);
+            } else if (strcmp(arg, "--trigger-level") == 0 && i+1 < argc) {
+                options.trigger_level = dbfs_to_linear(atof(argv[++i]));
+            } else if (strcmp(arg, "--gate") == 0 && i+1 < argc) {
+                options.gate.open_level = dbfs_to_linear(atof(argv[++i]));
+            } else if (strcmp(arg, "--gate-hysteresis") == 0 && i+1 < argc) {
+                options.gate.hysteresis_db = atof(argv[++i]);
+            } else if (strcmp(arg, "--gate-hangover") == 0 && i+1 < argc) {
+                options.gate.hangover_seconds = atof(argv[++i]);
+            } else if (strcmp(arg, "--shm") == 0 && i+1 < argc) {
+                options.shm_name = argv[++i];
+            } else if (strcmp(arg, "--shm-seconds") == 0 && i+1 < argc) {
+                options.shm_seconds = atof(argv[++i]);
+            } else if (strcmp(arg, "--out") == 0 && i+1 < argc) {
+                options.out_path = argv[++i];
+            } else if (strcmp(arg, "--pipe-backlog") == 0 && i+1 < argc) {
+                options.pipe_backlog_seconds = atof(argv[++i]);
+            } else if (strcmp(arg, "--planar") == 0) {
+                options.planar = true;
+            } else if (strcmp(arg, "--dither") == 0) {
+                options.dither = true;
+            } else if (strcmp(arg, "--channels") == 0 && i+1 < argc) {
+                for (char* p = argv[++i]; *p; ) {
+                    char* end;
+                    options.channel_select.push_back((int)strtol(p, &end, 10));
+                    if (end == p || (*end && *end != ',')) {
+                        return usage(exe);
+                    }
+                    p = *end ? end + 1 : end;
+                }
+            } else if (strcmp(arg, "--rates") == 0 && i+1 < argc) {
+                for (char* p = argv[++i]; *p; ) {
+                    char* end;
+                    options.rates.push_back((int)strtol(p, &end, 10));
+                    if (end == p || options.rates.back() <= 0 || (*end && *end != ',')) {
+                        return usage(exe);
+                    }
+                    p = *end ? end + 1 : end;
+                }
+            } else if (strcmp(arg, "--index-frames") == 0 && i+1 < argc) {
+                options.index_frames = atoi(argv[++i]);
+                if (options.index_frames <= 0) {
+                    return usage(exe);
+                }
+            } else if (strcmp(arg, "--cpus-callback") == 0 && i+1 < argc) {
+                if (parse_cpu_list(argv[++i], &options.callback_thread.cpus)) {
+                    return usage(exe);
+                }
+            } else if (strcmp(arg, "--cpus-loop") == 0 && i+1 < argc) {
+                if (parse_cpu_list(argv[++i], &loop_thread.cpus)) {
+                    return usage(exe);
+                }
+            } else if (strcmp(arg, "--cpus-writer") == 0 && i+1 < argc) {
+                if (parse_cpu_list(argv[++i], &options.writer_thread.cpus)) {
+                    return usage(exe);
+                }
+            } else if (strcmp(arg, "--rt") == 0 && i+1 < argc) {
+                const char* policy = argv[++i];
+                if (strcmp(policy, "fifo") == 0) {
+                    rt_policy = SCHED_FIFO;
+                } else if (strcmp(policy, "rr") == 0) {
+                    rt_policy = SCHED_RR;
+                } else {
+                    return usage(exe);
+                }
+            } else if (strcmp(arg, "--rt-priority") == 0 && i+1 < argc) {
+                rt_priority = atoi(argv[++i]);
+                if (rt_priority < 1 || rt_priority > 99) {
+                    return usage(exe);
+                }
+            } else if (strcmp(arg, "--shed") == 0 && i+1 < argc) {
+                if (parse_shed_ladder(argv[++i], &options.shed.ladder)) {
+                    return usage(exe);
+                }
+            } else if (strcmp(arg, "--shed-channels") == 0 && i+1 < argc) {
+                for (char* p = argv[++i]; *p; ) {
+                    char* end;
+                    options.shed.keep_channels.push_back((int)strtol(p, &end, 10));
+                    if (end == p || (*end && *end != ',')) {
+                        return usage(exe);
+                    }
+                    p = *end ? end + 1 : end;
+                }
+            } else if (strcmp(arg, "--shed-rate") == 0 && i+1 < argc) {
+                options.shed.lower_rate = atoi(argv[++i]);
+                if (options.shed.lower_rate <= 0) {
+                    return usage(exe);
+                }
+            } else if (strcmp(arg, "--spill-dir") == 0 && i+1 < argc) {
+                options.shed.spill_dir = argv[++i];
+            } else if (strcmp(arg, "--mlock") == 0) {
+                options.lock_memory = true;
+            } else if (strcmp(arg, "--shm-read") == 0 && i+1 < argc) {
+                shm_read = argv[++i];
             } else if (strcmp(arg, "--verbose") == 0) {
                 verbose = true;
             } else {
@@ -353,17 +1302,89 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (json && !listdevices) {
+        return usage(exe);
+    }
+    // pre-roll decides what to write by trigger, the gate by level
+    if (options.preroll_seconds > 0 && options.gate.open_level > 0) {
+        return usage(exe);
+    }
+    // planar files are PCM; --channels only means something for them
+    if ((options.planar && options.container == ContainerFlac) ||
+        (!options.planar && !options.channel_select.empty())) {
+        return usage(exe);
+    }
+    // resampled copies are interleaved PCM next to the native file
+    if (!options.rates.empty() && (options.planar || options.container == ContainerFlac)) {
+        return usage(exe);
+    }
+    // a stream is one device's raw frames, written as they come
+    if (is_stream_path(options.out_path) &&
+        (recordconv || options.container != ContainerRaw || options.preroll_seconds > 0 ||
+         options.gate.open_level > 0 || options.segment_seconds > 0 || options.segment_bytes > 0 ||
+         options.planar || !options.rates.empty() || options.index_frames > 0)) {
+        return usage(exe);
+    }
+
+    // shedding steps in for the plain drain loop; pre-roll and the gate
+    // already decide what to drop, and planar files have their own writers
+    if (!options.shed.ladder.empty() &&
+        (options.preroll_seconds > 0 || options.gate.open_level > 0 || options.planar ||
+         is_stream_path(options.out_path))) {
+        return usage(exe);
+    }
+    bool shed_reduces = false;
+    bool shed_spills = false;
+    for (ShedStep step : options.shed.ladder) {
+        shed_reduces |= step == ShedDropChannels || step == ShedNarrowFormat || step == ShedLowerRate;
+        shed_spills |= step == ShedSpill;
+    }
+    // cheaper series are PCM; spilling moves whole segments
+    if ((shed_reduces && options.container == ContainerFlac) ||
+        (shed_spills && (options.shed.spill_dir.empty() ||
+                         (options.segment_seconds <= 0 && options.segment_bytes <= 0)))) {
+        return usage(exe);
+    }
+
+    // the callback must never wait on the writer or the event loop, so
+    // they run below it
+    if (rt_policy != SCHED_OTHER) {
+        options.callback_thread.policy = rt_policy;
+        options.callback_thread.priority = rt_priority;
+        loop_thread.policy = options.writer_thread.policy = rt_policy;
+        loop_thread.priority = options.writer_thread.priority = max(1, rt_priority - 10);
+    }
+
     int ret = 0;
 
+    // let the drain loops finish their files on ^C / kill
+    signal(SIGINT, on_stop_signal);
+    signal(SIGTERM, on_stop_signal);
+    if (is_stream_path(options.out_path)) {
+        // a closed reader shows up as EPIPE from the write instead
+        signal(SIGPIPE, SIG_IGN);
+    }
+    if (options.preroll_seconds > 0) {
+        signal(SIGUSR1, on_trigger_signal);
+        thread(watch_stdin_triggers).detach();
+    }
+
+    // a reader needs no audio device
+    if (shm_read) {
+        return read_shm(shm_read);
+    }
+
     // -----------
     // SETUP
     struct SoundIo *soundio = soundio_create();
+    DeviceSupervisor *supervisor = nullptr;
     if (!soundio) {
         fprintf(stderr, "out of memory\n");
         ret = 1;
         goto finally;
     }
-    // Connects to backend in the following order -
+    // Without --backend, connects to the first backend that works, in the
+    // following order -
     // 1. JACK
     // 2. PulseAudio
     // 3. ALSA (Linux)
@@ -371,32 +1392,57 @@ int main(int argc, char **argv) {
     // 5. WASAPI (Windows)
     // 6. Dummy
     //
-    // Alternatively, we can use soundio_connect_backend() to explicitly choose a backend to connect to.
-    if ((ret = soundio_connect(soundio))) {
-        fprintf(stderr, "error connecting: %s", soundio_strerror(ret));
+    // Each one tried costs a probe (JACK and PulseAudio wait for their
+    // servers), so a host that knows its backend saves that on every start.
+    connect_start_ns = monotonic_ns();
+    if (backend == SoundIoBackendNone) {
+        ret = soundio_connect(soundio);
+    } else {
+        ret = soundio_connect_backend(soundio, backend);
+    }
+    if (ret) {
+        fprintf(stderr, "error connecting: %s\n", soundio_strerror(ret));
         ret = 1;
         goto finally;
     }
     soundio_flush_events(soundio);
+    if (verbose) {
+        fprintf(stderr, "backend: %s, connected in %.1f ms\n", soundio_backend_name(soundio->current_backend),
+                (monotonic_ns() - connect_start_ns) / 1e6);
+    }
     // ------------
 
     // LIST DEVICES
     if (listdevices) {
-        ret = list_devices(soundio, verbose);
+        ret = json ? list_devices_json(soundio) : list_devices(soundio, verbose);
         goto finally;
     }
 
+    // from here on only the supervisor flushes events
+    supervisor = new DeviceSupervisor(soundio, 10, loop_thread);
+
     // RECORD
     if (record) {
-        ret = record_in(soundio, deviceid_in);
+        ret = record_in(soundio, supervisor, deviceid_in, options);
         goto finally;
     }
 
     // RECORD CONV
     if (recordconv) {
+        // one shared-memory ring and output base per device: <name>-ch0, <name>-ch1
+        RecordOptions options_ch0 = options;
+        RecordOptions options_ch1 = options;
+        if (!options.shm_name.empty()) {
+            options_ch0.shm_name += "-ch0";
+            options_ch1.shm_name += "-ch1";
+        }
+        if (!options.out_path.empty()) {
+            options_ch0.out_path += "-ch0";
+            options_ch1.out_path += "-ch1";
+        }
         vector<future<int>> record_tasks;
-        record_tasks.push_back(async(launch::async, record_in, soundio, deviceid_ch0));
-        record_tasks.push_back(async(launch::async, record_in, soundio, deviceid_ch1));
+        record_tasks.push_back(async(launch::async, record_in, soundio, supervisor, deviceid_ch0, cref(options_ch0)));
+        record_tasks.push_back(async(launch::async, record_in, soundio, supervisor, deviceid_ch1, cref(options_ch1)));
 
         // wait for all tasks to finish
         for (auto& t : record_tasks) {
@@ -408,6 +1454,7 @@ int main(int argc, char **argv) {
 
 
 finally:
+    delete supervisor;
     if (soundio) {
         soundio_destroy(soundio);
     }
@@ -0,0 +1,251 @@
+#include "capture_archive.h"
+#include "wav_header.h"
+#include "dsp/resampler.h++"
+
+#include <iostream>
+#include <algorithm>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Pull a snippet out of a capture archive by time:
+//
+//     audioextract /tmp/recordconv-mic --start @1718000000.5 --duration 10 --out snip.wav
+//
+// Only the pages holding the snippet are read, however long the capture.
+
+static int usage(char *exe) {
+    fprintf(stderr, "Usage: %s $capture [options]\n"
+            "  $capture                     # capture base (/tmp/recordconv-<device>) or one .raw/.wav file\n"
+            "Options:\n"
+            "  [--start $seconds]           # from the start of the capture (default 0)\n"
+            "  [--start @$unix_seconds]     # wall clock, from the .blocks or segment index\n"
+            "  [--duration $seconds]        # default 10\n"
+            "  [--out $path]                # .wav gets a header, anything else raw frames; default stdout\n"
+            "  [--rate $hz]                 # resample the snippet\n"
+            "  [--raw-format s16le|s24le|s32le|f32le|f64le|u8]\n"
+            "  [--raw-rate $hz]             # describe a raw file without .blocks\n"
+            "  [--raw-channels $n]\n"
+            "  [--info]                     # print what the archive holds\n", exe);
+    return 1;
+}
+
+static enum SoundIoFormat format_from_name(const char* name) {
+    static const struct { const char* name; enum SoundIoFormat format; } names[] = {
+        {"u8", SoundIoFormatU8},
+        {"s16le", SoundIoFormatS16LE},
+        {"s24le", SoundIoFormatS24LE},
+        {"s32le", SoundIoFormatS32LE},
+        {"f32le", SoundIoFormatFloat32LE},
+        {"f64le", SoundIoFormatFloat64LE},
+    };
+    for (auto& n : names) {
+        if (strcmp(name, n.name) == 0)
+            return n.format;
+    }
+    return SoundIoFormatInvalid;
+}
+
+static double seconds_since(const struct timespec& t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+static long long gcd(long long a, long long b) {
+    while (b) {
+        long long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// `frames` at the archive's rate from `start`, resampled to `rate`.
+// The filters run over real audio on both sides of the snippet, so its
+// edges look like the middle of the capture.
+static int read_resampled(const CaptureArchive& archive, int64_t start, int64_t frames, int rate,
+                          vector<double>* out, int64_t* out_frames) {
+    int in_rate = archive.sample_rate();
+    int channels = archive.channels();
+    double padding = min(in_rate, rate) / 10.0;
+    Resampler probe(in_rate, rate, padding);
+    if (!probe.valid())
+        return 1;
+
+    // context before the snippet, a whole number of output samples long
+    long long step = in_rate / gcd(in_rate, rate);
+    int64_t context = (int64_t)ceil(probe.latency() * in_rate / rate) + 1;
+    context = (context + step - 1) / step * step;
+    int64_t total = context + frames + context;
+
+    vector<char> raw((size_t)(total * archive.bytes_per_frame()));
+    if (archive.read(start - context, total, raw.data()) < 0)
+        return 1;
+    vector<double> interleaved((size_t)(total * channels));
+    samples_to_double(raw.data(), archive.format(), total * channels, interleaved.data());
+
+    int64_t skip = llround(probe.latency() + (double)context * rate / in_rate);
+    *out_frames = (int64_t)llround((double)frames * rate / in_rate);
+    out->assign((size_t)(*out_frames * channels), 0.0);
+
+    vector<double> plane((size_t)total);
+    vector<double> resampled((size_t)(total * probe.max_output() + probe.max_flush()));
+    for (int ch = 0; ch < channels; ch += 1) {
+        Resampler resampler(probe);
+        for (int64_t i = 0; i < total; i += 1)
+            plane[i] = interleaved[i * channels + ch];
+        int n = resampler.process(plane.data(), (int)total, resampled.data());
+        n += resampler.flush(resampled.data() + n);
+        for (int64_t i = 0; i < *out_frames && skip + i < n; i += 1)
+            (*out)[i * channels + ch] = resampled[skip + i];
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    char* exe = argv[0];
+    const char* path = nullptr;
+    const char* start_arg = "0";
+    double duration = 10;
+    string out_path = "-";
+    int rate = 0;
+    bool info = false;
+    RawFormat raw;
+
+    for (int i = 1; i < argc; i++) {
+        char* arg = argv[i];
+        if (strcmp(arg, "--start") == 0 && i+1 < argc) {
+            start_arg = argv[++i];
+        } else if (strcmp(arg, "--duration") == 0 && i+1 < argc) {
+            duration = atof(argv[++i]);
+        } else if (strcmp(arg, "--out") == 0 && i+1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(arg, "--rate") == 0 && i+1 < argc) {
+            rate = atoi(argv[++i]);
+        } else if (strcmp(arg, "--raw-format") == 0 && i+1 < argc) {
+            raw.format = format_from_name(argv[++i]);
+            if (raw.format == SoundIoFormatInvalid)
+                return usage(exe);
+        } else if (strcmp(arg, "--raw-rate") == 0 && i+1 < argc) {
+            raw.sample_rate = atoi(argv[++i]);
+        } else if (strcmp(arg, "--raw-channels") == 0 && i+1 < argc) {
+            raw.channels = atoi(argv[++i]);
+        } else if (strcmp(arg, "--info") == 0) {
+            info = true;
+        } else if (arg[0] != '-' && !path) {
+            path = arg;
+        } else {
+            return usage(exe);
+        }
+    }
+    if (!path || duration <= 0 || rate < 0) {
+        return usage(exe);
+    }
+
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    CaptureArchive archive;
+    if (archive.open(path, raw)) {
+        return 1;
+    }
+    int in_rate = archive.sample_rate();
+    if (info) {
+        fprintf(stderr, "%d Hz, %d channels, %s%s, %d file(s)\n", in_rate, archive.channels(),
+                soundio_format_string(archive.format().format), archive.format().packed ? " packed" : "",
+                archive.file_count());
+        fprintf(stderr, "%lld capture frames (%.3fs), %lld on disk, %s\n",
+                (long long)archive.frames(), (double)archive.frames() / in_rate,
+                (long long)archive.frames_on_disk(), archive.has_clock() ? "clocked" : "no clock");
+    }
+
+    int64_t start;
+    if (start_arg[0] == '@') {
+        if (!archive.has_clock()) {
+            cerr << path << " has no clock; give --start in seconds from the start" << endl;
+            return 1;
+        }
+        start = archive.frame_at((int64_t)llround(atof(start_arg + 1) * 1e9));
+    } else {
+        start = (int64_t)llround(atof(start_arg) * in_rate);
+    }
+    int64_t frames = (int64_t)llround(duration * in_rate);
+
+    // out: frames of `format` at `out_rate`
+    SampleFormat format = archive.format();
+    int out_rate = in_rate;
+    int64_t out_frames = frames;
+    vector<char> pcm;
+    int64_t on_disk = 0;
+    if (rate > 0 && rate != in_rate) {
+        vector<double> samples;
+        if (read_resampled(archive, start, frames, rate, &samples, &out_frames)) {
+            cerr << "unable to resample " << in_rate << " Hz to " << rate << " Hz" << endl;
+            return 1;
+        }
+        // back to the archive's own sample format, 24 bit in 32 bit words
+        format.packed = false;
+        pcm.resize((size_t)(samples.size() * sample_format_bytes(format)));
+        samples_from_double(samples.data(), (int64_t)samples.size(), format, pcm.data());
+        out_rate = rate;
+        on_disk = -1;
+    } else {
+        pcm.resize((size_t)(frames * archive.bytes_per_frame()));
+        if ((on_disk = archive.read(start, frames, pcm.data())) < 0)
+            return 1;
+        if (format.packed) {
+            // WAV headers here describe 24 bit samples in 32 bit words
+            SampleFormat unpacked(format.format);
+            vector<char> wide((size_t)(frames * archive.channels() * sample_format_bytes(unpacked)));
+            samples_convert(pcm.data(), format, frames * archive.channels(), wide.data(), unpacked);
+            pcm.swap(wide);
+            format = unpacked;
+        }
+    }
+
+    FILE* out = out_path == "-" ? stdout : fopen(out_path.c_str(), "wb");
+    if (!out) {
+        cerr << "unable to open " << out_path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    if (out_path.size() > 4 && out_path.compare(out_path.size() - 4, 4, ".wav") == 0) {
+        WavFormat wav;
+        char header[WAV_MAX_HEADER_SIZE];
+        if (format.format == SoundIoFormatS24LE) {
+            // WAV keeps 24 bit samples at the top of a 32 bit word
+            vector<char> wide(pcm.size());
+            samples_convert(pcm.data(), format, (int64_t)(pcm.size() / 4), wide.data(), SoundIoFormatS32LE);
+            pcm.swap(wide);
+            format = SoundIoFormatS32LE;
+        }
+        if (wav_format_from_soundio(format.format, archive.channels(), out_rate, &wav) != 0) {
+            cerr << soundio_format_string(format.format) << " has no WAV representation" << endl;
+            return 1;
+        }
+        int size = wav_build_header(wav, pcm.size(), header);
+        fwrite(header, 1, size, out);
+    }
+    size_t written = fwrite(pcm.data(), 1, pcm.size(), out);
+    if (out != stdout)
+        fclose(out);
+    if (written != pcm.size()) {
+        cerr << "short write to " << out_path << endl;
+        return 1;
+    }
+
+    fprintf(stderr, "frames %lld..%lld (%.3fs at %d Hz)", (long long)start,
+            (long long)(start + frames), duration, in_rate);
+    if (on_disk >= 0 && on_disk < frames)
+        fprintf(stderr, ", %lld not on disk", (long long)(frames - on_disk));
+    fprintf(stderr, " -> %lld frames at %d Hz in %.1f ms\n", (long long)out_frames, out_rate,
+            seconds_since(t0) * 1000);
+    return 0;
+}
@@ -0,0 +1,273 @@
+#include "flac_encoder.h"
+#include "segment_writer.h"
+#include "wav_header.h"
+#include "dsp/convert.h++"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Checks of the files the capture writers produce, byte for byte against
+// the container specs rather than against our own readers:
+//
+//   capture_verify $dir
+//
+// writes its files under $dir and exits 1 if any check fails. Where the
+// reference `flac` tool is installed, ctest also decodes gaps.flac with it.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void check(bool ok, const char* what, const char* fmt, ...) {
+    if (ok)
+        return;
+    failures += 1;
+    fprintf(stderr, "FAIL %s: ", what);
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+}
+
+static vector<unsigned char> read_file(const string& path) {
+    vector<unsigned char> data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return data;
+    unsigned char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    fclose(f);
+    return data;
+}
+
+static void put_le(vector<unsigned char>& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i += 1)
+        out.push_back((unsigned char)(v >> (8 * i)));
+}
+
+static void put_tag(vector<unsigned char>& out, const char* tag) {
+    out.insert(out.end(), tag, tag + 4);
+}
+
+static uint64_t get_be(const unsigned char* p, int bits_offset, int bits) {
+    uint64_t v = 0;
+    for (int i = 0; i < bits; i += 1) {
+        int bit = bits_offset + i;
+        v = (v << 1) | ((p[bit / 8] >> (7 - bit % 8)) & 1);
+    }
+    return v;
+}
+
+static uint8_t crc8(const unsigned char* p, size_t n) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < n; i += 1) {
+        crc ^= p[i];
+        for (int b = 0; b < 8; b += 1)
+            crc = (uint8_t)((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+    return crc;
+}
+
+// A 24 bit capture as audiocapture writes it to WAV: converted to S32 so
+// the samples sit at the top of the word, in a WAVE_FORMAT_EXTENSIBLE file
+// any reader takes at full scale.
+static void check_wav_s24(const string& dir) {
+    WavFormat wav;
+    check(wav_format_from_soundio(SoundIoFormatS24LE, 2, 48000, &wav) != 0, "wav s24",
+          "S24 must not be labelled as a WAV layout");
+
+    // two stereo frames: 0x123456, -1, full scale positive and negative
+    const int32_t s24[4] = {0x123456, -1, 0x7FFFFF, -0x800000};
+    int32_t s32[4];
+    samples_convert(s24, SoundIoFormatS24LE, 4, s32, SoundIoFormatS32LE);
+
+    SegmentConfig config;
+    config.base_path = dir + "/s24";
+    config.extension = ".wav";
+    config.bytes_per_frame = 8;
+    config.sample_rate = 48000;
+    config.container = ContainerWav;
+    wav_format_from_soundio(SoundIoFormatS32LE, 2, 48000, &config.wav_format);
+    SegmentWriter writer(config);
+    check(writer.open(0) == 0 && writer.write((const char*)s32, sizeof(s32)) == 0 && writer.close() == 0,
+          "wav s24", "writing %s failed", (config.base_path + config.extension).c_str());
+
+    vector<unsigned char> expect;
+    put_tag(expect, "RIFF");
+    put_le(expect, 4 + 36 + 48 + 8 + 16, 4);
+    put_tag(expect, "WAVE");
+    put_tag(expect, "JUNK");
+    put_le(expect, 28, 4);
+    expect.insert(expect.end(), 28, 0);
+    put_tag(expect, "fmt ");
+    put_le(expect, 40, 4);
+    put_le(expect, WAVE_FORMAT_EXTENSIBLE, 2);
+    put_le(expect, 2, 2);                   // channels
+    put_le(expect, 48000, 4);
+    put_le(expect, 48000 * 8, 4);           // bytes per second
+    put_le(expect, 8, 2);                   // block align
+    put_le(expect, 32, 2);                  // container bits
+    put_le(expect, 22, 2);                  // cbSize
+    put_le(expect, 32, 2);                  // valid bits
+    put_le(expect, 0, 4);                   // channel mask
+    static const unsigned char pcm_guid[16] = {
+        0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+    };
+    expect.insert(expect.end(), pcm_guid, pcm_guid + 16);
+    put_tag(expect, "data");
+    put_le(expect, 16, 4);
+    static const unsigned char samples[16] = {
+        0x00, 0x56, 0x34, 0x12,  0x00, 0xFF, 0xFF, 0xFF,
+        0x00, 0xFF, 0xFF, 0x7F,  0x00, 0x00, 0x00, 0x80,
+    };
+    expect.insert(expect.end(), samples, samples + 16);
+
+    vector<unsigned char> got = read_file(config.base_path + config.extension);
+    check(got.size() == expect.size(), "wav s24", "%zu bytes, expected %zu", got.size(), expect.size());
+    for (size_t i = 0; i < got.size() && i < expect.size(); i += 1) {
+        if (got[i] != expect[i]) {
+            check(false, "wav s24", "byte %zu is %02x, expected %02x", i, got[i], expect[i]);
+            break;
+        }
+    }
+
+    // and our own reader takes it back as S32
+    WavFormat parsed;
+    int64_t offset = 0;
+    uint64_t bytes = 0;
+    bool packed = false;
+    check(wav_parse_header((const char*)got.data(), (int)got.size(), &parsed, &offset, &bytes) == 0 &&
+          wav_format_to_soundio(parsed, &packed) == SoundIoFormatS32LE && !packed &&
+          offset == 104 && bytes == 16, "wav s24", "header does not parse back as S32");
+}
+
+// A FLAC segment with short frames mid-stream, where the encoder was
+// flushed for a gap, and a short last frame. Mid-stream short frames are
+// only legal in a variable block size stream, whose frame headers number
+// samples rather than frames; STREAMINFO's minimum block size leaves the
+// last frame out.
+static void check_flac_gaps(const string& dir) {
+    const int blocks[] = {4096, 4096, 1000, 4096, 300};
+    const int block_count = sizeof(blocks) / sizeof(blocks[0]);
+
+    SegmentConfig config;
+    config.base_path = dir + "/gaps";
+    config.extension = ".flac";
+    config.bytes_per_frame = 4;
+    config.sample_rate = 48000;
+    config.container = ContainerFlac;
+    config.flac_info.sample_rate = 48000;
+    config.flac_info.channels = 2;
+    config.flac_info.bits_per_sample = 16;
+    SegmentWriter writer(config);
+    bool ok = writer.open(0) == 0;
+
+    vector<size_t> frame_sizes;
+    uint32_t seed = 1;
+    for (int b = 0; b < block_count && ok; b += 1) {
+        vector<int16_t> pcm(blocks[b] * 2);
+        for (size_t i = 0; i < pcm.size(); i += 1) {
+            seed = seed * 1664525u + 1013904223u;
+            pcm[i] = (int16_t)(8000 * sin(i * 0.01) + (int)(seed >> 24) - 128);
+        }
+        vector<uint8_t> body;
+        int assignment = flac_encode_subframes(config.flac_info, SoundIoFormatS16LE,
+                                               (const char*)pcm.data(), blocks[b], body);
+        ok = writer.write_flac_frame(body.data(), body.size(), blocks[b], assignment) == 0;
+        frame_sizes.push_back(body.size());
+        // an idle stretch reported a second at a time is still one gap
+        if (b == 2)
+            ok = ok && writer.skip(200, false) == 0 && writer.skip(300, false) == 0;
+    }
+    ok = ok && writer.close() == 0;
+    check(ok, "flac gaps", "writing %s failed", (config.base_path + config.extension).c_str());
+
+    vector<unsigned char> got = read_file(config.base_path + config.extension);
+    if (got.size() < FLAC_HEADER_SIZE || memcmp(got.data(), "fLaC", 4) != 0) {
+        check(false, "flac gaps", "no FLAC stream marker");
+        return;
+    }
+    const unsigned char* info = got.data() + 8;
+    check(get_be(info, 0, 16) == 1000, "flac gaps", "STREAMINFO min block size %llu, expected 1000",
+          (unsigned long long)get_be(info, 0, 16));
+    check(get_be(info, 16, 16) == 4096, "flac gaps", "STREAMINFO max block size %llu",
+          (unsigned long long)get_be(info, 16, 16));
+    check(get_be(info, 108, 36) == 13588, "flac gaps", "STREAMINFO total samples %llu",
+          (unsigned long long)get_be(info, 108, 36));
+
+    size_t pos = FLAC_HEADER_SIZE;
+    uint64_t sample = 0;
+    for (int b = 0; b < block_count; b += 1) {
+        if (pos + FLAC_MAX_FRAME_HEADER_SIZE > got.size()) {
+            check(false, "flac gaps", "file ends before frame %d", b);
+            return;
+        }
+        const unsigned char* h = got.data() + pos;
+        check(h[0] == 0xFF && h[1] == 0xF9, "flac gaps", "frame %d sync %02x%02x, expected fff9", b, h[0], h[1]);
+        check((h[2] >> 4) == 7, "flac gaps", "frame %d block size code %d", b, h[2] >> 4);
+
+        // UTF-8 coded first sample number
+        int len = 1;
+        uint64_t v = h[4];
+        if (h[4] & 0x80) {
+            while (len < 7 && (h[4] & (0x80 >> len)))
+                len += 1;
+            v = h[4] & (0x7F >> len);
+            for (int i = 1; i < len; i += 1)
+                v = (v << 6) | (h[4 + i] & 0x3F);
+        }
+        check(v == sample, "flac gaps", "frame %d starts at sample %llu, expected %llu", b,
+              (unsigned long long)v, (unsigned long long)sample);
+        const unsigned char* size_field = h + 4 + len;
+        int frames = ((size_field[0] << 8) | size_field[1]) + 1;
+        check(frames == blocks[b], "flac gaps", "frame %d holds %d samples, expected %d", b, frames, blocks[b]);
+        int header_size = 4 + len + 2;
+        check(h[header_size] == crc8(h, header_size), "flac gaps", "frame %d header CRC", b);
+
+        size_t frame_size = header_size + 1 + frame_sizes[b] + 2;
+        if (pos + frame_size > got.size()) {
+            check(false, "flac gaps", "frame %d runs past the end of the file", b);
+            return;
+        }
+        uint16_t crc = flac_crc16(h, frame_size - 2, 0);
+        check(h[frame_size - 2] == (crc >> 8) && h[frame_size - 1] == (crc & 0xFF), "flac gaps",
+              "frame %d CRC-16", b);
+        pos += frame_size;
+        sample += blocks[b];
+    }
+    check(pos == got.size(), "flac gaps", "%zu bytes after the last frame", got.size() - pos);
+
+    vector<unsigned char> gaps = read_file(config.base_path + ".gaps");
+    string expect_gaps = "# output_frame capture_frame skipped_frames\n9192 9192 500\n";
+    check(string(gaps.begin(), gaps.end()) == expect_gaps, "flac gaps", "unexpected .gaps file");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s $dir\n", argv[0]);
+        return 2;
+    }
+    string dir = argv[1];
+
+    check_wav_s24(dir);
+    check_flac_gaps(dir);
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
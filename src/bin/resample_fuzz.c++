@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "dsp/convert.h++"
+#include "dsp/resample_graph.h++"
+
+// Fuzz target for the path resample_pcm takes: S16 PCM converted to double,
+// run through a ResampleGraph and converted back, with the rates, number
+// of outputs and block sizes taken from the input too.
+//
+// Built with -DRESAMPLER_FUZZ=ON (clang) this is a libFuzzer target:
+//
+//   resample_fuzz corpus/
+//
+// Otherwise main() below runs the same function over the files given on
+// the command line, or over a fixed set of generated inputs, so a crash
+// libFuzzer found can be replayed under any compiler and ctest keeps a
+// smoke run of it.
+//
+// Input layout: 2 bytes input rate, 1 byte output count, 2 bytes per
+// output rate, 1 byte block size seed, then S16LE samples.
+
+#define FUZZ_MIN_RATE 4000
+#define FUZZ_MAX_RATE 192000
+#define FUZZ_MAX_OUTPUTS 3
+
+static double fuzz_rate(const uint8_t* p) {
+    unsigned v = p[0] | (p[1] << 8);
+    return FUZZ_MIN_RATE + (double) (v * (uint64_t) (FUZZ_MAX_RATE - FUZZ_MIN_RATE) / 65535);
+}
+
+static void expect(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "resample_fuzz: %s\n", what);
+        abort();
+    }
+}
+
+// bounded input cannot make an unbounded output: the filters overshoot a
+// full scale step by a few percent at most
+static void check_output(const double* out, int n) {
+    for (int i = 0; i < n; i++) {
+        expect(std::isfinite(out[i]), "output is not finite");
+        expect(fabs(out[i]) < 4.0, "output out of range");
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size < 6)
+        return 0;
+    double Fs_in = fuzz_rate(data);
+    int outputs = 1 + data[2] % FUZZ_MAX_OUTPUTS;
+    size_t header = 3 + 2 * outputs + 1;
+    if (size < header)
+        return 0;
+    std::vector<double> Fs_out;
+    double lowest = Fs_in;
+    for (int k = 0; k < outputs; k++) {
+        Fs_out.push_back(fuzz_rate(data + 3 + 2 * k));
+        lowest = std::min(lowest, Fs_out[k]);
+    }
+    uint32_t blocks = data[header - 1] * 2654435761u + 1;
+
+    // a tenth of the lowest rate, as resample_pcm and the capture tools
+    ResampleGraph graph(Fs_in, Fs_out, lowest / 10.0);
+    expect(graph.outputs() == outputs, "output count");
+
+    const uint8_t* pcm = data + header;
+    int64_t count = (int64_t) (size - header) / 2;
+    const int max_block = 4096;
+    std::vector<double> in(max_block);
+    std::vector<std::vector<double> > out(outputs);
+    std::vector<double*> outs(outputs);
+    std::vector<int> written(outputs);
+    std::vector<int16_t> back;
+    std::vector<int64_t> totals(outputs, 0);
+    for (int k = 0; k < outputs; k++) {
+        out[k].resize((size_t) std::max(max_block * graph.max_output(k), graph.max_flush(k)));
+        outs[k] = out[k].data();
+    }
+
+    for (int64_t i = 0; i < count; ) {
+        blocks = blocks * 1664525u + 1013904223u;
+        int n = (int) std::min((int64_t) (blocks >> 20) % max_block + 1, count - i);
+        // the samples sit at any alignment in the fuzzer's buffer
+        std::vector<int16_t> chunk(n);
+        memcpy(chunk.data(), pcm + 2 * i, n * sizeof(int16_t));
+        expect(samples_to_double(chunk.data(), SoundIoFormatS16LE, n, in.data()), "to double");
+        graph.process(in.data(), n, outs.data(), written.data());
+        for (int k = 0; k < outputs; k++) {
+            expect(written[k] >= 0 && written[k] <= n * graph.max_output(k), "more output than max_output()");
+            check_output(outs[k], written[k]);
+            back.resize(written[k]);
+            expect(samples_from_double(outs[k], written[k], SoundIoFormatS16LE, back.data()), "from double");
+            totals[k] += written[k];
+        }
+        i += n;
+    }
+
+    graph.flush(outs.data(), written.data());
+    for (int k = 0; k < outputs; k++) {
+        expect(written[k] >= 0 && written[k] <= graph.max_flush(k), "more output than max_flush()");
+        check_output(outs[k], written[k]);
+        totals[k] += written[k];
+        // the whole input in the output's rate, plus at most the flushed tail
+        double expected = count * graph.rate(k) / Fs_in;
+        expect(totals[k] >= expected - 2 && totals[k] <= expected + graph.max_flush(k) + 2, "output length");
+    }
+    return 0;
+}
+
+#ifndef RESAMPLE_FUZZ_LIBFUZZER
+
+static int replay(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    fclose(f);
+    LLVMFuzzerTestOneInput(data.data(), data.size());
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            if (replay(argv[i]))
+                return 1;
+        }
+        return 0;
+    }
+
+    // loud noise, silence and full scale square waves at random rates
+    uint32_t seed = 1;
+    for (int run = 0; run < 200; run++) {
+        std::vector<uint8_t> data(64 + (run % 13) * 1777);
+        for (size_t i = 0; i < data.size(); i++) {
+            seed = seed * 1664525u + 1013904223u;
+            data[i] = (uint8_t) (seed >> 24);
+        }
+        if (run % 3 == 1)
+            std::fill(data.begin() + 12, data.end(), 0);
+        if (run % 3 == 2) {
+            for (size_t i = 12; i + 1 < data.size(); i += 2) {
+                int16_t v = ((i / 64) % 2) ? 32767 : -32768;
+                memcpy(&data[i], &v, 2);
+            }
+        }
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+    }
+    printf("200 inputs\n");
+    return 0;
+}
+
+#endif
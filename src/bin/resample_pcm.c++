@@ -1,21 +1,24 @@
 
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstdio>
 #include <iostream>
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <string>
 
-#include "dsp/resampler.h++"
+#include "dsp/convert.h++"
+#include "dsp/resample_graph.h++"
 
 // ffmpeg -i "/Users/nsetzer/Music/Library/Beast/Beast/05_Mr._Hurricane.mp3" -ac 1 -ar 44100 -f s16le -acodec pcm_s16le input.pcm
 // vlc --demux=rawaud --rawaud-channels 1 --rawaud-samplerate 44100 input.pcm
 
-#define PCM_MAX_DOUBLE 32768.0
 #define STREAM_BUFFER_SIZE 2048
 
 
-void write_header(FILE * wf) {
+void write_header(FILE * wf, int32_t sample_rate) {
 
     int16_t pcm = 0x01;
     int32_t t;
@@ -23,7 +26,6 @@ void write_header(FILE * wf) {
 
     int32_t bitrate = 16;
     int16_t channel_count = 1;
-    int32_t sample_rate = 8000;
     int32_t file_size = 0x0FFFFFFF + 1;
     int32_t data_size = file_size - 44 + 8;
 
@@ -49,52 +51,132 @@ void write_header(FILE * wf) {
     fwrite32(wf,&data_size);
 
 }
-void resample(double Fs_in, double Fs_out, FILE* fin, FILE* fout)
+static void write_samples(const double* samples, int n, int* skip, Dither* dither, FILE* fout)
 {
-    // set Fc = Fs_out - padding
-    double padding = 1000.0;
-    Resampler resampler(Fs_in, Fs_out, padding);
+    // the first outputs only carry the filter's delay
+    int drop = (*skip < n) ? *skip : n;
+    *skip -= drop;
+    samples += drop;
+    n -= drop;
+
+    // rounded and saturated, instead of a truncating cast that wraps
+    int16_t pcm[STREAM_BUFFER_SIZE];
+    while (n > 0) {
+        int m = (n < STREAM_BUFFER_SIZE) ? n : STREAM_BUFFER_SIZE;
+        samples_from_double(samples, m, SoundIoFormatS16LE, pcm, dither);
+        fwrite(pcm, sizeof(int16_t), m, fout);
+        samples += m;
+        n -= m;
+    }
+}
 
-    int n, i, j;
-    int16_t vi;
-    double* sample_buffer = (double*) malloc(sizeof(double) * resampler.max_output());
+// Every output rate comes out of one pass over the input (see
+// ResampleGraph); fout[k] receives Fs_out[k].
+void resample(double Fs_in, const std::vector<double>& Fs_out, FILE* fin,
+              const std::vector<FILE*>& fout, Dither* dither)
+{
+    // set Fc = Fs_out - padding, with the padding a tenth of the lowest
+    // rate as the capture tools use it
+    double lowest = Fs_in;
+    for (double rate : Fs_out)
+        lowest = std::min(lowest, rate);
+    double padding = lowest / 10.0;
+    ResampleGraph graph(Fs_in, Fs_out, padding);
+    int outputs = graph.outputs();
+
+    int k;
+    std::vector<int> skip(outputs);
+    std::vector<int> written(outputs);
+    std::vector<std::vector<double> > sample_buffers(outputs);
+    std::vector<double*> sample_ptrs(outputs);
+    for (k=0; k < outputs; k++) {
+        skip[k] = static_cast<int>(graph.latency(k) + 0.5);
+        int buffer_size = graph.max_output(k) * (STREAM_BUFFER_SIZE / 2);
+        if (buffer_size < graph.max_flush(k))
+            buffer_size = graph.max_flush(k);
+        sample_buffers[k].resize(buffer_size);
+        sample_ptrs[k] = sample_buffers[k].data();
+    }
     char buffer[STREAM_BUFFER_SIZE];
-    int16_t* ptr;
+    double input[STREAM_BUFFER_SIZE / 2];
     size_t bytes_read;
 
-    // expect to read signed PCM data
-    ptr = reinterpret_cast<int16_t*>(&buffer[0]);
+    // expect to read signed 16 bit little endian PCM data
     bytes_read = fread(buffer, sizeof(char), sizeof(buffer), fin);
 
     while (bytes_read > 0) {
 
         //std::cerr << "bytes read " << bytes_read << std::endl;
 
-        for (i=0; i < bytes_read/2; i++) {
-            double v = static_cast<double>(ptr[i]) / PCM_MAX_DOUBLE;
-            n = resampler.insert(v, sample_buffer);
-
-            for (j=0; j < n; j++) {
-                vi = static_cast<int16_t>(sample_buffer[j] * PCM_MAX_DOUBLE);
-                fwrite( &vi, sizeof(int16_t), 1, fout);
-            }
-
+        int count = (int)(bytes_read/2);
+        samples_to_double(buffer, SoundIoFormatS16LE, count, input);
+        graph.process(input, count, sample_ptrs.data(), written.data());
+        for (k=0; k < outputs; k++) {
+            write_samples(sample_ptrs[k], written[k], &skip[k], dither, fout[k]);
+            fflush(fout[k]);
         }
 
-        fflush(fout);
-
         bytes_read = fread(buffer, sizeof(char), sizeof(buffer), fin);
     }
 
+    // the tail that is still inside the filters
+    graph.flush(sample_ptrs.data(), written.data());
+    for (k=0; k < outputs; k++) {
+        write_samples(sample_ptrs[k], written[k], &skip[k], dither, fout[k]);
+        fflush(fout[k]);
+    }
+}
+
+// "44100:16000,8000" -> Fs_in = 44100, Fs_out = {16000, 8000}
+static bool parse_rates(const char* arg, double* Fs_in, std::vector<double>& Fs_out)
+{
+    char* end;
+    *Fs_in = strtod(arg, &end);
+    if (*end != ':' || *Fs_in <= 0)
+        return false;
+    Fs_out.clear();
+    do {
+        double rate = strtod(end + 1, &end);
+        if (rate <= 0)
+            return false;
+        Fs_out.push_back(rate);
+    } while (*end == ',');
+    return *end == '\0';
 }
 
 int main(int argc, char* argv[]) {
 
     // INPUT is assumed to be MONO RAW PCM
     // output is a wave file
+    // usage: resample_pcm [--dither] [--rates Fs_in:Fs_out[,Fs_out...]] [input|-] [output|-]
+    //
+    // with several output rates, `output` is a prefix and each rate is
+    // written to <output>.<rate>.wav
 
     FILE* fin = stdin;
-    FILE* fout = stdout;
+    std::vector<FILE*> fout;
+    Dither dither;
+    bool use_dither = false;
+    double Fs_in = 44100;
+    std::vector<double> Fs_out(1, 8000);
+    size_t k;
+
+    for (;;) {
+        if (argc >= 2 && strcmp(argv[1], "--dither") == 0) {
+            use_dither = true;
+            argv++;
+            argc--;
+        } else if (argc >= 3 && strcmp(argv[1], "--rates") == 0) {
+            if (!parse_rates(argv[2], &Fs_in, Fs_out)) {
+                std::cerr << "invalid rates: " << argv[2] << std::endl;
+                return 1;
+            }
+            argv += 2;
+            argc -= 2;
+        } else {
+            break;
+        }
+    }
 
     if (argc >= 2) {
         if (strcmp(argv[1], "-") != 0) {
@@ -107,22 +189,39 @@ int main(int argc, char* argv[]) {
         goto err;
     }
 
-    if (argc >= 3) {
-        if (strcmp(argv[2], "-") != 0) {
-            fout = fopen(argv[2], "wb");
+    if (Fs_out.size() == 1) {
+        fout.push_back(stdout);
+        if (argc >= 3 && strcmp(argv[2], "-") != 0) {
+            fout[0] = fopen(argv[2], "wb");
+        }
+    } else if (argc >= 3 && strcmp(argv[2], "-") != 0) {
+        for (k=0; k < Fs_out.size(); k++) {
+            std::string path = std::string(argv[2]) + "." + std::to_string((long long) Fs_out[k]) + ".wav";
+            fout.push_back(fopen(path.c_str(), "wb"));
         }
+    } else {
+        std::cerr << "several output rates need an output prefix" << std::endl;
+        goto err;
     }
 
-    if (fout==NULL) {
-        std::cerr << "unable to open output file" << std::endl;
-        goto err;
+    for (k=0; k < fout.size(); k++) {
+        if (fout[k]==NULL) {
+            std::cerr << "unable to open output file" << std::endl;
+            goto err;
+        }
     }
 
-    write_header(fout);
-    resample(44100, 8000, fin, fout);
+    for (k=0; k < fout.size(); k++) {
+        write_header(fout[k], (int32_t) Fs_out[k]);
+    }
+    resample(Fs_in, Fs_out, fin, fout, use_dither ? &dither : nullptr);
 
 err:
-    fclose(fin);
-    fclose(fout);
+    if (fin != NULL)
+        fclose(fin);
+    for (k=0; k < fout.size(); k++) {
+        if (fout[k] != NULL)
+            fclose(fout[k]);
+    }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,598 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "dsp/cheby1.h++"
+#include "dsp/cpu.h++"
+#include "dsp/directform2.h++"
+#include "dsp/multiresampler.h++"
+#include "dsp/resample_graph.h++"
+#include "dsp/resampler.h++"
+
+// Numerical checks for Resampler and the filters under it, to run before
+// and after touching any of them:
+//
+//   resample_verify            every check, exits 1 if any fails
+//   resample_verify --bench    throughput of each rate pair instead
+//   resample_verify -v         also print every measured tone
+//
+// For each rate pair (the rates the capture tools use, through each of
+// the decimating, low pass + linear and polyphase paths) a sine sweep
+// measures
+//
+//   ripple   gain spread over the passband, dB
+//   reject   worst alias (downsampling) or image (upsampling) level
+//            relative to the tone, dB
+//   delay    worst group delay error in the passband after dropping
+//            round(latency()) outputs, in output samples; at the bottom
+//            of the band it must be the fraction latency() left over
+//            on every path
+//
+// with the tone measured by a least squares fit over the middle of the
+// output. Then the block APIs are checked to agree with each other:
+// output counts, chunking, insert() against process(), copies, reset(),
+// arenas and ResampleGraph, and MultiResampler against one Resampler per
+// channel. Finally cheby1 designs are run through DirectForm2Mono against
+// a plain difference equation.
+//
+// The limits below are what the filters are documented to do, with a
+// little room for rounding; a change that needs them loosened changes the
+// filters' behaviour and should say so.
+
+#define PI 3.14159265358979323846
+
+#define TONE_SECONDS 0.25
+#define TONE_AMPLITUDE 0.5
+
+struct RatePair {
+    double Fs_in;
+    double Fs_out;
+    const char* path;
+    double max_ripple_db;
+    double min_reject_db;
+    double max_delay_error;
+};
+
+// padding is a tenth of the lower rate, as the capture tools use it
+static const RatePair rate_pairs[] = {
+    // DecimatorCascade: about 80 dB, linear phase
+    {96000, 48000, "decimate", 0.1, 75, 0.02},
+    {48000, 24000, "decimate", 0.1, 75, 0.02},
+    {48000, 16000, "decimate", 0.1, 75, 0.02},
+    {48000,  8000, "decimate", 0.1, 75, 0.02},
+    {44100, 22050, "decimate", 0.1, 75, 0.02},
+    {32000, 16000, "decimate", 0.1, 75, 0.02},
+    // Chebyshev low pass + linear interpolation: 15% ripple, a 6 pole
+    // roll-off and no linear phase, so these limits only hold it where it
+    // is today. latency() is exact at DC; the delay error is how far the
+    // rest of the passband lags behind it, which trimming cannot remove
+    {48000, 44100, "lowpass", 6.0, 12, 21.5},
+    {44100, 16000, "lowpass", 3.5, 27, 7.0},
+    {44100,  8000, "lowpass", 3.2, 39, 6.5},
+    {48000, 22050, "lowpass", 4.0, 23, 7.5},
+    {32000, 11025, "lowpass", 3.5, 28, 7.0},
+    // PolyphaseInterpolator: about 80 dB of image rejection
+    {16000, 48000, "polyphase", 0.1, 75, 0.02},
+    { 8000, 48000, "polyphase", 0.1, 75, 0.02},
+    {22050, 44100, "polyphase", 0.1, 75, 0.02},
+    {44100, 48000, "polyphase", 0.1, 75, 0.02},
+    {16000, 44100, "polyphase", 0.1, 75, 0.02},
+};
+
+static int failures = 0;
+static bool verbose = false;
+
+static void check(bool ok, const char* what, const RatePair* pair, const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static void check(bool ok, const char* what, const RatePair* pair, const char* fmt, ...) {
+    if (ok)
+        return;
+    failures += 1;
+    if (pair)
+        fprintf(stderr, "FAIL %s %g -> %g: ", what, pair->Fs_in, pair->Fs_out);
+    else
+        fprintf(stderr, "FAIL %s: ", what);
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+}
+
+static double padding_for(const RatePair& pair) {
+    return std::min(pair.Fs_in, pair.Fs_out) / 10.0;
+}
+
+// Resample all of `in` in blocks of `block` and flush; the first
+// round(latency()) outputs are dropped so out[m] lines up with input
+// position m * Fs_in / Fs_out.
+static std::vector<double> resample_aligned(Resampler& r, const std::vector<double>& in, int block) {
+    std::vector<double> out;
+    std::vector<double> buf(std::max((size_t) r.max_flush(), (size_t) block * r.max_output()));
+    for (size_t i = 0; i < in.size(); i += block) {
+        int n = (int) std::min((size_t) block, in.size() - i);
+        int m = r.process(in.data() + i, n, buf.data());
+        out.insert(out.end(), buf.begin(), buf.begin() + m);
+    }
+    int m = r.flush(buf.data());
+    out.insert(out.end(), buf.begin(), buf.begin() + m);
+    size_t skip = (size_t) llround(r.latency());
+    out.erase(out.begin(), out.begin() + std::min(skip, out.size()));
+    return out;
+}
+
+struct ToneFit {
+    double amplitude;
+    double phase;       // of a sin(w m + phase)
+    double residual;    // rms of what the tone does not explain
+};
+
+// least squares fit of y[m] = a sin(w m) + b cos(w m) over the middle
+// half of y, away from the filters' start and end transients
+static ToneFit fit_tone(const std::vector<double>& y, double w) {
+    size_t first = y.size() / 4;
+    size_t last = y.size() - y.size() / 4;
+    double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0;
+    for (size_t m = first; m < last; m++) {
+        double s = sin(w * m), c = cos(w * m);
+        ss += s * s;
+        cc += c * c;
+        sc += s * c;
+        ys += y[m] * s;
+        yc += y[m] * c;
+    }
+    double det = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / det;
+    double b = (yc * ss - ys * sc) / det;
+    double rest = 0;
+    for (size_t m = first; m < last; m++) {
+        double e = y[m] - a * sin(w * m) - b * cos(w * m);
+        rest += e * e;
+    }
+    ToneFit fit;
+    fit.amplitude = sqrt(a * a + b * b);
+    fit.phase = atan2(b, a);
+    fit.residual = sqrt(rest / (last - first));
+    return fit;
+}
+
+static std::vector<double> tone(double f, double Fs, double seconds) {
+    std::vector<double> x((size_t) (Fs * seconds));
+    for (size_t n = 0; n < x.size(); n++)
+        x[n] = TONE_AMPLITUDE * sin(2 * PI * f * n / Fs);
+    return x;
+}
+
+static ToneFit measure_tone(const RatePair& pair, double f) {
+    Resampler r(pair.Fs_in, pair.Fs_out, padding_for(pair));
+    std::vector<double> y = resample_aligned(r, tone(f, pair.Fs_in, TONE_SECONDS), 1024);
+    return fit_tone(y, 2 * PI * f / pair.Fs_out);
+}
+
+static double db(double ratio) {
+    return 20 * log10(std::max(ratio, 1e-12));
+}
+
+// phase difference wrapped to (-pi, pi]
+static double wrap(double phase) {
+    while (phase > PI)
+        phase -= 2 * PI;
+    while (phase <= -PI)
+        phase += 2 * PI;
+    return phase;
+}
+
+static void check_response(const RatePair& pair) {
+    Resampler probe(pair.Fs_in, pair.Fs_out, padding_for(pair));
+    double padding = padding_for(pair);
+    double nyquist = std::min(pair.Fs_in, pair.Fs_out) / 2;
+    double pass_edge = nyquist - padding;
+    double fraction = probe.latency() - llround(probe.latency());
+    bool down = pair.Fs_out < pair.Fs_in;
+
+    // passband: gain, the rest of the output, and group delay from the
+    // phase change over a small step in frequency
+    const int points = 24;
+    double lo_gain = 1e9, hi_gain = 0, worst_image = 0, worst_delay = 0;
+    double step = pair.Fs_out * 0.001;
+    double first_delay = 0;
+    for (int i = 0; i < points; i++) {
+        double f = 50 + (pass_edge - step - 50) * i / (points - 1);
+        ToneFit a = measure_tone(pair, f);
+        ToneFit b = measure_tone(pair, f + step);
+        double gain = a.amplitude / TONE_AMPLITUDE;
+        double delay = -wrap(b.phase - a.phase) / (2 * PI * step / pair.Fs_out);
+        lo_gain = std::min(lo_gain, gain);
+        hi_gain = std::max(hi_gain, gain);
+        worst_image = std::max(worst_image, a.residual / (TONE_AMPLITUDE / sqrt(2.0)));
+        worst_delay = std::max(worst_delay, fabs(delay - fraction));
+        if (i == 0)
+            first_delay = delay;
+        if (verbose)
+            printf("    %8.1f Hz  gain %+8.4f dB  rest %7.1f dB  group delay %8.3f\n", f, db(gain),
+                   db(a.residual / (TONE_AMPLITUDE / sqrt(2.0))), delay);
+    }
+
+    // stopband: everything that comes out of a tone the output cannot
+    // hold is alias
+    double worst_alias = 0;
+    if (down) {
+        for (int i = 0; i < 12; i++) {
+            double f = pair.Fs_out / 2 + padding + (pair.Fs_in / 2 * 0.98 - pair.Fs_out / 2 - padding) * i / 11;
+            Resampler r(pair.Fs_in, pair.Fs_out, padding);
+            std::vector<double> y = resample_aligned(r, tone(f, pair.Fs_in, TONE_SECONDS), 1024);
+            double rms = 0;
+            for (size_t m = y.size() / 4; m < y.size() - y.size() / 4; m++)
+                rms += y[m] * y[m];
+            rms = sqrt(rms / (y.size() - y.size() / 2));
+            worst_alias = std::max(worst_alias, rms / (TONE_AMPLITUDE / sqrt(2.0)));
+            if (verbose)
+                printf("    %8.1f Hz  alias %7.1f dB\n", f, db(rms / (TONE_AMPLITUDE / sqrt(2.0))));
+        }
+    }
+
+    double ripple = db(hi_gain) - db(lo_gain);
+    double reject = -db(std::max(worst_image, worst_alias));
+    printf("%-9s %6g -> %6g  latency %8.3f  ripple %6.3f dB  reject %6.1f dB  delay error %6.3f\n",
+           pair.path, pair.Fs_in, pair.Fs_out, probe.latency(), ripple, reject, worst_delay);
+
+    check(fabs(first_delay - fraction) < 0.05, "latency", &pair,
+          "measured %.3f output samples, latency() leaves %.3f", first_delay, fraction);
+    if (pair.max_ripple_db > 0)
+        check(ripple <= pair.max_ripple_db, "ripple", &pair, "%.3f dB > %.3f dB", ripple, pair.max_ripple_db);
+    if (pair.min_reject_db > 0)
+        check(reject >= pair.min_reject_db, "reject", &pair, "%.1f dB < %.1f dB", reject, pair.min_reject_db);
+    if (pair.max_delay_error > 0)
+        check(worst_delay <= pair.max_delay_error, "group delay", &pair, "%.3f > %.3f",
+              worst_delay, pair.max_delay_error);
+}
+
+// what ResamplePhase promises for whole number rates
+static int64_t exact_count(const RatePair& pair, int64_t inputs) {
+    int64_t L = (int64_t) pair.Fs_out, M = (int64_t) pair.Fs_in;
+    int64_t a = L, b = M;
+    while (b) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    L /= a;
+    M /= a;
+    return inputs > 0 ? (inputs - 1) * L / M + 1 : 0;
+}
+
+static double max_difference(const std::vector<double>& a, const std::vector<double>& b) {
+    if (a.size() != b.size())
+        return INFINITY;
+    double worst = 0;
+    for (size_t i = 0; i < a.size(); i++)
+        worst = std::max(worst, fabs(a[i] - b[i]));
+    return worst;
+}
+
+// Resample `in` through process() in blocks whose sizes come from `sizes`
+// (cycled), checking every call against max_output()
+static std::vector<double> run_blocks(const RatePair& pair, Resampler& r, const std::vector<double>& in,
+                                      const std::vector<int>& sizes) {
+    std::vector<double> out;
+    std::vector<double> buf;
+    size_t i = 0;
+    for (int k = 0; i < in.size(); k++) {
+        int n = (int) std::min((size_t) sizes[k % sizes.size()], in.size() - i);
+        buf.resize((size_t) n * r.max_output() + 1);
+        int m = r.process(in.data() + i, n, buf.data());
+        check(m >= 0 && m <= n * r.max_output(), "max_output", &pair, "%d outputs from %d inputs", m, n);
+        out.insert(out.end(), buf.begin(), buf.begin() + m);
+        i += n;
+    }
+    return out;
+}
+
+static void check_lengths(const RatePair& pair) {
+    double padding = padding_for(pair);
+    uint32_t seed = 12345;
+    std::vector<double> in(20000);
+    for (double& x : in) {
+        seed = seed * 1664525u + 1013904223u;
+        x = (int32_t) seed / 2147483648.0 * 0.9;
+    }
+
+    // one insert() at a time is the reference
+    Resampler ref(pair.Fs_in, pair.Fs_out, padding);
+    check(ref.valid(), "valid", &pair, "construction failed");
+    std::vector<double> expect;
+    std::vector<double> buf(std::max(ref.max_output(), ref.max_flush()));
+    for (size_t i = 0; i < in.size(); i++) {
+        int m = ref.insert(in[i], buf.data());
+        check(m >= 0 && m <= ref.max_output(), "insert", &pair, "%d outputs, max_output() %d", m, ref.max_output());
+        expect.insert(expect.end(), buf.begin(), buf.begin() + m);
+        if (ref.exact() && (i == 0 || i == 1 || i == 999 || i + 1 == in.size())) {
+            check((int64_t) expect.size() == exact_count(pair, (int64_t) i + 1), "count", &pair,
+                  "%zu outputs after %zu inputs, expected %lld", expect.size(), i + 1,
+                  (long long) exact_count(pair, (int64_t) i + 1));
+        }
+    }
+    int tail = ref.flush(buf.data());
+    check(tail >= 0 && tail <= ref.max_flush(), "flush", &pair, "%d outputs, max_flush() %d", tail, ref.max_flush());
+    int64_t flush_inputs = (int64_t) ceil(ref.latency() * pair.Fs_in / pair.Fs_out - 1e-9);
+    check(!ref.exact() || (int64_t) expect.size() + tail >= exact_count(pair, (int64_t) in.size() + flush_inputs) - 1,
+          "flush", &pair, "flush left the tail short: %d outputs", tail);
+
+    // any blocking gives the same samples
+    static const int size_sets[][6] = {
+        {1, 1, 1, 1, 1, 1}, {7, 0, 64, 3, 1000, 1}, {4096, 4096, 4096, 4096, 4096, 4096}, {20000, 0, 0, 0, 0, 0},
+    };
+    for (const auto& set : size_sets) {
+        Resampler r(pair.Fs_in, pair.Fs_out, padding);
+        std::vector<double> got = run_blocks(pair, r, in, std::vector<int>(set, set + 6));
+        check(max_difference(got, expect) == 0, "blocks", &pair, "block sizes %d,%d,... differ by %g",
+              set[0], set[1], max_difference(got, expect));
+    }
+
+    // a copy taken mid-stream carries on exactly like the original, and
+    // reset() starts over like a new object
+    Resampler a(pair.Fs_in, pair.Fs_out, padding);
+    std::vector<int> sizes(1, 512);
+    std::vector<double> first(in.begin(), in.begin() + 7000), rest(in.begin() + 7000, in.end());
+    std::vector<double> head = run_blocks(pair, a, first, sizes);
+    Resampler b(a);
+    std::vector<double> from_a = run_blocks(pair, a, rest, sizes);
+    std::vector<double> from_b = run_blocks(pair, b, rest, sizes);
+    check(max_difference(from_a, from_b) == 0, "copy", &pair, "copy differs by %g", max_difference(from_a, from_b));
+    head.insert(head.end(), from_a.begin(), from_a.end());
+    check(max_difference(head, expect) == 0, "copy", &pair, "original changed by the copy");
+    a.reset();
+    check(max_difference(run_blocks(pair, a, in, sizes), expect) == 0, "reset", &pair, "differs from a new object");
+
+    // the same filter in caller memory
+    std::vector<char> mem(Resampler::arena_bytes(pair.Fs_in, pair.Fs_out, padding));
+    DspArena arena(mem.data(), mem.size());
+    Resampler c(pair.Fs_in, pair.Fs_out, padding, arena);
+    check(c.valid(), "arena", &pair, "arena_bytes() too small");
+    check(max_difference(run_blocks(pair, c, in, sizes), expect) == 0, "arena", &pair, "differs from the heap");
+
+    // a graph output has the count of its own Resampler
+    ResampleGraph graph(pair.Fs_in, std::vector<double>(1, pair.Fs_out), padding);
+    std::vector<double> out((size_t) 4096 * graph.max_output(0) + graph.max_flush(0));
+    double* outs[1] = {out.data()};
+    int written[1];
+    int64_t total = 0;
+    for (size_t i = 0; i < in.size(); i += 4096) {
+        int n = (int) std::min((size_t) 4096, in.size() - i);
+        graph.process(in.data() + i, n, outs, written);
+        check(written[0] <= n * graph.max_output(0), "graph", &pair, "%d outputs from %d inputs", written[0], n);
+        total += written[0];
+    }
+    check(total == (int64_t) expect.size(), "graph", &pair, "%lld outputs, Resampler gives %zu",
+          (long long) total, expect.size());
+    check(fabs(graph.latency(0) - ref.latency()) < 1e-9, "graph", &pair, "latency %.3f, Resampler %.3f",
+          graph.latency(0), ref.latency());
+}
+
+// Interleaved `in` through process() in blocks of `block` frames, and the
+// flush when `flush` is set
+static std::vector<double> run_multi(const RatePair& pair, MultiResampler& r, const std::vector<double>& in,
+                                     int block, bool flush) {
+    const int C = r.channels();
+    size_t frames = in.size() / C;
+    std::vector<double> out;
+    std::vector<double> buf((size_t) C * std::max(r.max_flush(), block * r.max_output()));
+    for (size_t i = 0; i < frames; i += block) {
+        int n = (int) std::min((size_t) block, frames - i);
+        int m = r.process(in.data() + i * C, n, buf.data());
+        check(m >= 0 && m <= n * r.max_output(), "multi max_output", &pair, "%d outputs from %d inputs", m, n);
+        out.insert(out.end(), buf.begin(), buf.begin() + (size_t) m * C);
+    }
+    if (flush) {
+        int m = r.flush(buf.data());
+        check(m >= 0 && m <= r.max_flush(), "multi flush", &pair, "%d outputs, max_flush() %d", m, r.max_flush());
+        out.insert(out.end(), buf.begin(), buf.begin() + (size_t) m * C);
+    }
+    return out;
+}
+
+// MultiResampler against a Resampler per channel: the same counts and
+// latency, and the same samples up to rounding, since the row kernels add
+// in another order. 7 channels take every vector width's tail.
+static void check_multi(const RatePair& pair) {
+    static const int channel_counts[] = {1, 7};
+    double padding = padding_for(pair);
+    for (int C : channel_counts) {
+        const size_t frames = 12000;
+        uint32_t seed = 777;
+        std::vector<double> in(frames * C);
+        for (double& x : in) {
+            seed = seed * 1664525u + 1013904223u;
+            x = (int32_t) seed / 2147483648.0 * 0.9;
+        }
+
+        std::vector<std::vector<double>> planes(C);
+        Resampler ref(pair.Fs_in, pair.Fs_out, padding);
+        for (int ch = 0; ch < C; ch++) {
+            std::vector<double> plane(frames);
+            for (size_t i = 0; i < frames; i++)
+                plane[i] = in[i * C + ch];
+            Resampler r(pair.Fs_in, pair.Fs_out, padding);
+            planes[ch] = run_blocks(pair, r, plane, std::vector<int>(1, 512));
+            std::vector<double> tail(r.max_flush());
+            planes[ch].insert(planes[ch].end(), tail.begin(), tail.begin() + r.flush(tail.data()));
+        }
+        std::vector<double> expect(planes[0].size() * C);
+        for (int ch = 0; ch < C; ch++) {
+            for (size_t i = 0; i < planes[0].size(); i++)
+                expect[i * C + ch] = planes[ch][i];
+        }
+
+        MultiResampler m(pair.Fs_in, pair.Fs_out, padding, C);
+        check(m.valid(), "multi", &pair, "construction failed");
+        check(fabs(m.latency() - ref.latency()) < 1e-9 && m.max_output() == ref.max_output() &&
+              m.max_flush() == ref.max_flush() && m.exact() == ref.exact(), "multi", &pair,
+              "latency %.3f, max_output %d, max_flush %d; Resampler %.3f, %d, %d",
+              m.latency(), m.max_output(), m.max_flush(), ref.latency(), ref.max_output(), ref.max_flush());
+        std::vector<double> got = run_multi(pair, m, in, 512, true);
+        check(max_difference(got, expect) < 1e-9, "multi", &pair, "%d channels: %zu samples, Resampler %zu, "
+              "differ by %g", C, got.size(), expect.size(), max_difference(got, expect));
+
+        // a mid-stream copy, reset() and caller memory, as for Resampler
+        m.reset();
+        std::vector<double> first(in.begin(), in.begin() + 5000 * C), rest(in.begin() + 5000 * C, in.end());
+        std::vector<double> head = run_multi(pair, m, first, 333, false);
+        MultiResampler copy(m);
+        std::vector<double> from_m = run_multi(pair, m, rest, 333, true);
+        std::vector<double> from_copy = run_multi(pair, copy, rest, 333, true);
+        check(max_difference(from_m, from_copy) == 0, "multi copy", &pair, "copy differs by %g",
+              max_difference(from_m, from_copy));
+        head.insert(head.end(), from_m.begin(), from_m.end());
+        check(max_difference(head, got) == 0, "multi reset", &pair, "differs from a new object by %g",
+              max_difference(head, got));
+
+        std::vector<char> mem(MultiResampler::arena_bytes(pair.Fs_in, pair.Fs_out, padding, C));
+        DspArena arena(mem.data(), mem.size());
+        MultiResampler a(pair.Fs_in, pair.Fs_out, padding, C, arena);
+        check(a.valid(), "multi arena", &pair, "arena_bytes() too small");
+        if (a.valid()) {
+            std::vector<double> from_arena = run_multi(pair, a, in, 4096, true);
+            check(max_difference(from_arena, got) == 0, "multi arena", &pair, "differs from the heap by %g",
+                  max_difference(from_arena, got));
+        }
+    }
+}
+
+// cheby1 through DirectForm2Mono against the difference equation written
+// out: y[n] = sum B[k] x[n-k] - sum A[k] y[n-k]. Direct form coefficients
+// lose the poles to rounding well before 12 poles or at corners near DC,
+// so the designs cover what resampler_lowpass asks for with room to spare.
+static void check_filters(void) {
+    static const int poles[] = {2, 4, 6, 8};
+    static const int ripples[] = {0, 5, 15};
+    static const double corners[] = {0.05, 0.1, 0.15, 0.25, 0.4, 0.45};
+    int designs = 0;
+    for (int np : poles) {
+        for (int pr : ripples) {
+            for (double fc : corners) {
+                for (int high = 0; high < 2; high++) {
+                    double B[CHEBY1_STACK_SIZE], A[CHEBY1_STACK_SIZE];
+                    int n = cheby1(np, pr, fc, high, B, A, CHEBY1_STACK_SIZE);
+                    char what[64];
+                    snprintf(what, sizeof(what), "cheby1(%d, %d%%, %g, %s)", np, pr, fc, high ? "high" : "low");
+                    check(n == np + 1, what, nullptr, "%d coefficients", n);
+                    if (n != np + 1)
+                        continue;
+                    designs += 1;
+
+                    // gain at DC and at Nyquist, denominator as DirectForm2Mono applies it
+                    double b0 = 0, a0 = 1, bn = 0, an = 1;
+                    for (int k = 0; k < n; k++) {
+                        double sign = (k % 2) ? -1 : 1;
+                        b0 += B[k];
+                        bn += sign * B[k];
+                        if (k > 0) {
+                            a0 += A[k];
+                            an += sign * A[k];
+                        }
+                    }
+                    double pass = high ? fabs(bn / an) : fabs(b0 / a0);
+                    double stop = high ? fabs(b0 / a0) : fabs(bn / an);
+                    check(fabs(pass - 1) < 0.01 + pr / 100.0, what, nullptr, "passband gain %g", pass);
+                    check(stop < 0.01, what, nullptr, "stopband gain %g", stop);
+
+                    std::vector<char> mem(DirectForm2Mono<double>::arena_bytes(n));
+                    DspArena arena(mem.data(), mem.size());
+                    DirectForm2Mono<double> df2(B, A, n, arena);
+                    std::vector<double> x(n, 0), y(n, 0);
+                    double worst = 0, energy = 0, late = 0;
+                    const int length = 40000;
+                    for (int i = 0; i < length; i++) {
+                        double v = (i == 0) ? 1.0 : 0.0;
+                        if (i >= 100 && i < 200)
+                            v = (i % 7) * 0.1;
+                        double got = df2.IIR(v);
+                        for (int k = n - 1; k > 0; k--) {
+                            x[k] = x[k - 1];
+                            y[k] = y[k - 1];
+                        }
+                        x[0] = v;
+                        double want = 0;
+                        for (int k = 0; k < n; k++)
+                            want += B[k] * x[k];
+                        for (int k = 1; k < n; k++)
+                            want -= A[k] * y[k];
+                        y[0] = want;
+                        worst = std::max(worst, fabs(got - want));
+                        energy += got * got;
+                        if (i >= length - 1000)
+                            late += got * got;
+                        if (!std::isfinite(got))
+                            break;
+                    }
+                    // decayed: every pole inside the unit circle
+                    check(std::isfinite(energy) && late <= energy * 1e-12, what, nullptr,
+                          "impulse response does not decay (%g of %g in the last 1000 samples)", late, energy);
+                    check(worst <= 1e-7 * std::max(1.0, sqrt(energy)), what, nullptr,
+                          "DirectForm2Mono differs from the difference equation by %g", worst);
+                }
+            }
+        }
+    }
+    printf("cheby1    %d designs through DirectForm2Mono\n", designs);
+}
+
+static void bench(void) {
+    const double seconds = 20;
+    printf("%-9s %15s  %10s  %10s\n", "path", "rates", "Msamples/s", "realtime");
+    for (const RatePair& pair : rate_pairs) {
+        Resampler r(pair.Fs_in, pair.Fs_out, padding_for(pair));
+        std::vector<double> in = tone(1000, pair.Fs_in, 1.0);
+        std::vector<double> out(in.size() * r.max_output());
+        int passes = (int) seconds;
+        auto t0 = std::chrono::steady_clock::now();
+        volatile double sink = 0;
+        for (int k = 0; k < passes; k++) {
+            int m = r.process(in.data(), (int) in.size(), out.data());
+            sink = sink + out[m / 2];
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        printf("%-9s %6g -> %6g  %10.1f  %9.0fx\n", pair.path, pair.Fs_in, pair.Fs_out,
+               passes * in.size() / elapsed / 1e6, passes / elapsed);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool do_bench = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            do_bench = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else {
+            fprintf(stderr, "usage: %s [--bench] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+    printf("kernels: %s\n", simd_level_name(simd_level()));
+    if (do_bench) {
+        bench();
+        return 0;
+    }
+
+    for (const RatePair& pair : rate_pairs) {
+        check_response(pair);
+        check_lengths(pair);
+        check_multi(pair);
+    }
+    check_filters();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "block_index.h"
+
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+void BlockMarkQueue::reset(int capacity) {
+    uint64_t size = 1;
+    while (size < (uint64_t)capacity)
+        size <<= 1;
+    m_entries.assign(size, BlockIndexEntry());
+    m_mask = size - 1;
+    m_head = 0;
+    m_tail = 0;
+    m_dropped = 0;
+}
+
+bool BlockMarkQueue::push(const BlockIndexEntry& entry) {
+    uint64_t tail = m_tail.load(memory_order_relaxed);
+    if (tail - m_head.load(memory_order_acquire) > m_mask) {
+        m_dropped.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    m_entries[tail & m_mask] = entry;
+    m_tail.store(tail + 1, memory_order_release);
+    return true;
+}
+
+int BlockMarkQueue::pop(BlockIndexEntry* out, int max) {
+    uint64_t head = m_head.load(memory_order_relaxed);
+    uint64_t tail = m_tail.load(memory_order_acquire);
+    int count = 0;
+    while (head != tail && count < max) {
+        out[count] = m_entries[head & m_mask];
+        head += 1;
+        count += 1;
+    }
+    m_head.store(head, memory_order_release);
+    return count;
+}
+
+BlockIndexWriter::~BlockIndexWriter() {
+    close();
+}
+
+int BlockIndexWriter::open(const string& path, int sample_rate, int channels, int format,
+                           int interval_frames) {
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file) {
+        cerr << "unable to open block index " << path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    BlockIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BLOCK_INDEX_MAGIC, sizeof(header.magic));
+    header.version = BLOCK_INDEX_VERSION;
+    header.entry_bytes = sizeof(BlockIndexEntry);
+    header.sample_rate = sample_rate;
+    header.channels = channels;
+    header.format = format;
+    header.interval_frames = interval_frames;
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1 || fflush(m_file) != 0) {
+        cerr << "unable to write block index " << path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// one fwrite and one flush per drain pass, so readers only ever see whole
+// entries past the ones they already have
+int BlockIndexWriter::write(const BlockIndexEntry* entries, int count) {
+    if (!m_file || count <= 0)
+        return 0;
+    if (fwrite(entries, sizeof(BlockIndexEntry), count, m_file) != (size_t)count ||
+        fflush(m_file) != 0) {
+        cerr << "block index write failed: " << strerror(errno) << endl;
+        return 1;
+    }
+    m_written += count;
+    return 0;
+}
+
+int BlockIndexWriter::close() {
+    int ret = 0;
+    if (m_file && fclose(m_file) != 0)
+        ret = 1;
+    m_file = nullptr;
+    return ret;
+}
+
+BlockIndexReader::~BlockIndexReader() {
+    close();
+}
+
+int BlockIndexReader::open(const string& path) {
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0) {
+        cerr << "unable to open block index " << path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    if (pread(m_fd, &m_header, sizeof(m_header), 0) != (ssize_t)sizeof(m_header) ||
+        memcmp(m_header.magic, BLOCK_INDEX_MAGIC, sizeof(m_header.magic)) != 0 ||
+        m_header.version != BLOCK_INDEX_VERSION ||
+        m_header.entry_bytes != sizeof(BlockIndexEntry)) {
+        cerr << path << " is not a block index" << endl;
+        close();
+        return 1;
+    }
+    return 0;
+}
+
+void BlockIndexReader::close() {
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+}
+
+int64_t BlockIndexReader::count() const {
+    struct stat st;
+    if (m_fd < 0 || fstat(m_fd, &st) != 0 || st.st_size < (off_t)sizeof(m_header))
+        return 0;
+    return (st.st_size - (int64_t)sizeof(m_header)) / (int64_t)sizeof(BlockIndexEntry);
+}
+
+int BlockIndexReader::entry(int64_t i, BlockIndexEntry* out) const {
+    off_t offset = (off_t)(sizeof(m_header) + i * sizeof(BlockIndexEntry));
+    if (pread(m_fd, out, sizeof(*out), offset) != (ssize_t)sizeof(*out))
+        return 1;
+    return 0;
+}
+
+static int64_t entry_key(const BlockIndexEntry& e, BlockIndexKey key) {
+    switch (key) {
+        case BlockIndexByFrame:     return (int64_t)e.frame;
+        case BlockIndexByMonotonic: return e.monotonic_ns;
+        case BlockIndexByRealtime:  return e.realtime_ns;
+    }
+    return 0;
+}
+
+int64_t BlockIndexReader::find(BlockIndexKey key, int64_t value) const {
+    int64_t lo = 0;
+    int64_t hi = count();
+    BlockIndexEntry e;
+    // first entry past value
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (entry(mid, &e))
+            return -1;
+        if (entry_key(e, key) <= value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
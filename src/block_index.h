@@ -0,0 +1,147 @@
+#ifndef AUDIOCAPTURE_BLOCK_INDEX_H
+#define AUDIOCAPTURE_BLOCK_INDEX_H
+
+// Timing sidecar for a capture: `<base_path>.blocks`.
+//
+// The read callback marks a block every `interval_frames` captured frames
+// and whenever something happened to the stream (a hole, an overflow, a
+// restart after a device came back). A mark ties the capture frame count
+// to both clocks and to the latency the backend reported, so audio can be
+// lined up with other sensors sample-accurately:
+//
+//     frame `frame` entered the device at about monotonic_ns - latency_ns
+//
+// Frames count the whole capture, holes and gaps included, like the
+// <base_path>.index and .gaps logs of SegmentWriter; together they map a
+// time to a file offset.
+//
+// The file is a BlockIndexHeader followed by fixed-size entries in host
+// byte order, appended in capture order, so `frame` and `monotonic_ns`
+// are non-decreasing and a reader finds a time with a binary search over
+// the entry count it derives from the file size. realtime_ns follows the
+// wall clock and may step.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#define BLOCK_INDEX_MAGIC "ACBLKIX1"
+#define BLOCK_INDEX_VERSION 1
+
+enum BlockIndexFlags {
+    BlockIndexStart    = 1 << 0,  // first block after start or recovery
+    BlockIndexHole     = 1 << 1,  // the backend dropped event_frames; silence was inserted
+    BlockIndexOverflow = 1 << 2,  // the backend reported an overflow since the last mark
+    BlockIndexGap      = 1 << 3,  // the stream was down; event_frames of silence inserted
+    BlockIndexOverrun  = 1 << 4,  // the ring was full; event_frames lost, silence inserted
+};
+
+struct BlockIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_bytes;         // sizeof(BlockIndexEntry)
+    uint32_t sample_rate;
+    uint32_t channels;
+    int32_t format;               // enum SoundIoFormat of the capture
+    uint32_t interval_frames;
+};
+
+struct BlockIndexEntry {
+    uint64_t frame;               // capture frame at the start of the block
+    int64_t monotonic_ns;         // CLOCK_MONOTONIC when the block was read
+    int64_t realtime_ns;          // CLOCK_REALTIME at the same moment
+    int64_t latency_ns;           // soundio_instream_get_latency, -1 if unknown
+    uint32_t flags;               // BlockIndexFlags
+    uint32_t event_frames;        // silence inserted for a hole or gap
+};
+
+static_assert(sizeof(BlockIndexHeader) == 32, "block index header layout");
+static_assert(sizeof(BlockIndexEntry) == 40, "block index entry layout");
+
+// Single-producer, single-consumer queue of marks between the read
+// callback and the drain loop. push() never blocks or allocates; when the
+// drain loop falls behind by the whole capacity the mark is dropped and
+// counted.
+class BlockMarkQueue
+{
+public:
+    BlockMarkQueue() : m_head(0), m_tail(0), m_dropped(0) {}
+
+    // capacity is rounded up to a power of two
+    void reset(int capacity);
+    bool enabled() const { return !m_entries.empty(); }
+
+    bool push(const BlockIndexEntry& entry);
+    int pop(BlockIndexEntry* out, int max);
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    // the entry storage, for lock_memory()
+    void* storage() { return m_entries.data(); }
+    size_t storage_bytes() const { return m_entries.size() * sizeof(BlockIndexEntry); }
+
+private:
+    std::vector<BlockIndexEntry> m_entries;
+    uint64_t m_mask = 0;
+    std::atomic<uint64_t> m_head;  // next to pop
+    std::atomic<uint64_t> m_tail;  // next to push
+    std::atomic<uint64_t> m_dropped;
+};
+
+class BlockIndexWriter
+{
+public:
+    BlockIndexWriter() {}
+    ~BlockIndexWriter();
+
+    BlockIndexWriter(const BlockIndexWriter&) = delete;
+    BlockIndexWriter& operator=(const BlockIndexWriter&) = delete;
+
+    int open(const std::string& path, int sample_rate, int channels, int format,
+             int interval_frames);
+    int write(const BlockIndexEntry* entries, int count);
+    int close();
+
+    int64_t entries_written() const { return m_written; }
+
+private:
+    FILE* m_file = nullptr;
+    int64_t m_written = 0;
+};
+
+enum BlockIndexKey {
+    BlockIndexByFrame,
+    BlockIndexByMonotonic,
+    BlockIndexByRealtime,
+};
+
+// Random access to a .blocks file, which may still be growing.
+class BlockIndexReader
+{
+public:
+    BlockIndexReader() {}
+    ~BlockIndexReader();
+
+    BlockIndexReader(const BlockIndexReader&) = delete;
+    BlockIndexReader& operator=(const BlockIndexReader&) = delete;
+
+    int open(const std::string& path);
+    void close();
+
+    const BlockIndexHeader& header() const { return m_header; }
+
+    // complete entries in the file right now
+    int64_t count() const;
+    int entry(int64_t i, BlockIndexEntry* out) const;
+
+    // Index of the last entry whose key is at or before `value`, or -1 when
+    // the first entry is already later. O(log n) reads.
+    int64_t find(BlockIndexKey key, int64_t value) const;
+
+private:
+    int m_fd = -1;
+    BlockIndexHeader m_header;
+};
+
+#endif
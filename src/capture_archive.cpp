@@ -0,0 +1,338 @@
+#include "capture_archive.h"
+#include "wav_header.h"
+
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static bool ends_with(const string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static int64_t file_size(const string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return -1;
+    return (int64_t)st.st_size;
+}
+
+int CaptureArchive::open(const string& path, const RawFormat& raw) {
+    if (file_size(path) >= 0 && (ends_with(path, ".raw") || ends_with(path, ".wav")))
+        return open_file(path, raw);
+    return open_base(path, raw);
+}
+
+// Sets the format from a WAV header, the .blocks sidecar or `raw`.
+// data_bytes is what a WAV header claims, UINT64_MAX otherwise.
+int CaptureArchive::describe(const string& path, const RawFormat& raw, int64_t* data_offset,
+                             uint64_t* data_bytes) {
+    *data_offset = 0;
+    *data_bytes = UINT64_MAX;
+    if (ends_with(path, ".wav")) {
+        char header[WAV_PARSE_BYTES];
+        WavFormat wav;
+        bool packed;
+        int fd = ::open(path.c_str(), O_RDONLY);
+        ssize_t got = fd < 0 ? -1 : pread(fd, header, sizeof(header), 0);
+        if (fd >= 0)
+            ::close(fd);
+        if (got < 0) {
+            cerr << "unable to read " << path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        if (wav_parse_header(header, (int)got, &wav, data_offset, data_bytes) != 0) {
+            cerr << path << ": not a WAV file" << endl;
+            return 1;
+        }
+        m_format = SampleFormat(wav_format_to_soundio(wav, &packed), packed);
+        m_sample_rate = wav.sample_rate;
+        m_channels = wav.channels;
+    } else if (m_has_blocks) {
+        m_format = SampleFormat((enum SoundIoFormat)m_blocks.header().format);
+        m_sample_rate = (int)m_blocks.header().sample_rate;
+        m_channels = (int)m_blocks.header().channels;
+    } else {
+        m_format = SampleFormat(raw.format);
+        m_sample_rate = raw.sample_rate;
+        m_channels = raw.channels;
+    }
+    if (sample_format_bytes(m_format) == 0 || m_sample_rate <= 0 || m_channels <= 0) {
+        cerr << path << ": unknown sample format; describe raw files or keep their .blocks" << endl;
+        return 1;
+    }
+    m_bytes_per_frame = sample_format_bytes(m_format) * m_channels;
+
+    // silence in the file's own format, unsigned formats at mid scale
+    vector<double> zero(m_channels, 0.0);
+    m_silence.resize(m_bytes_per_frame);
+    samples_from_double(zero.data(), m_channels, m_format, m_silence.data());
+    return 0;
+}
+
+// capture_start < 0: the file continues the capture frames of the one before
+int CaptureArchive::add_file(const string& path, int64_t data_offset, int64_t capture_start) {
+    int64_t size = file_size(path);
+    if (size < 0) {
+        cerr << "unable to stat " << path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    File file;
+    file.path = path;
+    file.output_start = m_output_frames;
+    file.frames = max<int64_t>(0, (size - data_offset) / m_bytes_per_frame);
+    file.data_offset = data_offset;
+    m_files.push_back(file);
+    if (capture_start >= 0 || m_runs.empty()) {
+        Run run;
+        run.output = m_output_frames;
+        run.capture = max<int64_t>(0, capture_start);
+        m_runs.push_back(run);
+    }
+    m_output_frames += file.frames;
+    return 0;
+}
+
+int CaptureArchive::open_file(const string& path, const RawFormat& raw) {
+    int64_t data_offset;
+    uint64_t data_bytes;
+    string base = path.substr(0, path.size() - 4);
+    if (file_size(base + ".blocks") >= 0)
+        m_has_blocks = m_blocks.open(base + ".blocks") == 0;
+    if (describe(path, raw, &data_offset, &data_bytes) || add_file(path, data_offset, 0))
+        return 1;
+    // A finished file from elsewhere may carry chunks after the data. A
+    // zero or oversized claim is a header that was never patched.
+    if (data_bytes > 0 && data_bytes != UINT64_MAX &&
+        (int64_t)(data_bytes / m_bytes_per_frame) < m_files[0].frames) {
+        m_files[0].frames = (int64_t)(data_bytes / m_bytes_per_frame);
+        m_output_frames = m_files[0].frames;
+    }
+    read_gaps(base);
+    m_frames = m_output_frames;
+    if (!m_runs.empty()) {
+        const Run& last = m_runs.back();
+        m_frames = last.capture + (m_output_frames - last.output);
+    }
+    return 0;
+}
+
+int CaptureArchive::open_base(const string& base, const RawFormat& raw) {
+    int64_t data_offset = 0;
+    uint64_t data_bytes;
+    string extension;
+    int next_segment = 0;
+    char name[32];
+
+    if (file_size(base + ".blocks") >= 0)
+        m_has_blocks = m_blocks.open(base + ".blocks") == 0;
+
+    // finished segments: <segment> <start frame> <frame count> <start time ns> <path>
+    FILE* index = fopen((base + ".index").c_str(), "r");
+    int64_t first_frame = -1;
+    int64_t first_ns = 0;
+    if (index) {
+        char line[4096];
+        while (fgets(line, sizeof(line), index)) {
+            int segment;
+            long long start_frame, frame_count, start_ns;
+            int path_at = 0;
+            if (line[0] == '#' ||
+                sscanf(line, "%d %lld %lld %lld %n", &segment, &start_frame, &frame_count,
+                       &start_ns, &path_at) < 4 || path_at == 0)
+                continue;
+            string path = line + path_at;
+            while (!path.empty() && (path.back() == '\n' || path.back() == '\r'))
+                path.pop_back();
+            if (m_files.empty()) {
+                extension = path.substr(path.rfind('.'));
+                if (describe(path, raw, &data_offset, &data_bytes)) {
+                    fclose(index);
+                    return 1;
+                }
+                first_frame = start_frame;
+                first_ns = start_ns;
+            }
+            if (add_file(path, data_offset, start_frame)) {
+                fclose(index);
+                return 1;
+            }
+            next_segment = segment + 1;
+        }
+        fclose(index);
+    }
+
+    if (m_files.empty()) {
+        static const char* extensions[] = {".raw", ".wav"};
+        for (const char* ext : extensions) {
+            snprintf(name, sizeof(name), ".%06d%s", 0, ext);
+            if (file_size(base + ext) >= 0) {
+                // one unsegmented file
+                if (describe(base + ext, raw, &data_offset, &data_bytes) ||
+                    add_file(base + ext, data_offset, 0))
+                    return 1;
+                break;
+            }
+            if (file_size(base + name) >= 0) {
+                // segmented, but none finished yet
+                if (describe(base + name, raw, &data_offset, &data_bytes))
+                    return 1;
+                extension = ext;
+                break;
+            }
+        }
+    }
+    if (!extension.empty()) {
+        // segments still being written, or left behind by a crash
+        for (;; next_segment += 1) {
+            snprintf(name, sizeof(name), ".%06d", next_segment);
+            string path = base + name + extension;
+            if (file_size(path) < 0)
+                break;
+            if (add_file(path, data_offset, m_files.empty() ? 0 : -1))
+                return 1;
+        }
+    }
+    if (m_files.empty()) {
+        cerr << "no capture files under " << base << " (FLAC segments are not supported)" << endl;
+        return 1;
+    }
+
+    read_gaps(base);
+    const Run& last = m_runs.back();
+    m_frames = last.capture + (m_output_frames - last.output);
+    if (first_frame >= 0)
+        m_start_ns = first_ns - (int64_t)((double)first_frame * 1e9 / m_sample_rate);
+    return 0;
+}
+
+// <output frame> <capture frame> <skipped frames>: after output frame o
+// the capture continues at c + s
+void CaptureArchive::read_gaps(const string& base) {
+    FILE* gaps = fopen((base + ".gaps").c_str(), "r");
+    if (gaps) {
+        char line[256];
+        while (fgets(line, sizeof(line), gaps)) {
+            long long o, c, s;
+            if (line[0] == '#' || sscanf(line, "%lld %lld %lld", &o, &c, &s) != 3)
+                continue;
+            Run run;
+            run.output = o;
+            run.capture = c + s;
+            m_runs.push_back(run);
+        }
+        fclose(gaps);
+    }
+    stable_sort(m_runs.begin(), m_runs.end(), [](const Run& a, const Run& b) {
+        return a.output < b.output;
+    });
+    // a gap at a segment boundary is also that segment's start; keep the later capture frame
+    vector<Run> runs;
+    for (const Run& run : m_runs) {
+        if (!runs.empty() && runs.back().output == run.output) {
+            runs.back().capture = max(runs.back().capture, run.capture);
+        } else {
+            runs.push_back(run);
+        }
+    }
+    m_runs.swap(runs);
+}
+
+int64_t CaptureArchive::frames_on_disk() const {
+    return m_output_frames;
+}
+
+int64_t CaptureArchive::frame_at(int64_t ns) const {
+    if (m_has_blocks && m_blocks.count() > 0) {
+        // frame e.frame entered the device latency_ns before it was read
+        int64_t i = max<int64_t>(0, m_blocks.find(BlockIndexByRealtime, ns));
+        BlockIndexEntry e;
+        if (m_blocks.entry(i, &e) == 0) {
+            int64_t at = e.realtime_ns - max<int64_t>(0, e.latency_ns);
+            return (int64_t)e.frame + (int64_t)floor((double)(ns - at) * m_sample_rate / 1e9);
+        }
+    }
+    if (m_start_ns != 0)
+        return (int64_t)floor((double)(ns - m_start_ns) * m_sample_rate / 1e9);
+    return INT64_MIN;
+}
+
+int64_t CaptureArchive::read(int64_t start, int64_t count, char* out) const {
+    for (int64_t i = 0; i < count; i += 1)
+        memcpy(out + i * m_bytes_per_frame, m_silence.data(), m_bytes_per_frame);
+    if (m_runs.empty())
+        return 0;
+
+    // the run holding `start`, or the first one after it
+    size_t k = upper_bound(m_runs.begin(), m_runs.end(), start, [](int64_t frame, const Run& run) {
+        return frame < run.capture;
+    }) - m_runs.begin();
+    k = k > 0 ? k - 1 : 0;
+
+    int64_t found = 0;
+    int64_t end = start + count;
+    for (; k < m_runs.size(); k += 1) {
+        int64_t out_begin = m_runs[k].output;
+        int64_t out_end = k + 1 < m_runs.size() ? m_runs[k + 1].output : m_output_frames;
+        int64_t cap_begin = m_runs[k].capture;
+        int64_t cap_end = cap_begin + (out_end - out_begin);
+        if (cap_begin >= end)
+            break;
+        int64_t a = max(start, cap_begin);
+        int64_t b = min(end, cap_end);
+        if (a >= b)
+            continue;
+        if (read_output(out_begin + (a - cap_begin), b - a, out + (a - start) * m_bytes_per_frame))
+            return -1;
+        found += b - a;
+    }
+    return found;
+}
+
+// output frames [output, output + count), all on disk
+int CaptureArchive::read_output(int64_t output, int64_t count, char* out) const {
+    static const int64_t page = sysconf(_SC_PAGESIZE);
+    size_t f = upper_bound(m_files.begin(), m_files.end(), output, [](int64_t frame, const File& file) {
+        return frame < file.output_start;
+    }) - m_files.begin() - 1;
+
+    while (count > 0 && f < m_files.size()) {
+        const File& file = m_files[f];
+        int64_t first = output - file.output_start;
+        int64_t n = min(count, file.frames - first);
+        if (n > 0) {
+            // map only the pages holding these frames
+            int64_t offset = file.data_offset + first * m_bytes_per_frame;
+            int64_t map_offset = offset - offset % page;
+            size_t bytes = (size_t)(n * m_bytes_per_frame);
+            size_t map_bytes = bytes + (size_t)(offset - map_offset);
+            int fd = ::open(file.path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                cerr << "unable to open " << file.path << ": " << strerror(errno) << endl;
+                return 1;
+            }
+            void* map = mmap(nullptr, map_bytes, PROT_READ, MAP_SHARED, fd, (off_t)map_offset);
+            ::close(fd);
+            if (map == MAP_FAILED) {
+                cerr << "unable to map " << file.path << ": " << strerror(errno) << endl;
+                return 1;
+            }
+            memcpy(out, (char*)map + (offset - map_offset), bytes);
+            munmap(map, map_bytes);
+            out += bytes;
+            output += n;
+            count -= n;
+        }
+        f += 1;
+    }
+    return 0;
+}
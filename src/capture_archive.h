@@ -0,0 +1,107 @@
+#ifndef AUDIOCAPTURE_CAPTURE_ARCHIVE_H
+#define AUDIOCAPTURE_CAPTURE_ARCHIVE_H
+
+#include "block_index.h"
+#include "dsp/convert.h++"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Raw files do not say what they hold; this describes them when no
+// .blocks sidecar does.
+struct RawFormat {
+    enum SoundIoFormat format = SoundIoFormatInvalid;
+    int sample_rate = 0;
+    int channels = 0;
+};
+
+// Random access to what record_in wrote, by capture frame or by time.
+//
+// `path` is either a capture base, e.g. /tmp/recordconv-<device name>,
+// or a single .raw / .wav file (a resampled copy, or a file from
+// elsewhere). For a base everything that is there is used:
+//
+//   <base>.raw / <base>.wav                   one unsegmented file
+//   <base>.NNNNNN.raw / .wav and <base>.index  segments; segments past the
+//                                             last indexed one (a capture
+//                                             still running) are found by
+//                                             name and sized with stat()
+//   <base>.gaps                               frames deliberately not written
+//   <base>.blocks                             capture clock (block_index.h)
+//
+// open() turns the logs into two small sorted tables, files by output
+// frame and runs of contiguous capture frames, so a capture frame maps to
+// a file offset with two binary searches. read() then maps just the pages
+// it copies. Times map to frames through the .blocks marks when there are
+// some and through the segment start times otherwise. FLAC segments are
+// not supported.
+class CaptureArchive
+{
+public:
+    CaptureArchive() {}
+
+    CaptureArchive(const CaptureArchive&) = delete;
+    CaptureArchive& operator=(const CaptureArchive&) = delete;
+
+    // Returns 0, or 1 after printing what is missing to stderr.
+    int open(const std::string& path, const RawFormat& raw = RawFormat());
+
+    int sample_rate() const { return m_sample_rate; }
+    int channels() const { return m_channels; }
+    SampleFormat format() const { return m_format; }
+    int bytes_per_frame() const { return m_bytes_per_frame; }
+
+    // capture frames up to the end of the last file
+    int64_t frames() const { return m_frames; }
+    int file_count() const { return (int)m_files.size(); }
+    int64_t frames_on_disk() const;
+
+    // Capture frame at CLOCK_REALTIME `ns`, or INT64_MIN when the archive
+    // carries no clock (an unsegmented file without .blocks).
+    int64_t frame_at(int64_t ns) const;
+    bool has_clock() const { return m_has_blocks || m_start_ns != 0; }
+
+    // Copy capture frames [start, start + count) to `out`. Frames that are
+    // not on disk (gaps, before the start, past the end) come out as
+    // silence. Returns the frames found on disk, or -1 on a read error.
+    int64_t read(int64_t start, int64_t count, char* out) const;
+
+private:
+    struct File {
+        std::string path;
+        int64_t output_start;   // frames of the earlier files
+        int64_t frames;
+        int64_t data_offset;    // header bytes
+    };
+    // from `output` on, output frames are capture frames `capture` onwards
+    struct Run {
+        int64_t output;
+        int64_t capture;
+    };
+
+    int open_base(const std::string& base, const RawFormat& raw);
+    int open_file(const std::string& path, const RawFormat& raw);
+    int describe(const std::string& path, const RawFormat& raw, int64_t* data_offset,
+                 uint64_t* data_bytes);
+    int add_file(const std::string& path, int64_t data_offset, int64_t capture_start);
+    void read_gaps(const std::string& base);
+    int read_output(int64_t output, int64_t count, char* out) const;
+
+    int m_sample_rate = 0;
+    int m_channels = 0;
+    SampleFormat m_format;
+    int m_bytes_per_frame = 0;
+    std::vector<char> m_silence;    // one frame
+
+    std::vector<File> m_files;      // by output frame
+    std::vector<Run> m_runs;        // by output frame, and so by capture frame
+    int64_t m_output_frames = 0;
+    int64_t m_frames = 0;
+
+    BlockIndexReader m_blocks;
+    bool m_has_blocks = false;
+    int64_t m_start_ns = 0;         // realtime of capture frame 0 from the segment index
+};
+
+#endif
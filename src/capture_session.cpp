@@ -0,0 +1,561 @@
+#include "capture_session.h"
+#include "segment_writer.h"
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+static int min_int(int a, int b) {
+    return (a < b) ? a : b;
+}
+
+struct SoundIoDevice* capture_find_input_device(struct SoundIo* soundio, const string& id,
+                                                const DeviceCache* cache) {
+    if (cache)
+        return cache->find(id);
+    if (id.empty()) {
+        int device_index = soundio_default_input_device_index(soundio);
+        if (device_index < 0)
+            return nullptr;
+        return soundio_get_input_device(soundio, device_index);
+    }
+    struct SoundIoDevice *named = nullptr;
+    int names = 0;
+    for (int i = 0; i < soundio_input_device_count(soundio); i += 1) {
+        struct SoundIoDevice *device = soundio_get_input_device(soundio, i);
+        if (strcmp(device->id, id.c_str()) == 0) {
+            if (named)
+                soundio_device_unref(named);
+            return device;
+        }
+        if (strcmp(device->name, id.c_str()) == 0) {
+            names += 1;
+            if (!named) {
+                named = device;
+                continue;
+            }
+        }
+        soundio_device_unref(device);
+    }
+    if (named && names > 1) {
+        soundio_device_unref(named);
+        named = nullptr;
+    }
+    return named;
+}
+
+int64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+CaptureSession::CaptureSession(struct SoundIo* soundio)
+: m_soundio(soundio), m_frames_captured(0), m_hole_frames(0), m_overflows(0),
+  m_gap_frames(0), m_recoveries(0), m_overruns(0), m_overrun_frames(0), m_stream_error(0), m_last_callback_ns(0), m_tuned(false) {
+    memset(&m_layout, 0, sizeof(m_layout));
+}
+
+CaptureSession::~CaptureSession() {
+    stop();
+    soundio_instream_destroy(m_instream);
+    if (m_ring_buffer)
+        soundio_ring_buffer_destroy(m_ring_buffer);
+    if (m_device)
+        soundio_device_unref(m_device);
+}
+
+// read and drop up to `frames` frames; returns how many, or -1 with *err set
+static int discard_input(struct SoundIoInStream *instream, int frames, int *err) {
+    struct SoundIoChannelArea *areas;
+    int done = 0;
+    while (done < frames) {
+        int frame_count = frames - done;
+        if ((*err = soundio_instream_begin_read(instream, &areas, &frame_count)))
+            return -1;
+        if (!frame_count)
+            break;
+        if ((*err = soundio_instream_end_read(instream)))
+            return -1;
+        done += frame_count;
+    }
+    return done;
+}
+
+void CaptureSession::read_callback(struct SoundIoInStream *instream, int frame_count_min, int frame_count_max) {
+    CaptureSession *session = (CaptureSession*) instream->userdata;
+    struct SoundIoRingBuffer *ring_buffer = session->m_ring_buffer;
+    if (!session->m_callback_tuned) {
+        // once per stream: the backend may hand a new stream a new thread
+        session->m_callback_tuned = true;
+        if (session->m_config.callback_thread.requested()) {
+            session->m_tuning = tune_this_thread(session->m_config.callback_thread);
+            session->m_tuned.store(true, memory_order_release);
+        }
+    }
+    struct SoundIoChannelArea *areas;
+    int err = 0;
+    char *block_start = soundio_ring_buffer_write_ptr(ring_buffer);
+    char *write_ptr = block_start;
+    int free_bytes = soundio_ring_buffer_free_count(ring_buffer);
+    int free_count = free_bytes / instream->bytes_per_frame;
+    int64_t now_ns = monotonic_ns();
+    uint64_t block_frame = session->m_frames_captured.load(memory_order_relaxed);
+    uint32_t mark_flags = 0;
+    int64_t latency_ns = -1;
+    uint32_t hole_frames = 0;
+    uint32_t owed_frames = 0;
+    if (session->m_overrun_owed > 0 && free_count > 0) {
+        // pay back what a full ring cost first, so the silence lands where
+        // the audio went missing
+        owed_frames = (uint32_t)min<uint64_t>(session->m_overrun_owed, (uint64_t)free_count);
+        session->write_silence(write_ptr, owed_frames);
+        write_ptr += owed_frames * instream->bytes_per_frame;
+        free_count -= owed_frames;
+        session->m_overrun_owed -= owed_frames;
+    }
+    if (free_count < frame_count_min) {
+        // the consumer is behind by the whole ring; the backend must still
+        // be drained, so drop the block and owe the ring its length
+        int dropped = discard_input(instream, frame_count_min, &err);
+        if (dropped > 0) {
+            session->m_overrun_owed += dropped;
+            session->m_overrun_frames.fetch_add(dropped, memory_order_relaxed);
+        }
+        session->m_overruns.fetch_add(1, memory_order_relaxed);
+        free_count = 0;
+    }
+    int write_frames = min_int(free_count, frame_count_max);
+    int frames_left = write_frames;
+    if (session->m_mark_interval > 0) {
+        uint64_t overflows = session->m_overflows.load(memory_order_relaxed);
+        if (session->m_mark_start)
+            mark_flags |= BlockIndexStart;
+        if (overflows != session->m_marked_overflows)
+            mark_flags |= BlockIndexOverflow;
+        session->m_marked_overflows = overflows;
+        if (mark_flags || block_frame >= session->m_next_mark_frame) {
+            double latency;
+            if (soundio_instream_get_latency(instream, &latency) == 0)
+                latency_ns = (int64_t)(latency * 1e9);
+        }
+    }
+    while (!err && frames_left > 0) {
+        int frame_count = frames_left;
+        if ((err = soundio_instream_begin_read(instream, &areas, &frame_count)))
+            break;
+        if (!frame_count)
+            break;
+        if (!areas) {
+            // Due to an overflow there is a hole. Fill the ring buffer with
+            // silence for the size of the hole.
+            session->write_silence(write_ptr, frame_count);
+            write_ptr += frame_count * instream->bytes_per_frame;
+            session->m_hole_frames.fetch_add(frame_count, memory_order_relaxed);
+            hole_frames += frame_count;
+        } else {
+            for (int frame = 0; frame < frame_count; frame += 1) {
+                for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
+                    memcpy(write_ptr, areas[ch].ptr, instream->bytes_per_sample);
+                    areas[ch].ptr += areas[ch].step;
+                    write_ptr += instream->bytes_per_sample;
+                }
+            }
+        }
+        frames_left -= frame_count;
+        if ((err = soundio_instream_end_read(instream)))
+            break;
+    }
+    int advance_frames = owed_frames + write_frames - frames_left;
+    soundio_ring_buffer_advance_write_ptr(ring_buffer, advance_frames * instream->bytes_per_frame);
+    if (session->m_publish) {
+        // the block is contiguous in the mirrored ring
+        session->m_publish->write(block_start, (int64_t)advance_frames * instream->bytes_per_frame);
+    }
+    session->m_frames_captured.fetch_add(advance_frames, memory_order_relaxed);
+    session->m_last_callback_ns.store(now_ns, memory_order_relaxed);
+    if (session->m_mark_interval > 0) {
+        if (hole_frames > 0)
+            mark_flags |= BlockIndexHole;
+        if (owed_frames > 0)
+            mark_flags |= BlockIndexOverrun;
+        if (mark_flags || block_frame >= session->m_next_mark_frame)
+            session->mark(block_frame, now_ns, latency_ns, mark_flags, hole_frames + owed_frames);
+    }
+    if (err) {
+        // the supervisor reopens the stream; nothing else is safe here
+        session->m_stream_error.store(err, memory_order_release);
+    }
+}
+
+void CaptureSession::overflow_callback(struct SoundIoInStream *instream) {
+    CaptureSession *session = (CaptureSession*) instream->userdata;
+    uint64_t count = session->m_overflows.fetch_add(1, memory_order_relaxed) + 1;
+    cerr << "overflow " << count << endl;
+}
+
+void CaptureSession::error_callback(struct SoundIoInStream *instream, int err) {
+    CaptureSession *session = (CaptureSession*) instream->userdata;
+    session->m_stream_error.store(err, memory_order_release);
+}
+
+void CaptureSession::index_blocks(int interval_frames) {
+    m_mark_interval = interval_frames;
+    if (interval_frames <= 0)
+        return;
+    // room for the whole ring's worth of marks, so the queue only fills
+    // when the ring itself is about to
+    int64_t ring_frames = 0;
+    if (m_ring_buffer && m_bytes_per_frame > 0)
+        ring_frames = soundio_ring_buffer_capacity(m_ring_buffer) / m_bytes_per_frame;
+    int64_t capacity = ring_frames / interval_frames + 1024;
+    if (capacity > (1 << 20))
+        capacity = 1 << 20;
+    m_marks.reset((int)capacity);
+    if (m_config.lock_memory && lock_memory(m_marks.storage(), m_marks.storage_bytes()))
+        cerr << "unable to lock the block index queue" << endl;
+}
+
+void CaptureSession::mark(uint64_t frame, int64_t now_ns, int64_t latency_ns,
+                          uint32_t flags, uint32_t event_frames) {
+    BlockIndexEntry entry;
+    entry.frame = frame;
+    entry.monotonic_ns = now_ns;
+    entry.realtime_ns = realtime_ns();
+    entry.latency_ns = latency_ns;
+    entry.flags = flags;
+    entry.event_frames = event_frames;
+    m_marks.push(entry);
+    m_mark_start = false;
+    m_next_mark_frame = frame + m_mark_interval;
+}
+
+// silence in the stream's sample format: unsigned formats sit at mid scale
+void CaptureSession::write_silence(char* dst, int64_t frames) const {
+    int64_t bytes = frames * m_bytes_per_frame;
+    if (!m_silence_nonzero) {
+        memset(dst, 0, bytes);
+        return;
+    }
+    for (int64_t i = 0; i < bytes; i += m_bytes_per_sample) {
+        memcpy(dst + i, m_silence, m_bytes_per_sample);
+    }
+}
+
+int CaptureSession::open(const CaptureConfig& config) {
+    int err;
+
+    m_config = config;
+    m_device = capture_find_input_device(m_soundio, config.device_id, config.devices);
+    if (!m_device) {
+        if (config.device_id.empty()) {
+            cerr << "No Input Device Available" << endl;
+        } else {
+            cerr << "Input Device '" << config.device_id << "' not available" << endl;
+        }
+        return SoundIoErrorNoSuchDevice;
+    }
+
+    cerr << "Input Device: " << m_device->name << endl;
+
+    if (m_device->probe_error) {
+        cerr << "Unable to probe device: " << soundio_strerror(m_device->probe_error) << endl;
+        return m_device->probe_error;
+    }
+
+    soundio_device_sort_channel_layouts(m_device);
+
+    enum SoundIoFormat fmt = m_device->formats[0];
+    if (!config.formats.empty()) {
+        fmt = SoundIoFormatInvalid;
+        for (enum SoundIoFormat f : config.formats) {
+            if (soundio_device_supports_format(m_device, f)) {
+                fmt = f;
+                break;
+            }
+        }
+        if (fmt == SoundIoFormatInvalid) {
+            cerr << "Input Device supports none of the requested formats" << endl;
+            return SoundIoErrorIncompatibleDevice;
+        }
+    }
+
+    int sample_rate = config.sample_rate;
+    if (sample_rate == 0) {
+        sample_rate = m_device->sample_rates[0].max;
+    } else if (!soundio_device_supports_sample_rate(m_device, sample_rate)) {
+        cerr << "Input Device does not support " << sample_rate << "Hz" << endl;
+        return SoundIoErrorIncompatibleDevice;
+    }
+
+    // a default device is reopened as the same device, not whatever is
+    // the default by then
+    m_device_id = m_device->id;
+    m_device_name = m_device->name;
+    m_format = fmt;
+    m_sample_rate = sample_rate;
+
+    if ((err = open_stream())) {
+        cerr << "unable to open input stream: " << soundio_strerror(err) << endl;
+        return err;
+    }
+    m_layout = m_instream->layout;
+    m_bytes_per_frame = m_instream->bytes_per_frame;
+    m_bytes_per_sample = m_instream->bytes_per_sample;
+
+    memset(m_silence, 0, sizeof(m_silence));
+    m_silence_nonzero = true;
+    switch (fmt) {
+        case SoundIoFormatU8:    m_silence[0] = (char)0x80; break;
+        case SoundIoFormatU16LE: m_silence[1] = (char)0x80; break;
+        case SoundIoFormatU16BE: m_silence[0] = (char)0x80; break;
+        case SoundIoFormatU24LE: m_silence[2] = (char)0x80; break;
+        case SoundIoFormatU24BE: m_silence[1] = (char)0x80; break;
+        case SoundIoFormatU32LE: m_silence[3] = (char)0x80; break;
+        case SoundIoFormatU32BE: m_silence[0] = (char)0x80; break;
+        default:                 m_silence_nonzero = false; break;
+    }
+
+    cerr << m_layout.name << " " << sample_rate << "Hz "
+         << soundio_format_string(fmt) << " interleaved " << endl;
+
+    int capacity = (int)(config.ring_seconds * sample_rate) * m_bytes_per_frame;
+    m_ring_buffer = soundio_ring_buffer_create(m_soundio, capacity);
+    if (!m_ring_buffer) {
+        cerr << "out of memory" << endl;
+        return SoundIoErrorNoMem;
+    }
+    if (config.lock_memory) {
+        // nothing is written yet, so the write pointer is the start of the
+        // mapping; the mirror behind it has page tables of its own
+        capacity = soundio_ring_buffer_capacity(m_ring_buffer);
+        if ((err = lock_memory(soundio_ring_buffer_write_ptr(m_ring_buffer), 2 * (size_t)capacity))) {
+            cerr << "unable to lock the ring buffer: " << strerror(err) << endl;
+        } else {
+            cerr << "locked " << capacity / 1024 << " KiB ring buffer" << endl;
+        }
+    }
+    return 0;
+}
+
+// an instream on m_device with the session's format, rate and (once
+// known) layout
+int CaptureSession::open_stream() {
+    int err;
+    m_instream = soundio_instream_create(m_device);
+    if (!m_instream)
+        return SoundIoErrorNoMem;
+    m_instream->format = m_format;
+    m_instream->sample_rate = m_sample_rate;
+    if (m_layout.channel_count > 0 && soundio_device_supports_layout(m_device, &m_layout))
+        m_instream->layout = m_layout;
+    m_instream->read_callback = read_callback;
+    m_instream->overflow_callback = overflow_callback;
+    m_instream->error_callback = error_callback;
+    m_instream->userdata = this;
+
+    if ((err = soundio_instream_open(m_instream)))
+        return err;
+    if (m_layout.channel_count > 0 &&
+        (m_instream->layout.channel_count != m_layout.channel_count ||
+         m_instream->bytes_per_frame != m_bytes_per_frame))
+        return SoundIoErrorIncompatibleDevice;
+    return 0;
+}
+
+int CaptureSession::start() {
+    int err;
+    if ((err = soundio_instream_start(m_instream))) {
+        cerr << "unable to start input device: " << soundio_strerror(err) << endl;
+        return err;
+    }
+    m_started = true;
+    return 0;
+}
+
+void CaptureSession::stop() {
+    if (m_started && m_instream) {
+        soundio_instream_pause(m_instream, true);
+    }
+    m_started = false;
+}
+
+void CaptureSession::close() {
+    stop();
+    soundio_instream_destroy(m_instream);
+    m_instream = nullptr;
+    if (m_device)
+        soundio_device_unref(m_device);
+    m_device = nullptr;
+}
+
+void CaptureSession::suspend() {
+    if (m_suspended)
+        return;
+    // destroying the stream joins its callback thread, after which this
+    // thread is the ring's only producer
+    soundio_instream_destroy(m_instream);
+    m_instream = nullptr;
+    if (m_device)
+        soundio_device_unref(m_device);
+    m_device = nullptr;
+    m_suspended = true;
+    m_gap_start_ns = m_last_callback_ns.load(memory_order_relaxed);
+    if (m_gap_start_ns == 0)
+        m_gap_start_ns = monotonic_ns();
+    m_gap_filled = 0;
+    m_last_resume_error = 0;
+}
+
+void CaptureSession::fill_gap() {
+    if (!m_suspended || !m_started)
+        return;
+    int64_t due = (monotonic_ns() - m_gap_start_ns) * m_sample_rate / 1000000000LL;
+    int64_t frames = due - (int64_t)m_gap_filled;
+    int64_t free_frames = soundio_ring_buffer_free_count(m_ring_buffer) / m_bytes_per_frame;
+    if (frames > free_frames)
+        frames = free_frames;
+    if (frames <= 0)
+        return;
+    char *block_start = soundio_ring_buffer_write_ptr(m_ring_buffer);
+    write_silence(block_start, frames);
+    soundio_ring_buffer_advance_write_ptr(m_ring_buffer, (int)(frames * m_bytes_per_frame));
+    if (m_publish)
+        m_publish->write(block_start, frames * m_bytes_per_frame);
+    if (m_mark_interval > 0)
+        mark(m_frames_captured.load(memory_order_relaxed), monotonic_ns(), -1, BlockIndexGap, (uint32_t)frames);
+    m_gap_filled += frames;
+    m_gap_frames.fetch_add(frames, memory_order_relaxed);
+    m_frames_captured.fetch_add(frames, memory_order_relaxed);
+}
+
+int CaptureSession::resume() {
+    int err;
+    if (!m_suspended)
+        return 0;
+    m_device = capture_find_input_device(m_soundio, m_device_id, m_config.devices);
+    if (!m_device) {
+        err = SoundIoErrorNoSuchDevice;
+    } else if (m_device->probe_error) {
+        err = m_device->probe_error;
+    } else if (!soundio_device_supports_format(m_device, m_format) ||
+               !soundio_device_supports_sample_rate(m_device, m_sample_rate)) {
+        err = SoundIoErrorIncompatibleDevice;
+    } else {
+        err = open_stream();
+    }
+    if (!err) {
+        // everything up to now is silence; the stream picks up from here
+        fill_gap();
+        m_stream_error.store(0, memory_order_relaxed);
+        m_last_callback_ns.store(0, memory_order_relaxed);
+        m_mark_start = true;
+        m_callback_tuned = false;
+        if (m_started)
+            err = soundio_instream_start(m_instream);
+    }
+    if (err) {
+        soundio_instream_destroy(m_instream);
+        m_instream = nullptr;
+        if (m_device)
+            soundio_device_unref(m_device);
+        m_device = nullptr;
+        if (err != m_last_resume_error && err != SoundIoErrorNoSuchDevice) {
+            cerr << "Input Device '" << m_device_name << "' not reopened: " << soundio_strerror(err) << endl;
+        }
+        m_last_resume_error = err;
+        return err;
+    }
+    m_suspended = false;
+    m_recoveries.fetch_add(1, memory_order_relaxed);
+    cerr << "Input Device '" << m_device_name << "' recovered, " << m_gap_filled
+         << " frames of silence (" << (double)m_gap_filled / m_sample_rate << "s)" << endl;
+    return 0;
+}
+
+CaptureSpan CaptureSession::peek() const {
+    CaptureSpan span;
+    if (!m_ring_buffer)
+        return span;
+    span.bytes = soundio_ring_buffer_fill_count(m_ring_buffer);
+    span.data = soundio_ring_buffer_read_ptr(m_ring_buffer);
+    span.frames = span.bytes / m_bytes_per_frame;
+    return span;
+}
+
+void CaptureSession::consume(int64_t bytes) {
+    if (bytes > 0)
+        soundio_ring_buffer_advance_read_ptr(m_ring_buffer, (int)bytes);
+}
+
+int64_t CaptureSession::wait(int64_t min_bytes, int timeout_ms) const {
+    // the read callback runs on a realtime thread, so it does not signal
+    // anything; a short poll is cheap compared to the block sizes involved
+    const int step_ms = 5;
+    int64_t fill = soundio_ring_buffer_fill_count(m_ring_buffer);
+    for (int waited = 0; fill < min_bytes && waited < timeout_ms; waited += step_ms) {
+        usleep(step_ms * 1000);
+        fill = soundio_ring_buffer_fill_count(m_ring_buffer);
+    }
+    return fill;
+}
+
+int64_t CaptureSession::pump(const BlockCallback& callback) {
+    CaptureSpan span = peek();
+    if (span.bytes == 0)
+        return 0;
+    int64_t used = callback(span);
+    if (used > span.bytes)
+        used = span.bytes;
+    consume(used);
+    return used;
+}
+
+bool CaptureSession::callback_tuning(ThreadTuningResult* result) const {
+    if (!m_tuned.load(memory_order_acquire))
+        return false;
+    *result = m_tuning;
+    return true;
+}
+
+CaptureStats CaptureSession::stats() const {
+    CaptureStats stats;
+    stats.frames_captured = m_frames_captured.load(memory_order_relaxed);
+    stats.hole_frames = m_hole_frames.load(memory_order_relaxed);
+    stats.overflows = m_overflows.load(memory_order_relaxed);
+    stats.gap_frames = m_gap_frames.load(memory_order_relaxed);
+    stats.overruns = m_overruns.load(memory_order_relaxed);
+    stats.overrun_frames = m_overrun_frames.load(memory_order_relaxed);
+    stats.recoveries = m_recoveries.load(memory_order_relaxed);
+    stats.marks_dropped = m_marks.dropped();
+    if (m_ring_buffer) {
+        stats.ring_fill_bytes = soundio_ring_buffer_fill_count(m_ring_buffer);
+        stats.ring_capacity_bytes = soundio_ring_buffer_capacity(m_ring_buffer);
+    }
+    return stats;
+}
+
+int CaptureSession::channels() const {
+    return m_layout.channel_count;
+}
+
+int CaptureSession::sample_rate() const {
+    return m_sample_rate;
+}
+
+enum SoundIoFormat CaptureSession::format() const {
+    return m_format;
+}
+
+int CaptureSession::bytes_per_frame() const {
+    return m_bytes_per_frame;
+}
+
+int CaptureSession::bytes_per_sample() const {
+    return m_bytes_per_sample;
+}
@@ -0,0 +1,235 @@
+#ifndef AUDIOCAPTURE_CAPTURE_SESSION_H
+#define AUDIOCAPTURE_CAPTURE_SESSION_H
+
+#include "soundio/soundio.h"
+#include "block_index.h"
+#include "device_cache.h"
+#include "rt_thread.h"
+#include "shm_ring.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct CaptureConfig {
+    std::string device_id;        // or a device name; empty = default input device
+    int sample_rate = 0;          // 0 = highest rate the device offers
+
+    // First format in this list the device supports is used; when empty
+    // the device's preferred format is taken.
+    std::vector<enum SoundIoFormat> formats;
+
+    double ring_seconds = 30;     // capacity of the capture ring buffer
+
+    // Placement and priority for libsoundio's callback thread, applied
+    // from inside the first callback of every stream (see rt_thread.h).
+    ThreadTuning callback_thread;
+
+    // Fault in and mlock the ring (and the block index queue), so the
+    // callback never waits for the pager.
+    bool lock_memory = false;
+
+    // Where the device is looked up, on open and on every resume; null =
+    // walk the SoundIo's device list. DeviceSupervisor::open fills it in.
+    const DeviceCache* devices = nullptr;
+};
+
+struct CaptureStats {
+    uint64_t frames_captured = 0; // frames written into the ring, holes and gaps included
+    uint64_t hole_frames = 0;     // silence inserted for backend holes
+    uint64_t overflows = 0;       // backend overflow callbacks
+    uint64_t gap_frames = 0;      // silence inserted while the stream was down
+    uint64_t recoveries = 0;      // times the stream was reopened
+    uint64_t overruns = 0;        // callbacks that found the ring full
+    uint64_t overrun_frames = 0;  // frames lost to a full ring, replaced by silence
+    uint64_t marks_dropped = 0;   // block index marks lost to a full queue
+    int64_t ring_fill_bytes = 0;
+    int64_t ring_capacity_bytes = 0;
+};
+
+// A contiguous, zero-copy view into the capture ring buffer. The mirrored
+// mapping of SoundIoRingBuffer means readable data never wraps.
+struct CaptureSpan {
+    const char* data = nullptr;
+    int64_t bytes = 0;
+    int64_t frames = 0;
+};
+
+// One input device streaming into a lock-free ring buffer.
+//
+// The libsoundio read callback only interleaves samples into the ring;
+// everything else runs on the consumer's thread through the pull API
+// (peek/consume) or pump(). Several sessions may share one SoundIo; the
+// owner of the SoundIo is responsible for calling soundio_flush_events.
+//
+// A stream that fails (device unplugged, backend restarted) does not end
+// the session. A DeviceSupervisor suspends it, keeps the ring fed with
+// silence for the time it is down and reopens the same device by id with
+// the same format and rate; the consumer only sees a run of silence.
+// Likewise a consumer that falls so far behind that the ring fills up
+// loses audio, not the capture: the callback reads and discards what does
+// not fit and writes as much silence once there is room again, so frame
+// counts keep following the device clock.
+// Geometry getters (format, rate, channels) are fixed at open() and safe
+// to call while that happens.
+//
+//     CaptureSession session(soundio);
+//     CaptureConfig config;
+//     if (session.open(config) || session.start())
+//         return 1;
+//     for (;;) {
+//         soundio_flush_events(soundio);
+//         session.wait(session.bytes_per_frame() * 1024, 100);
+//         CaptureSpan span = session.peek();
+//         consume(span.data, span.bytes);
+//         session.consume(span.bytes);
+//     }
+class CaptureSession
+{
+public:
+    // returns how many bytes of the span were used; the rest is offered again
+    typedef std::function<int64_t(const CaptureSpan&)> BlockCallback;
+
+    explicit CaptureSession(struct SoundIo* soundio);
+    ~CaptureSession();
+
+    CaptureSession(const CaptureSession&) = delete;
+    CaptureSession& operator=(const CaptureSession&) = delete;
+
+    // Resolve the device, open the stream and allocate the ring buffer.
+    // Returns 0 or a SoundIoError; a message is printed to stderr.
+    int open(const CaptureConfig& config);
+    int start();
+    void stop();
+
+    // Stop and drop the stream and the device; the ring stays readable.
+    void close();
+
+    // Everything readable right now
+    CaptureSpan peek() const;
+    void consume(int64_t bytes);
+
+    // Sleep until at least `min_bytes` are readable or `timeout_ms` passed;
+    // returns the readable byte count.
+    int64_t wait(int64_t min_bytes, int timeout_ms) const;
+
+    // Offer everything readable to `callback` and consume what it used.
+    // Returns the bytes consumed.
+    int64_t pump(const BlockCallback& callback);
+
+    CaptureStats stats() const;
+
+    // What the callback thread got from CaptureConfig::callback_thread;
+    // false until a callback has run with a request to apply.
+    bool callback_tuning(ThreadTuningResult* result) const;
+
+    // Also copy every captured block into `ring` from the read callback, so
+    // other processes see it without waiting for the drain loop. Set before
+    // start(); the ring must outlive the stream.
+    void publish(ShmRingWriter* ring) { m_publish = ring; }
+
+    // Mark a block for the timing index every `interval_frames` frames and
+    // on every hole, overflow and restart (see block_index.h). Set after
+    // open() and before start(); take_marks() hands them to the consumer.
+    void index_blocks(int interval_frames);
+    int take_marks(BlockIndexEntry* out, int max) { return m_marks.pop(out, max); }
+
+    const char* device_name() const { return m_device_name.c_str(); }
+    const char* device_id() const { return m_device_id.c_str(); }
+    const struct SoundIoChannelLayout* layout() const { return &m_layout; }
+    int channels() const;
+    int sample_rate() const;
+    enum SoundIoFormat format() const;
+    int bytes_per_frame() const;
+    int bytes_per_sample() const;
+
+    struct SoundIoDevice* device() const { return m_device; }
+    struct SoundIoInStream* instream() const { return m_instream; }
+
+    // Recovery, driven by DeviceSupervisor with the SoundIo events flushed
+    // and no other thread calling into libsoundio.
+    //
+    // stream_error(): a SoundIoError the callbacks reported, or 0.
+    // suspend() tears the stream down, keeping the ring and the
+    // consumer's view of it.
+    // fill_gap() tops the ring up with silence for the time since the
+    // last callback. resume() reopens the device; 0 or a SoundIoError.
+    int stream_error() const { return m_stream_error.load(std::memory_order_acquire); }
+    bool suspended() const { return m_suspended; }
+    void suspend();
+    void fill_gap();
+    int resume();
+
+private:
+    static void read_callback(struct SoundIoInStream* instream, int frame_count_min, int frame_count_max);
+    static void overflow_callback(struct SoundIoInStream* instream);
+    static void error_callback(struct SoundIoInStream* instream, int err);
+
+    int open_stream();
+    void write_silence(char* dst, int64_t frames) const;
+    void mark(uint64_t frame, int64_t now_ns, int64_t latency_ns, uint32_t flags, uint32_t event_frames);
+
+    struct SoundIo* m_soundio;
+    struct SoundIoDevice* m_device = nullptr;
+    struct SoundIoInStream* m_instream = nullptr;
+    struct SoundIoRingBuffer* m_ring_buffer = nullptr;
+    ShmRingWriter* m_publish = nullptr;
+    bool m_started = false;
+
+    // fixed by open(); a reopened stream must match
+    CaptureConfig m_config;
+    std::string m_device_id;
+    std::string m_device_name;
+    struct SoundIoChannelLayout m_layout;
+    enum SoundIoFormat m_format = SoundIoFormatInvalid;
+    int m_sample_rate = 0;
+    int m_bytes_per_frame = 0;
+    int m_bytes_per_sample = 0;
+    char m_silence[4];              // one silent sample
+    bool m_silence_nonzero = false;
+
+    // block index; the mark state belongs to whichever thread produces
+    BlockMarkQueue m_marks;
+    int m_mark_interval = 0;
+    uint64_t m_next_mark_frame = 0;
+    uint64_t m_marked_overflows = 0;
+    bool m_mark_start = true;
+
+    // callback thread: frames discarded on a full ring, still owed as silence
+    uint64_t m_overrun_owed = 0;
+
+    // callback thread, published through m_tuned
+    bool m_callback_tuned = false;
+    ThreadTuningResult m_tuning;
+
+    // supervisor thread only
+    bool m_suspended = false;
+    int64_t m_gap_start_ns = 0;
+    uint64_t m_gap_filled = 0;      // frames of silence for the current gap
+    int m_last_resume_error = 0;
+
+    // written by the callback thread (and the supervisor while suspended)
+    std::atomic<uint64_t> m_frames_captured;
+    std::atomic<uint64_t> m_hole_frames;
+    std::atomic<uint64_t> m_overflows;
+    std::atomic<uint64_t> m_gap_frames;
+    std::atomic<uint64_t> m_recoveries;
+    std::atomic<uint64_t> m_overruns;
+    std::atomic<uint64_t> m_overrun_frames;
+    std::atomic<int> m_stream_error;
+    std::atomic<int64_t> m_last_callback_ns;
+    std::atomic<bool> m_tuned;
+};
+
+// Look up an input device by id, then by name (unless several devices
+// share it), or the default input device when `id` is empty; in `cache`
+// when one is given. The caller owns the returned reference.
+struct SoundIoDevice* capture_find_input_device(struct SoundIo* soundio, const std::string& id,
+                                                const DeviceCache* cache = nullptr);
+
+// CLOCK_MONOTONIC in nanoseconds; cheap enough for the read callback
+int64_t monotonic_ns();
+
+#endif
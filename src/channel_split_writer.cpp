@@ -0,0 +1,77 @@
+#include "channel_split_writer.h"
+#include "deinterleave.h"
+
+using namespace std;
+
+ChannelSplitWriter::ChannelSplitWriter(const SegmentConfig& mono, int channels,
+                                       const vector<int>& select)
+: m_channels(channels), m_sample_bytes(mono.bytes_per_frame), m_select(select) {
+    for (int channel : m_select) {
+        SegmentConfig config = mono;
+        config.base_path = mono.base_path + ".ch" + to_string(channel);
+        m_writers.push_back(new SegmentWriter(config));
+    }
+    m_planes.resize(m_select.size());
+    m_plane_ptrs.resize(m_select.size());
+}
+
+ChannelSplitWriter::~ChannelSplitWriter() {
+    for (SegmentWriter* writer : m_writers)
+        delete writer;
+}
+
+int ChannelSplitWriter::open(int64_t capture_start_ns) {
+    for (SegmentWriter* writer : m_writers) {
+        if (writer->open(capture_start_ns))
+            return 1;
+    }
+    return 0;
+}
+
+int ChannelSplitWriter::write(const char* buf, int64_t bytes) {
+    int64_t frames = bytes / ((int64_t)m_channels * m_sample_bytes);
+    if (frames <= 0)
+        return 0;
+    size_t plane_bytes = (size_t)(frames * m_sample_bytes);
+    for (size_t i = 0; i < m_planes.size(); i += 1) {
+        if (m_planes[i].size() < plane_bytes)
+            m_planes[i].resize(plane_bytes);
+        m_plane_ptrs[i] = m_planes[i].data();
+    }
+    deinterleave(buf, frames, m_channels, m_sample_bytes,
+                 m_select.data(), (int)m_select.size(), m_plane_ptrs.data());
+    for (size_t i = 0; i < m_writers.size(); i += 1) {
+        if (m_writers[i]->write(m_plane_ptrs[i], (int64_t)plane_bytes))
+            return 1;
+    }
+    return 0;
+}
+
+int ChannelSplitWriter::skip(int64_t frames, bool new_segment) {
+    for (SegmentWriter* writer : m_writers) {
+        if (writer->skip(frames, new_segment))
+            return 1;
+    }
+    return 0;
+}
+
+int ChannelSplitWriter::close() {
+    int ret = 0;
+    for (SegmentWriter* writer : m_writers) {
+        if (writer->close())
+            ret = 1;
+    }
+    return ret;
+}
+
+int64_t ChannelSplitWriter::frames_written() const {
+    return m_writers.empty() ? 0 : m_writers[0]->frames_written();
+}
+
+int64_t ChannelSplitWriter::frames_skipped() const {
+    return m_writers.empty() ? 0 : m_writers[0]->frames_skipped();
+}
+
+int ChannelSplitWriter::segment_count() const {
+    return m_writers.empty() ? 0 : m_writers[0]->segment_count();
+}
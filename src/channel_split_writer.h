@@ -0,0 +1,47 @@
+#ifndef AUDIOCAPTURE_CHANNEL_SPLIT_WRITER_H
+#define AUDIOCAPTURE_CHANNEL_SPLIT_WRITER_H
+
+#include "segment_writer.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Planar output: one mono SegmentWriter per selected channel, written
+// under `<base_path>.ch<N>`, so each channel is a contiguous file a
+// consumer can mmap on its own. Channels that are not selected are never
+// written. Blocks are de-interleaved with deinterleave() into per-channel
+// scratch buffers that are reused across writes.
+//
+// Segmenting, headers, the index and gap log work exactly as for
+// SegmentWriter, once per channel; every channel rotates on the same frame.
+class ChannelSplitWriter
+{
+public:
+    // `mono` describes one channel's files (bytes_per_frame is the sample
+    // size, a WAV format has one channel); `channels` is the interleaved
+    // channel count of the capture.
+    ChannelSplitWriter(const SegmentConfig& mono, int channels, const std::vector<int>& select);
+    ~ChannelSplitWriter();
+
+    int open(int64_t capture_start_ns);
+
+    // whole interleaved frames
+    int write(const char* buf, int64_t bytes);
+    int skip(int64_t frames, bool new_segment);
+    int close();
+
+    int channel_count() const { return (int)m_select.size(); }
+    int64_t frames_written() const;
+    int64_t frames_skipped() const;
+    int segment_count() const;
+
+private:
+    int m_channels;
+    int m_sample_bytes;
+    std::vector<int> m_select;
+    std::vector<SegmentWriter*> m_writers;
+    std::vector<std::vector<char>> m_planes;
+    std::vector<char*> m_plane_ptrs;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "deinterleave.h"
+#include "dsp/kernels.h++"
+
+#include <string.h>
+
+// One channel out of interleaved frames. memcpy keeps the loads legal for
+// unaligned ring buffer positions and compiles to a plain move.
+template <typename T>
+static void gather(const char* in, int64_t frames, int channels, int channel, char* out) {
+    const char* p = in + channel * sizeof(T);
+    const int64_t stride = (int64_t)channels * sizeof(T);
+    for (int64_t i = 0; i < frames; i += 1) {
+        T v;
+        memcpy(&v, p, sizeof(T));
+        memcpy(out + i * sizeof(T), &v, sizeof(T));
+        p += stride;
+    }
+}
+
+static void gather_any(const char* in, int64_t frames, int channels, int sample_bytes,
+                       int channel, char* out) {
+    switch (sample_bytes) {
+    case 1: gather<uint8_t>(in, frames, channels, channel, out); break;
+    case 2: gather<uint16_t>(in, frames, channels, channel, out); break;
+    case 4: gather<uint32_t>(in, frames, channels, channel, out); break;
+    case 8: gather<uint64_t>(in, frames, channels, channel, out); break;
+    default:
+        for (int64_t i = 0; i < frames; i += 1) {
+            memcpy(out + i * sample_bytes,
+                   in + (i * channels + channel) * sample_bytes, sample_bytes);
+        }
+    }
+}
+
+void deinterleave(const char* in, int64_t frames, int channels, int sample_bytes,
+                  const int* select, int select_count, char* const* out) {
+    bool all = select_count == channels;
+    for (int i = 0; all && i < select_count; i += 1)
+        all = select[i] == i;
+
+    // the kernels transpose what they can and leave the tail to gather()
+    const DspKernels& k = dsp_kernels();
+    int64_t done = 0;
+    if (all && channels == 2 && sample_bytes == 4) {
+        done = k.split2_32(in, frames, out[0], out[1]);
+    } else if (all && channels == 2 && sample_bytes == 2) {
+        done = k.split2_16(in, frames, out[0], out[1]);
+    } else if (all && channels == 4 && sample_bytes == 4) {
+        done = k.split4_32(in, frames, out);
+    }
+
+    const char* tail = in + done * channels * sample_bytes;
+    for (int i = 0; i < select_count; i += 1) {
+        gather_any(tail, frames - done, channels, sample_bytes, select[i],
+                   out[i] + done * sample_bytes);
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef AUDIOCAPTURE_DEINTERLEAVE_H
+#define AUDIOCAPTURE_DEINTERLEAVE_H
+
+#include <stdint.h>
+
+// Split `frames` interleaved frames of `channels` samples of `sample_bytes`
+// each into one contiguous plane per selected channel: out[i] receives
+// channel select[i]. Samples are moved as opaque words, so any format with
+// 1, 2, 4 or 8 byte samples works.
+//
+// Taking every channel of a stereo or 4 channel stream with 2 or 4 byte
+// samples runs a SIMD transpose from DspKernels (SSE2, AVX2 or NEON, picked
+// at run time); everything else is a strided copy per plane.
+void deinterleave(const char* in, int64_t frames, int channels, int sample_bytes,
+                  const int* select, int select_count, char* const* out);
+
+#endif
@@ -0,0 +1,64 @@
+#include "device_cache.h"
+
+using namespace std;
+
+DeviceCache::~DeviceCache() {
+    clear();
+}
+
+void DeviceCache::clear() {
+    for (struct SoundIoDevice* device : m_devices)
+        soundio_device_unref(device);
+    m_devices.clear();
+    m_by_id.clear();
+    m_by_name.clear();
+    m_default = -1;
+}
+
+void DeviceCache::refresh(struct SoundIo* soundio) {
+    clear();
+    int count = soundio_input_device_count(soundio);
+    int default_input = soundio_default_input_device_index(soundio);
+    m_devices.reserve(count > 0 ? count : 0);
+    for (int i = 0; i < count; i += 1) {
+        struct SoundIoDevice* device = soundio_get_input_device(soundio, i);
+        if (!device)
+            continue;
+        int index = (int)m_devices.size();
+        m_devices.push_back(device);
+        // the same id can come twice (a raw and a shared view of one
+        // device); the first one wins, as in a walk over the list
+        m_by_id.insert(make_pair(string(device->id), index));
+        auto named = m_by_name.insert(make_pair(string(device->name), index));
+        if (!named.second)
+            named.first->second = -1;
+        if (i == default_input)
+            m_default = index;
+    }
+    m_refreshes += 1;
+}
+
+struct SoundIoDevice* DeviceCache::find(const string& key) const {
+    int index = -1;
+    if (key.empty()) {
+        index = m_default;
+    } else {
+        auto by_id = m_by_id.find(key);
+        if (by_id != m_by_id.end()) {
+            index = by_id->second;
+        } else {
+            auto by_name = m_by_name.find(key);
+            if (by_name != m_by_name.end())
+                index = by_name->second;
+        }
+    }
+    if (index < 0)
+        return nullptr;
+    struct SoundIoDevice* device = m_devices[index];
+    soundio_device_ref(device);
+    return device;
+}
+
+bool DeviceCache::has_id(const char* id) const {
+    return m_by_id.count(id) > 0;
+}
@@ -0,0 +1,51 @@
+#ifndef AUDIOCAPTURE_DEVICE_CACHE_H
+#define AUDIOCAPTURE_DEVICE_CACHE_H
+
+#include "soundio/soundio.h"
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The input devices of one libsoundio device snapshot, by id and by name.
+//
+// libsoundio only replaces its device list inside soundio_flush_events,
+// and says so with on_devices_change; until then every lookup would walk
+// the same list with soundio_get_input_device. The cache holds a
+// reference to each input device of the snapshot it was built from and
+// answers from hash maps; the owner calls refresh() when
+// on_devices_change fired. Like every other libsoundio call on a shared
+// SoundIo it is not locked: the owner serialises it (see
+// DeviceSupervisor).
+class DeviceCache
+{
+public:
+    DeviceCache() {}
+    ~DeviceCache();
+
+    DeviceCache(const DeviceCache&) = delete;
+    DeviceCache& operator=(const DeviceCache&) = delete;
+
+    // rebuild from the SoundIo's current input device list
+    void refresh(struct SoundIo* soundio);
+    void clear();
+
+    // The device with id `key`, else the one named `key` (names shared by
+    // several devices do not match); the default input device when `key`
+    // is empty. The caller owns the returned reference; nullptr if none.
+    struct SoundIoDevice* find(const std::string& key) const;
+    bool has_id(const char* id) const;
+
+    int count() const { return (int)m_devices.size(); }
+    uint64_t refreshes() const { return m_refreshes; }
+
+private:
+    std::vector<struct SoundIoDevice*> m_devices;
+    std::unordered_map<std::string, int> m_by_id;     // first device with the id
+    std::unordered_map<std::string, int> m_by_name;   // -1 = ambiguous
+    int m_default = -1;
+    uint64_t m_refreshes = 0;
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include "device_supervisor.h"
+
+#include <iostream>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+// how often a missing device or backend is looked for again, besides
+// on every devices change
+static const int64_t RETRY_NS = 100000000LL;
+
+DeviceSupervisor::DeviceSupervisor(struct SoundIo* soundio, int poll_ms, const ThreadTuning& loop)
+: m_soundio(soundio), m_backend(soundio->current_backend), m_poll_ms(poll_ms), m_loop_tuning(loop),
+  m_stop(false), m_reconnects(0) {
+    m_soundio->userdata = this;
+    m_soundio->on_devices_change = on_devices_change;
+    m_soundio->on_backend_disconnect = on_backend_disconnect;
+    m_devices.refresh(m_soundio);
+    m_thread = thread(&DeviceSupervisor::run, this);
+}
+
+DeviceSupervisor::~DeviceSupervisor() {
+    m_stop = true;
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+// both run inside soundio_flush_events, i.e. on the supervisor thread
+// with the lock held
+void DeviceSupervisor::on_devices_change(struct SoundIo* soundio) {
+    DeviceSupervisor* supervisor = (DeviceSupervisor*) soundio->userdata;
+    supervisor->m_devices_changed = true;
+}
+
+void DeviceSupervisor::on_backend_disconnect(struct SoundIo* soundio, int err) {
+    DeviceSupervisor* supervisor = (DeviceSupervisor*) soundio->userdata;
+    cerr << "audio backend disconnected: " << soundio_strerror(err) << endl;
+    supervisor->m_backend_lost = true;
+}
+
+int DeviceSupervisor::open(CaptureSession* session, const CaptureConfig& config) {
+    CaptureConfig cached = config;
+    cached.devices = &m_devices;
+    lock_guard<mutex> lock(m_mutex);
+    return session->open(cached);
+}
+
+int DeviceSupervisor::start(CaptureSession* session) {
+    lock_guard<mutex> lock(m_mutex);
+    int err = session->start();
+    if (!err)
+        m_sessions.push_back(session);
+    return err;
+}
+
+void DeviceSupervisor::close(CaptureSession* session) {
+    lock_guard<mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_sessions.size(); i += 1) {
+        if (m_sessions[i] == session) {
+            m_sessions.erase(m_sessions.begin() + i);
+            break;
+        }
+    }
+    session->close();
+}
+
+void DeviceSupervisor::run() {
+    if (m_loop_tuning.requested()) {
+        ThreadTuningResult result = tune_this_thread(m_loop_tuning);
+        cerr << "event loop: " << describe_tuning(m_loop_tuning, result) << endl;
+    }
+    while (!m_stop) {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if (!m_disconnected)
+                soundio_flush_events(m_soundio);
+            supervise();
+        }
+        usleep(m_poll_ms * 1000);
+    }
+}
+
+void DeviceSupervisor::supervise() {
+    if (m_backend_lost) {
+        reconnect();
+        return;
+    }
+    if (m_devices_changed)
+        m_devices.refresh(m_soundio);
+    int64_t now = monotonic_ns();
+    bool retry = m_devices_changed || now >= m_next_retry_ns;
+    for (CaptureSession* session : m_sessions) {
+        if (!session->suspended()) {
+            int err = session->stream_error();
+            if (err) {
+                cerr << "Input Device '" << session->device_name() << "' failed: "
+                     << soundio_strerror(err) << "; filling with silence" << endl;
+            } else if (m_devices_changed && !m_devices.has_id(session->device_id())) {
+                cerr << "Input Device '" << session->device_name() << "' removed; filling with silence" << endl;
+            } else {
+                continue;
+            }
+            session->suspend();
+        }
+        session->fill_gap();
+        if (retry)
+            session->resume();
+    }
+    if (retry)
+        m_next_retry_ns = now + RETRY_NS;
+    m_devices_changed = false;
+}
+
+// Every stream belongs to the backend that went away: drop them all,
+// then keep trying to connect to the same backend.
+void DeviceSupervisor::reconnect() {
+    int err;
+    if (!m_disconnected) {
+        for (CaptureSession* session : m_sessions)
+            session->suspend();
+        m_devices.clear();
+        soundio_disconnect(m_soundio);
+        m_disconnected = true;
+        m_next_retry_ns = 0;
+    }
+    for (CaptureSession* session : m_sessions)
+        session->fill_gap();
+
+    int64_t now = monotonic_ns();
+    if (now < m_next_retry_ns)
+        return;
+    m_next_retry_ns = now + RETRY_NS;
+    if ((err = soundio_connect_backend(m_soundio, m_backend)))
+        return;
+    soundio_flush_events(m_soundio);
+    m_devices.refresh(m_soundio);
+    m_disconnected = false;
+    m_backend_lost = false;
+    m_devices_changed = false;
+    m_reconnects.fetch_add(1, memory_order_relaxed);
+    cerr << "reconnected to " << soundio_backend_name(m_backend) << endl;
+
+    for (CaptureSession* session : m_sessions)
+        session->resume();
+}
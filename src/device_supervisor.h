@@ -0,0 +1,82 @@
+#ifndef AUDIOCAPTURE_DEVICE_SUPERVISOR_H
+#define AUDIOCAPTURE_DEVICE_SUPERVISOR_H
+
+#include "soundio/soundio.h"
+#include "capture_session.h"
+#include "device_cache.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Keeps capture sessions running across device unplugs and backend
+// restarts.
+//
+// The supervisor owns the SoundIo event loop: a thread of its own calls
+// soundio_flush_events every few milliseconds and handles
+// on_devices_change and on_backend_disconnect. Every other libsoundio call
+// on the shared SoundIo goes through open()/start()/close() here, under
+// the one lock; the read callbacks never see it. Sessions find their
+// devices in a DeviceCache that is rebuilt only when the device list
+// changes.
+//
+// A watched session whose stream reports an error, or whose device id
+// drops out of the device list, is suspended: its stream is destroyed
+// and the supervisor writes silence into its ring at the stream's rate
+// until the device with the same id comes back and the stream is reopened
+// with the same format, rate and channel count. When the backend itself
+// goes away every session is suspended, the backend is reconnected and
+// the sessions are resumed. Other sessions keep streaming throughout.
+class DeviceSupervisor
+{
+public:
+    // `soundio` must be connected; the supervisor flushes its events from
+    // now on and the owner must stop doing so. `loop` places and schedules
+    // the event loop thread; the outcome is printed once it has started.
+    explicit DeviceSupervisor(struct SoundIo* soundio, int poll_ms = 10,
+                              const ThreadTuning& loop = ThreadTuning());
+    ~DeviceSupervisor();
+
+    DeviceSupervisor(const DeviceSupervisor&) = delete;
+    DeviceSupervisor& operator=(const DeviceSupervisor&) = delete;
+
+    // CaptureSession::open / start, then supervise the session; the
+    // session looks its device up in devices()
+    int open(CaptureSession* session, const CaptureConfig& config);
+    int start(CaptureSession* session);
+
+    // stop supervising, then CaptureSession::close; the ring stays readable
+    void close(CaptureSession* session);
+
+    uint64_t backend_reconnects() const { return m_reconnects.load(std::memory_order_relaxed); }
+    const DeviceCache* devices() const { return &m_devices; }
+
+private:
+    static void on_devices_change(struct SoundIo* soundio);
+    static void on_backend_disconnect(struct SoundIo* soundio, int err);
+
+    void run();
+    void supervise();
+    void reconnect();
+
+    struct SoundIo* m_soundio;
+    enum SoundIoBackend m_backend;
+    int m_poll_ms;
+    ThreadTuning m_loop_tuning;
+
+    std::mutex m_mutex;                     // every libsoundio call on m_soundio
+    DeviceCache m_devices;                  // m_soundio's input devices, under m_mutex
+    std::vector<CaptureSession*> m_sessions;
+    bool m_devices_changed = false;
+    bool m_backend_lost = false;
+    bool m_disconnected = false;
+    int64_t m_next_retry_ns = 0;
+
+    std::atomic<bool> m_stop;
+    std::atomic<uint64_t> m_reconnects;
+    std::thread m_thread;
+};
+
+#endif
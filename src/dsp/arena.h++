@@ -0,0 +1,74 @@
+#ifndef SIGPROC_ARENA_H
+#define SIGPROC_ARENA_H
+
+#include <cstddef>
+#include <cstring>
+
+// Offsets into an arena are rounded up to this many bytes, so a block
+// allocated with this alignment hands out cache line aligned tables.
+#define DSP_ARENA_ALIGN 64
+
+// Bytes an arena gives up for n objects of type T
+template <class T>
+inline size_t dsp_arena_bytes(size_t n) {
+    return (n * sizeof(T) + DSP_ARENA_ALIGN - 1) & ~(size_t) (DSP_ARENA_ALIGN - 1);
+}
+
+// Bump allocator over memory the caller owns.
+//
+// The filters take their coefficient tables and histories from an arena
+// instead of the heap (see Resampler::arena_bytes for how much they need),
+// so a service can construct and drop resamplers per stream without
+// touching the allocator. Nothing is freed one object at a time: the
+// owner reuses the memory once everything placed in it is gone, by
+// calling clear() or dropping the arena. Allocations are zeroed.
+//
+// An allocation that does not fit returns nullptr and is counted in
+// failures(); objects that got one must not be used.
+class DspArena
+{
+public:
+    DspArena() : m_base(nullptr), m_size(0), m_used(0), m_failures(0) {}
+    DspArena(void* memory, size_t bytes)
+    : m_base((char*) memory), m_size(bytes), m_used(0), m_failures(0) {}
+
+    template <class T>
+    T* alloc(size_t n) {
+        size_t bytes = dsp_arena_bytes<T>(n);
+        if (bytes > m_size - m_used) {
+            m_failures += 1;
+            return nullptr;
+        }
+        char* p = m_base + m_used;
+        m_used += bytes;
+        if (bytes > 0) {
+            memset(p, 0, bytes);
+        }
+        return (T*) p;
+    }
+
+    // start over; everything allocated so far is invalid
+    void clear() {
+        m_used = 0;
+        m_failures = 0;
+    }
+
+    char* base(void) const { return m_base; }
+    size_t used(void) const { return m_used; }
+    size_t size(void) const { return m_size; }
+    int failures(void) const { return m_failures; }
+
+private:
+    char* m_base;
+    size_t m_size;
+    size_t m_used;
+    int m_failures;
+};
+
+// Pointer p into a block that was copied from `from` to `to`
+template <class T>
+inline T* dsp_relocate(T* p, const char* from, char* to) {
+    return p == nullptr ? nullptr : (T*) (to + ((const char*) p - from));
+}
+
+#endif
@@ -138,6 +138,8 @@ int cheby1(int NumPoles,int PercentRipple,double Fc,int createHighPass, double *
 	int i,p,bsize=sizeof(double) * size;
 	double *TA;
 	double *TB;
+	double stackA[CHEBY1_STACK_SIZE];
+	double stackB[CHEBY1_STACK_SIZE];
 	double T2A[3];
 	double T2B[3];
 	double SA=0,SB=0,GAIN;
@@ -160,12 +162,18 @@ int cheby1(int NumPoles,int PercentRipple,double Fc,int createHighPass, double *
 		return -5;
 	}
 
-	TA = (double*) malloc( bsize );
-	TB = (double*) malloc( bsize );
-	if (!TA||!TB) {
-		free(TA);
-		free(TB);
-		return -1;
+	// the usual filter orders need no heap for the scratch arrays
+	if (size <= CHEBY1_STACK_SIZE) {
+		TA = stackA;
+		TB = stackB;
+	} else {
+		TA = (double*) malloc( bsize );
+		TB = (double*) malloc( bsize );
+		if (!TA||!TB) {
+			free(TA);
+			free(TB);
+			return -1;
+		}
 	}
 
 	Fc /= 2.; // algorithm defines Fc on the range 0 - .5 not 0 to 1.
@@ -217,8 +225,10 @@ int cheby1(int NumPoles,int PercentRipple,double Fc,int createHighPass, double *
 			printf("A[%d]= %.6f\r\n",i,A[i]);
 		}
 	#endif
-	free(TA);
-	free(TB);
+	if (TA != stackA) {
+		free(TA);
+		free(TB);
+	}
 
 	return NumPoles+1;
 }
@@ -1,6 +1,9 @@
 #ifndef SIGPROC_CHEBY1_H
 #define SIGPROC_CHEBY1_H
 
+// cheby1 keeps its scratch arrays on the stack up to this size (20 poles)
+#define CHEBY1_STACK_SIZE 23
+
 double * newCheby1Array(int NumPoles, int * size);
 
 int cheby1(int NumPoles,int PercentRipple,double Fc,int createHighPass, double * B, double * A, int size);
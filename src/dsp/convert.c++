@@ -0,0 +1,343 @@
+#include <cmath>
+#include <cstring>
+
+#include "dsp/convert.h++"
+#include "dsp/kernels.h++"
+
+// samples per pass: every scratch buffer below stays in L1
+#define CONVERT_CHUNK 1024
+
+#ifdef SOUNDIO_OS_BIG_ENDIAN
+#define CONVERT_HOST_BIG true
+#else
+#define CONVERT_HOST_BIG false
+#endif
+
+struct Layout {
+	int bytes;
+	int bits;
+	bool is_float;
+	bool is_unsigned;
+	bool big;
+	bool packed;
+	bool foreign;
+};
+
+static bool layout_of(SampleFormat fmt, Layout* l) {
+	int bytes = 0, bits = 0;
+	bool is_float = false, is_unsigned = false, big = false;
+	switch (fmt.format) {
+		case SoundIoFormatS8:        bytes = 1; bits = 8; break;
+		case SoundIoFormatU8:        bytes = 1; bits = 8; is_unsigned = true; break;
+		case SoundIoFormatS16LE:     bytes = 2; bits = 16; break;
+		case SoundIoFormatS16BE:     bytes = 2; bits = 16; big = true; break;
+		case SoundIoFormatU16LE:     bytes = 2; bits = 16; is_unsigned = true; break;
+		case SoundIoFormatU16BE:     bytes = 2; bits = 16; is_unsigned = true; big = true; break;
+		case SoundIoFormatS24LE:     bytes = 4; bits = 24; break;
+		case SoundIoFormatS24BE:     bytes = 4; bits = 24; big = true; break;
+		case SoundIoFormatU24LE:     bytes = 4; bits = 24; is_unsigned = true; break;
+		case SoundIoFormatU24BE:     bytes = 4; bits = 24; is_unsigned = true; big = true; break;
+		case SoundIoFormatS32LE:     bytes = 4; bits = 32; break;
+		case SoundIoFormatS32BE:     bytes = 4; bits = 32; big = true; break;
+		case SoundIoFormatU32LE:     bytes = 4; bits = 32; is_unsigned = true; break;
+		case SoundIoFormatU32BE:     bytes = 4; bits = 32; is_unsigned = true; big = true; break;
+		case SoundIoFormatFloat32LE: bytes = 4; bits = 24; is_float = true; break;
+		case SoundIoFormatFloat32BE: bytes = 4; bits = 24; is_float = true; big = true; break;
+		case SoundIoFormatFloat64LE: bytes = 8; bits = 53; is_float = true; break;
+		case SoundIoFormatFloat64BE: bytes = 8; bits = 53; is_float = true; big = true; break;
+		default:
+			return false;
+	}
+	if (fmt.packed) {
+		if (bits != 24 || is_float) {
+			return false;
+		}
+		bytes = 3;
+	}
+	l->bytes = bytes;
+	l->bits = bits;
+	l->is_float = is_float;
+	l->is_unsigned = is_unsigned;
+	l->big = big;
+	l->packed = fmt.packed;
+	l->foreign = bytes > 1 && big != CONVERT_HOST_BIG;
+	return true;
+}
+
+int sample_format_bytes(SampleFormat fmt) {
+	Layout l;
+	return layout_of(fmt, &l) ? l.bytes : 0;
+}
+
+int sample_format_bits(SampleFormat fmt) {
+	Layout l;
+	return layout_of(fmt, &l) ? l.bits : 0;
+}
+
+bool sample_format_foreign(SampleFormat fmt) {
+	Layout l;
+	return layout_of(fmt, &l) && l.foreign;
+}
+
+// 24 or 32 bit samples to native signed words, the 24 bit ones in the
+// low three bytes
+static void load_words(const Layout& l, const uint8_t* p, int n, int32_t* w) {
+	const DspKernels& k = dsp_kernels();
+	if (l.packed) {
+		for (int i=0; i<n; i++, p += 3) {
+			w[i] = l.big ? (p[0] << 16 | p[1] << 8 | p[2]) : (p[2] << 16 | p[1] << 8 | p[0]);
+		}
+	} else if (l.foreign) {
+		k.bswap32(p, n, w);
+	} else {
+		memcpy(w, p, (size_t) n * 4);
+	}
+	if (l.is_unsigned) {
+		const uint32_t flip = (l.bits == 24) ? 0x800000u : 0x80000000u;
+		for (int i=0; i<n; i++) {
+			w[i] = (int32_t) ((uint32_t) w[i] ^ flip);
+		}
+	}
+}
+
+static void store_words(const Layout& l, int32_t* w, int n, uint8_t* p) {
+	const DspKernels& k = dsp_kernels();
+	if (l.is_unsigned) {
+		const uint32_t flip = (l.bits == 24) ? 0x800000u : 0x80000000u;
+		const uint32_t mask = (l.bits == 24) ? 0xffffffu : 0xffffffffu;
+		for (int i=0; i<n; i++) {
+			w[i] = (int32_t) (((uint32_t) w[i] ^ flip) & mask);
+		}
+	}
+	if (l.packed) {
+		for (int i=0; i<n; i++, p += 3) {
+			uint32_t v = (uint32_t) w[i];
+			p[l.big ? 2 : 0] = (uint8_t) v;
+			p[1] = (uint8_t) (v >> 8);
+			p[l.big ? 0 : 2] = (uint8_t) (v >> 16);
+		}
+	} else if (l.foreign) {
+		k.bswap32(w, n, p);
+	} else {
+		memcpy(p, w, (size_t) n * 4);
+	}
+}
+
+static void chunk_to_float(const Layout& l, const uint8_t* p, int n, float* out) {
+	const DspKernels& k = dsp_kernels();
+	if (l.is_float && l.bytes == 4) {
+		if (l.foreign) {
+			k.bswap32(p, n, out);
+		} else {
+			memcpy(out, p, (size_t) n * 4);
+		}
+	} else if (l.is_float) {
+		double d[CONVERT_CHUNK];
+		if (l.foreign) {
+			k.bswap64(p, n, d);
+		} else {
+			memcpy(d, p, (size_t) n * 8);
+		}
+		for (int i=0; i<n; i++) {
+			out[i] = (float) d[i];
+		}
+	} else if (l.bits == 8) {
+		for (int i=0; i<n; i++) {
+			int v = l.is_unsigned ? (int) p[i] - 128 : (int) (int8_t) p[i];
+			out[i] = v * (1.0f / 128.0f);
+		}
+	} else if (l.bits == 16) {
+		int16_t w[CONVERT_CHUNK];
+		if (l.foreign) {
+			k.bswap16(p, n, w);
+		} else {
+			memcpy(w, p, (size_t) n * 2);
+		}
+		if (l.is_unsigned) {
+			for (int i=0; i<n; i++) {
+				w[i] = (int16_t) ((uint16_t) w[i] ^ 0x8000u);
+			}
+		}
+		k.s16_to_f32(w, n, out);
+	} else {
+		int32_t w[CONVERT_CHUNK];
+		load_words(l, p, n, w);
+		k.s32_to_f32(w, n, 32 - l.bits, out);
+	}
+}
+
+static void chunk_from_float(const Layout& l, const float* in, int n, uint8_t* p, Dither* dither) {
+	const DspKernels& k = dsp_kernels();
+	float dithered[CONVERT_CHUNK];
+	if (dither != nullptr && !l.is_float && l.bits <= 24) {
+		const float lsb = ldexpf(1.0f, 1 - l.bits);
+		for (int i=0; i<n; i++) {
+			dithered[i] = in[i] + dither->next() * lsb;
+		}
+		in = dithered;
+	}
+
+	if (l.is_float && l.bytes == 4) {
+		if (l.foreign) {
+			k.bswap32(in, n, p);
+		} else {
+			memcpy(p, in, (size_t) n * 4);
+		}
+	} else if (l.is_float) {
+		double d[CONVERT_CHUNK];
+		for (int i=0; i<n; i++) {
+			d[i] = in[i];
+		}
+		if (l.foreign) {
+			k.bswap64(d, n, p);
+		} else {
+			memcpy(p, d, (size_t) n * 8);
+		}
+	} else if (l.bits == 8) {
+		for (int i=0; i<n; i++) {
+			float y = in[i] * 128.0f;
+			y = y < -128.0f ? -128.0f : (y > 127.0f ? 127.0f : y);
+			int v = (int) lrintf(y);
+			p[i] = (uint8_t) (l.is_unsigned ? v + 128 : v);
+		}
+	} else if (l.bits == 16) {
+		int16_t w[CONVERT_CHUNK];
+		k.f32_to_s16(in, n, w);
+		if (l.is_unsigned) {
+			for (int i=0; i<n; i++) {
+				w[i] = (int16_t) ((uint16_t) w[i] ^ 0x8000u);
+			}
+		}
+		if (l.foreign) {
+			k.bswap16(w, n, p);
+		} else {
+			memcpy(p, w, (size_t) n * 2);
+		}
+	} else {
+		int32_t w[CONVERT_CHUNK];
+		k.f32_to_s32(in, n, l.bits, w);
+		store_words(l, w, n, p);
+	}
+}
+
+bool samples_to_float(const void* in, SampleFormat fmt, int64_t n, float* out) {
+	Layout l;
+	if (!layout_of(fmt, &l)) {
+		return false;
+	}
+	const uint8_t* p = (const uint8_t*) in;
+	for (int64_t i=0; i<n; i += CONVERT_CHUNK) {
+		int c = (int) (n - i < CONVERT_CHUNK ? n - i : CONVERT_CHUNK);
+		chunk_to_float(l, p + i * l.bytes, c, out + i);
+	}
+	return true;
+}
+
+bool samples_from_float(const float* in, int64_t n, SampleFormat fmt, void* out, Dither* dither) {
+	Layout l;
+	if (!layout_of(fmt, &l)) {
+		return false;
+	}
+	uint8_t* p = (uint8_t*) out;
+	for (int64_t i=0; i<n; i += CONVERT_CHUNK) {
+		int c = (int) (n - i < CONVERT_CHUNK ? n - i : CONVERT_CHUNK);
+		chunk_from_float(l, in + i, c, p + i * l.bytes, dither);
+	}
+	return true;
+}
+
+// Formats of up to 24 bits (and Float32) go through float, which holds
+// them exactly; 32 bit integers and Float64 are converted in double.
+bool samples_to_double(const void* in, SampleFormat fmt, int64_t n, double* out) {
+	Layout l;
+	if (!layout_of(fmt, &l)) {
+		return false;
+	}
+	const DspKernels& k = dsp_kernels();
+	const uint8_t* p = (const uint8_t*) in;
+	for (int64_t i=0; i<n; i += CONVERT_CHUNK) {
+		int c = (int) (n - i < CONVERT_CHUNK ? n - i : CONVERT_CHUNK);
+		const uint8_t* q = p + i * l.bytes;
+		double* o = out + i;
+		if (l.is_float && l.bytes == 8) {
+			if (l.foreign) {
+				k.bswap64(q, c, o);
+			} else {
+				memcpy(o, q, (size_t) c * 8);
+			}
+		} else if (l.bits == 32) {
+			int32_t w[CONVERT_CHUNK];
+			load_words(l, q, c, w);
+			for (int j=0; j<c; j++) {
+				o[j] = w[j] * (1.0 / 2147483648.0);
+			}
+		} else {
+			float f[CONVERT_CHUNK];
+			chunk_to_float(l, q, c, f);
+			for (int j=0; j<c; j++) {
+				o[j] = f[j];
+			}
+		}
+	}
+	return true;
+}
+
+bool samples_from_double(const double* in, int64_t n, SampleFormat fmt, void* out, Dither* dither) {
+	Layout l;
+	if (!layout_of(fmt, &l)) {
+		return false;
+	}
+	const DspKernels& k = dsp_kernels();
+	uint8_t* p = (uint8_t*) out;
+	for (int64_t i=0; i<n; i += CONVERT_CHUNK) {
+		int c = (int) (n - i < CONVERT_CHUNK ? n - i : CONVERT_CHUNK);
+		const double* x = in + i;
+		uint8_t* q = p + i * l.bytes;
+		if (l.is_float && l.bytes == 8) {
+			if (l.foreign) {
+				k.bswap64(x, c, q);
+			} else {
+				memcpy(q, x, (size_t) c * 8);
+			}
+		} else if (l.bits == 32) {
+			int32_t w[CONVERT_CHUNK];
+			for (int j=0; j<c; j++) {
+				double y = x[j] * 2147483648.0;
+				y = y < -2147483648.0 ? -2147483648.0 : (y > 2147483647.0 ? 2147483647.0 : y);
+				w[j] = (int32_t) llrint(y);
+			}
+			store_words(l, w, c, q);
+		} else {
+			float f[CONVERT_CHUNK];
+			for (int j=0; j<c; j++) {
+				f[j] = (float) x[j];
+			}
+			chunk_from_float(l, f, c, q, dither);
+		}
+	}
+	return true;
+}
+
+bool samples_convert(const void* in, SampleFormat in_fmt, int64_t n,
+                     void* out, SampleFormat out_fmt, Dither* dither) {
+	Layout li, lo;
+	if (!layout_of(in_fmt, &li) || !layout_of(out_fmt, &lo)) {
+		return false;
+	}
+	const uint8_t* p = (const uint8_t*) in;
+	uint8_t* q = (uint8_t*) out;
+	bool wide = li.bits > 24 && lo.bits > 24;
+	for (int64_t i=0; i<n; i += CONVERT_CHUNK) {
+		int64_t c = (n - i < CONVERT_CHUNK) ? n - i : CONVERT_CHUNK;
+		if (wide) {
+			double d[CONVERT_CHUNK];
+			samples_to_double(p + i * li.bytes, in_fmt, c, d);
+			samples_from_double(d, c, out_fmt, q + i * lo.bytes, dither);
+		} else {
+			float f[CONVERT_CHUNK];
+			chunk_to_float(li, p + i * li.bytes, (int) c, f);
+			chunk_from_float(lo, f, (int) c, q + i * lo.bytes, dither);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,74 @@
+#ifndef SIGPROC_CONVERT_H
+#define SIGPROC_CONVERT_H
+
+#include <cstdint>
+
+#include "soundio/soundio.h"
+
+// Interleaved samples in any libsoundio format to and from float or
+// double, full scale being +-1.0.
+//
+// Foreign byte order (against SOUNDIO_OS_BIG_ENDIAN from soundio/endian.h)
+// is swapped, unsigned formats are offset to signed, and 24 bit samples are
+// either in the low three bytes of a 32 bit word, as libsoundio has them, or
+// packed into three bytes as in WAV and FLAC files. The common layouts then
+// run the s16 / s32 / byte swap kernels from DspKernels in chunks that stay
+// in L1; 8 bit and packed 24 bit samples are unpacked one at a time.
+//
+// Float to integer rounds to nearest and saturates at full scale instead of
+// wrapping. With a Dither, TPDF noise of +-1 LSB of the output format is
+// added first, which turns the rounding error into signal-independent
+// noise when reducing to 16 bits or less.
+struct SampleFormat
+{
+    SampleFormat(enum SoundIoFormat f = SoundIoFormatInvalid, bool packed24 = false)
+    : format(f), packed(packed24) {}
+
+    enum SoundIoFormat format;
+    bool packed;    // 24 bit formats only: three bytes per sample
+};
+
+// Bytes per sample, 0 for an invalid format
+int sample_format_bytes(SampleFormat fmt);
+
+// Significant bits of the integer formats, 24 for Float32 and 53 for Float64
+int sample_format_bits(SampleFormat fmt);
+
+// true when the sample bytes are not in the host's order
+bool sample_format_foreign(SampleFormat fmt);
+
+// Triangular (TPDF) dither source: the difference of two uniform
+// variables of one LSB, from a small xorshift generator.
+class Dither
+{
+public:
+    Dither(uint32_t seed = 0x9e3779b9u) : m_state(seed ? seed : 1) {}
+
+    // triangular on (-1, 1)
+    float next(void) {
+        return uniform() - uniform();
+    }
+
+private:
+    float uniform(void) {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return (m_state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    uint32_t m_state;
+};
+
+// `n` samples; false when the format is not supported (nothing written)
+bool samples_to_float(const void* in, SampleFormat fmt, int64_t n, float* out);
+bool samples_to_double(const void* in, SampleFormat fmt, int64_t n, double* out);
+bool samples_from_float(const float* in, int64_t n, SampleFormat fmt, void* out, Dither* dither = nullptr);
+bool samples_from_double(const double* in, int64_t n, SampleFormat fmt, void* out, Dither* dither = nullptr);
+
+// Format to format, through float when that holds every bit of both
+// sides and through double otherwise.
+bool samples_convert(const void* in, SampleFormat in_fmt, int64_t n,
+                     void* out, SampleFormat out_fmt, Dither* dither = nullptr);
+
+#endif
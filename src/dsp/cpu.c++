@@ -0,0 +1,94 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "dsp/cpu.h++"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static SimdLevel detect(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	// __builtin_cpu_supports also checks that the OS saves the wide
+	// registers
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return SIMD_AVX512;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return SIMD_SSE2;
+	}
+	return SIMD_SCALAR;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int r[4];
+	__cpuid(r, 1);
+	bool sse2 = (r[3] >> 26) & 1;
+	bool fma = (r[2] >> 12) & 1;
+	bool osxsave = (r[2] >> 27) & 1;
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	__cpuidex(r, 7, 0);
+	bool avx2 = (r[1] >> 5) & 1;
+	bool avx512f = (r[1] >> 16) & 1;
+	if (avx512f && (xcr0 & 0xe6) == 0xe6) {
+		return SIMD_AVX512;
+	}
+	if (avx2 && fma && (xcr0 & 0x6) == 0x6) {
+		return SIMD_AVX2;
+	}
+	return sse2 ? SIMD_SSE2 : SIMD_SCALAR;
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+	return SIMD_NEON;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+SimdLevel cpu_simd_level(void) {
+	static const SimdLevel level = detect();
+	return level;
+}
+
+static SimdLevel choose(void) {
+	SimdLevel cpu = cpu_simd_level();
+	const char* env = getenv("SIGPROC_SIMD");
+	if (env == nullptr || env[0] == '\0') {
+		return cpu;
+	}
+
+	for (int i=SIMD_SCALAR; i<=SIMD_NEON; i++) {
+		SimdLevel level = (SimdLevel) i;
+		if (strcmp(env, simd_level_name(level)) != 0) {
+			continue;
+		}
+		// only a level this CPU can run: anything on the same family at or
+		// below the detected one, or scalar
+		if (level == SIMD_SCALAR) {
+			return level;
+		}
+		if (level == SIMD_NEON || cpu == SIMD_NEON) {
+			return (level == cpu) ? level : cpu;
+		}
+		return (level <= cpu) ? level : cpu;
+	}
+	return cpu;
+}
+
+SimdLevel simd_level(void) {
+	static const SimdLevel level = choose();
+	return level;
+}
+
+const char* simd_level_name(SimdLevel level) {
+	switch (level) {
+	case SIMD_SCALAR: return "scalar";
+	case SIMD_SSE2: return "sse2";
+	case SIMD_AVX2: return "avx2";
+	case SIMD_AVX512: return "avx512";
+	case SIMD_NEON: return "neon";
+	}
+	return "unknown";
+}
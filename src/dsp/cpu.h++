@@ -0,0 +1,24 @@
+#ifndef SIGPROC_CPU_H
+#define SIGPROC_CPU_H
+
+// Instruction set levels the DSP kernels are built for. The x86 levels
+// are ordered: a CPU at SIMD_AVX512 also runs the SSE2 and AVX2 kernels.
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2,
+    SIMD_AVX2,      // AVX2 + FMA
+    SIMD_AVX512,    // AVX-512F
+    SIMD_NEON,
+};
+
+// Best level this CPU (and OS) supports, detected once.
+SimdLevel cpu_simd_level(void);
+
+// Level the kernels use: cpu_simd_level(), lowered by the SIGPROC_SIMD
+// environment variable (scalar, sse2, avx2, avx512 or neon) when that
+// names a level the CPU supports. Read once, at the first call.
+SimdLevel simd_level(void);
+
+const char* simd_level_name(SimdLevel level);
+
+#endif
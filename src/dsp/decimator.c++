@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <cmath>
+
+#include "dsp/decimator.h++"
+#include "dsp/kernels.h++"
+
+#undef PI
+#define PI (3.14159265358979323846)
+
+#define DECIMATOR_ATTENUATION 80.0
+
+// zeroth order modified Bessel function of the first kind
+static double bessel_i0(double x) {
+	double sum = 1.0, term = 1.0;
+	for (int k=1; k<50; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-17)
+			break;
+	}
+	return sum;
+}
+
+// factor Fs_in / Fs_out into 3s then 2s; 0 when it does not factor
+int DecimatorCascade::factors(double Fs_in, double Fs_out, int* f) {
+	if (Fs_out <= 0 || std::floor(Fs_in) != Fs_in || std::floor(Fs_out) != Fs_out) {
+		return 0;
+	}
+	double q = Fs_in / Fs_out;
+	if (std::floor(q) != q || q < 2 || q >= 18446744073709551616.0) {
+		return 0;
+	}
+	unsigned long long d = (unsigned long long) q;
+	int n = 0;
+	while (d % 3 == 0) {
+		f[n++] = 3;
+		d /= 3;
+	}
+	while (d % 2 == 0) {
+		f[n++] = 2;
+		d /= 2;
+	}
+	return (d == 1) ? n : 0;
+}
+
+bool DecimatorCascade::supports(double Fs_in, double Fs_out) {
+	int f[MAX_STAGES];
+	return factors(Fs_in, Fs_out, f) > 0;
+}
+
+// Kaiser windowed sinc with its cutoff at Fs_in / (2 * factor), which
+// makes every factor-th tap from the center zero; unnormalized tap at
+// offset o of a window reaching H
+static double stage_tap(int D, int H, int o) {
+	const double beta = 0.1102 * (DECIMATOR_ATTENUATION - 8.7);
+	if (o % D == 0 && o != 0) {
+		return 0;
+	}
+	double u = (double) o / D;
+	double sinc = (o == 0) ? 1.0 : sin(PI * u) / (PI * u);
+	double w = (double) o / (H + 1);
+	return sinc * bessel_i0(beta * sqrt(1.0 - w * w)) / bessel_i0(beta) / D;
+}
+
+// Only the nonzero taps on one side are kept: for a half-band stage the
+// odd offsets 1, 3, ..., for a third-band stage the offsets 1, 2, 4, 5,
+// ... in consecutive pairs. Without an arena only the sizes are set.
+void DecimatorCascade::design_stage(Stage& stage, double Fs_in, double pass, double stop, int channels,
+                                    DspArena* arena) {
+	const int D = stage.factor;
+	double dw = 2.0 * PI * (stop - pass) / Fs_in;
+	int length = (int) ceil((DECIMATOR_ATTENUATION - 8.0) / (2.285 * dw)) + 1;
+
+	// H is the largest offset with a nonzero tap: odd for D = 2 and
+	// 2 mod 3 for D = 3, so the tap list ends on a full pair
+	int H = std::max(1, length / 2);
+	if (D == 2) {
+		H += (H % 2 == 0);
+	} else {
+		while (H % 3 != 2)
+			H++;
+	}
+	stage.half = H;
+
+	// a half-band stage splits its window of 2H + 1 inputs into the H + 1
+	// that emit and the H that do not (see halfband())
+	stage.ntaps = H - H / D;
+	stage.hist_size = (D == 2) ? H + 1 : 2 * H + 1;
+	stage.odd_size = (D == 2) ? (H + 1) / 2 : 0;
+	stage.count = 0;
+	stage.pos = 0;
+	stage.odd_pos = 0;
+	if (arena == nullptr) {
+		return;
+	}
+	stage.taps = arena->alloc<double>(stage.ntaps);
+	stage.hist = arena->alloc<double>((size_t) 2 * stage.hist_size * channels);
+	stage.odd = stage.odd_size > 0 ? arena->alloc<double>((size_t) 2 * stage.odd_size * channels) : nullptr;
+	if (stage.taps == nullptr || stage.hist == nullptr) {
+		return;
+	}
+
+	double sum = 0;
+	for (int o=0; o<=H; o++) {
+		sum += (o == 0) ? stage_tap(D, H, o) : 2.0 * stage_tap(D, H, o);
+	}
+	stage.center = stage_tap(D, H, 0) / sum;
+	int k = 0;
+	for (int o=1; o<=H; o++) {
+		if (o % D != 0) {
+			stage.taps[k++] = stage_tap(D, H, o) / sum;
+		}
+	}
+}
+
+void DecimatorCascade::build(double Fs_in, const int* f, int count, double pass, int channels,
+                             Stage* stages, DspArena* arena, double* delay) {
+	double rate = Fs_in;
+	double step = 1;   // input samples per sample at this stage's input
+	*delay = 0;
+	for (int i=0; i<count; i++) {
+		Stage& stage = stages[i];
+		stage.factor = f[i];
+		// keep anything that would alias into 0..pass out of this stage
+		design_stage(stage, rate, pass, rate / f[i] - pass, channels, arena);
+		*delay += stage.half * step;
+		rate /= f[i];
+		step *= f[i];
+	}
+}
+
+size_t DecimatorCascade::arena_bytes(double Fs_in, const int* f, int count, double Fs_pass, int channels) {
+	Stage stages[MAX_STAGES];
+	double delay;
+	build(Fs_in, f, count, Fs_pass, channels, stages, nullptr, &delay);
+	size_t bytes = dsp_arena_bytes<Stage>(count);
+	for (int i=0; i<count; i++) {
+		bytes += dsp_arena_bytes<double>(stages[i].ntaps);
+		bytes += dsp_arena_bytes<double>((size_t) 2 * stages[i].hist_size * channels);
+		if (stages[i].odd_size > 0) {
+			bytes += dsp_arena_bytes<double>((size_t) 2 * stages[i].odd_size * channels);
+		}
+	}
+	return bytes;
+}
+
+size_t DecimatorCascade::arena_bytes(double Fs_in, const int* f, int count, double Fs_pass) {
+	return arena_bytes(Fs_in, f, count, Fs_pass, 1);
+}
+
+size_t DecimatorCascade::arena_bytes(double Fs_in, double Fs_out, double Fs_padding, int channels) {
+	int f[MAX_STAGES];
+	int count = factors(Fs_in, Fs_out, f);
+	return arena_bytes(Fs_in, f, count, Fs_out / 2.0 - std::max(Fs_padding, 1.0), channels);
+}
+
+DecimatorCascade::DecimatorCascade()
+: m_kernels(&dsp_kernels()), m_stages(nullptr), m_count(0), m_channels(1), m_delay(0) {
+}
+
+DecimatorCascade::DecimatorCascade(double Fs_in, double Fs_out, double Fs_padding, DspArena& arena, int channels)
+: m_kernels(&dsp_kernels()), m_stages(nullptr), m_count(0), m_channels(channels), m_delay(0) {
+	int f[MAX_STAGES];
+	int count = factors(Fs_in, Fs_out, f);
+	m_stages = arena.alloc<Stage>(count);
+	if (m_stages != nullptr) {
+		m_count = count;
+		build(Fs_in, f, count, Fs_out / 2.0 - std::max(Fs_padding, 1.0), channels, m_stages, &arena, &m_delay);
+	}
+}
+
+DecimatorCascade::DecimatorCascade(double Fs_in, const int* f, int count, double Fs_pass, DspArena& arena)
+: m_kernels(&dsp_kernels()), m_stages(nullptr), m_count(0), m_channels(1), m_delay(0) {
+	m_stages = arena.alloc<Stage>(count);
+	if (m_stages != nullptr) {
+		m_count = count;
+		build(Fs_in, f, count, Fs_pass, 1, m_stages, &arena, &m_delay);
+	}
+}
+
+void DecimatorCascade::relocate(const char* from, char* to) {
+	m_stages = dsp_relocate(m_stages, from, to);
+	for (int i=0; i<m_count; i++) {
+		m_stages[i].taps = dsp_relocate(m_stages[i].taps, from, to);
+		m_stages[i].hist = dsp_relocate(m_stages[i].hist, from, to);
+		m_stages[i].odd = dsp_relocate(m_stages[i].odd, from, to);
+	}
+}
+
+// A half-band stage emits on every other input, n, and with H odd the
+// nonzero taps x[n - H -+ o], o odd, are exactly the inputs that emitted:
+// e[i] = x[n - 2i]. They are kept apart from the others, so each side of
+// the symmetric sum is a contiguous run, e[(H - 1)/2 - k] .. and
+// e[(H + 1)/2 + k] .. for o = 2k + 1. The center x[n - H] is an odd one.
+double DecimatorCascade::halfband(const Stage& s) {
+	const double* e = &s.hist[s.pos] + (s.half + 1) / 2;
+	double center = s.odd[s.odd_pos + (s.half - 1) / 2];
+	return s.center * center + m_kernels->fold_dot(s.taps, e - 1, e, s.ntaps);
+}
+
+// A third-band stage keeps every input, w[i] = x[n - i], with the center
+// at w[H]. The nonzero offsets come in adjacent pairs (1, 2), (4, 5), ...
+// so each pair is one load on either side of the center.
+double DecimatorCascade::thirdband(const Stage& s) {
+	const double* c = &s.hist[s.pos] + s.half;
+	return s.center * c[0] + m_kernels->fold_dot3(s.taps, c, s.ntaps);
+}
+
+bool DecimatorCascade::push(Stage& s, double v, double* out) {
+	bool emit = s.count == 0;
+	s.count = (s.count + 1 == s.factor) ? 0 : s.count + 1;
+
+	if (s.factor == 2 && !emit) {
+		const int W = s.odd_size;
+		s.odd_pos = (s.odd_pos == 0) ? W - 1 : s.odd_pos - 1;
+		s.odd[s.odd_pos] = v;
+		s.odd[s.odd_pos + W] = v;
+		return false;
+	}
+
+	const int W = s.hist_size;
+	s.pos = (s.pos == 0) ? W - 1 : s.pos - 1;
+	s.hist[s.pos] = v;
+	s.hist[s.pos + W] = v;
+	if (!emit) {
+		return false;
+	}
+
+	*out = (s.factor == 2) ? halfband(s) : thirdband(s);
+	return true;
+}
+
+int DecimatorCascade::insert(double value, double* out) {
+	double v = value;
+	for (int i=0; i<m_count; i++) {
+		if (!push(m_stages[i], v, &v)) {
+			return 0;
+		}
+	}
+	*out = v;
+	return 1;
+}
+
+// halfband() and thirdband() with a row of m_channels samples per input
+void DecimatorCascade::halfband_frame(const Stage& s, double* out) {
+	const int C = m_channels;
+	const double* e = &s.hist[(size_t) s.pos * C] + (size_t) (s.half + 1) / 2 * C;
+	const double* center = &s.odd[(size_t) (s.odd_pos + (s.half - 1) / 2) * C];
+	for (int ch=0; ch<C; ch++) {
+		out[ch] = s.center * center[ch];
+	}
+	m_kernels->fold_rows(s.taps, e - C, e, s.ntaps, C, out);
+}
+
+void DecimatorCascade::thirdband_frame(const Stage& s, double* out) {
+	const int C = m_channels;
+	const double* c = &s.hist[(size_t) s.pos * C] + (size_t) s.half * C;
+	for (int ch=0; ch<C; ch++) {
+		out[ch] = s.center * c[ch];
+	}
+	m_kernels->fold_rows3(s.taps, c, s.ntaps, C, out);
+}
+
+// `frame` is copied into the history before `out` is written, so the two
+// may be the same
+bool DecimatorCascade::push_frame(Stage& s, const double* frame, double* out) {
+	const size_t C = m_channels;
+	bool emit = s.count == 0;
+	s.count = (s.count + 1 == s.factor) ? 0 : s.count + 1;
+
+	if (s.factor == 2 && !emit) {
+		const int W = s.odd_size;
+		s.odd_pos = (s.odd_pos == 0) ? W - 1 : s.odd_pos - 1;
+		std::copy(frame, frame + C, &s.odd[s.odd_pos * C]);
+		std::copy(frame, frame + C, &s.odd[(s.odd_pos + W) * C]);
+		return false;
+	}
+
+	const int W = s.hist_size;
+	s.pos = (s.pos == 0) ? W - 1 : s.pos - 1;
+	std::copy(frame, frame + C, &s.hist[s.pos * C]);
+	std::copy(frame, frame + C, &s.hist[(s.pos + W) * C]);
+	if (!emit) {
+		return false;
+	}
+
+	if (s.factor == 2) {
+		halfband_frame(s, out);
+	} else {
+		thirdband_frame(s, out);
+	}
+	return true;
+}
+
+// each stage's output frame is the next one's input, all in `out`
+int DecimatorCascade::insert_frame(const double* frame, double* out) {
+	const double* v = frame;
+	for (int i=0; i<m_count; i++) {
+		if (!push_frame(m_stages[i], v, out)) {
+			return 0;
+		}
+		v = out;
+	}
+	return 1;
+}
+
+void DecimatorCascade::reset() {
+	const size_t C = m_channels;
+	for (int i=0; i<m_count; i++) {
+		Stage& s = m_stages[i];
+		std::fill(s.hist, s.hist + 2 * s.hist_size * C, 0.0);
+		std::fill(s.odd, s.odd + 2 * s.odd_size * C, 0.0);
+		s.count = 0;
+		s.pos = 0;
+		s.odd_pos = 0;
+	}
+}
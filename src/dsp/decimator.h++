@@ -0,0 +1,101 @@
+#ifndef SIGPROC_DECIMATOR_H
+#define SIGPROC_DECIMATOR_H
+
+#include <cstddef>
+
+#include "dsp/arena.h++"
+#include "dsp/kernels.h++"
+
+// Integer downsampling by a factor made of 2s and 3s, as a cascade of
+// linear phase FIR stages that each decimate by 2 (half-band) or 3
+// (third-band).
+//
+// A half-band filter has every other tap zero and a third-band filter
+// every third, and each stage only computes the samples it keeps, so the
+// work per stage runs at its output rate. Every stage passes 0..Fs_out/2 -
+// Fs_padding and rejects, by about 80 dB, whatever would alias into that
+// band; the early stages, with a lot of room between the band and their
+// own Nyquist frequency, need only a handful of taps.
+//
+// The symmetric tap pairs are summed by the fold_dot kernels (see
+// DspKernels). With more than one channel the histories hold interleaved
+// frames, channel innermost, and insert_frame() runs every channel through
+// each tap at once with the fold_rows kernels.
+class DecimatorCascade
+{
+public:
+    // enough for any ratio below 2^64
+    static const int MAX_STAGES = 64;
+
+    // true when Fs_in / Fs_out is an integer > 1 made of 2s and 3s
+    static bool supports(double Fs_in, double Fs_out);
+
+    // the stage factors, 3s first, into f[MAX_STAGES]; returns the count,
+    // 0 when not supported
+    static int factors(double Fs_in, double Fs_out, int* f);
+
+    DecimatorCascade();
+
+    // The tables and histories are taken from `arena`, which must have
+    // arena_bytes() free.
+    DecimatorCascade(double Fs_in, double Fs_out, double Fs_padding, DspArena& arena, int channels = 1);
+
+    // Explicit stages, each passing 0..Fs_pass; used by ResampleGraph,
+    // where a stage shared by several outputs must pass the widest band.
+    DecimatorCascade(double Fs_in, const int* factors, int count, double Fs_pass, DspArena& arena);
+    ~DecimatorCascade() {};
+
+    static size_t arena_bytes(double Fs_in, double Fs_out, double Fs_padding, int channels = 1);
+    static size_t arena_bytes(double Fs_in, const int* factors, int count, double Fs_pass);
+
+    // the arena block was copied from `from` to `to`
+    void relocate(const char* from, char* to);
+
+    // 0 or 1 outputs; the first input always yields one, like Resampler
+    int insert(double value, double* out);
+
+    // insert() for one frame of channels() interleaved samples
+    int insert_frame(const double* frame, double* out);
+    void reset();
+
+    // in input samples
+    double delay(void) const { return m_delay; }
+    int stages(void) const { return m_count; }
+    int channels(void) const { return m_channels; }
+
+private:
+    struct Stage {
+        int factor;                 // 2 or 3
+        int half;                   // H: the window is x[n - 2H] .. x[n]
+        int count;                  // inputs since the last output
+        double center;              // tap 0 coefficient
+        double* taps;               // pair coefficients, see design_stage()
+        int ntaps;
+        double* hist;               // newest first, stored twice
+        int hist_size;              // window length in frames (half the array)
+        int pos;
+        double* odd;                // half-band: the inputs that emit nothing
+        int odd_size;
+        int odd_pos;
+    };
+
+    static size_t arena_bytes(double Fs_in, const int* factors, int count, double Fs_pass, int channels);
+    static void build(double Fs_in, const int* factors, int count, double pass, int channels,
+                      Stage* stages, DspArena* arena, double* delay);
+    static void design_stage(Stage& stage, double Fs_in, double pass, double stop, int channels,
+                             DspArena* arena);
+    bool push(Stage& stage, double value, double* out);
+    double halfband(const Stage& stage);
+    double thirdband(const Stage& stage);
+    bool push_frame(Stage& stage, const double* frame, double* out);
+    void halfband_frame(const Stage& stage, double* out);
+    void thirdband_frame(const Stage& stage, double* out);
+
+    const DspKernels* m_kernels;
+    Stage* m_stages;
+    int m_count;
+    int m_channels;
+    double m_delay;
+};
+
+#endif
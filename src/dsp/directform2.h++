@@ -1,78 +1,85 @@
-
 #ifndef SIGPROC_DIRECTFORM2_H
 #define SIGPROC_DIRECTFORM2_H
 
-#include <deque>
-#include <vector>
+#include <cstddef>
+
+#include "dsp/arena.h++"
 
+// Direct form 2 IIR filter of order N - 1. The coefficients and the
+// history w[n-1] .. w[n-N] live in an arena (3 * arena_bytes(N)); the
+// history is circular, so a sample costs no moves.
 template <class T>
 class DirectForm2Mono
 {
 public:
-    DirectForm2Mono(std::vector<T> B, std::vector<T> A)
-    : m_B(B), m_A(A), m_deque() {
-
-        // TODO: assert m_A, m_B are equal size
-        m_N = m_B.size();
+    DirectForm2Mono()
+    : m_B(nullptr), m_A(nullptr), m_w(nullptr), m_N(0), m_head(0) {}
+
+    DirectForm2Mono(const T* B, const T* A, int N, DspArena& arena)
+    : m_N(N), m_head(0) {
+
+        m_B = arena.alloc<T>(N);
+        m_A = arena.alloc<T>(N);
+        m_w = arena.alloc<T>(N);
+        if (m_B == nullptr || m_A == nullptr || m_w == nullptr) {
+            m_N = 0;
+            return;
+        }
         //in director form 2 the multiplicative constant
         // for feedback is negative the pole value
         for (int i=0; i<m_N; i++) {
-            m_A[i] = -m_A[i];
+            m_B[i] = B[i];
+            m_A[i] = -A[i];
         }
         m_A[0] = 1.0;
-
-        //initialize the output
-        for (int i=0; i<m_N; i++) {
-            m_deque.push_back(0.0);
-        }
-
     };
 
-    DirectForm2Mono(T* B, T* A, int N)
-    : m_B(), m_A(), m_deque() {
-
-        m_N = N;
-        //in director form 2 the multiplicative constant
-        // for feedback is negative the pole value
-        for (int i=0; i<m_N; i++) {
-            m_B.push_back(B[i]);
-            m_A.push_back(-A[i]);
-        }
-        m_A[0] = 1.0;
+    static size_t arena_bytes(int N) {
+        return 3 * dsp_arena_bytes<T>(N);
+    }
 
-        //initialize the output
+    // forget all history, as if newly constructed
+    void reset() {
         for (int i=0; i<m_N; i++) {
-            m_deque.push_back(0.0);
+            m_w[i] = 0.0;
         }
+        m_head = 0;
+    }
 
-    };
-
-    ~DirectForm2Mono() {}
+    // the arena block was copied from `from` to `to`
+    void relocate(const char* from, char* to) {
+        m_B = dsp_relocate(m_B, from, to);
+        m_A = dsp_relocate(m_A, from, to);
+        m_w = dsp_relocate(m_w, from, to);
+    }
 
     T IIR(T value) {
         T a=0, b=0;
 
+        // m_w[(m_head + i - 1) % N] is w[n-i]
+        int j = m_head;
         for (int i=1; i<m_N; i++) {
-            a += m_A[i] * m_deque[i-1];
-            b += m_B[i] * m_deque[i-1];
+            a += m_A[i] * m_w[j];
+            b += m_B[i] * m_w[j];
+            j = (j + 1 == m_N) ? 0 : j + 1;
         }
 
         //T new_value = value * m_A[0] + a
         T new_value = value + a;
 
-        m_deque.pop_back();
-        m_deque.push_front(new_value);
+        m_head = (m_head == 0) ? m_N - 1 : m_head - 1;
+        m_w[m_head] = new_value;
 
         return new_value * m_B[0] + b;
     }
 
 private:
-    std::vector<T> m_B;
-    std::vector<T> m_A;
-    std::deque<T> m_deque;
-    size_t m_N;
+    T* m_B;
+    T* m_A;
+    T* m_w;
+    int m_N;
+    int m_head;
 };
 
 
 #endif
-
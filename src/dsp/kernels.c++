@@ -0,0 +1,191 @@
+#include "dsp/kernels.h++"
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+static double dot_scalar(const double* a, const double* b, int n) {
+	double acc = 0;
+	for (int i=0; i<n; i++) {
+		acc += a[i] * b[i];
+	}
+	return acc;
+}
+
+static double fold_dot_scalar(const double* h, const double* lo, const double* hi, int n) {
+	double acc = 0;
+	for (int k=0; k<n; k++) {
+		acc += h[k] * (lo[-k] + hi[k]);
+	}
+	return acc;
+}
+
+static double fold_dot3_scalar(const double* h, const double* c, int n) {
+	double acc = 0;
+	for (int k=0; k<n; k++) {
+		int o = 3 * (k / 2) + 1 + (k % 2);
+		acc += h[k] * (c[-o] + c[o]);
+	}
+	return acc;
+}
+
+static void iir_rows_scalar(const double* const* rows, const double* A, const double* B,
+                            int taps, int channels, double* a, double* y) {
+	for (int i=1; i<=taps; i++) {
+		const double* w = rows[i - 1];
+		for (int ch=0; ch<channels; ch++) {
+			a[ch] += A[i] * w[ch];
+			y[ch] += B[i] * w[ch];
+		}
+	}
+}
+
+static void lerp_scalar(const double* x1, const double* x0, double t, int n, double* out) {
+	for (int i=0; i<n; i++) {
+		out[i] = x1[i] + (x0[i] - x1[i]) * t;
+	}
+}
+
+static void dot_rows_scalar(const double* h, const double* x, int n, int channels, double* y) {
+	for (int k=0; k<n; k++) {
+		const double* r = x + (ptrdiff_t) k * channels;
+		for (int ch=0; ch<channels; ch++) {
+			y[ch] += h[k] * r[ch];
+		}
+	}
+}
+
+static void fold_rows_scalar(const double* h, const double* lo, const double* hi, int n, int channels, double* y) {
+	for (int k=0; k<n; k++) {
+		const double* l = lo - (ptrdiff_t) k * channels;
+		const double* r = hi + (ptrdiff_t) k * channels;
+		for (int ch=0; ch<channels; ch++) {
+			y[ch] += h[k] * (l[ch] + r[ch]);
+		}
+	}
+}
+
+static void fold_rows3_scalar(const double* h, const double* c, int n, int channels, double* y) {
+	for (int k=0; k<n; k++) {
+		int o = 3 * (k / 2) + 1 + (k % 2);
+		fold_rows_scalar(h + k, c - (ptrdiff_t) o * channels, c + (ptrdiff_t) o * channels, 1, channels, y);
+	}
+}
+
+static void s16_to_f32_scalar(const int16_t* in, int n, float* out) {
+	for (int i=0; i<n; i++) {
+		out[i] = in[i] * (1.0f / 32768.0f);
+	}
+}
+
+static void f32_to_s16_scalar(const float* in, int n, int16_t* out) {
+	for (int i=0; i<n; i++) {
+		float y = in[i] * 32768.0f;
+		y = y < -32768.0f ? -32768.0f : (y > 32767.0f ? 32767.0f : y);
+		out[i] = (int16_t) lrintf(y);
+	}
+}
+
+static void s32_to_f32_scalar(const int32_t* in, int n, int shift, float* out) {
+	for (int i=0; i<n; i++) {
+		out[i] = (float) (int32_t) ((uint32_t) in[i] << shift) * (1.0f / 2147483648.0f);
+	}
+}
+
+static void f32_to_s32_scalar(const float* in, int n, int bits, int32_t* out) {
+	const float scale = ldexpf(1.0f, bits - 1);
+	const float hi = kernel_s32_limit(bits);
+	for (int i=0; i<n; i++) {
+		float y = in[i] * scale;
+		y = y < -scale ? -scale : (y > hi ? hi : y);
+		out[i] = (int32_t) lrintf(y);
+	}
+}
+
+static void bswap16_scalar(const void* in, int n, void* out) {
+	const uint8_t* p = (const uint8_t*) in;
+	uint8_t* q = (uint8_t*) out;
+	for (int i=0; i<n; i++, p += 2, q += 2) {
+		uint8_t a = p[0], b = p[1];
+		q[0] = b;
+		q[1] = a;
+	}
+}
+
+static void bswap32_scalar(const void* in, int n, void* out) {
+	for (int i=0; i<n; i++) {
+		uint32_t v;
+		memcpy(&v, (const char*) in + 4 * i, 4);
+		v = (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+		memcpy((char*) out + 4 * i, &v, 4);
+	}
+}
+
+static void bswap64_scalar(const void* in, int n, void* out) {
+	for (int i=0; i<n; i++) {
+		uint8_t b[8];
+		memcpy(b, (const char*) in + 8 * i, 8);
+		for (int j=0; j<4; j++) {
+			uint8_t t = b[j];
+			b[j] = b[7 - j];
+			b[7 - j] = t;
+		}
+		memcpy((char*) out + 8 * i, b, 8);
+	}
+}
+
+// the caller's strided copy does all of it
+static int64_t split2_none(const char*, int64_t, char*, char*) {
+	return 0;
+}
+
+static int64_t split4_none(const char*, int64_t, char* const*) {
+	return 0;
+}
+
+DspKernels dsp_kernels_for(SimdLevel level) {
+	// never hand out kernels the CPU cannot run
+	SimdLevel cpu = cpu_simd_level();
+	if (level != SIMD_SCALAR && (level > cpu || (level == SIMD_NEON) != (cpu == SIMD_NEON))) {
+		level = cpu;
+	}
+
+	DspKernels k;
+	k.dot = dot_scalar;
+	k.fold_dot = fold_dot_scalar;
+	k.fold_dot3 = fold_dot3_scalar;
+	k.iir_rows = iir_rows_scalar;
+	k.lerp = lerp_scalar;
+	k.dot_rows = dot_rows_scalar;
+	k.fold_rows = fold_rows_scalar;
+	k.fold_rows3 = fold_rows3_scalar;
+	k.s16_to_f32 = s16_to_f32_scalar;
+	k.f32_to_s16 = f32_to_s16_scalar;
+	k.s32_to_f32 = s32_to_f32_scalar;
+	k.f32_to_s32 = f32_to_s32_scalar;
+	k.bswap16 = bswap16_scalar;
+	k.bswap32 = bswap32_scalar;
+	k.bswap64 = bswap64_scalar;
+	k.split2_16 = split2_none;
+	k.split2_32 = split2_none;
+	k.split4_32 = split4_none;
+
+	if (level == SIMD_NEON) {
+		dsp_kernels_neon(&k);
+	}
+	if (level >= SIMD_SSE2 && level <= SIMD_AVX512) {
+		dsp_kernels_sse2(&k);
+	}
+	if (level >= SIMD_AVX2 && level <= SIMD_AVX512) {
+		dsp_kernels_avx2(&k);
+	}
+	if (level == SIMD_AVX512) {
+		dsp_kernels_avx512(&k);
+	}
+	return k;
+}
+
+const DspKernels& dsp_kernels(void) {
+	static const DspKernels kernels = dsp_kernels_for(simd_level());
+	return kernels;
+}
@@ -0,0 +1,86 @@
+#ifndef SIGPROC_KERNELS_H
+#define SIGPROC_KERNELS_H
+
+#include <cstdint>
+
+#include "dsp/cpu.h++"
+
+// The inner loops of the DSP code, built once per instruction set and
+// picked at run time, so one binary runs the widest kernels each host has.
+//
+// kernels.c++ holds the portable versions; kernels_sse2.c++,
+// kernels_avx2.c++, kernels_avx512.c++ and kernels_neon.c++ are compiled
+// with their own target flags and each overwrites the entries it has a
+// faster version of. Nothing outside those files is compiled for more than
+// the baseline, so no wide instruction runs before the CPU is checked.
+//
+// Results may differ in the last bits between levels (FMA, summation
+// order).
+struct DspKernels
+{
+    // sum a[i] * b[i]
+    double (*dot)(const double* a, const double* b, int n);
+
+    // sum h[k] * (lo[-k] + hi[k]): a symmetric FIR folded at its center
+    double (*fold_dot)(const double* h, const double* lo, const double* hi, int n);
+
+    // sum h[k] * (c[-o] + c[o]) for the offsets o = 1, 2, 4, 5, 7, 8, ...
+    // of a third-band filter (every third one is a zero tap); n is even
+    double (*fold_dot3)(const double* h, const double* c, int n);
+
+    // Direct form 2 taps across channels: for each tap i in 1..taps and
+    // channel ch, a[ch] += A[i] * rows[i-1][ch] and y[ch] += B[i] * rows[i-1][ch]
+    void (*iir_rows)(const double* const* rows, const double* A, const double* B,
+                     int taps, int channels, double* a, double* y);
+
+    // out[i] = x1[i] + (x0[i] - x1[i]) * t
+    void (*lerp)(const double* x1, const double* x0, double t, int n, double* out);
+
+    // dot, fold_dot and fold_dot3 over frames of `channels` interleaved
+    // samples: tap k reads the frame k rows away (k * channels doubles), and
+    // channel ch's sum is added to y[ch].
+    void (*dot_rows)(const double* h, const double* x, int n, int channels, double* y);
+    void (*fold_rows)(const double* h, const double* lo, const double* hi, int n, int channels, double* y);
+    void (*fold_rows3)(const double* h, const double* c, int n, int channels, double* y);
+
+    // Sample conversion between native order integers and float, full
+    // scale being +-1.0. s32_to_f32 first shifts each word left by `shift`
+    // (8 for 24 bit samples in the low three bytes). The float to integer
+    // kernels round to nearest and saturate to `bits` (16, 24 or 32).
+    void (*s16_to_f32)(const int16_t* in, int n, float* out);
+    void (*f32_to_s16)(const float* in, int n, int16_t* out);
+    void (*s32_to_f32)(const int32_t* in, int n, int shift, float* out);
+    void (*f32_to_s32)(const float* in, int n, int bits, int32_t* out);
+
+    // Reverse the bytes of each 2, 4 or 8 byte word; in == out is fine.
+    void (*bswap16)(const void* in, int n, void* out);
+    void (*bswap32)(const void* in, int n, void* out);
+    void (*bswap64)(const void* in, int n, void* out);
+
+    // Transpose interleaved frames into planes; each returns the frames
+    // done and leaves the tail to the caller.
+    int64_t (*split2_16)(const char* in, int64_t frames, char* a, char* b);
+    int64_t (*split2_32)(const char* in, int64_t frames, char* a, char* b);
+    int64_t (*split4_32)(const char* in, int64_t frames, char* const* out);
+};
+
+// Largest float that f32_to_s32 can convert to `bits` without overflow
+inline float kernel_s32_limit(int bits) {
+    return bits >= 32 ? 2147483520.0f : (float) ((1 << (bits - 1)) - 1);
+}
+
+// The table for simd_level(), built at the first call.
+const DspKernels& dsp_kernels(void);
+
+// The table for a given level (at most cpu_simd_level()), for tests and
+// benchmarks that compare levels.
+DspKernels dsp_kernels_for(SimdLevel level);
+
+// Overwrite the entries a level has its own version of; false when this
+// build does not include that level.
+bool dsp_kernels_sse2(DspKernels* k);
+bool dsp_kernels_avx2(DspKernels* k);
+bool dsp_kernels_avx512(DspKernels* k);
+bool dsp_kernels_neon(DspKernels* k);
+
+#endif
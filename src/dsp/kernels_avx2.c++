@@ -0,0 +1,381 @@
+#include "dsp/kernels.h++"
+
+#include <cstddef>
+
+// built with -mavx2 -mfma (/arch:AVX2); empty otherwise
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+static inline double hsum(__m256d v) {
+	__m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+static double dot_avx2(const double* a, const double* b, int n) {
+	__m256d s0 = _mm256_setzero_pd();
+	__m256d s1 = _mm256_setzero_pd();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+		s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), s1);
+	}
+	double acc = hsum(_mm256_add_pd(s0, s1));
+	for (; i<n; i++) {
+		acc += a[i] * b[i];
+	}
+	return acc;
+}
+
+// p[0..3] in reverse order
+static inline __m256d load_reversed(const double* p) {
+	return _mm256_permute4x64_pd(_mm256_loadu_pd(p), _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+static double fold_dot_avx2(const double* h, const double* lo, const double* hi, int n) {
+	__m256d s0 = _mm256_setzero_pd();
+	__m256d s1 = _mm256_setzero_pd();
+	int k = 0;
+	for (; k + 8 <= n; k += 8) {
+		__m256d x0 = _mm256_add_pd(load_reversed(lo - k - 3), _mm256_loadu_pd(hi + k));
+		__m256d x1 = _mm256_add_pd(load_reversed(lo - k - 7), _mm256_loadu_pd(hi + k + 4));
+		s0 = _mm256_fmadd_pd(_mm256_loadu_pd(h + k), x0, s0);
+		s1 = _mm256_fmadd_pd(_mm256_loadu_pd(h + k + 4), x1, s1);
+	}
+	double acc = hsum(_mm256_add_pd(s0, s1));
+	for (; k<n; k++) {
+		acc += h[k] * (lo[-k] + hi[k]);
+	}
+	return acc;
+}
+
+// two tap pairs per step, one in each 128 bit lane
+static double fold_dot3_avx2(const double* h, const double* c, int n) {
+	__m256d s = _mm256_setzero_pd();
+	int k = 0;
+	for (; k + 4 <= n; k += 4) {
+		int o = 3 * (k / 2) + 1;
+		__m256d lo = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(c - o - 1)),
+		                                  _mm_loadu_pd(c - o - 4), 1);
+		__m256d hi = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(c + o)),
+		                                  _mm_loadu_pd(c + o + 3), 1);
+		lo = _mm256_permute_pd(lo, 0x5);
+		s = _mm256_fmadd_pd(_mm256_loadu_pd(h + k), _mm256_add_pd(lo, hi), s);
+	}
+	double acc = hsum(s);
+	for (; k<n; k++) {
+		int o = 3 * (k / 2) + 1 + (k % 2);
+		acc += h[k] * (c[-o] + c[o]);
+	}
+	return acc;
+}
+
+static void iir_rows_avx2(const double* const* rows, const double* A, const double* B,
+                          int taps, int channels, double* a, double* y) {
+	int ch = 0;
+	for (; ch + 4 <= channels; ch += 4) {
+		__m256d va = _mm256_loadu_pd(a + ch);
+		__m256d vy = _mm256_loadu_pd(y + ch);
+		for (int i=1; i<=taps; i++) {
+			__m256d w = _mm256_loadu_pd(rows[i - 1] + ch);
+			va = _mm256_fmadd_pd(_mm256_set1_pd(A[i]), w, va);
+			vy = _mm256_fmadd_pd(_mm256_set1_pd(B[i]), w, vy);
+		}
+		_mm256_storeu_pd(a + ch, va);
+		_mm256_storeu_pd(y + ch, vy);
+	}
+	for (; ch + 2 <= channels; ch += 2) {
+		__m128d va = _mm_loadu_pd(a + ch);
+		__m128d vy = _mm_loadu_pd(y + ch);
+		for (int i=1; i<=taps; i++) {
+			__m128d w = _mm_loadu_pd(rows[i - 1] + ch);
+			va = _mm_fmadd_pd(_mm_set1_pd(A[i]), w, va);
+			vy = _mm_fmadd_pd(_mm_set1_pd(B[i]), w, vy);
+		}
+		_mm_storeu_pd(a + ch, va);
+		_mm_storeu_pd(y + ch, vy);
+	}
+	for (; ch<channels; ch++) {
+		for (int i=1; i<=taps; i++) {
+			a[ch] += A[i] * rows[i - 1][ch];
+			y[ch] += B[i] * rows[i - 1][ch];
+		}
+	}
+}
+
+static void lerp_avx2(const double* x1, const double* x0, double t, int n, double* out) {
+	__m256d vt = _mm256_set1_pd(t);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d a = _mm256_loadu_pd(x1 + i);
+		__m256d d = _mm256_sub_pd(_mm256_loadu_pd(x0 + i), a);
+		_mm256_storeu_pd(out + i, _mm256_fmadd_pd(d, vt, a));
+	}
+	for (; i<n; i++) {
+		out[i] = x1[i] + (x0[i] - x1[i]) * t;
+	}
+}
+
+static void dot_rows_avx2(const double* h, const double* x, int n, int channels, double* y) {
+	int ch = 0;
+	for (; ch + 4 <= channels; ch += 4) {
+		__m256d acc = _mm256_loadu_pd(y + ch);
+		for (int k=0; k<n; k++) {
+			__m256d r = _mm256_loadu_pd(x + (ptrdiff_t) k * channels + ch);
+			acc = _mm256_fmadd_pd(_mm256_set1_pd(h[k]), r, acc);
+		}
+		_mm256_storeu_pd(y + ch, acc);
+	}
+	for (; ch + 2 <= channels; ch += 2) {
+		__m128d acc = _mm_loadu_pd(y + ch);
+		for (int k=0; k<n; k++) {
+			__m128d r = _mm_loadu_pd(x + (ptrdiff_t) k * channels + ch);
+			acc = _mm_fmadd_pd(_mm_set1_pd(h[k]), r, acc);
+		}
+		_mm_storeu_pd(y + ch, acc);
+	}
+	for (; ch<channels; ch++) {
+		for (int k=0; k<n; k++) {
+			y[ch] += h[k] * x[(ptrdiff_t) k * channels + ch];
+		}
+	}
+}
+
+static void fold_rows_avx2(const double* h, const double* lo, const double* hi, int n, int channels, double* y) {
+	int ch = 0;
+	for (; ch + 4 <= channels; ch += 4) {
+		__m256d acc = _mm256_loadu_pd(y + ch);
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) k * channels;
+			__m256d r = _mm256_add_pd(_mm256_loadu_pd(lo - off + ch), _mm256_loadu_pd(hi + off + ch));
+			acc = _mm256_fmadd_pd(_mm256_set1_pd(h[k]), r, acc);
+		}
+		_mm256_storeu_pd(y + ch, acc);
+	}
+	for (; ch + 2 <= channels; ch += 2) {
+		__m128d acc = _mm_loadu_pd(y + ch);
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) k * channels;
+			__m128d r = _mm_add_pd(_mm_loadu_pd(lo - off + ch), _mm_loadu_pd(hi + off + ch));
+			acc = _mm_fmadd_pd(_mm_set1_pd(h[k]), r, acc);
+		}
+		_mm_storeu_pd(y + ch, acc);
+	}
+	for (; ch<channels; ch++) {
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) k * channels;
+			y[ch] += h[k] * (lo[ch - off] + hi[off + ch]);
+		}
+	}
+}
+
+static void fold_rows3_avx2(const double* h, const double* c, int n, int channels, double* y) {
+	int ch = 0;
+	for (; ch + 4 <= channels; ch += 4) {
+		__m256d acc = _mm256_loadu_pd(y + ch);
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) (3 * (k / 2) + 1 + (k % 2)) * channels;
+			__m256d r = _mm256_add_pd(_mm256_loadu_pd(c - off + ch), _mm256_loadu_pd(c + off + ch));
+			acc = _mm256_fmadd_pd(_mm256_set1_pd(h[k]), r, acc);
+		}
+		_mm256_storeu_pd(y + ch, acc);
+	}
+	for (; ch + 2 <= channels; ch += 2) {
+		__m128d acc = _mm_loadu_pd(y + ch);
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) (3 * (k / 2) + 1 + (k % 2)) * channels;
+			__m128d r = _mm_add_pd(_mm_loadu_pd(c - off + ch), _mm_loadu_pd(c + off + ch));
+			acc = _mm_fmadd_pd(_mm_set1_pd(h[k]), r, acc);
+		}
+		_mm_storeu_pd(y + ch, acc);
+	}
+	for (; ch<channels; ch++) {
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) (3 * (k / 2) + 1 + (k % 2)) * channels;
+			y[ch] += h[k] * (c[ch - off] + c[off + ch]);
+		}
+	}
+}
+
+static void s16_to_f32_avx2(const int16_t* in, int n, float* out) {
+	const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	for (; i<n; i++) {
+		out[i] = in[i] * (1.0f / 32768.0f);
+	}
+}
+
+static void f32_to_s16_avx2(const float* in, int n, int16_t* out) {
+	const __m256 scale = _mm256_set1_ps(32768.0f);
+	const __m256 lo = _mm256_set1_ps(-32768.0f);
+	const __m256 hi = _mm256_set1_ps(32767.0f);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale), lo), hi);
+		__m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale), lo), hi);
+		__m256i v = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+		// the pack works per 128 bit lane
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	for (; i<n; i++) {
+		float y = in[i] * 32768.0f;
+		y = y < -32768.0f ? -32768.0f : (y > 32767.0f ? 32767.0f : y);
+		out[i] = (int16_t) _mm_cvtss_si32(_mm_set_ss(y));
+	}
+}
+
+static void s32_to_f32_avx2(const int32_t* in, int n, int shift, float* out) {
+	const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_sll_epi32(_mm256_loadu_si256((const __m256i*)(in + i)), count);
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	for (; i<n; i++) {
+		out[i] = (float) (int32_t) ((uint32_t) in[i] << shift) * (1.0f / 2147483648.0f);
+	}
+}
+
+static void f32_to_s32_avx2(const float* in, int n, int bits, int32_t* out) {
+	const float s = (float) (1u << (bits - 1));
+	const __m256 scale = _mm256_set1_ps(s);
+	const __m256 lo = _mm256_set1_ps(-s);
+	const __m256 hi = _mm256_set1_ps(kernel_s32_limit(bits));
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 y = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale), lo), hi);
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_cvtps_epi32(y));
+	}
+	for (; i<n; i++) {
+		__m128 y = _mm_min_ss(_mm_max_ss(_mm_mul_ss(_mm_set_ss(in[i]), _mm256_castps256_ps128(scale)),
+		                                 _mm256_castps256_ps128(lo)), _mm256_castps256_ps128(hi));
+		out[i] = _mm_cvtss_si32(y);
+	}
+}
+
+// one byte shuffle per 32 bytes, whatever the word size
+static inline void bswap_avx2(const void* in, int n, void* out, int size, __m256i order) {
+	const char* p = (const char*) in;
+	char* q = (char*) out;
+	const int step = 32 / size;
+	int i = 0;
+	for (; i + step <= n; i += step) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(p + size * i));
+		_mm256_storeu_si256((__m256i*)(q + size * i), _mm256_shuffle_epi8(v, order));
+	}
+	for (; i<n; i++) {
+		char w[8];
+		for (int j=0; j<size; j++) {
+			w[j] = p[size * i + size - 1 - j];
+		}
+		for (int j=0; j<size; j++) {
+			q[size * i + j] = w[j];
+		}
+	}
+}
+
+static void bswap16_avx2(const void* in, int n, void* out) {
+	const __m256i order = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+	                                       1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	bswap_avx2(in, n, out, 2, order);
+}
+
+static void bswap32_avx2(const void* in, int n, void* out) {
+	const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+	                                       3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	bswap_avx2(in, n, out, 4, order);
+}
+
+static void bswap64_avx2(const void* in, int n, void* out) {
+	const __m256i order = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+	                                       7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	bswap_avx2(in, n, out, 8, order);
+}
+
+static int64_t split2_32_avx2(const char* in, int64_t frames, char* a, char* b) {
+	const __m256i even_odd = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	int64_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		// [l0 r0 .. l3 r3] -> [l0 .. l3 r0 .. r3]
+		__m256i v0 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(in + i * 8)), even_odd);
+		__m256i v1 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(in + i * 8 + 32)), even_odd);
+		_mm256_storeu_si256((__m256i*)(a + i * 4), _mm256_permute2x128_si256(v0, v1, 0x20));
+		_mm256_storeu_si256((__m256i*)(b + i * 4), _mm256_permute2x128_si256(v0, v1, 0x31));
+	}
+	return i;
+}
+
+static int64_t split2_16_avx2(const char* in, int64_t frames, char* a, char* b) {
+	int64_t i = 0;
+	for (; i + 16 <= frames; i += 16) {
+		__m256i v0 = _mm256_loadu_si256((const __m256i*)(in + i * 4));
+		__m256i v1 = _mm256_loadu_si256((const __m256i*)(in + i * 4 + 32));
+		__m256i l0 = _mm256_srai_epi32(_mm256_slli_epi32(v0, 16), 16);
+		__m256i l1 = _mm256_srai_epi32(_mm256_slli_epi32(v1, 16), 16);
+		__m256i r0 = _mm256_srai_epi32(v0, 16);
+		__m256i r1 = _mm256_srai_epi32(v1, 16);
+		// the pack works per 128 bit lane; put the quarters back in order
+		__m256i l = _mm256_permute4x64_epi64(_mm256_packs_epi32(l0, l1), _MM_SHUFFLE(3, 1, 2, 0));
+		__m256i r = _mm256_permute4x64_epi64(_mm256_packs_epi32(r0, r1), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i*)(a + i * 2), l);
+		_mm256_storeu_si256((__m256i*)(b + i * 2), r);
+	}
+	return i;
+}
+
+static int64_t split4_32_avx2(const char* in, int64_t frames, char* const* out) {
+	// [a0 b0 c0 d0 a1 b1 c1 d1] -> [a0 a1 b0 b1 c0 c1 d0 d1]
+	const __m256i pairs = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	int64_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		const char* p = in + i * 16;
+		__m256i q0 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(p)), pairs);
+		__m256i q1 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(p + 32)), pairs);
+		__m256i q2 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(p + 64)), pairs);
+		__m256i q3 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(p + 96)), pairs);
+		// low lane a / b, high lane c / d, frames 0..3 and 4..7
+		__m256i ac0 = _mm256_unpacklo_epi64(q0, q1);
+		__m256i bd0 = _mm256_unpackhi_epi64(q0, q1);
+		__m256i ac1 = _mm256_unpacklo_epi64(q2, q3);
+		__m256i bd1 = _mm256_unpackhi_epi64(q2, q3);
+		_mm256_storeu_si256((__m256i*)(out[0] + i * 4), _mm256_permute2x128_si256(ac0, ac1, 0x20));
+		_mm256_storeu_si256((__m256i*)(out[1] + i * 4), _mm256_permute2x128_si256(bd0, bd1, 0x20));
+		_mm256_storeu_si256((__m256i*)(out[2] + i * 4), _mm256_permute2x128_si256(ac0, ac1, 0x31));
+		_mm256_storeu_si256((__m256i*)(out[3] + i * 4), _mm256_permute2x128_si256(bd0, bd1, 0x31));
+	}
+	return i;
+}
+
+bool dsp_kernels_avx2(DspKernels* k) {
+	k->dot = dot_avx2;
+	k->fold_dot = fold_dot_avx2;
+	k->fold_dot3 = fold_dot3_avx2;
+	k->iir_rows = iir_rows_avx2;
+	k->lerp = lerp_avx2;
+	k->dot_rows = dot_rows_avx2;
+	k->fold_rows = fold_rows_avx2;
+	k->fold_rows3 = fold_rows3_avx2;
+	k->s16_to_f32 = s16_to_f32_avx2;
+	k->f32_to_s16 = f32_to_s16_avx2;
+	k->s32_to_f32 = s32_to_f32_avx2;
+	k->f32_to_s32 = f32_to_s32_avx2;
+	k->bswap16 = bswap16_avx2;
+	k->bswap32 = bswap32_avx2;
+	k->bswap64 = bswap64_avx2;
+	k->split2_16 = split2_16_avx2;
+	k->split2_32 = split2_32_avx2;
+	k->split4_32 = split4_32_avx2;
+	return true;
+}
+
+#else
+
+bool dsp_kernels_avx2(DspKernels*) {
+	return false;
+}
+
+#endif
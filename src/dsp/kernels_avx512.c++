@@ -0,0 +1,144 @@
+#include "dsp/kernels.h++"
+
+#include <cstddef>
+
+// built with -mavx512f -mfma (/arch:AVX512); empty otherwise. Only the
+// floating point kernels gain from the width, the rest stay AVX2.
+#if defined(__AVX512F__)
+#include <immintrin.h>
+
+// by hand: the reduce and permute helpers of some GCC versions trip
+// -Wuninitialized
+static inline double hsum(__m512d v) {
+	double t[8];
+	_mm512_storeu_pd(t, v);
+	return ((t[0] + t[1]) + (t[2] + t[3])) + ((t[4] + t[5]) + (t[6] + t[7]));
+}
+
+static double dot_avx512(const double* a, const double* b, int n) {
+	__m512d s0 = _mm512_setzero_pd();
+	__m512d s1 = _mm512_setzero_pd();
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), s0);
+		s1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8), s1);
+	}
+	if (i + 8 <= n) {
+		s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), s0);
+		i += 8;
+	}
+	double acc = hsum(_mm512_add_pd(s0, s1));
+	for (; i<n; i++) {
+		acc += a[i] * b[i];
+	}
+	return acc;
+}
+
+static double fold_dot_avx512(const double* h, const double* lo, const double* hi, int n) {
+	const __m512i reverse = _mm512_set_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+	__m512d s0 = _mm512_setzero_pd();
+	__m512d s1 = _mm512_setzero_pd();
+	int k = 0;
+	for (; k + 16 <= n; k += 16) {
+		__m512d l0 = _mm512_maskz_permutexvar_pd(0xff, reverse, _mm512_loadu_pd(lo - k - 7));
+		__m512d l1 = _mm512_maskz_permutexvar_pd(0xff, reverse, _mm512_loadu_pd(lo - k - 15));
+		s0 = _mm512_fmadd_pd(_mm512_loadu_pd(h + k), _mm512_add_pd(l0, _mm512_loadu_pd(hi + k)), s0);
+		s1 = _mm512_fmadd_pd(_mm512_loadu_pd(h + k + 8), _mm512_add_pd(l1, _mm512_loadu_pd(hi + k + 8)), s1);
+	}
+	if (k + 8 <= n) {
+		__m512d l0 = _mm512_maskz_permutexvar_pd(0xff, reverse, _mm512_loadu_pd(lo - k - 7));
+		s0 = _mm512_fmadd_pd(_mm512_loadu_pd(h + k), _mm512_add_pd(l0, _mm512_loadu_pd(hi + k)), s0);
+		k += 8;
+	}
+	double acc = hsum(_mm512_add_pd(s0, s1));
+	for (; k<n; k++) {
+		acc += h[k] * (lo[-k] + hi[k]);
+	}
+	return acc;
+}
+
+static void iir_rows_avx512(const double* const* rows, const double* A, const double* B,
+                            int taps, int channels, double* a, double* y) {
+	int ch = 0;
+	for (; ch < channels; ch += 8) {
+		// the last group is masked, so any channel count stays in one pass
+		__mmask8 m = (channels - ch >= 8) ? (__mmask8) 0xff : (__mmask8) ((1u << (channels - ch)) - 1);
+		__m512d va = _mm512_maskz_loadu_pd(m, a + ch);
+		__m512d vy = _mm512_maskz_loadu_pd(m, y + ch);
+		for (int i=1; i<=taps; i++) {
+			__m512d w = _mm512_maskz_loadu_pd(m, rows[i - 1] + ch);
+			va = _mm512_fmadd_pd(_mm512_set1_pd(A[i]), w, va);
+			vy = _mm512_fmadd_pd(_mm512_set1_pd(B[i]), w, vy);
+		}
+		_mm512_mask_storeu_pd(a + ch, m, va);
+		_mm512_mask_storeu_pd(y + ch, m, vy);
+	}
+}
+
+static void lerp_avx512(const double* x1, const double* x0, double t, int n, double* out) {
+	__m512d vt = _mm512_set1_pd(t);
+	for (int i=0; i<n; i += 8) {
+		__mmask8 m = (n - i >= 8) ? (__mmask8) 0xff : (__mmask8) ((1u << (n - i)) - 1);
+		__m512d a = _mm512_maskz_loadu_pd(m, x1 + i);
+		__m512d d = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, x0 + i), a);
+		_mm512_mask_storeu_pd(out + i, m, _mm512_fmadd_pd(d, vt, a));
+	}
+}
+
+// the last group of channels is masked, as in iir_rows_avx512
+static void dot_rows_avx512(const double* h, const double* x, int n, int channels, double* y) {
+	for (int ch=0; ch<channels; ch += 8) {
+		__mmask8 m = (channels - ch >= 8) ? (__mmask8) 0xff : (__mmask8) ((1u << (channels - ch)) - 1);
+		__m512d acc = _mm512_maskz_loadu_pd(m, y + ch);
+		for (int k=0; k<n; k++) {
+			__m512d r = _mm512_maskz_loadu_pd(m, x + (ptrdiff_t) k * channels + ch);
+			acc = _mm512_fmadd_pd(_mm512_set1_pd(h[k]), r, acc);
+		}
+		_mm512_mask_storeu_pd(y + ch, m, acc);
+	}
+}
+
+static void fold_rows_avx512(const double* h, const double* lo, const double* hi, int n, int channels, double* y) {
+	for (int ch=0; ch<channels; ch += 8) {
+		__mmask8 m = (channels - ch >= 8) ? (__mmask8) 0xff : (__mmask8) ((1u << (channels - ch)) - 1);
+		__m512d acc = _mm512_maskz_loadu_pd(m, y + ch);
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) k * channels;
+			__m512d r = _mm512_add_pd(_mm512_maskz_loadu_pd(m, lo - off + ch), _mm512_maskz_loadu_pd(m, hi + off + ch));
+			acc = _mm512_fmadd_pd(_mm512_set1_pd(h[k]), r, acc);
+		}
+		_mm512_mask_storeu_pd(y + ch, m, acc);
+	}
+}
+
+static void fold_rows3_avx512(const double* h, const double* c, int n, int channels, double* y) {
+	for (int ch=0; ch<channels; ch += 8) {
+		__mmask8 m = (channels - ch >= 8) ? (__mmask8) 0xff : (__mmask8) ((1u << (channels - ch)) - 1);
+		__m512d acc = _mm512_maskz_loadu_pd(m, y + ch);
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) (3 * (k / 2) + 1 + (k % 2)) * channels;
+			__m512d r = _mm512_add_pd(_mm512_maskz_loadu_pd(m, c - off + ch), _mm512_maskz_loadu_pd(m, c + off + ch));
+			acc = _mm512_fmadd_pd(_mm512_set1_pd(h[k]), r, acc);
+		}
+		_mm512_mask_storeu_pd(y + ch, m, acc);
+	}
+}
+
+bool dsp_kernels_avx512(DspKernels* k) {
+	k->dot = dot_avx512;
+	k->fold_dot = fold_dot_avx512;
+	k->iir_rows = iir_rows_avx512;
+	k->lerp = lerp_avx512;
+	k->dot_rows = dot_rows_avx512;
+	k->fold_rows = fold_rows_avx512;
+	k->fold_rows3 = fold_rows3_avx512;
+	return true;
+}
+
+#else
+
+bool dsp_kernels_avx512(DspKernels*) {
+	return false;
+}
+
+#endif
@@ -0,0 +1,310 @@
+#include "dsp/kernels.h++"
+
+#include <cstddef>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+// double precision lanes need AArch64
+#if defined(__aarch64__)
+
+static double dot_neon(const double* a, const double* b, int n) {
+	float64x2_t s0 = vdupq_n_f64(0);
+	float64x2_t s1 = vdupq_n_f64(0);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		s0 = vfmaq_f64(s0, vld1q_f64(a + i), vld1q_f64(b + i));
+		s1 = vfmaq_f64(s1, vld1q_f64(a + i + 2), vld1q_f64(b + i + 2));
+	}
+	double acc = vaddvq_f64(vaddq_f64(s0, s1));
+	for (; i<n; i++) {
+		acc += a[i] * b[i];
+	}
+	return acc;
+}
+
+static inline float64x2_t load_reversed(const double* p) {
+	float64x2_t v = vld1q_f64(p);
+	return vextq_f64(v, v, 1);
+}
+
+static double fold_dot_neon(const double* h, const double* lo, const double* hi, int n) {
+	float64x2_t s0 = vdupq_n_f64(0);
+	float64x2_t s1 = vdupq_n_f64(0);
+	int k = 0;
+	for (; k + 4 <= n; k += 4) {
+		float64x2_t x0 = vaddq_f64(load_reversed(lo - k - 1), vld1q_f64(hi + k));
+		float64x2_t x1 = vaddq_f64(load_reversed(lo - k - 3), vld1q_f64(hi + k + 2));
+		s0 = vfmaq_f64(s0, vld1q_f64(h + k), x0);
+		s1 = vfmaq_f64(s1, vld1q_f64(h + k + 2), x1);
+	}
+	double acc = vaddvq_f64(vaddq_f64(s0, s1));
+	for (; k<n; k++) {
+		acc += h[k] * (lo[-k] + hi[k]);
+	}
+	return acc;
+}
+
+static double fold_dot3_neon(const double* h, const double* c, int n) {
+	float64x2_t s = vdupq_n_f64(0);
+	for (int k=0; k + 2 <= n; k += 2) {
+		int o = 3 * (k / 2) + 1;
+		s = vfmaq_f64(s, vld1q_f64(h + k), vaddq_f64(load_reversed(c - o - 1), vld1q_f64(c + o)));
+	}
+	return vaddvq_f64(s);
+}
+
+static void iir_rows_neon(const double* const* rows, const double* A, const double* B,
+                          int taps, int channels, double* a, double* y) {
+	int ch = 0;
+	for (; ch + 2 <= channels; ch += 2) {
+		float64x2_t va = vld1q_f64(a + ch);
+		float64x2_t vy = vld1q_f64(y + ch);
+		for (int i=1; i<=taps; i++) {
+			float64x2_t w = vld1q_f64(rows[i - 1] + ch);
+			va = vfmaq_n_f64(va, w, A[i]);
+			vy = vfmaq_n_f64(vy, w, B[i]);
+		}
+		vst1q_f64(a + ch, va);
+		vst1q_f64(y + ch, vy);
+	}
+	for (; ch<channels; ch++) {
+		for (int i=1; i<=taps; i++) {
+			a[ch] += A[i] * rows[i - 1][ch];
+			y[ch] += B[i] * rows[i - 1][ch];
+		}
+	}
+}
+
+static void lerp_neon(const double* x1, const double* x0, double t, int n, double* out) {
+	int i = 0;
+	for (; i + 2 <= n; i += 2) {
+		float64x2_t a = vld1q_f64(x1 + i);
+		vst1q_f64(out + i, vfmaq_n_f64(a, vsubq_f64(vld1q_f64(x0 + i), a), t));
+	}
+	for (; i<n; i++) {
+		out[i] = x1[i] + (x0[i] - x1[i]) * t;
+	}
+}
+
+static void dot_rows_neon(const double* h, const double* x, int n, int channels, double* y) {
+	int ch = 0;
+	for (; ch + 2 <= channels; ch += 2) {
+		float64x2_t acc = vld1q_f64(y + ch);
+		for (int k=0; k<n; k++) {
+			float64x2_t r = vld1q_f64(x + (ptrdiff_t) k * channels + ch);
+			acc = vfmaq_n_f64(acc, r, h[k]);
+		}
+		vst1q_f64(y + ch, acc);
+	}
+	for (; ch<channels; ch++) {
+		for (int k=0; k<n; k++) {
+			y[ch] += h[k] * x[(ptrdiff_t) k * channels + ch];
+		}
+	}
+}
+
+static void fold_rows_neon(const double* h, const double* lo, const double* hi, int n, int channels, double* y) {
+	int ch = 0;
+	for (; ch + 2 <= channels; ch += 2) {
+		float64x2_t acc = vld1q_f64(y + ch);
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) k * channels;
+			float64x2_t r = vaddq_f64(vld1q_f64(lo - off + ch), vld1q_f64(hi + off + ch));
+			acc = vfmaq_n_f64(acc, r, h[k]);
+		}
+		vst1q_f64(y + ch, acc);
+	}
+	for (; ch<channels; ch++) {
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) k * channels;
+			y[ch] += h[k] * (lo[ch - off] + hi[off + ch]);
+		}
+	}
+}
+
+static void fold_rows3_neon(const double* h, const double* c, int n, int channels, double* y) {
+	int ch = 0;
+	for (; ch + 2 <= channels; ch += 2) {
+		float64x2_t acc = vld1q_f64(y + ch);
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) (3 * (k / 2) + 1 + (k % 2)) * channels;
+			float64x2_t r = vaddq_f64(vld1q_f64(c - off + ch), vld1q_f64(c + off + ch));
+			acc = vfmaq_n_f64(acc, r, h[k]);
+		}
+		vst1q_f64(y + ch, acc);
+	}
+	for (; ch<channels; ch++) {
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) (3 * (k / 2) + 1 + (k % 2)) * channels;
+			y[ch] += h[k] * (c[ch - off] + c[off + ch]);
+		}
+	}
+}
+
+static void s16_to_f32_neon(const int16_t* in, int n, float* out) {
+	const float32x4_t scale = vdupq_n_f32(1.0f / 32768.0f);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t v = vld1q_s16(in + i);
+		vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+		vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+	}
+	for (; i<n; i++) {
+		out[i] = in[i] * (1.0f / 32768.0f);
+	}
+}
+
+static void f32_to_s16_neon(const float* in, int n, int16_t* out) {
+	const float32x4_t scale = vdupq_n_f32(32768.0f);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		// round to nearest, then the narrowing saturates
+		int32x4_t a = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i), scale));
+		int32x4_t b = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i + 4), scale));
+		vst1q_s16(out + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+	}
+	for (; i<n; i++) {
+		float y = in[i] * 32768.0f;
+		y = y < -32768.0f ? -32768.0f : (y > 32767.0f ? 32767.0f : y);
+		out[i] = (int16_t) vcvtns_s32_f32(y);
+	}
+}
+
+static void s32_to_f32_neon(const int32_t* in, int n, int shift, float* out) {
+	const float32x4_t scale = vdupq_n_f32(1.0f / 2147483648.0f);
+	const int32x4_t count = vdupq_n_s32(shift);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		int32x4_t v = vshlq_s32(vld1q_s32(in + i), count);
+		vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(v), scale));
+	}
+	for (; i<n; i++) {
+		out[i] = (float) (int32_t) ((uint32_t) in[i] << shift) * (1.0f / 2147483648.0f);
+	}
+}
+
+static void f32_to_s32_neon(const float* in, int n, int bits, int32_t* out) {
+	const float s = (float) (1u << (bits - 1));
+	const float32x4_t scale = vdupq_n_f32(s);
+	const float32x4_t lo = vdupq_n_f32(-s);
+	const float32x4_t hi = vdupq_n_f32(kernel_s32_limit(bits));
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t y = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(in + i), scale), lo), hi);
+		vst1q_s32(out + i, vcvtnq_s32_f32(y));
+	}
+	for (; i<n; i++) {
+		float y = in[i] * s;
+		y = y < -s ? -s : (y > kernel_s32_limit(bits) ? kernel_s32_limit(bits) : y);
+		out[i] = vcvtns_s32_f32(y);
+	}
+}
+
+#endif
+
+// reverse each `size` byte word of a tail
+static void bswap_tail(const char* p, int n, int size, char* q) {
+	for (int i=0; i<n; i++) {
+		char w[8];
+		for (int j=0; j<size; j++) {
+			w[j] = p[size * i + size - 1 - j];
+		}
+		for (int j=0; j<size; j++) {
+			q[size * i + j] = w[j];
+		}
+	}
+}
+
+static void bswap16_neon(const void* in, int n, void* out) {
+	const char* p = (const char*) in;
+	char* q = (char*) out;
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		vst1q_u8((uint8_t*)(q + 2 * i), vrev16q_u8(vld1q_u8((const uint8_t*)(p + 2 * i))));
+	}
+	bswap_tail(p + 2 * i, n - i, 2, q + 2 * i);
+}
+
+static void bswap32_neon(const void* in, int n, void* out) {
+	const char* p = (const char*) in;
+	char* q = (char*) out;
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		vst1q_u8((uint8_t*)(q + 4 * i), vrev32q_u8(vld1q_u8((const uint8_t*)(p + 4 * i))));
+	}
+	bswap_tail(p + 4 * i, n - i, 4, q + 4 * i);
+}
+
+static void bswap64_neon(const void* in, int n, void* out) {
+	const char* p = (const char*) in;
+	char* q = (char*) out;
+	int i = 0;
+	for (; i + 2 <= n; i += 2) {
+		vst1q_u8((uint8_t*)(q + 8 * i), vrev64q_u8(vld1q_u8((const uint8_t*)(p + 8 * i))));
+	}
+	bswap_tail(p + 8 * i, n - i, 8, q + 8 * i);
+}
+
+static int64_t split2_32_neon(const char* in, int64_t frames, char* a, char* b) {
+	int64_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		uint32x4x2_t v = vld2q_u32((const uint32_t*)(in + i * 8));
+		vst1q_u32((uint32_t*)(a + i * 4), v.val[0]);
+		vst1q_u32((uint32_t*)(b + i * 4), v.val[1]);
+	}
+	return i;
+}
+
+static int64_t split2_16_neon(const char* in, int64_t frames, char* a, char* b) {
+	int64_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		uint16x8x2_t v = vld2q_u16((const uint16_t*)(in + i * 4));
+		vst1q_u16((uint16_t*)(a + i * 2), v.val[0]);
+		vst1q_u16((uint16_t*)(b + i * 2), v.val[1]);
+	}
+	return i;
+}
+
+static int64_t split4_32_neon(const char* in, int64_t frames, char* const* out) {
+	int64_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		uint32x4x4_t v = vld4q_u32((const uint32_t*)(in + i * 16));
+		for (int c=0; c<4; c++) {
+			vst1q_u32((uint32_t*)(out[c] + i * 4), v.val[c]);
+		}
+	}
+	return i;
+}
+
+bool dsp_kernels_neon(DspKernels* k) {
+#if defined(__aarch64__)
+	k->dot = dot_neon;
+	k->fold_dot = fold_dot_neon;
+	k->fold_dot3 = fold_dot3_neon;
+	k->iir_rows = iir_rows_neon;
+	k->lerp = lerp_neon;
+	k->dot_rows = dot_rows_neon;
+	k->fold_rows = fold_rows_neon;
+	k->fold_rows3 = fold_rows3_neon;
+	k->s16_to_f32 = s16_to_f32_neon;
+	k->f32_to_s16 = f32_to_s16_neon;
+	k->s32_to_f32 = s32_to_f32_neon;
+	k->f32_to_s32 = f32_to_s32_neon;
+#endif
+	k->bswap16 = bswap16_neon;
+	k->bswap32 = bswap32_neon;
+	k->bswap64 = bswap64_neon;
+	k->split2_16 = split2_16_neon;
+	k->split2_32 = split2_32_neon;
+	k->split4_32 = split4_32_neon;
+	return true;
+}
+
+#else
+
+bool dsp_kernels_neon(DspKernels*) {
+	return false;
+}
+
+#endif
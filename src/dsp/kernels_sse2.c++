@@ -0,0 +1,345 @@
+#include "dsp/kernels.h++"
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+static inline double hsum(__m128d v) {
+	return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static double dot_sse2(const double* a, const double* b, int n) {
+	__m128d s0 = _mm_setzero_pd();
+	__m128d s1 = _mm_setzero_pd();
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+		s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+	}
+	double acc = hsum(_mm_add_pd(s0, s1));
+	for (; i<n; i++) {
+		acc += a[i] * b[i];
+	}
+	return acc;
+}
+
+// lo[-k - 1], lo[-k] swapped to line up with hi[k], hi[k + 1]
+static inline __m128d load_reversed(const double* p) {
+	__m128d v = _mm_loadu_pd(p);
+	return _mm_shuffle_pd(v, v, 1);
+}
+
+static double fold_dot_sse2(const double* h, const double* lo, const double* hi, int n) {
+	__m128d s0 = _mm_setzero_pd();
+	__m128d s1 = _mm_setzero_pd();
+	int k = 0;
+	for (; k + 4 <= n; k += 4) {
+		__m128d x0 = _mm_add_pd(load_reversed(lo - k - 1), _mm_loadu_pd(hi + k));
+		__m128d x1 = _mm_add_pd(load_reversed(lo - k - 3), _mm_loadu_pd(hi + k + 2));
+		s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(h + k), x0));
+		s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(h + k + 2), x1));
+	}
+	double acc = hsum(_mm_add_pd(s0, s1));
+	for (; k<n; k++) {
+		acc += h[k] * (lo[-k] + hi[k]);
+	}
+	return acc;
+}
+
+static double fold_dot3_sse2(const double* h, const double* c, int n) {
+	__m128d s = _mm_setzero_pd();
+	for (int k=0; k + 2 <= n; k += 2) {
+		int o = 3 * (k / 2) + 1;
+		__m128d x = _mm_add_pd(load_reversed(c - o - 1), _mm_loadu_pd(c + o));
+		s = _mm_add_pd(s, _mm_mul_pd(_mm_loadu_pd(h + k), x));
+	}
+	return hsum(s);
+}
+
+static void iir_rows_sse2(const double* const* rows, const double* A, const double* B,
+                          int taps, int channels, double* a, double* y) {
+	int ch = 0;
+	for (; ch + 2 <= channels; ch += 2) {
+		__m128d va = _mm_loadu_pd(a + ch);
+		__m128d vy = _mm_loadu_pd(y + ch);
+		for (int i=1; i<=taps; i++) {
+			__m128d w = _mm_loadu_pd(rows[i - 1] + ch);
+			va = _mm_add_pd(va, _mm_mul_pd(_mm_set1_pd(A[i]), w));
+			vy = _mm_add_pd(vy, _mm_mul_pd(_mm_set1_pd(B[i]), w));
+		}
+		_mm_storeu_pd(a + ch, va);
+		_mm_storeu_pd(y + ch, vy);
+	}
+	for (; ch<channels; ch++) {
+		for (int i=1; i<=taps; i++) {
+			a[ch] += A[i] * rows[i - 1][ch];
+			y[ch] += B[i] * rows[i - 1][ch];
+		}
+	}
+}
+
+static void lerp_sse2(const double* x1, const double* x0, double t, int n, double* out) {
+	__m128d vt = _mm_set1_pd(t);
+	int i = 0;
+	for (; i + 2 <= n; i += 2) {
+		__m128d a = _mm_loadu_pd(x1 + i);
+		__m128d d = _mm_sub_pd(_mm_loadu_pd(x0 + i), a);
+		_mm_storeu_pd(out + i, _mm_add_pd(a, _mm_mul_pd(d, vt)));
+	}
+	for (; i<n; i++) {
+		out[i] = x1[i] + (x0[i] - x1[i]) * t;
+	}
+}
+
+static void dot_rows_sse2(const double* h, const double* x, int n, int channels, double* y) {
+	int ch = 0;
+	for (; ch + 2 <= channels; ch += 2) {
+		__m128d acc = _mm_loadu_pd(y + ch);
+		for (int k=0; k<n; k++) {
+			__m128d r = _mm_loadu_pd(x + (ptrdiff_t) k * channels + ch);
+			acc = _mm_add_pd(acc, _mm_mul_pd(_mm_set1_pd(h[k]), r));
+		}
+		_mm_storeu_pd(y + ch, acc);
+	}
+	for (; ch<channels; ch++) {
+		for (int k=0; k<n; k++) {
+			y[ch] += h[k] * x[(ptrdiff_t) k * channels + ch];
+		}
+	}
+}
+
+static void fold_rows_sse2(const double* h, const double* lo, const double* hi, int n, int channels, double* y) {
+	int ch = 0;
+	for (; ch + 2 <= channels; ch += 2) {
+		__m128d acc = _mm_loadu_pd(y + ch);
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) k * channels;
+			__m128d r = _mm_add_pd(_mm_loadu_pd(lo - off + ch), _mm_loadu_pd(hi + off + ch));
+			acc = _mm_add_pd(acc, _mm_mul_pd(_mm_set1_pd(h[k]), r));
+		}
+		_mm_storeu_pd(y + ch, acc);
+	}
+	for (; ch<channels; ch++) {
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) k * channels;
+			y[ch] += h[k] * (lo[ch - off] + hi[off + ch]);
+		}
+	}
+}
+
+static void fold_rows3_sse2(const double* h, const double* c, int n, int channels, double* y) {
+	int ch = 0;
+	for (; ch + 2 <= channels; ch += 2) {
+		__m128d acc = _mm_loadu_pd(y + ch);
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) (3 * (k / 2) + 1 + (k % 2)) * channels;
+			__m128d r = _mm_add_pd(_mm_loadu_pd(c - off + ch), _mm_loadu_pd(c + off + ch));
+			acc = _mm_add_pd(acc, _mm_mul_pd(_mm_set1_pd(h[k]), r));
+		}
+		_mm_storeu_pd(y + ch, acc);
+	}
+	for (; ch<channels; ch++) {
+		for (int k=0; k<n; k++) {
+			ptrdiff_t off = (ptrdiff_t) (3 * (k / 2) + 1 + (k % 2)) * channels;
+			y[ch] += h[k] * (c[ch - off] + c[off + ch]);
+		}
+	}
+}
+
+static void s16_to_f32_sse2(const int16_t* in, int n, float* out) {
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+		// sign extend by unpacking into the high half and shifting down
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	for (; i<n; i++) {
+		out[i] = in[i] * (1.0f / 32768.0f);
+	}
+}
+
+static void f32_to_s16_sse2(const float* in, int n, int16_t* out) {
+	const __m128 scale = _mm_set1_ps(32768.0f);
+	const __m128 lo = _mm_set1_ps(-32768.0f);
+	const __m128 hi = _mm_set1_ps(32767.0f);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		// clamp first: out of range floats convert to INT_MIN
+		__m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), lo), hi);
+		__m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), lo), hi);
+		__m128i v = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+		_mm_storeu_si128((__m128i*)(out + i), v);
+	}
+	for (; i<n; i++) {
+		float y = in[i] * 32768.0f;
+		y = y < -32768.0f ? -32768.0f : (y > 32767.0f ? 32767.0f : y);
+		out[i] = (int16_t) _mm_cvtss_si32(_mm_set_ss(y));
+	}
+}
+
+static void s32_to_f32_sse2(const int32_t* in, int n, int shift, float* out) {
+	const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_sll_epi32(_mm_loadu_si128((const __m128i*)(in + i)), count);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+	for (; i<n; i++) {
+		out[i] = (float) (int32_t) ((uint32_t) in[i] << shift) * (1.0f / 2147483648.0f);
+	}
+}
+
+static void f32_to_s32_sse2(const float* in, int n, int bits, int32_t* out) {
+	const float s = (float) (1u << (bits - 1));
+	const __m128 scale = _mm_set1_ps(s);
+	const __m128 lo = _mm_set1_ps(-s);
+	const __m128 hi = _mm_set1_ps(kernel_s32_limit(bits));
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 y = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), lo), hi);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_cvtps_epi32(y));
+	}
+	for (; i<n; i++) {
+		__m128 y = _mm_min_ss(_mm_max_ss(_mm_mul_ss(_mm_set_ss(in[i]), scale), lo), hi);
+		out[i] = _mm_cvtss_si32(y);
+	}
+}
+
+static inline __m128i swap16(__m128i v) {
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static inline __m128i swap32(__m128i v) {
+	v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+	return swap16(v);
+}
+
+static void bswap16_sse2(const void* in, int n, void* out) {
+	const char* p = (const char*) in;
+	char* q = (char*) out;
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm_storeu_si128((__m128i*)(q + 2 * i), swap16(_mm_loadu_si128((const __m128i*)(p + 2 * i))));
+	}
+	for (; i<n; i++) {
+		char a = p[2 * i], b = p[2 * i + 1];
+		q[2 * i] = b;
+		q[2 * i + 1] = a;
+	}
+}
+
+static void bswap32_sse2(const void* in, int n, void* out) {
+	const char* p = (const char*) in;
+	char* q = (char*) out;
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_si128((__m128i*)(q + 4 * i), swap32(_mm_loadu_si128((const __m128i*)(p + 4 * i))));
+	}
+	for (; i<n; i++) {
+		int w;
+		memcpy(&w, p + 4 * i, 4);
+		w = _mm_cvtsi128_si32(swap32(_mm_cvtsi32_si128(w)));
+		memcpy(q + 4 * i, &w, 4);
+	}
+}
+
+static void bswap64_sse2(const void* in, int n, void* out) {
+	const char* p = (const char*) in;
+	char* q = (char*) out;
+	int i = 0;
+	for (; i + 2 <= n; i += 2) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(p + 8 * i));
+		_mm_storeu_si128((__m128i*)(q + 8 * i), swap32(_mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1))));
+	}
+	for (; i<n; i++) {
+		__m128i v = _mm_loadl_epi64((const __m128i*)(p + 8 * i));
+		_mm_storel_epi64((__m128i*)(q + 8 * i), swap32(_mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1))));
+	}
+}
+
+static int64_t split2_32_sse2(const char* in, int64_t frames, char* a, char* b) {
+	int64_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128i v0 = _mm_loadu_si128((const __m128i*)(in + i * 8));
+		__m128i v1 = _mm_loadu_si128((const __m128i*)(in + i * 8 + 16));
+		// [l0 r0 l1 r1] -> [l0 l1 r0 r1]
+		__m128i s0 = _mm_shuffle_epi32(v0, _MM_SHUFFLE(3, 1, 2, 0));
+		__m128i s1 = _mm_shuffle_epi32(v1, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm_storeu_si128((__m128i*)(a + i * 4), _mm_unpacklo_epi64(s0, s1));
+		_mm_storeu_si128((__m128i*)(b + i * 4), _mm_unpackhi_epi64(s0, s1));
+	}
+	return i;
+}
+
+static int64_t split2_16_sse2(const char* in, int64_t frames, char* a, char* b) {
+	int64_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		__m128i v0 = _mm_loadu_si128((const __m128i*)(in + i * 4));
+		__m128i v1 = _mm_loadu_si128((const __m128i*)(in + i * 4 + 16));
+		// sign extend each half to 32 bits so the saturating pack is exact
+		__m128i l0 = _mm_srai_epi32(_mm_slli_epi32(v0, 16), 16);
+		__m128i l1 = _mm_srai_epi32(_mm_slli_epi32(v1, 16), 16);
+		__m128i r0 = _mm_srai_epi32(v0, 16);
+		__m128i r1 = _mm_srai_epi32(v1, 16);
+		_mm_storeu_si128((__m128i*)(a + i * 2), _mm_packs_epi32(l0, l1));
+		_mm_storeu_si128((__m128i*)(b + i * 2), _mm_packs_epi32(r0, r1));
+	}
+	return i;
+}
+
+static int64_t split4_32_sse2(const char* in, int64_t frames, char* const* out) {
+	int64_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		const char* p = in + i * 16;
+		__m128i r0 = _mm_loadu_si128((const __m128i*)(p));
+		__m128i r1 = _mm_loadu_si128((const __m128i*)(p + 16));
+		__m128i r2 = _mm_loadu_si128((const __m128i*)(p + 32));
+		__m128i r3 = _mm_loadu_si128((const __m128i*)(p + 48));
+		__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+		__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+		__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+		__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+		_mm_storeu_si128((__m128i*)(out[0] + i * 4), _mm_unpacklo_epi64(t0, t1));
+		_mm_storeu_si128((__m128i*)(out[1] + i * 4), _mm_unpackhi_epi64(t0, t1));
+		_mm_storeu_si128((__m128i*)(out[2] + i * 4), _mm_unpacklo_epi64(t2, t3));
+		_mm_storeu_si128((__m128i*)(out[3] + i * 4), _mm_unpackhi_epi64(t2, t3));
+	}
+	return i;
+}
+
+bool dsp_kernels_sse2(DspKernels* k) {
+	k->dot = dot_sse2;
+	k->fold_dot = fold_dot_sse2;
+	k->fold_dot3 = fold_dot3_sse2;
+	k->iir_rows = iir_rows_sse2;
+	k->lerp = lerp_sse2;
+	k->dot_rows = dot_rows_sse2;
+	k->fold_rows = fold_rows_sse2;
+	k->fold_rows3 = fold_rows3_sse2;
+	k->s16_to_f32 = s16_to_f32_sse2;
+	k->f32_to_s16 = f32_to_s16_sse2;
+	k->s32_to_f32 = s32_to_f32_sse2;
+	k->f32_to_s32 = f32_to_s32_sse2;
+	k->bswap16 = bswap16_sse2;
+	k->bswap32 = bswap32_sse2;
+	k->bswap64 = bswap64_sse2;
+	k->split2_16 = split2_16_sse2;
+	k->split2_32 = split2_32_sse2;
+	k->split4_32 = split4_32_sse2;
+	return true;
+}
+
+#else
+
+bool dsp_kernels_sse2(DspKernels*) {
+	return false;
+}
+
+#endif
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#include "dsp/multiresampler.h++"
+#include "dsp/resampler.h++"
+
+// Everything init() takes from the arena, in the same order
+size_t MultiResampler::arena_bytes(double Fs_in, double Fs_out, double Fs_padding, int channels) {
+	size_t bytes = ResamplePhase::arena_bytes(Fs_in, Fs_out);
+	bytes += dsp_arena_bytes<double>(ResamplePhase::untabled(Fs_in, Fs_out).max_output());
+	bytes += 3 * dsp_arena_bytes<double>(channels);
+	if (Fs_out > Fs_in) {
+		bytes += PolyphaseInterpolator::arena_bytes(Fs_in, Fs_out, Fs_padding, channels);
+	} else if (DecimatorCascade::supports(Fs_in, Fs_out)) {
+		bytes += DecimatorCascade::arena_bytes(Fs_in, Fs_out, Fs_padding, channels);
+	} else {
+		double B[RESAMPLER_LOWPASS_SIZE], A[RESAMPLER_LOWPASS_SIZE];
+		int n = resampler_lowpass(Fs_in, Fs_out, Fs_padding, B, A);
+		if (n > 0) {
+			bytes += 2 * dsp_arena_bytes<double>(n);
+			bytes += dsp_arena_bytes<double>((size_t) (n - 1) * channels);
+			bytes += dsp_arena_bytes<double>(channels);
+			bytes += dsp_arena_bytes<const double*>(n - 1);
+		}
+	}
+	return bytes;
+}
+
+MultiResampler::MultiResampler(double Fs_in, double Fs_out, double Fs_padding, int channels)
+: m_mem(nullptr), m_mem_bytes(0), m_owned(true), m_valid(false), m_channels(channels) {
+	size_t bytes = arena_bytes(Fs_in, Fs_out, Fs_padding, channels);
+	DspArena arena(malloc(bytes), bytes);
+	if (arena.base() == nullptr) {
+		arena = DspArena();
+	}
+	init(Fs_in, Fs_out, Fs_padding, arena);
+}
+
+MultiResampler::MultiResampler(double Fs_in, double Fs_out, double Fs_padding, int channels, DspArena& arena)
+: m_mem(nullptr), m_mem_bytes(0), m_owned(false), m_valid(false), m_channels(channels) {
+	init(Fs_in, Fs_out, Fs_padding, arena);
+}
+
+void MultiResampler::init(double Fs_in, double Fs_out, double Fs_padding, DspArena& arena) {
+	const int C = m_channels;
+	size_t start = arena.used();
+	int failures = arena.failures();
+
+	m_kernels = &dsp_kernels();
+	m_mode = MODE_LINEAR;
+	m_phase = ResamplePhase(Fs_in, Fs_out, arena);
+	m_t = arena.alloc<double>(m_phase.max_output());
+	m_x0 = arena.alloc<double>(C);
+	m_x1 = arena.alloc<double>(C);
+	m_zero = arena.alloc<double>(C);
+	m_B = m_A = m_w = m_acc = nullptr;
+	m_rows = nullptr;
+	m_taps = 0;
+	m_head = 0;
+
+	m_delay = 0;
+	if (Fs_out > Fs_in) {
+		m_mode = MODE_UP;
+		m_up = PolyphaseInterpolator(Fs_in, Fs_out, Fs_padding, arena, C);
+		m_delay = m_up.delay();
+	} else if (DecimatorCascade::supports(Fs_in, Fs_out)) {
+		m_mode = MODE_DECIMATE;
+		m_dec = DecimatorCascade(Fs_in, Fs_out, Fs_padding, arena, C);
+		m_delay = m_dec.delay();
+	} else {
+		double B[RESAMPLER_LOWPASS_SIZE], A[RESAMPLER_LOWPASS_SIZE];
+		int n = resampler_lowpass(Fs_in, Fs_out, Fs_padding, B, A);
+		if (n > 0) {
+			m_mode = MODE_LOWPASS;
+			m_B = arena.alloc<double>(n);
+			m_A = arena.alloc<double>(n);
+			m_w = arena.alloc<double>((size_t) (n - 1) * C);
+			m_acc = arena.alloc<double>(C);
+			m_rows = arena.alloc<const double*>(n - 1);
+			m_delay = resampler_group_delay(B, A, n);
+			if (m_B != nullptr && m_A != nullptr) {
+				// same conventions as DirectForm2Mono
+				for (int i=0; i<n; i++) {
+					m_B[i] = B[i];
+					m_A[i] = -A[i];
+				}
+				m_A[0] = 1.0;
+				m_taps = n - 1;
+			}
+		}
+	}
+	m_flush_inputs = (int) ceil(m_delay);
+
+	m_mem = arena.base() + start;
+	m_mem_bytes = arena.used() - start;
+	m_valid = arena.failures() == failures;
+}
+
+MultiResampler::~MultiResampler() {
+	release();
+}
+
+void MultiResampler::release() {
+	if (m_owned) {
+		free(m_mem);
+	}
+	m_mem = nullptr;
+	m_mem_bytes = 0;
+	m_owned = false;
+}
+
+void MultiResampler::relocate(const char* from, char* to) {
+	m_phase.relocate(from, to);
+	m_t = dsp_relocate(m_t, from, to);
+	m_x0 = dsp_relocate(m_x0, from, to);
+	m_x1 = dsp_relocate(m_x1, from, to);
+	m_zero = dsp_relocate(m_zero, from, to);
+	m_B = dsp_relocate(m_B, from, to);
+	m_A = dsp_relocate(m_A, from, to);
+	m_w = dsp_relocate(m_w, from, to);
+	m_acc = dsp_relocate(m_acc, from, to);
+	m_rows = dsp_relocate(m_rows, from, to);
+	m_up.relocate(from, to);
+	m_dec.relocate(from, to);
+}
+
+// everything but the block itself
+void MultiResampler::take_fields(const MultiResampler& o) {
+	m_valid = o.m_valid;
+	m_kernels = o.m_kernels;
+	m_mode = o.m_mode;
+	m_channels = o.m_channels;
+	m_phase = o.m_phase;
+	m_t = o.m_t;
+	m_delay = o.m_delay;
+	m_flush_inputs = o.m_flush_inputs;
+	m_x0 = o.m_x0;
+	m_x1 = o.m_x1;
+	m_zero = o.m_zero;
+	m_B = o.m_B;
+	m_A = o.m_A;
+	m_taps = o.m_taps;
+	m_head = o.m_head;
+	m_w = o.m_w;
+	m_acc = o.m_acc;
+	m_rows = o.m_rows;
+	m_up = o.m_up;
+	m_dec = o.m_dec;
+}
+
+MultiResampler::MultiResampler(const MultiResampler& o)
+: m_mem(nullptr), m_mem_bytes(0), m_owned(true) {
+	take_fields(o);
+	m_mem = (char*) malloc(o.m_mem_bytes);
+	if (m_mem == nullptr && o.m_mem_bytes > 0) {
+		m_valid = false;
+		return;
+	}
+	m_mem_bytes = o.m_mem_bytes;
+	memcpy(m_mem, o.m_mem, m_mem_bytes);
+	relocate(o.m_mem, m_mem);
+}
+
+MultiResampler::MultiResampler(MultiResampler&& o) noexcept
+: m_mem(o.m_mem), m_mem_bytes(o.m_mem_bytes), m_owned(o.m_owned) {
+	take_fields(o);
+	o.m_mem = nullptr;
+	o.m_mem_bytes = 0;
+	o.m_owned = false;
+	o.m_valid = false;
+}
+
+MultiResampler& MultiResampler::operator=(const MultiResampler& o) {
+	if (this != &o) {
+		*this = MultiResampler(o);
+	}
+	return *this;
+}
+
+MultiResampler& MultiResampler::operator=(MultiResampler&& o) noexcept {
+	if (this != &o) {
+		release();
+		m_mem = o.m_mem;
+		m_mem_bytes = o.m_mem_bytes;
+		m_owned = o.m_owned;
+		take_fields(o);
+		o.m_mem = nullptr;
+		o.m_mem_bytes = 0;
+		o.m_owned = false;
+		o.m_valid = false;
+	}
+	return *this;
+}
+
+// y[ch] = filtered frame[ch]; the history rows rotate instead of moving
+void MultiResampler::filter(const double* frame, double* y) {
+	const int C = m_channels;
+	double* a = m_acc;
+
+	for (int ch=0; ch<C; ch++) {
+		a[ch] = frame[ch];
+		y[ch] = 0.0;
+	}
+	for (int i=1; i<=m_taps; i++) {
+		m_rows[i - 1] = &m_w[(size_t) ((m_head + i - 1) % m_taps) * C];
+	}
+	m_kernels->iir_rows(m_rows, m_A, m_B, m_taps, C, a, y);
+
+	// the oldest row becomes w[n]
+	m_head = (m_head + m_taps - 1) % m_taps;
+	double* w0 = &m_w[(size_t) m_head * C];
+	const double B0 = m_B[0];
+	for (int ch=0; ch<C; ch++) {
+		w0[ch] = a[ch];
+		y[ch] += B0 * a[ch];
+	}
+}
+
+int MultiResampler::insert(const double* frame, double* out) {
+	const int C = m_channels;
+
+	if (m_mode == MODE_UP) {
+		return m_up.insert_frame(frame, out);
+	}
+	if (m_mode == MODE_DECIMATE) {
+		return m_dec.insert_frame(frame, out);
+	}
+
+	// m_x1 takes the previous input and m_x0 the new (filtered) one
+	std::swap(m_x0, m_x1);
+	if (m_taps > 0) {
+		filter(frame, m_x0);
+	} else {
+		std::copy(frame, frame + C, m_x0);
+	}
+
+	int n = m_phase.advance(m_t);
+	for (int i=0; i<n; i++) {
+		m_kernels->lerp(m_x1, m_x0, m_t[i], C, out);
+		out += C;
+	}
+	return n;
+}
+
+int MultiResampler::process(const double* in, int frames, double* out) {
+	int n = 0;
+	for (int i=0; i<frames; i++) {
+		n += insert(in + (size_t) i * m_channels, out + (size_t) n * m_channels);
+	}
+	return n;
+}
+
+int MultiResampler::flush(double* out) {
+	int n = 0;
+	for (int i=0; i<m_flush_inputs; i++) {
+		n += insert(m_zero, out + (size_t) n * m_channels);
+	}
+	return n;
+}
+
+void MultiResampler::reset() {
+	std::fill(m_x0, m_x0 + m_channels, 0.0);
+	std::fill(m_x1, m_x1 + m_channels, 0.0);
+	std::fill(m_w, m_w + (size_t) m_taps * m_channels, 0.0);
+	m_head = 0;
+	m_phase.reset();
+	if (m_mode == MODE_UP) {
+		m_up.reset();
+	}
+	if (m_mode == MODE_DECIMATE) {
+		m_dec.reset();
+	}
+}
+
+double MultiResampler::latency(void) const {
+	return m_delay / m_phase.rate();
+}
+
+//returns the maximum number of frames an insert method could return.
+//flush() may return up to max_flush().
+int MultiResampler::max_output(void) const {
+	return m_phase.max_output();
+}
+
+int MultiResampler::max_flush(void) const {
+	return m_flush_inputs * m_phase.max_output();
+}
@@ -0,0 +1,108 @@
+#ifndef SIGPROC_MULTIRESAMPLER_H
+#define SIGPROC_MULTIRESAMPLER_H
+
+#include <cstddef>
+
+#include "dsp/arena.h++"
+#include "dsp/decimator.h++"
+#include "dsp/kernels.h++"
+#include "dsp/phase.h++"
+#include "dsp/polyphase.h++"
+
+// Resamples every channel of an interleaved stream with one object.
+//
+// The paths and filters are Resampler's: a DecimatorCascade for
+// downsampling by 2s and 3s, the Chebyshev low pass and linear
+// interpolation for any other downsampling, a PolyphaseInterpolator for
+// upsampling. Each channel comes out as a Resampler would make it, up to
+// rounding. All channels share one ResamplePhase, and every filter
+// history and interpolation endpoint is stored with the channel index
+// innermost, so each tap and each output frame is a single loop over
+// contiguous channels (the iir_rows, lerp and *_rows kernels, see
+// DspKernels).
+//
+// Tables and histories live in one block of arena_bytes(), on the heap or
+// in a caller's arena, with the same rules as Resampler.
+class MultiResampler
+{
+public:
+    MultiResampler(double Fs_in, double Fs_out, double Fs_padding, int channels);
+    MultiResampler(double Fs_in, double Fs_out, double Fs_padding, int channels, DspArena& arena);
+    ~MultiResampler();
+
+    static size_t arena_bytes(double Fs_in, double Fs_out, double Fs_padding, int channels);
+
+    // as for Resampler: a copy gets its own heap block in the same state,
+    // a move leaves the source empty
+    MultiResampler(const MultiResampler& o);
+    MultiResampler(MultiResampler&& o) noexcept;
+    MultiResampler& operator=(const MultiResampler& o);
+    MultiResampler& operator=(MultiResampler&& o) noexcept;
+
+    bool valid(void) const { return m_valid; }
+
+    // One interleaved input frame; writes up to max_output() interleaved
+    // frames to out and returns how many.
+    int insert(const double* frame, double* out);
+
+    // `frames` interleaved input frames; out must hold
+    // frames * max_output() frames. Returns the frames written.
+    int process(const double* in, int frames, double* out);
+
+    int max_output(void) const;
+
+    // Same contract as Resampler: flush() feeds silence for the filter
+    // delay and writes up to max_flush() frames, reset() returns to the
+    // initial state and latency() is the filter delay in output frames.
+    int flush(double* out);
+    int max_flush(void) const;
+    void reset();
+    double latency(void) const;
+
+    int channels(void) const { return m_channels; }
+    bool exact(void) const { return m_phase.exact(); }
+
+private:
+    enum Mode {
+        MODE_LINEAR,            // interpolation only
+        MODE_LOWPASS,           // filter(), then interpolation
+        MODE_UP,                // m_up
+        MODE_DECIMATE,          // m_dec
+    };
+
+    void init(double Fs_in, double Fs_out, double Fs_padding, DspArena& arena);
+    void take_fields(const MultiResampler& o);
+    void relocate(const char* from, char* to);
+    void release();
+    void filter(const double* frame, double* y);
+
+    char* m_mem;                // this object's part of the arena
+    size_t m_mem_bytes;
+    bool m_owned;               // m_mem is our heap block
+    bool m_valid;
+
+    const DspKernels* m_kernels;
+    Mode m_mode;
+    int m_channels;
+    ResamplePhase m_phase;
+    double* m_t;                // interpolation weights of one insert
+    double m_delay;             // filter group delay in input frames
+    int m_flush_inputs;         // silent frames fed by flush()
+    double* m_x0;               // [channel]
+    double* m_x1;               // [channel]
+    double* m_zero;             // [channel], silence for flush()
+
+    // direct form 2 low pass; m_taps is 0 off the low pass path
+    double* m_B;
+    double* m_A;                // feedback, already negated
+    int m_taps;                 // history length, filter order
+    int m_head;                 // row holding w[n-1]
+    double* m_w;                // [tap][channel], circular over taps
+    double* m_acc;              // [channel] scratch
+    const double** m_rows;      // w[n-1] .. w[n-taps] for iir_rows
+
+    PolyphaseInterpolator m_up;
+    DecimatorCascade m_dec;
+};
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef SIGPROC_PHASE_H
+#define SIGPROC_PHASE_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "dsp/arena.h++"
+
+// Position of the output samples relative to the input samples.
+//
+// Output k sits at input position k * Fs_in / Fs_out. When both rates are
+// whole numbers the position is kept as an exact fraction p / L with
+// L / M = Fs_out / Fs_in reduced, so after n inputs exactly
+// floor((n - 1) * L / M) + 1 outputs have been produced no matter how
+// long the stream runs. The interpolation weight of each phase p is looked
+// up in a table built once (or scaled by 1 / L when L is too large for a
+// table), so advancing needs no division and no floating point compare.
+//
+// Other rates fall back to a double accumulator, which drifts by rounding
+// over very long streams.
+class ResamplePhase
+{
+public:
+    // rate 1, no table; a placeholder to assign a real phase to
+    ResamplePhase()
+    : m_exact(false), m_L(1), m_M(1), m_p(1), m_inv_L(1.0), m_table(nullptr), m_x(1.0), m_rate(1.0) {}
+
+    // the weight table (if any) on the heap
+    ResamplePhase(double Fs_in, double Fs_out) {
+        init(Fs_in, Fs_out);
+        if (table_size() > 0) {
+            m_own.resize(table_size());
+            m_table = m_own.data();
+            fill_table();
+        }
+    }
+
+    // the weight table (if any) in `arena`, which must have
+    // arena_bytes(Fs_in, Fs_out) free
+    ResamplePhase(double Fs_in, double Fs_out, DspArena& arena) {
+        init(Fs_in, Fs_out);
+        if (table_size() > 0) {
+            m_table = arena.alloc<double>(table_size());
+            if (m_table != nullptr) {
+                fill_table();
+            }
+        }
+    }
+
+    ResamplePhase(const ResamplePhase& o) {
+        *this = o;
+    }
+
+    ResamplePhase& operator=(const ResamplePhase& o) {
+        m_exact = o.m_exact;
+        m_L = o.m_L;
+        m_M = o.m_M;
+        m_p = o.m_p;
+        m_inv_L = o.m_inv_L;
+        m_own = o.m_own;
+        m_table = o.m_own.empty() ? o.m_table : m_own.data();
+        m_x = o.m_x;
+        m_rate = o.m_rate;
+        return *this;
+    }
+
+    // Same positions as ResamplePhase(Fs_in, Fs_out), with the weights
+    // computed instead of looked up; enough to size buffers with.
+    static ResamplePhase untabled(double Fs_in, double Fs_out) {
+        ResamplePhase phase;
+        phase.init(Fs_in, Fs_out);
+        return phase;
+    }
+
+    static size_t arena_bytes(double Fs_in, double Fs_out) {
+        size_t n = untabled(Fs_in, Fs_out).table_size();
+        return n > 0 ? dsp_arena_bytes<double>(n) : 0;
+    }
+
+    // the arena block holding the table was copied from `from` to `to`
+    void relocate(const char* from, char* to) {
+        if (m_own.empty()) {
+            m_table = dsp_relocate(m_table, from, to);
+        }
+    }
+
+    // Back to the state of a new object: the first input yields one
+    // output at weight 1, i.e. the input sample itself.
+    void reset() {
+        m_p = m_L;
+        m_x = 1.0;
+    }
+
+    // Interpolation weights (0, 1] between the previous and the current
+    // input for every output that falls in that interval; returns the count
+    // (at most max_output()).
+    int advance(double* t) {
+        int n = 0;
+        if (m_exact) {
+            if (m_table != nullptr) {
+                while (m_p <= m_L) {
+                    t[n++] = m_table[m_p];
+                    m_p += m_M;
+                }
+            } else {
+                while (m_p <= m_L) {
+                    t[n++] = m_p * m_inv_L;
+                    m_p += m_M;
+                }
+            }
+            m_p -= m_L;
+        } else {
+            while (m_x <= 1.0) {
+                t[n++] = m_x;
+                m_x += m_rate;
+            }
+            m_x -= 1.0;
+        }
+        return n;
+    }
+
+    // Exact mode only: like advance() but reports each output's phase as
+    // the numerator p of p / phases(), p in 1..phases().
+    int advance_phase(int64_t* p) {
+        int n = 0;
+        while (m_p <= m_L) {
+            p[n++] = m_p;
+            m_p += m_M;
+        }
+        m_p -= m_L;
+        return n;
+    }
+
+    // denominator of the exact position (1 when inexact)
+    int64_t phases(void) const { return m_L; }
+
+    // the position enters advance() in (0, 1], so at most floor(1/rate) + 1
+    // outputs fit before it passes 1
+    int max_output(void) const {
+        if (m_exact)
+            return (int) (m_L / m_M) + 1;
+        return (int) (1. / m_rate) + 1;
+    }
+
+    bool exact(void) const { return m_exact; }
+    double rate(void) const { return m_rate; }
+
+private:
+    static const int64_t MAX_TABLE = 1 << 16;
+
+    void init(double Fs_in, double Fs_out) {
+        m_exact = false;
+        m_L = m_M = 1;
+        m_inv_L = 1.0;
+        m_table = nullptr;
+        m_rate = Fs_in / Fs_out;
+        if (is_integer_rate(Fs_in) && is_integer_rate(Fs_out)) {
+            int64_t in = (int64_t) Fs_in;
+            int64_t out = (int64_t) Fs_out;
+            int64_t g = gcd(in, out);
+            m_exact = true;
+            m_L = out / g;
+            m_M = in / g;
+            m_inv_L = 1.0 / m_L;
+        }
+        reset();
+    }
+
+    // weights p / L for p in 0..L, when L is small enough for a table
+    size_t table_size(void) const {
+        return (m_exact && m_L <= MAX_TABLE) ? (size_t) (m_L + 1) : 0;
+    }
+
+    void fill_table() {
+        for (int64_t p=0; p<=m_L; p++) {
+            m_table[p] = (double) p / m_L;
+        }
+    }
+
+    static bool is_integer_rate(double Fs) {
+        return Fs >= 1.0 && Fs < 2147483648.0 && std::floor(Fs) == Fs;
+    }
+
+    static int64_t gcd(int64_t a, int64_t b) {
+        while (b != 0) {
+            int64_t r = a % b;
+            a = b;
+            b = r;
+        }
+        return a;
+    }
+
+    bool m_exact;
+    int64_t m_L;      // output rate / gcd
+    int64_t m_M;      // input rate / gcd
+    int64_t m_p;      // position * m_L, in (0, m_L] on entry to advance()
+    double m_inv_L;
+    double* m_table;              // weights by phase, or null
+    std::vector<double> m_own;    // the table when it is on the heap
+
+    double m_x;       // inexact mode position
+    double m_rate;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cmath>
+
+#include "dsp/polyphase.h++"
+
+#undef PI
+#define PI (3.14159265358979323846)
+
+// zeroth order modified Bessel function of the first kind
+static double bessel_i0(double x) {
+	double sum = 1.0, term = 1.0;
+	for (int k=1; k<50; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-17)
+			break;
+	}
+	return sum;
+}
+
+// Kaiser design for 80 dB with a transition of 2 * Fs_padding at the
+// input rate; taps counted per phase
+#define POLYPHASE_ATTENUATION 80.0
+
+int PolyphaseInterpolator::design_taps(double Fs_in, double Fs_padding) {
+	const double atten = POLYPHASE_ATTENUATION;
+	double padding = Fs_padding > 1.0 ? Fs_padding : 1.0;
+	double dw = 2.0 * PI * (2.0 * padding) / Fs_in;
+	int taps = (int) ceil((atten - 8.0) / (2.285 * dw)) + 1;
+	return std::max(8, std::min(128, taps + (taps & 1)));
+}
+
+int PolyphaseInterpolator::design_rows(const ResamplePhase& phase) {
+	return (phase.exact() && phase.phases() <= MAX_PHASES) ? (int) phase.phases() : MAX_PHASES;
+}
+
+size_t PolyphaseInterpolator::arena_bytes(double Fs_in, double Fs_out, double Fs_padding, int channels) {
+	ResamplePhase phase = ResamplePhase::untabled(Fs_in, Fs_out);
+	int taps = design_taps(Fs_in, Fs_padding);
+	int rows = design_rows(phase);
+	return ResamplePhase::arena_bytes(Fs_in, Fs_out)
+		+ dsp_arena_bytes<double>((size_t) (rows + 1) * taps)
+		+ dsp_arena_bytes<double>((size_t) 2 * taps * channels)
+		+ dsp_arena_bytes<int64_t>(phase.max_output())
+		+ dsp_arena_bytes<double>(phase.max_output())
+		+ dsp_arena_bytes<double>(channels);
+}
+
+PolyphaseInterpolator::PolyphaseInterpolator()
+: m_kernels(&dsp_kernels()), m_table_exact(false), m_rows(0), m_taps(0), m_channels(1),
+  m_coeff(nullptr), m_hist(nullptr), m_pos(0), m_frame(nullptr), m_p(nullptr), m_t(nullptr) {
+}
+
+PolyphaseInterpolator::PolyphaseInterpolator(double Fs_in, double Fs_out, double Fs_padding, DspArena& arena,
+                                             int channels)
+: m_kernels(&dsp_kernels()), m_phase(Fs_in, Fs_out, arena), m_channels(channels), m_pos(0), m_frame(nullptr) {
+
+	const double beta = 0.1102 * (POLYPHASE_ATTENUATION - 8.7);
+	int taps = design_taps(Fs_in, Fs_padding);
+	m_taps = taps;
+
+	m_table_exact = m_phase.exact() && m_phase.phases() <= MAX_PHASES;
+	m_rows = design_rows(m_phase);
+
+	m_coeff = arena.alloc<double>((size_t) (m_rows + 1) * taps);
+	m_hist = arena.alloc<double>((size_t) 2 * taps * channels);
+	m_p = arena.alloc<int64_t>(m_phase.max_output());
+	m_t = arena.alloc<double>(m_phase.max_output());
+	m_frame = arena.alloc<double>(channels);
+	if (m_coeff == nullptr || m_hist == nullptr || m_p == nullptr || m_t == nullptr || m_frame == nullptr) {
+		return;
+	}
+
+	// row r holds the phase t = r / m_rows; the output lands at
+	// n - taps/2 + t, so tap j sits at u = j - taps/2 + t
+	const double half = taps / 2.0;
+	for (int r=0; r<=m_rows; r++) {
+		double t = (double) r / m_rows;
+		double* c = &m_coeff[(size_t) r * taps];
+		double sum = 0;
+		for (int j=0; j<taps; j++) {
+			double u = j - half + t;
+			double sinc = (u == 0.0) ? 1.0 : sin(PI * u) / (PI * u);
+			double w = u / half;
+			double window = (fabs(w) >= 1.0) ? 0.0 : bessel_i0(beta * sqrt(1.0 - w * w)) / bessel_i0(beta);
+			c[j] = sinc * window;
+			sum += c[j];
+		}
+		// unity gain at DC for every phase
+		for (int j=0; j<taps; j++) {
+			c[j] /= sum;
+		}
+	}
+}
+
+void PolyphaseInterpolator::relocate(const char* from, char* to) {
+	m_phase.relocate(from, to);
+	m_coeff = dsp_relocate(m_coeff, from, to);
+	m_hist = dsp_relocate(m_hist, from, to);
+	m_p = dsp_relocate(m_p, from, to);
+	m_t = dsp_relocate(m_t, from, to);
+	m_frame = dsp_relocate(m_frame, from, to);
+}
+
+double PolyphaseInterpolator::dot(const double* c, const double* x) const {
+	return m_kernels->dot(c, x, m_taps);
+}
+
+int PolyphaseInterpolator::insert(double v, double* out) {
+	m_pos = (m_pos == 0) ? m_taps - 1 : m_pos - 1;
+	m_hist[m_pos] = v;
+	m_hist[m_pos + m_taps] = v;
+	const double* x = &m_hist[m_pos];
+
+	int n;
+	if (m_table_exact) {
+		n = m_phase.advance_phase(m_p);
+		for (int i=0; i<n; i++) {
+			int64_t p = m_p[i];
+			if (p == m_rows) {
+				// lands on an input sample: the filter is a pure delay here
+				out[i] = x[m_taps / 2 - 1];
+			} else {
+				out[i] = dot(&m_coeff[(size_t) p * m_taps], x);
+			}
+		}
+	} else {
+		n = m_phase.advance(m_t);
+		for (int i=0; i<n; i++) {
+			double f = m_t[i] * m_rows;
+			int r = std::min((int) f, m_rows - 1);
+			double frac = f - r;
+			double y0 = dot(&m_coeff[(size_t) r * m_taps], x);
+			double y1 = dot(&m_coeff[(size_t) (r + 1) * m_taps], x);
+			out[i] = y0 + (y1 - y0) * frac;
+		}
+	}
+	return n;
+}
+
+int PolyphaseInterpolator::insert_frame(const double* frame, double* out) {
+	const size_t C = m_channels;
+	m_pos = (m_pos == 0) ? m_taps - 1 : m_pos - 1;
+	std::copy(frame, frame + C, &m_hist[m_pos * C]);
+	std::copy(frame, frame + C, &m_hist[(m_pos + m_taps) * C]);
+	const double* x = &m_hist[m_pos * C];
+
+	int n;
+	if (m_table_exact) {
+		n = m_phase.advance_phase(m_p);
+		for (int i=0; i<n; i++) {
+			int64_t p = m_p[i];
+			if (p == m_rows) {
+				const double* d = x + (size_t) (m_taps / 2 - 1) * C;
+				std::copy(d, d + C, out);
+			} else {
+				std::fill(out, out + C, 0.0);
+				m_kernels->dot_rows(&m_coeff[(size_t) p * m_taps], x, m_taps, (int) C, out);
+			}
+			out += C;
+		}
+	} else {
+		// the two nearest rows, then linear between them
+		double* y1 = m_frame;
+		n = m_phase.advance(m_t);
+		for (int i=0; i<n; i++) {
+			double f = m_t[i] * m_rows;
+			int r = std::min((int) f, m_rows - 1);
+			std::fill(out, out + C, 0.0);
+			std::fill(y1, y1 + C, 0.0);
+			m_kernels->dot_rows(&m_coeff[(size_t) r * m_taps], x, m_taps, (int) C, out);
+			m_kernels->dot_rows(&m_coeff[(size_t) (r + 1) * m_taps], x, m_taps, (int) C, y1);
+			m_kernels->lerp(out, y1, f - r, (int) C, out);
+			out += C;
+		}
+	}
+	return n;
+}
+
+void PolyphaseInterpolator::reset() {
+	std::fill(m_hist, m_hist + 2 * m_taps * m_channels, 0.0);
+	m_pos = 0;
+	m_phase.reset();
+}
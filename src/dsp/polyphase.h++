@@ -0,0 +1,78 @@
+#ifndef SIGPROC_POLYPHASE_H
+#define SIGPROC_POLYPHASE_H
+
+#include <cstdint>
+
+#include "dsp/arena.h++"
+#include "dsp/kernels.h++"
+#include "dsp/phase.h++"
+
+// Band limited interpolation for upsampling.
+//
+// Each output is a dot product of the last `taps` inputs with one phase of
+// a Kaiser windowed sinc whose cutoff is the input Nyquist frequency, so
+// nothing is zero stuffed and images above Fs_in/2 are rejected by about
+// 80 dB. The transition band is Fs_padding either side of Fs_in/2, which
+// sets the number of taps.
+//
+// Exact ratios (see ResamplePhase) get one coefficient row per phase, up
+// to MAX_PHASES rows. The phase that lands on an input sample is a pure
+// delay and costs nothing, so a 2x step runs as a half-band filter: every
+// other output is a copy. Other ratios interpolate linearly between the
+// two nearest of MAX_PHASES rows.
+//
+// With more than one channel the history holds interleaved frames,
+// channel innermost, and insert_frame() runs every channel through each
+// tap at once with the dot_rows kernel.
+//
+// The coefficient table and history are taken from an arena, which must
+// have arena_bytes() free.
+class PolyphaseInterpolator
+{
+public:
+    PolyphaseInterpolator();
+    PolyphaseInterpolator(double Fs_in, double Fs_out, double Fs_padding, DspArena& arena, int channels = 1);
+    ~PolyphaseInterpolator() {};
+
+    static size_t arena_bytes(double Fs_in, double Fs_out, double Fs_padding, int channels = 1);
+
+    // the arena block was copied from `from` to `to`
+    void relocate(const char* from, char* to);
+
+    int insert(double value, double* out);
+
+    // insert() for one frame of channels() interleaved samples; writes up
+    // to max_output() frames
+    int insert_frame(const double* frame, double* out);
+
+    int max_output(void) const { return m_phase.max_output(); }
+    void reset();
+
+    // delay relative to the linear interpolator, in input samples
+    double delay(void) const { return m_taps / 2 - 1; }
+    int taps(void) const { return m_taps; }
+    int channels(void) const { return m_channels; }
+
+private:
+    static const int MAX_PHASES = 512;
+
+    static int design_taps(double Fs_in, double Fs_padding);
+    static int design_rows(const ResamplePhase& phase);
+
+    double dot(const double* c, const double* x) const;
+
+    const DspKernels* m_kernels;
+    ResamplePhase m_phase;
+    bool m_table_exact;          // one row per exact phase
+    int m_rows;                  // coefficient rows - 1
+    int m_taps;
+    int m_channels;
+    double* m_coeff;             // [row][tap]; tap j weights x[n - j]
+    double* m_hist;              // last m_taps inputs (frames), stored twice
+    int m_pos;                   // m_hist[m_pos + j] = x[n - j]
+    double* m_frame;             // one frame of insert_frame() scratch
+    int64_t* m_p;                // max_output() phases of one insert
+    double* m_t;
+};
+
+#endif
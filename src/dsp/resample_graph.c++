@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "dsp/resample_graph.h++"
+
+ResampleGraph::ResampleGraph(double Fs_in, const std::vector<double>& Fs_out, double Fs_padding)
+: m_Fs_in(Fs_in), m_block(nullptr), m_flush_inputs(0) {
+
+	Node root;
+	root.rate = Fs_in;
+	root.parent = -1;
+	root.factor = 1;
+	root.pass = 0;
+	root.delay = 0;
+	root.data = nullptr;
+	root.count = 0;
+	m_nodes.push_back(root);
+
+	m_outputs.resize(Fs_out.size());
+	for (size_t k=0; k<Fs_out.size(); k++) {
+		m_outputs[k].rate = Fs_out[k];
+		m_outputs[k].node = 0;
+		m_outputs[k].resampler = -1;
+	}
+
+	// the highest rates first, so lower ones can branch off their stages
+	std::vector<int> order(Fs_out.size());
+	for (size_t k=0; k<order.size(); k++) {
+		order[k] = (int) k;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		return Fs_out[a] > Fs_out[b];
+	});
+
+	const double padding = std::max(Fs_padding, 1.0);
+	std::vector<bool> placed(Fs_out.size(), false);
+	for (int k : order) {
+		double F = Fs_out[k];
+		if (F != Fs_in && !DecimatorCascade::supports(Fs_in, F)) {
+			continue;
+		}
+		// branch off the lowest rate that still reaches F
+		int best = 0;
+		for (size_t i=1; i<m_nodes.size(); i++) {
+			double R = m_nodes[i].rate;
+			if ((R == F || DecimatorCascade::supports(R, F)) && R < m_nodes[best].rate) {
+				best = (int) i;
+			}
+		}
+		int f[DecimatorCascade::MAX_STAGES];
+		int count = DecimatorCascade::factors(m_nodes[best].rate, F, f);
+		for (int i=0; i<count; i++) {
+			best = add_node(best, f[i]);
+		}
+		m_outputs[k].node = best;
+		mark_pass(best, F / 2.0 - padding);
+		placed[k] = true;
+	}
+	for (int k : order) {
+		if (placed[k]) {
+			continue;
+		}
+		double F = Fs_out[k];
+		int best = 0;
+		if (F < Fs_in) {
+			for (size_t i=1; i<m_nodes.size(); i++) {
+				if (m_nodes[i].rate > F && m_nodes[i].rate < m_nodes[best].rate) {
+					best = (int) i;
+				}
+			}
+			mark_pass(best, F / 2.0 - padding);
+		}
+		m_outputs[k].node = best;
+	}
+
+	// the stages can only be designed once every band they carry is known;
+	// then they and the resamplers fill one block
+	size_t bytes = 0;
+	for (size_t i=1; i<m_nodes.size(); i++) {
+		const Node& node = m_nodes[i];
+		bytes += DecimatorCascade::arena_bytes(m_nodes[node.parent].rate, &node.factor, 1, node.pass);
+	}
+	for (const Output& out : m_outputs) {
+		const Node& node = m_nodes[out.node];
+		if (out.rate != node.rate) {
+			bytes += Resampler::arena_bytes(node.rate, out.rate, Fs_padding);
+		}
+	}
+	m_block = (char*) malloc(bytes);
+	m_arena = DspArena(m_block, m_block != nullptr ? bytes : 0);
+
+	for (size_t i=1; i<m_nodes.size(); i++) {
+		Node& node = m_nodes[i];
+		const Node& parent = m_nodes[node.parent];
+		node.dec = DecimatorCascade(parent.rate, &node.factor, 1, node.pass, m_arena);
+		node.delay = parent.delay + node.dec.delay() * (Fs_in / parent.rate);
+	}
+
+	double longest = 0;
+	m_resamplers.reserve(m_outputs.size());
+	for (Output& out : m_outputs) {
+		const Node& node = m_nodes[out.node];
+		if (out.rate != node.rate) {
+			out.resampler = (int) m_resamplers.size();
+			m_resamplers.emplace_back(node.rate, out.rate, Fs_padding, m_arena);
+		}
+		longest = std::max(longest, latency((int) (&out - &m_outputs[0])) * Fs_in / out.rate);
+	}
+	m_flush_inputs = (int) ceil(longest);
+	m_zeros.assign(m_flush_inputs, 0.0);
+}
+
+ResampleGraph::~ResampleGraph() {
+	// the resamplers only borrow the block
+	m_resamplers.clear();
+	free(m_block);
+}
+
+int ResampleGraph::add_node(int parent, int factor) {
+	double rate = m_nodes[parent].rate / factor;
+	for (size_t i=1; i<m_nodes.size(); i++) {
+		if (m_nodes[i].parent == parent && m_nodes[i].rate == rate) {
+			return (int) i;
+		}
+	}
+	Node node;
+	node.rate = rate;
+	node.parent = parent;
+	node.factor = factor;
+	node.pass = 0;
+	node.delay = 0;
+	node.data = nullptr;
+	node.count = 0;
+	m_nodes.push_back(node);
+	return (int) m_nodes.size() - 1;
+}
+
+// every stage from the input down to `node` must keep 0..pass
+void ResampleGraph::mark_pass(int node, double pass) {
+	for (int i=node; i>0; i=m_nodes[i].parent) {
+		m_nodes[i].pass = std::max(m_nodes[i].pass, pass);
+	}
+}
+
+void ResampleGraph::process(const double* in, int n, double* const* out, int* written) {
+	m_nodes[0].data = in;
+	m_nodes[0].count = n;
+	for (size_t i=1; i<m_nodes.size(); i++) {
+		Node& node = m_nodes[i];
+		const Node& parent = m_nodes[node.parent];
+		if (node.buf.size() < (size_t) parent.count) {
+			node.buf.resize(parent.count);
+		}
+		int m = 0;
+		for (int j=0; j<parent.count; j++) {
+			m += node.dec.insert(parent.data[j], node.buf.data() + m);
+		}
+		node.data = node.buf.data();
+		node.count = m;
+	}
+
+	for (size_t k=0; k<m_outputs.size(); k++) {
+		const Node& node = m_nodes[m_outputs[k].node];
+		if (m_outputs[k].resampler >= 0) {
+			written[k] = m_resamplers[m_outputs[k].resampler].process(node.data, node.count, out[k]);
+		} else {
+			std::copy(node.data, node.data + node.count, out[k]);
+			written[k] = node.count;
+		}
+	}
+}
+
+int ResampleGraph::max_output(int k) const {
+	return m_outputs[k].resampler >= 0 ? m_resamplers[m_outputs[k].resampler].max_output() : 1;
+}
+
+void ResampleGraph::flush(double* const* out, int* written) {
+	process(m_zeros.data(), m_flush_inputs, out, written);
+}
+
+int ResampleGraph::max_flush(int k) const {
+	return m_flush_inputs * max_output(k);
+}
+
+void ResampleGraph::reset() {
+	for (Node& node : m_nodes) {
+		node.dec.reset();
+	}
+	for (Resampler& resampler : m_resamplers) {
+		resampler.reset();
+	}
+}
+
+double ResampleGraph::latency(int k) const {
+	const Output& out = m_outputs[k];
+	double l = m_nodes[out.node].delay * out.rate / m_Fs_in;
+	if (out.resampler >= 0) {
+		l += m_resamplers[out.resampler].latency();
+	}
+	return l;
+}
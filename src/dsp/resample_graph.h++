@@ -0,0 +1,82 @@
+#ifndef SIGPROC_RESAMPLE_GRAPH_H
+#define SIGPROC_RESAMPLE_GRAPH_H
+
+#include <vector>
+
+#include "dsp/decimator.h++"
+#include "dsp/resampler.h++"
+
+// Resamples one stream to several output rates in a single pass.
+//
+// Outputs whose rate divides the input rate by a product of 2s and 3s are
+// reached through a tree of single decimation stages (see
+// DecimatorCascade) that they share: with 48k in and 24k, 16k and 8k out,
+// 48k -> 24k and 48k -> 16k each run once, and 8k is one more half-band
+// stage on the 16k branch. A shared stage passes the widest band that any
+// output below it keeps. Every other rate gets its own Resampler, fed from
+// the lowest rate in the tree that is still above it (upsampling from the
+// input), and an output at the input rate is a copy.
+//
+// Each output behaves like a Resampler from Fs_in: latency(k) is its delay
+// in its own samples (at DC, for an output that ends in a Chebyshev low
+// pass; see Resampler::latency) and flush() pushes every tail out. All stages and
+// resamplers share one arena block.
+class ResampleGraph
+{
+public:
+    ResampleGraph(double Fs_in, const std::vector<double>& Fs_out, double Fs_padding);
+    ~ResampleGraph();
+
+    ResampleGraph(const ResampleGraph&) = delete;
+    ResampleGraph& operator=(const ResampleGraph&) = delete;
+
+    int outputs(void) const { return (int) m_outputs.size(); }
+    double rate(int k) const { return m_outputs[k].rate; }
+
+    // `n` inputs; out[k] must hold n * max_output(k) samples and
+    // written[k] is set to the samples written there.
+    void process(const double* in, int n, double* const* out, int* written);
+    int max_output(int k) const;
+
+    // feeds silence for the longest delay; out[k] must hold max_flush(k)
+    void flush(double* const* out, int* written);
+    int max_flush(int k) const;
+
+    void reset();
+    double latency(int k) const;
+
+    // decimation stages actually run, shared ones counted once
+    int stages(void) const { return (int) m_nodes.size() - 1; }
+
+private:
+    struct Node {
+        double rate;
+        int parent;                 // -1 for the input
+        int factor;                 // decimation from the parent
+        double pass;                // widest band kept below this node
+        double delay;               // in input samples
+        DecimatorCascade dec;
+        std::vector<double> buf;    // this pass's samples
+        const double* data;
+        int count;
+    };
+    struct Output {
+        double rate;
+        int node;
+        int resampler;              // into m_resamplers, -1 when the node is at this rate
+    };
+
+    int add_node(int parent, int factor);
+    void mark_pass(int node, double pass);
+
+    double m_Fs_in;
+    std::vector<Node> m_nodes;      // parents before children
+    std::vector<Output> m_outputs;
+    std::vector<Resampler> m_resamplers;
+    char* m_block;
+    DspArena m_arena;
+    int m_flush_inputs;
+    std::vector<double> m_zeros;
+};
+
+#endif
@@ -1,39 +1,129 @@
 
+#include <cmath>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 
 #include "dsp/resampler.h++"
 
-Resampler::Resampler(double Fs_in, double Fs_out, double Fs_padding) {
+int resampler_lowpass(double Fs_in, double Fs_out, double Fs_padding, double* B, double* A) {
+	if (Fs_out >= Fs_in) {
+		return 0;
+	}
 
-	// this requirement is some what arbitrary
-	// however for low target rates this algorithm does not work very well.
-	if (Fs_in<10.0||Fs_out<10.0) {
-		// TODO THROW
+	int num_poles_lpf = 6;
+	int percent_ripple = 15;
+
+	double Fc = ((Fs_out/2.0)-Fs_padding)/ (Fs_in/2.0);
+	int num_coeff = cheby1(num_poles_lpf,percent_ripple, Fc, 0, B, A, RESAMPLER_LOWPASS_SIZE);
+	return (num_coeff > 0) ? num_coeff : 0;
+}
+
+bool resampler_lowpass(double Fs_in, double Fs_out, double Fs_padding,
+                       std::vector<double>& B, std::vector<double>& A) {
+	double tb[RESAMPLER_LOWPASS_SIZE];
+	double ta[RESAMPLER_LOWPASS_SIZE];
+	int num_coeff = resampler_lowpass(Fs_in, Fs_out, Fs_padding, tb, ta);
+	B.assign(tb, tb + num_coeff);
+	A.assign(ta, ta + num_coeff);
+	return num_coeff > 0;
+}
+
+double resampler_group_delay(const double* B, const double* A, int n) {
+	// tau(0) = sum(k b_k)/sum(b_k) - sum(k a_k)/sum(a_k) with the
+	// denominator 1 + a_1 z^-1 + ... as DirectForm2Mono applies it
+	double sb = 0, skb = 0, sa = 1, ska = 0;
+	for (int k=0; k<n; k++) {
+		sb += B[k];
+		skb += k * B[k];
+		if (k > 0) {
+			sa += A[k];
+			ska += k * A[k];
+		}
+	}
+	if (n == 0 || sb == 0 || sa == 0) {
+		return 0;
 	}
+	return skb / sb - ska / sa;
+}
 
-	m_x0 = m_x1 = 0.0;
-	m_x = 1.0; // this removes any sample delay
-	m_rate = Fs_in / Fs_out;
+double resampler_group_delay(const std::vector<double>& B, const std::vector<double>& A) {
+	return resampler_group_delay(B.data(), A.data(), (int) B.size());
+}
 
-	if (Fs_out < Fs_in) {
+// Everything init() takes from the arena, in the same order
+size_t Resampler::arena_bytes(double Fs_in, double Fs_out, double Fs_padding) {
+	size_t bytes = ResamplePhase::arena_bytes(Fs_in, Fs_out);
+	bytes += dsp_arena_bytes<double>(ResamplePhase::untabled(Fs_in, Fs_out).max_output());
+	if (Fs_out > Fs_in) {
+		bytes += PolyphaseInterpolator::arena_bytes(Fs_in, Fs_out, Fs_padding);
+	} else if (DecimatorCascade::supports(Fs_in, Fs_out)) {
+		bytes += DecimatorCascade::arena_bytes(Fs_in, Fs_out, Fs_padding);
+	} else {
+		double B[RESAMPLER_LOWPASS_SIZE], A[RESAMPLER_LOWPASS_SIZE];
+		int n = resampler_lowpass(Fs_in, Fs_out, Fs_padding, B, A);
+		if (n > 0) {
+			bytes += DirectForm2Mono<double>::arena_bytes(n);
+		}
+	}
+	return bytes;
+}
 
-		int num_poles_lpf = 6;
-    	int percent_ripple = 15;
+Resampler::Resampler(double Fs_in, double Fs_out, double Fs_padding)
+: m_mem(nullptr), m_mem_bytes(0), m_owned(true), m_valid(false) {
+	size_t bytes = arena_bytes(Fs_in, Fs_out, Fs_padding);
+	DspArena arena(malloc(bytes), bytes);
+	if (arena.base() == nullptr) {
+		arena = DspArena();
+	}
+	init(Fs_in, Fs_out, Fs_padding, arena);
+}
+
+Resampler::Resampler(double Fs_in, double Fs_out, double Fs_padding, DspArena& arena)
+: m_mem(nullptr), m_mem_bytes(0), m_owned(false), m_valid(false) {
+	init(Fs_in, Fs_out, Fs_padding, arena);
+}
+
+void Resampler::init(double Fs_in, double Fs_out, double Fs_padding, DspArena& arena) {
 
-	    int coeff_buf_size;
-	    double* tb = newCheby1Array(num_poles_lpf, &coeff_buf_size);
-	    double* ta = newCheby1Array(num_poles_lpf, &coeff_buf_size);
+	// this requirement is some what arbitrary
+	// however for low target rates this algorithm does not work very well.
+	if (Fs_in<10.0||Fs_out<10.0) {
+		// TODO THROW
+	}
 
-	    double Fc = ((Fs_out/2.0)-Fs_padding)/ (Fs_in/2.0);
-	    int num_coeff = cheby1(num_poles_lpf,percent_ripple, Fc, 0, tb, ta, coeff_buf_size);
+	size_t start = arena.used();
+	int failures = arena.failures();
 
-		m_df2 = new DirectForm2Mono<double>(tb, ta, num_coeff);
+	m_mode = MODE_LINEAR;
+	m_x0 = m_x1 = 0.0;
+	m_phase = ResamplePhase(Fs_in, Fs_out, arena);
+	m_t = arena.alloc<double>(m_phase.max_output());
 
-		free(tb);
-	    free(ta);
+	m_delay = 0;
+	if (Fs_out > Fs_in) {
+		m_mode = MODE_UP;
+		m_up = PolyphaseInterpolator(Fs_in, Fs_out, Fs_padding, arena);
+		m_delay = m_up.delay();
+	} else if (DecimatorCascade::supports(Fs_in, Fs_out)) {
+		m_mode = MODE_DECIMATE;
+		m_dec = DecimatorCascade(Fs_in, Fs_out, Fs_padding, arena);
+		m_delay = m_dec.delay();
+	} else {
+		double B[RESAMPLER_LOWPASS_SIZE], A[RESAMPLER_LOWPASS_SIZE];
+		int n = resampler_lowpass(Fs_in, Fs_out, Fs_padding, B, A);
+		if (n > 0) {
+			m_mode = MODE_LOWPASS;
+			m_df2 = DirectForm2Mono<double>(B, A, n, arena);
+			m_delay = resampler_group_delay(B, A, n);
+		}
 	}
+	m_flush_inputs = (int) ceil(m_delay);
+
+	m_mem = arena.base() + start;
+	m_mem_bytes = arena.used() - start;
+	m_valid = arena.failures() == failures;
 
 	// these are used for a simple 1 pole LPF
 	// double Fc = 7000.0;
@@ -44,6 +134,85 @@ Resampler::Resampler(double Fs_in, double Fs_out, double Fs_padding) {
 
 }
 
+Resampler::~Resampler() {
+	release();
+}
+
+void Resampler::release() {
+	if (m_owned) {
+		free(m_mem);
+	}
+	m_mem = nullptr;
+	m_mem_bytes = 0;
+	m_owned = false;
+}
+
+void Resampler::relocate(const char* from, char* to) {
+	m_phase.relocate(from, to);
+	m_t = dsp_relocate(m_t, from, to);
+	m_df2.relocate(from, to);
+	m_up.relocate(from, to);
+	m_dec.relocate(from, to);
+}
+
+Resampler::Resampler(const Resampler& o)
+: m_mem(nullptr), m_mem_bytes(0), m_owned(true), m_valid(o.m_valid),
+  m_mode(o.m_mode), m_x0(o.m_x0), m_x1(o.m_x1), m_phase(o.m_phase), m_t(o.m_t),
+  m_delay(o.m_delay), m_flush_inputs(o.m_flush_inputs),
+  m_df2(o.m_df2), m_up(o.m_up), m_dec(o.m_dec) {
+	m_mem = (char*) malloc(o.m_mem_bytes);
+	if (m_mem == nullptr && o.m_mem_bytes > 0) {
+		m_valid = false;
+		return;
+	}
+	m_mem_bytes = o.m_mem_bytes;
+	memcpy(m_mem, o.m_mem, m_mem_bytes);
+	relocate(o.m_mem, m_mem);
+}
+
+Resampler::Resampler(Resampler&& o) noexcept
+: m_mem(o.m_mem), m_mem_bytes(o.m_mem_bytes), m_owned(o.m_owned), m_valid(o.m_valid),
+  m_mode(o.m_mode), m_x0(o.m_x0), m_x1(o.m_x1), m_phase(o.m_phase), m_t(o.m_t),
+  m_delay(o.m_delay), m_flush_inputs(o.m_flush_inputs),
+  m_df2(o.m_df2), m_up(o.m_up), m_dec(o.m_dec) {
+	o.m_mem = nullptr;
+	o.m_mem_bytes = 0;
+	o.m_owned = false;
+	o.m_valid = false;
+}
+
+Resampler& Resampler::operator=(const Resampler& o) {
+	if (this != &o) {
+		*this = Resampler(o);
+	}
+	return *this;
+}
+
+Resampler& Resampler::operator=(Resampler&& o) noexcept {
+	if (this != &o) {
+		release();
+		m_mem = o.m_mem;
+		m_mem_bytes = o.m_mem_bytes;
+		m_owned = o.m_owned;
+		m_valid = o.m_valid;
+		m_mode = o.m_mode;
+		m_x0 = o.m_x0;
+		m_x1 = o.m_x1;
+		m_phase = o.m_phase;
+		m_t = o.m_t;
+		m_delay = o.m_delay;
+		m_flush_inputs = o.m_flush_inputs;
+		m_df2 = o.m_df2;
+		m_up = o.m_up;
+		m_dec = o.m_dec;
+		o.m_mem = nullptr;
+		o.m_mem_bytes = 0;
+		o.m_owned = false;
+		o.m_valid = false;
+	}
+	return *this;
+}
+
 /*
 	out must be an array location where N consecutive double precision
 	floats can can be written. N is determined by the resample rate.
@@ -51,8 +220,15 @@ Resampler::Resampler(double Fs_in, double Fs_out, double Fs_padding) {
 int Resampler::insert(double v, double * out) {
 	int n=0;
 
-	if (m_df2 != nullptr) {
-		v = m_df2->IIR(v);
+	if (m_mode == MODE_UP) {
+		return m_up.insert(v, out);
+	}
+	if (m_mode == MODE_DECIMATE) {
+		return m_dec.insert(v, out);
+	}
+
+	if (m_mode == MODE_LOWPASS) {
+		v = m_df2.IIR(v);
 	}
 
 	//out[0] = v;
@@ -68,23 +244,56 @@ int Resampler::insert(double v, double * out) {
 
 	m_x1 = m_x0;
 	m_x0 = v;
-	while (m_x <= 1.0) {
-		*out++ = m_x1+(m_x0-m_x1)*m_x;
-		m_x += m_rate;
-		n++;
+	n = m_phase.advance(m_t);
+	for (int i=0; i<n; i++) {
+		out[i] = m_x1+(m_x0-m_x1)*m_t[i];
 	}
-	m_x -= 1.0;
 	return n;
 
 }
 
+int Resampler::process(const double* in, int n, double* out) {
+	int m = 0;
+	for (int i=0; i<n; i++) {
+		m += insert(in[i], out + m);
+	}
+	return m;
+}
+
+int Resampler::flush(double* out) {
+	int m = 0;
+	for (int i=0; i<m_flush_inputs; i++) {
+		m += insert(0.0, out + m);
+	}
+	return m;
+}
+
+void Resampler::reset() {
+	m_x0 = m_x1 = 0.0;
+	m_phase.reset();
+	if (m_mode == MODE_LOWPASS) {
+		m_df2.reset();
+	}
+	if (m_mode == MODE_UP) {
+		m_up.reset();
+	}
+	if (m_mode == MODE_DECIMATE) {
+		m_dec.reset();
+	}
+}
+
+double Resampler::latency(void) const {
+	return m_delay / m_phase.rate();
+}
+
 //returns the maximum number of samples an insert method could return.
 //In practice, the filter may return less than this number frequently.
-//A flush function may return up to twice this number.
+//flush() may return up to max_flush().
 int Resampler::max_output(void) const {
-	int n = (int) (1./m_rate + .5);
-	if ( n < 1 )
-		n = 1;
-	return n;
+	return m_phase.max_output();
+}
+
+int Resampler::max_flush(void) const {
+	return m_flush_inputs * m_phase.max_output();
 }
 
@@ -1,29 +1,124 @@
 #ifndef SIGPROC_RESAMPLE_H
 #define SIGPROC_RESAMPLE_H
 
+#include <cstddef>
+#include <vector>
+
+#include "dsp/arena.h++"
 #include "dsp/directform2.h++"
 #include "dsp/cheby1.h++"
+#include "dsp/decimator.h++"
+#include "dsp/phase.h++"
+#include "dsp/polyphase.h++"
+
+// Room resampler_lowpass needs in B and A (cheby1 works in place)
+#define RESAMPLER_LOWPASS_SIZE 9
+
+// Coefficients of the anti-aliasing low pass used when Fs_out < Fs_in:
+// a 6 pole Chebyshev type 1 filter with its corner Fs_padding below the
+// output Nyquist frequency. Returns the number of coefficients, 0 when no
+// filter is needed.
+int resampler_lowpass(double Fs_in, double Fs_out, double Fs_padding, double* B, double* A);
+bool resampler_lowpass(double Fs_in, double Fs_out, double Fs_padding,
+                       std::vector<double>& B, std::vector<double>& A);
+
+// Group delay at DC, in input samples, of a filter designed by
+// resampler_lowpass (0 for an empty filter).
+double resampler_group_delay(const double* B, const double* A, int n);
+double resampler_group_delay(const std::vector<double>& B, const std::vector<double>& A);
 
 class Resampler
 {
 public:
+    // Downsampling by an integer factor of 2s and 3s (96k -> 48k,
+    // 48k -> 16k, ...) runs a DecimatorCascade; any other downsampling runs
+    // the input through a Chebyshev low pass and then interpolates
+    // linearly; upsampling uses a PolyphaseInterpolator.
+    //
+    // Every table and history lives in one block of arena_bytes(): a
+    // single heap allocation, or with an arena the caller's memory and no
+    // heap use at all. The arena must outlive the object; valid() is false
+    // when it was too small.
     Resampler(double FS_in,double FS_out, double Fs_padding);
-    ~Resampler() {};
+    Resampler(double Fs_in, double Fs_out, double Fs_padding, DspArena& arena);
+    ~Resampler();
+
+    static size_t arena_bytes(double Fs_in, double Fs_out, double Fs_padding);
+
+    // A copy gets its own heap block holding the same filter in the same
+    // state. A move takes the block over and leaves the source empty, fit
+    // only to be assigned to or destroyed.
+    Resampler(const Resampler& o);
+    Resampler(Resampler&& o) noexcept;
+    Resampler& operator=(const Resampler& o);
+    Resampler& operator=(Resampler&& o) noexcept;
+
+    bool valid(void) const { return m_valid; }
 
     int insert(double value, double* out);
     int max_output(void) const;
 
+    // `n` inputs; out must hold n * max_output() samples. Returns the
+    // samples written.
+    int process(const double* in, int n, double* out);
+
+    // Push the filter tail out by feeding silence for the filter's delay;
+    // out must hold max_flush() samples. Call reset() before reusing the
+    // object for an unrelated stream.
+    int flush(double* out);
+    int max_flush(void) const;
+
+    // Back to the state of a newly constructed object
+    void reset();
+
+    // Delay of the anti-aliasing (or anti-imaging) filter in output samples. Dropping the
+    // first round(latency()) outputs and flushing at the end lines the
+    // output up with the input, so independently resampled segments can
+    // be trimmed and concatenated without an offset.
+    //
+    // That holds at every frequency on the decimating and polyphase
+    // paths, whose FIR filters have linear phase. The Chebyshev low pass
+    // does not: latency() is its group delay at DC, and towards the top
+    // of the passband the delay grows by several output samples (about 20
+    // at 48000 -> 44100; resample_verify holds the bounds).
+    double latency(void) const;
+
+    // true when the rates are whole numbers and the output count is exact
+    // (see ResamplePhase)
+    bool exact(void) const { return m_phase.exact(); }
+
 private:
+    enum Mode {
+        MODE_LINEAR,            // interpolation only
+        MODE_LOWPASS,           // m_df2, then interpolation
+        MODE_UP,                // m_up
+        MODE_DECIMATE,          // m_dec
+    };
+
+    void init(double Fs_in, double Fs_out, double Fs_padding, DspArena& arena);
+    void relocate(const char* from, char* to);
+    void release();
+
+    char* m_mem;                // this object's part of the arena
+    size_t m_mem_bytes;
+    bool m_owned;               // m_mem is our heap block
+    bool m_valid;
+
+    Mode m_mode;
     double m_x0;
     double m_x1;
-    double m_x;
-    double m_rate;
+    ResamplePhase m_phase;
+    double* m_t;                // interpolation weights of one insert
+    double m_delay;             // filter group delay in input samples
+    int m_flush_inputs;         // silence fed by flush()
 
     // these are used for a simple 1 pole LPF
     //double v_last = 0;
     //double alpha = 0;
 
-    DirectForm2Mono<double> *m_df2 = nullptr;
+    DirectForm2Mono<double> m_df2;
+    PolyphaseInterpolator m_up;
+    DecimatorCascade m_dec;
 };
 
 #endif
\ No newline at end of file
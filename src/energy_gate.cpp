@@ -0,0 +1,38 @@
+#include "energy_gate.h"
+
+#include <math.h>
+
+EnergyGate::EnergyGate(const GateConfig& config, int sample_rate, int channels,
+                       enum SoundIoFormat fmt)
+: m_channels(channels), m_format(fmt) {
+    m_open_level = config.open_level;
+    m_close_level = config.open_level * dbfs_to_linear(-fabs(config.hysteresis_db));
+    m_block_frames = (int)(config.block_seconds * sample_rate + 0.5);
+    if (m_block_frames < 1)
+        m_block_frames = 1;
+    m_hangover_blocks = (int)ceil(config.hangover_seconds / config.block_seconds);
+}
+
+bool EnergyGate::process(const char* block) {
+    BlockStats stats;
+    block_stats(block, (int64_t)m_block_frames * m_channels, m_format, &stats);
+
+    if (!m_open) {
+        if (stats.rms >= m_open_level) {
+            m_open = true;
+            m_hangover_left = m_hangover_blocks;
+        }
+    } else if (stats.rms >= m_close_level) {
+        m_hangover_left = m_hangover_blocks;
+    } else if (m_hangover_left > 0) {
+        m_hangover_left -= 1;
+    } else {
+        m_open = false;
+    }
+
+    if (m_open)
+        m_blocks_open += 1;
+    else
+        m_blocks_closed += 1;
+    return m_open;
+}
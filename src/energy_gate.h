@@ -0,0 +1,49 @@
+#ifndef AUDIOCAPTURE_ENERGY_GATE_H
+#define AUDIOCAPTURE_ENERGY_GATE_H
+
+#include "levels.h"
+
+#include <stdint.h>
+
+struct GateConfig {
+    double open_level = 0;        // block RMS that opens the gate, linear; 0 = off
+    double hysteresis_db = 6;     // gate closes this far below open_level
+    double hangover_seconds = 0.5;
+    double block_seconds = 0.02;
+};
+
+// Energy gate for the writer: blocks of `block_frames()` frames are
+// classified by their RMS over all channels. The gate opens on a block at
+// or above the open level, stays open while blocks stay above the lower
+// close level, and only closes after `hangover_seconds` of quieter audio
+// so word endings and short pauses are kept.
+class EnergyGate
+{
+public:
+    EnergyGate(const GateConfig& config, int sample_rate, int channels, enum SoundIoFormat fmt);
+
+    int block_frames() const { return m_block_frames; }
+
+    // Classify one block of exactly block_frames() interleaved frames.
+    // Returns true when the block should be written.
+    bool process(const char* block);
+
+    bool is_open() const { return m_open; }
+    int64_t blocks_open() const { return m_blocks_open; }
+    int64_t blocks_closed() const { return m_blocks_closed; }
+
+private:
+    double m_open_level;
+    double m_close_level;
+    int m_hangover_blocks;
+    int m_block_frames;
+    int m_channels;
+    enum SoundIoFormat m_format;
+
+    bool m_open = false;
+    int m_hangover_left = 0;
+    int64_t m_blocks_open = 0;
+    int64_t m_blocks_closed = 0;
+};
+
+#endif
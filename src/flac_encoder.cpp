@@ -0,0 +1,584 @@
+#include "flac_encoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+using namespace std;
+
+#define FLAC_MAX_PARTITION_ORDER 8
+#define FLAC_MAX_FIXED_ORDER 4
+
+// channel assignments from the frame header
+#define FLAC_LEFT_SIDE 8
+#define FLAC_SIDE_RIGHT 9
+#define FLAC_MID_SIDE 10
+
+// MSB-first bit packer used for STREAMINFO, frame headers and subframes
+class BitWriter
+{
+public:
+    explicit BitWriter(vector<uint8_t>& out) : m_out(out) {}
+
+    void put(uint32_t value, int bits) {
+        if (bits == 0)
+            return;
+        uint64_t mask = (bits == 32) ? 0xFFFFFFFFull : ((1ull << bits) - 1);
+        m_acc = (m_acc << bits) | (value & mask);
+        m_bits += bits;
+        while (m_bits >= 8) {
+            m_bits -= 8;
+            m_out.push_back((uint8_t)(m_acc >> m_bits));
+        }
+    }
+
+    void put_signed(int32_t value, int bits) {
+        put((uint32_t)value, bits);
+    }
+
+    void put_unary(uint32_t zeros) {
+        while (zeros >= 32) {
+            put(0, 32);
+            zeros -= 32;
+        }
+        put(1, zeros + 1);
+    }
+
+    void align() {
+        if (m_bits > 0)
+            put(0, 8 - m_bits);
+    }
+
+private:
+    vector<uint8_t>& m_out;
+    uint64_t m_acc = 0;
+    int m_bits = 0;
+};
+
+static uint8_t crc8_table[256];
+static uint16_t crc16_table[256];
+
+static bool init_crc_tables() {
+    for (int i = 0; i < 256; i += 1) {
+        uint8_t c8 = (uint8_t)i;
+        uint16_t c16 = (uint16_t)(i << 8);
+        for (int b = 0; b < 8; b += 1) {
+            c8 = (c8 & 0x80) ? (uint8_t)((c8 << 1) ^ 0x07) : (uint8_t)(c8 << 1);
+            c16 = (c16 & 0x8000) ? (uint16_t)((c16 << 1) ^ 0x8005) : (uint16_t)(c16 << 1);
+        }
+        crc8_table[i] = c8;
+        crc16_table[i] = c16;
+    }
+    return true;
+}
+
+static const bool crc_tables_ready = init_crc_tables();
+
+static uint8_t flac_crc8(const uint8_t* data, size_t size) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i += 1)
+        crc = crc8_table[crc ^ data[i]];
+    return crc;
+}
+
+uint16_t flac_crc16(const uint8_t* data, size_t size, uint16_t crc) {
+    for (size_t i = 0; i < size; i += 1)
+        crc = (uint16_t)((crc << 8) ^ crc16_table[(crc >> 8) ^ data[i]]);
+    return crc;
+}
+
+int flac_bits_for_format(enum SoundIoFormat fmt) {
+    switch (fmt) {
+        case SoundIoFormatS8:
+        case SoundIoFormatU8:    return 8;
+        case SoundIoFormatS16LE: return 16;
+        case SoundIoFormatS24LE: return 24;
+        default:                 return 0;
+    }
+}
+
+int flac_build_header(const FlacStreamInfo& info, char* out) {
+    vector<uint8_t> buf;
+    BitWriter bw(buf);
+    bw.put('f', 8); bw.put('L', 8); bw.put('a', 8); bw.put('C', 8);
+    bw.put(1, 1);            // last metadata block
+    bw.put(0, 7);            // STREAMINFO
+    bw.put(34, 24);
+    int min_block = info.min_block_size;
+    if (min_block <= 0 || min_block > info.block_size)
+        min_block = info.block_size;
+    if (min_block < 16)
+        min_block = 16;
+    bw.put(min_block, 16);
+    bw.put(info.block_size, 16);
+    bw.put(info.min_frame_size, 24);
+    bw.put(info.max_frame_size, 24);
+    bw.put(info.sample_rate, 20);
+    bw.put(info.channels - 1, 3);
+    bw.put(info.bits_per_sample - 1, 5);
+    bw.put((uint32_t)(info.total_samples >> 32) & 0xF, 4);
+    bw.put((uint32_t)info.total_samples, 32);
+    for (int i = 0; i < 4; i += 1)
+        bw.put(0, 32);       // MD5 unknown
+    memcpy(out, buf.data(), buf.size());
+    return (int)buf.size();
+}
+
+static int sample_rate_code(int rate) {
+    switch (rate) {
+        case 88200:  return 1;
+        case 176400: return 2;
+        case 192000: return 3;
+        case 8000:   return 4;
+        case 16000:  return 5;
+        case 22050:  return 6;
+        case 24000:  return 7;
+        case 32000:  return 8;
+        case 44100:  return 9;
+        case 48000:  return 10;
+        case 96000:  return 11;
+        default:     return 0; // from STREAMINFO
+    }
+}
+
+static int sample_size_code(int bits) {
+    switch (bits) {
+        case 8:  return 1;
+        case 12: return 2;
+        case 16: return 4;
+        case 20: return 5;
+        case 24: return 6;
+        default: return 0;
+    }
+}
+
+int flac_frame_header(const FlacStreamInfo& info, int frames, int channel_assignment,
+                      uint64_t first_sample, uint8_t* out) {
+    vector<uint8_t> buf;
+    buf.reserve(FLAC_MAX_FRAME_HEADER_SIZE);
+    BitWriter bw(buf);
+    bw.put(0xFFF9, 16);                 // sync, variable block size
+    bw.put(7, 4);                       // 16 bit (block size - 1) follows
+    bw.put(sample_rate_code(info.sample_rate), 4);
+    bw.put(channel_assignment, 4);
+    bw.put(sample_size_code(info.bits_per_sample), 3);
+    bw.put(0, 1);
+
+    // first sample number in the UTF-8 style variable length code
+    uint64_t v = first_sample;
+    if (v < 0x80) {
+        bw.put((uint32_t)v, 8);
+    } else {
+        int bytes = 2;
+        while (bytes < 7 && v >= (1ull << (5 * bytes + 1)))
+            bytes += 1;
+        int lead_bits = 7 - bytes;
+        uint32_t lead = (0xFF00u >> bytes) & 0xFF;
+        bw.put(lead | ((uint32_t)(v >> (6 * (bytes - 1))) & ((1u << lead_bits) - 1)), 8);
+        for (int i = bytes - 2; i >= 0; i -= 1)
+            bw.put(0x80 | ((v >> (6 * i)) & 0x3F), 8);
+    }
+
+    bw.put(frames - 1, 16);
+    buf.push_back(flac_crc8(buf.data(), buf.size()));
+    memcpy(out, buf.data(), buf.size());
+    return (int)buf.size();
+}
+
+static inline int32_t read_sample(enum SoundIoFormat fmt, const uint8_t* p) {
+    switch (fmt) {
+        case SoundIoFormatS8:    return (int8_t)p[0];
+        case SoundIoFormatU8:    return (int32_t)p[0] - 128;
+        case SoundIoFormatS16LE: return (int16_t)(p[0] | (p[1] << 8));
+        case SoundIoFormatS24LE: {
+            uint32_t u = p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16);
+            return (int32_t)(u << 8) >> 8;
+        }
+        default: return 0;
+    }
+}
+
+static inline uint32_t zigzag(int32_t r) {
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+// A coded subframe choice and its estimated size in bits
+struct SubframePlan {
+    int type = 0;                // 0 constant, 1 verbatim, 2 fixed
+    int order = 0;
+    int partition_order = 0;
+    int params[1 << FLAC_MAX_PARTITION_ORDER];
+    bool rice2 = false;
+    uint64_t bits = 0;
+    vector<int32_t> residual;
+};
+
+static int best_rice_param(uint64_t count, uint64_t sum, uint64_t* bits) {
+    if (count == 0) {
+        *bits = 0;
+        return 0;
+    }
+    int k = 0;
+    uint64_t mean = sum / count;
+    while (k < 30 && (mean >> (k + 1)) > 0)
+        k += 1;
+    uint64_t best = UINT64_MAX;
+    int best_k = 0;
+    for (int c = (k > 0 ? k - 1 : 0); c <= k + 1 && c <= 30; c += 1) {
+        uint64_t b = count * (c + 1) + (sum >> c);
+        if (b < best) {
+            best = b;
+            best_k = c;
+        }
+    }
+    *bits = best;
+    return best_k;
+}
+
+// Choose partition order and Rice parameters for residual[order..n)
+static uint64_t plan_residual(const int32_t* residual, int n, int order, SubframePlan& plan) {
+    uint64_t sums[1 << FLAC_MAX_PARTITION_ORDER];
+    int max_order = 0;
+    while (max_order < FLAC_MAX_PARTITION_ORDER &&
+           (n % (1 << (max_order + 1))) == 0 &&
+           (n >> (max_order + 1)) > order)
+        max_order += 1;
+
+    int parts = 1 << max_order;
+    int psize = n >> max_order;
+    for (int p = 0; p < parts; p += 1) {
+        uint64_t s = 0;
+        int start = (p == 0) ? order : p * psize;
+        for (int i = start; i < (p + 1) * psize; i += 1)
+            s += zigzag(residual[i]);
+        sums[p] = s;
+    }
+
+    uint64_t best_bits = UINT64_MAX;
+    for (int po = max_order; po >= 0; po -= 1) {
+        int count = 1 << po;
+        int size = n >> po;
+        uint64_t total = 6;
+        int params[1 << FLAC_MAX_PARTITION_ORDER];
+        bool rice2 = false;
+        for (int p = 0; p < count; p += 1) {
+            uint64_t pbits;
+            int samples = (p == 0) ? size - order : size;
+            params[p] = best_rice_param(samples, sums[p], &pbits);
+            if (params[p] > 14)
+                rice2 = true;
+            total += pbits;
+        }
+        total += (uint64_t)count * (rice2 ? 5 : 4);
+        if (total < best_bits) {
+            best_bits = total;
+            plan.partition_order = po;
+            plan.rice2 = rice2;
+            memcpy(plan.params, params, sizeof(int) * count);
+        }
+        // merge neighbouring partitions for the next lower order
+        for (int p = 0; p < count / 2; p += 1)
+            sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+    return best_bits;
+}
+
+static void plan_subframe(const int32_t* x, int n, int bps, SubframePlan& plan) {
+    bool constant = true;
+    for (int i = 1; i < n && constant; i += 1)
+        constant = (x[i] == x[0]);
+    if (constant) {
+        plan.type = 0;
+        plan.bits = 8 + bps;
+        return;
+    }
+
+    plan.type = 1;
+    plan.bits = 8 + (uint64_t)n * bps;
+
+    vector<int32_t> residual(n);
+    SubframePlan candidate;
+    for (int order = 0; order <= FLAC_MAX_FIXED_ORDER && order < n; order += 1) {
+        bool fits = true;
+        for (int i = order; i < n; i += 1) {
+            int64_t r;
+            switch (order) {
+                case 0: r = x[i]; break;
+                case 1: r = (int64_t)x[i] - x[i-1]; break;
+                case 2: r = (int64_t)x[i] - 2*(int64_t)x[i-1] + x[i-2]; break;
+                case 3: r = (int64_t)x[i] - 3*(int64_t)x[i-1] + 3*(int64_t)x[i-2] - x[i-3]; break;
+                default: r = (int64_t)x[i] - 4*(int64_t)x[i-1] + 6*(int64_t)x[i-2]
+                             - 4*(int64_t)x[i-3] + x[i-4]; break;
+            }
+            if (r > INT32_MAX || r <= INT32_MIN) {
+                fits = false;
+                break;
+            }
+            residual[i] = (int32_t)r;
+        }
+        if (!fits)
+            continue;
+        uint64_t bits = 8 + (uint64_t)order * bps + plan_residual(residual.data(), n, order, candidate);
+        if (bits < plan.bits) {
+            plan.type = 2;
+            plan.order = order;
+            plan.bits = bits;
+            plan.partition_order = candidate.partition_order;
+            plan.rice2 = candidate.rice2;
+            memcpy(plan.params, candidate.params, sizeof(int) << candidate.partition_order);
+            plan.residual.assign(residual.begin(), residual.end());
+        }
+    }
+}
+
+static void write_subframe(BitWriter& bw, const int32_t* x, int n, int bps, const SubframePlan& plan) {
+    bw.put(0, 1);
+    if (plan.type == 0) {
+        bw.put(0, 6);
+        bw.put(0, 1);
+        bw.put_signed(x[0], bps);
+        return;
+    }
+    if (plan.type == 1) {
+        bw.put(1, 6);
+        bw.put(0, 1);
+        for (int i = 0; i < n; i += 1)
+            bw.put_signed(x[i], bps);
+        return;
+    }
+
+    bw.put(8 | plan.order, 6);
+    bw.put(0, 1);
+    for (int i = 0; i < plan.order; i += 1)
+        bw.put_signed(x[i], bps);
+
+    bw.put(plan.rice2 ? 1 : 0, 2);
+    bw.put(plan.partition_order, 4);
+    int count = 1 << plan.partition_order;
+    int size = n >> plan.partition_order;
+    int param_bits = plan.rice2 ? 5 : 4;
+    for (int p = 0; p < count; p += 1) {
+        int k = plan.params[p];
+        bw.put(k, param_bits);
+        int start = (p == 0) ? plan.order : p * size;
+        for (int i = start; i < (p + 1) * size; i += 1) {
+            uint32_t u = zigzag(plan.residual[i]);
+            bw.put_unary(u >> k);
+            bw.put(u & ((1u << k) - 1), k);
+        }
+    }
+}
+
+int flac_encode_subframes(const FlacStreamInfo& info, enum SoundIoFormat fmt,
+                          const char* pcm, int frames, vector<uint8_t>& body) {
+    int channels = info.channels;
+    int bps = info.bits_per_sample;
+    int bytes_per_sample = soundio_get_bytes_per_sample(fmt);
+    const uint8_t* p = (const uint8_t*)pcm;
+
+    vector<vector<int32_t>> x(channels, vector<int32_t>(frames));
+    for (int i = 0; i < frames; i += 1) {
+        for (int ch = 0; ch < channels; ch += 1) {
+            x[ch][i] = read_sample(fmt, p);
+            p += bytes_per_sample;
+        }
+    }
+
+    body.clear();
+    BitWriter bw(body);
+    int assignment = channels - 1;
+
+    if (channels == 2) {
+        vector<int32_t> mid(frames), side(frames);
+        for (int i = 0; i < frames; i += 1) {
+            mid[i] = (x[0][i] + x[1][i]) >> 1;
+            side[i] = x[0][i] - x[1][i];
+        }
+        SubframePlan left, right, m, s;
+        plan_subframe(x[0].data(), frames, bps, left);
+        plan_subframe(x[1].data(), frames, bps, right);
+        plan_subframe(mid.data(), frames, bps, m);
+        plan_subframe(side.data(), frames, bps + 1, s);
+
+        uint64_t costs[4] = {
+            left.bits + right.bits, left.bits + s.bits, s.bits + right.bits, m.bits + s.bits
+        };
+        int best = 0;
+        for (int i = 1; i < 4; i += 1) {
+            if (costs[i] < costs[best])
+                best = i;
+        }
+        switch (best) {
+            case 0:
+                write_subframe(bw, x[0].data(), frames, bps, left);
+                write_subframe(bw, x[1].data(), frames, bps, right);
+                break;
+            case 1:
+                assignment = FLAC_LEFT_SIDE;
+                write_subframe(bw, x[0].data(), frames, bps, left);
+                write_subframe(bw, side.data(), frames, bps + 1, s);
+                break;
+            case 2:
+                assignment = FLAC_SIDE_RIGHT;
+                write_subframe(bw, side.data(), frames, bps + 1, s);
+                write_subframe(bw, x[1].data(), frames, bps, right);
+                break;
+            default:
+                assignment = FLAC_MID_SIDE;
+                write_subframe(bw, mid.data(), frames, bps, m);
+                write_subframe(bw, side.data(), frames, bps + 1, s);
+                break;
+        }
+    } else {
+        for (int ch = 0; ch < channels; ch += 1) {
+            SubframePlan plan;
+            plan_subframe(x[ch].data(), frames, bps, plan);
+            write_subframe(bw, x[ch].data(), frames, bps, plan);
+        }
+    }
+    bw.align();
+    return assignment;
+}
+
+FlacEncoderPool::FlacEncoderPool(const FlacStreamInfo& info, enum SoundIoFormat fmt, int threads)
+: m_info(info), m_format(fmt) {
+    m_bytes_per_frame = soundio_get_bytes_per_frame(fmt, info.channels);
+    if (threads < 1)
+        threads = 1;
+    int per_second = (info.sample_rate + info.block_size - 1) / info.block_size;
+    m_max_blocks = (size_t)max(2 * threads, FLAC_BACKLOG_SECONDS * per_second);
+    for (int i = 0; i < threads; i += 1)
+        m_threads.push_back(thread(&FlacEncoderPool::worker, this));
+}
+
+FlacEncoderPool::~FlacEncoderPool() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_work_cv.notify_all();
+    for (auto& t : m_threads)
+        t.join();
+    for (Block* b : m_ordered)
+        delete b;
+    for (Block* b : m_free)
+        delete b;
+    delete m_staging;
+}
+
+void FlacEncoderPool::worker() {
+    for (;;) {
+        Block* block;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_work_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_stop)
+                return;
+            block = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        auto start = chrono::steady_clock::now();
+        block->channel_assignment = flac_encode_subframes(m_info, m_format, block->pcm.data(),
+                                                          block->frames, block->encoded);
+        block->encode_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            block->done = true;
+        }
+        m_done_cv.notify_all();
+    }
+}
+
+void FlacEncoderPool::submit_staging() {
+    lock_guard<mutex> lock(m_mutex);
+    m_queue.push_back(m_staging);
+    m_ordered.push_back(m_staging);
+    m_staging = nullptr;
+    m_work_cv.notify_one();
+}
+
+int64_t FlacEncoderPool::push(const char* pcm, int64_t frames) {
+    int64_t taken = 0;
+    while (frames > 0) {
+        if (!m_staging) {
+            lock_guard<mutex> lock(m_mutex);
+            if (m_ordered.size() >= m_max_blocks)
+                break;
+            if (!m_free.empty()) {
+                m_staging = m_free.back();
+                m_free.pop_back();
+            } else {
+                m_staging = new Block();
+            }
+            m_staging->frames = 0;
+            m_staging->done = false;
+            m_staging->pcm.resize((size_t)m_info.block_size * m_bytes_per_frame);
+        }
+        int64_t n = m_info.block_size - m_staging->frames;
+        if (n > frames)
+            n = frames;
+        memcpy(&m_staging->pcm[(size_t)m_staging->frames * m_bytes_per_frame], pcm,
+               (size_t)n * m_bytes_per_frame);
+        m_staging->frames += (int)n;
+        pcm += n * m_bytes_per_frame;
+        frames -= n;
+        taken += n;
+        if (m_staging->frames == m_info.block_size)
+            submit_staging();
+    }
+    return taken;
+}
+
+int64_t FlacEncoderPool::room() {
+    lock_guard<mutex> lock(m_mutex);
+    // the block being filled takes one of the free slots when it is queued
+    int64_t slots = (int64_t)m_max_blocks - (int64_t)m_ordered.size() - (m_staging ? 1 : 0);
+    int64_t frames = m_staging ? m_info.block_size - m_staging->frames : 0;
+    if (slots > 0)
+        frames += slots * m_info.block_size;
+    return frames;
+}
+
+void FlacEncoderPool::flush() {
+    if (m_staging && m_staging->frames > 0)
+        submit_staging();
+}
+
+bool FlacEncoderPool::next(Block& out, bool wait) {
+    Block* block;
+    {
+        unique_lock<mutex> lock(m_mutex);
+        if (m_ordered.empty())
+            return false;
+        block = m_ordered.front();
+        if (!block->done) {
+            if (!wait)
+                return false;
+            m_done_cv.wait(lock, [block] { return block->done; });
+        }
+        m_ordered.pop_front();
+    }
+
+    out.frames = block->frames;
+    out.channel_assignment = block->channel_assignment;
+    out.encode_seconds = block->encode_seconds;
+    out.done = true;
+    // hand the buffers over and recycle the caller's old ones
+    out.encoded.swap(block->encoded);
+
+    m_bytes_in += (uint64_t)block->frames * m_bytes_per_frame;
+    m_bytes_out += out.encoded.size();
+    m_frames_out += block->frames;
+    m_encode_seconds += block->encode_seconds;
+
+    lock_guard<mutex> lock(m_mutex);
+    m_free.push_back(block);
+    return true;
+}
+
+int FlacEncoderPool::pending() {
+    lock_guard<mutex> lock(m_mutex);
+    return (int)m_ordered.size() + (m_staging && m_staging->frames > 0 ? 1 : 0);
+}
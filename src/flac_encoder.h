@@ -0,0 +1,137 @@
+#ifndef AUDIOCAPTURE_FLAC_ENCODER_H
+#define AUDIOCAPTURE_FLAC_ENCODER_H
+
+#include "soundio/soundio.h"
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// "fLaC" + last-metadata-block header + 34 byte STREAMINFO
+#define FLAC_HEADER_SIZE 42
+#define FLAC_MAX_FRAME_HEADER_SIZE 16
+#define FLAC_MAX_CHANNELS 8
+
+// audio FlacEncoderPool holds before push() refuses more; the drain loop
+// hands over a second at a time
+#define FLAC_BACKLOG_SECONDS 2
+
+struct FlacStreamInfo {
+    int sample_rate = 0;
+    int channels = 0;
+    int bits_per_sample = 0;
+    int block_size = 4096;
+    int min_block_size = 0;       // 0 = block_size
+    uint64_t total_samples = 0;   // per channel; 0 = unknown
+    uint32_t min_frame_size = 0;  // bytes; 0 = unknown
+    uint32_t max_frame_size = 0;
+};
+
+// Bits per sample FLAC should use for a capture format, or 0 when the
+// format cannot be encoded losslessly (float, unsigned wide, big endian,
+// 32 bit).
+int flac_bits_for_format(enum SoundIoFormat fmt);
+
+// Serialize the stream marker and STREAMINFO block (FLAC_HEADER_SIZE bytes).
+// Frames are normally all `block_size` long, but flushing the encoder
+// around a gap emits short frames mid-stream; `min_block_size` records that
+// (excluding the last frame, as the format defines it).
+int flac_build_header(const FlacStreamInfo& info, char* out);
+
+// Encode the subframes of one FLAC frame from `frames` interleaved
+// native-format frames into `body`, padded to a byte boundary. Each channel
+// is coded with the cheapest of CONSTANT, VERBATIM and FIXED order 0-4
+// prediction with partitioned Rice residuals; stereo input also tries
+// left/side, side/right and mid/side. Returns the channel assignment code
+// for the frame header.
+//
+// The header and CRC are left to the writer because the sample number
+// depends on which segment file the frame ends up in.
+int flac_encode_subframes(const FlacStreamInfo& info, enum SoundIoFormat fmt,
+                          const char* pcm, int frames, std::vector<uint8_t>& body);
+
+// Serialize a frame header (with its CRC-8) into `out`; returns its size.
+// Streams use the variable block size strategy, where each header carries
+// the number of its first sample rather than a frame number, because short
+// frames come mid-stream wherever the encoder is flushed for a gap.
+int flac_frame_header(const FlacStreamInfo& info, int frames, int channel_assignment,
+                      uint64_t first_sample, uint8_t* out);
+
+uint16_t flac_crc16(const uint8_t* data, size_t size, uint16_t crc);
+
+// Encodes fixed-size blocks on a small pool of worker threads and hands
+// them back in submission order. The drain loop only copies PCM into a
+// job and never waits on the encoder; finished blocks are collected on
+// the next pass.
+//
+// The blocks in flight are bounded (FLAC_BACKLOG_SECONDS of audio, and
+// at least two per thread). Once an encoder that cannot keep up reaches
+// that, push() takes no more and the PCM stays in the capture ring, where
+// the fill level and the load shedder see it, instead of piling up here.
+class FlacEncoderPool
+{
+public:
+    struct Block {
+        int frames = 0;
+        int channel_assignment = 0;
+        std::vector<char> pcm;
+        std::vector<uint8_t> encoded;
+        bool done = false;
+        double encode_seconds = 0;
+    };
+
+    FlacEncoderPool(const FlacStreamInfo& info, enum SoundIoFormat fmt, int threads);
+    ~FlacEncoderPool();
+
+    // Append interleaved PCM; every full block is queued for encoding.
+    // Returns the frames taken, fewer than `frames` when the backlog is
+    // full (at most room()).
+    int64_t push(const char* pcm, int64_t frames);
+
+    // frames push() would take right now
+    int64_t room();
+
+    // Queue whatever is left over as a final short block.
+    void flush();
+
+    // Take the oldest block if it is finished (or wait for it when `wait`).
+    // Returns false when nothing is ready.
+    bool next(Block& out, bool wait);
+
+    int pending();
+
+    // Totals over every block returned by next()
+    uint64_t bytes_in() const { return m_bytes_in; }
+    uint64_t bytes_out() const { return m_bytes_out; }
+    uint64_t frames_out() const { return m_frames_out; }
+    double encode_seconds() const { return m_encode_seconds; }
+
+private:
+    void worker();
+    void submit_staging();
+
+    FlacStreamInfo m_info;
+    enum SoundIoFormat m_format;
+    int m_bytes_per_frame;
+    Block* m_staging = nullptr;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+    std::deque<Block*> m_queue;    // waiting for a worker
+    std::deque<Block*> m_ordered;  // every block not yet returned
+    std::vector<Block*> m_free;
+    size_t m_max_blocks = 0;       // in m_ordered, not counting m_staging
+    std::vector<std::thread> m_threads;
+    bool m_stop = false;
+
+    uint64_t m_bytes_in = 0;
+    uint64_t m_bytes_out = 0;
+    uint64_t m_frames_out = 0;
+    double m_encode_seconds = 0;
+};
+
+#endif
@@ -0,0 +1,347 @@
+#include "levels.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LEVELS_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LEVELS_NEON 1
+#endif
+
+// float partial sums are folded into a double this often to keep precision
+#define LEVELS_CHUNK 4096
+
+static inline uint32_t load_u16(const uint8_t* p, bool be) {
+    return be ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]);
+}
+
+static inline uint32_t load_u24(const uint8_t* p, bool be) {
+    // 24 bit formats use the low three bytes of a 32 bit word
+    return be ? ((uint32_t)p[1] << 16 | p[2] << 8 | p[3])
+              : ((uint32_t)p[2] << 16 | p[1] << 8 | p[0]);
+}
+
+static inline uint32_t load_u32(const uint8_t* p, bool be) {
+    return be ? ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | p[2] << 8 | p[3])
+              : ((uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | p[1] << 8 | p[0]);
+}
+
+static inline uint64_t load_u64(const uint8_t* p, bool be) {
+    uint64_t hi = load_u32(be ? p : p + 4, be);
+    uint64_t lo = load_u32(be ? p + 4 : p, be);
+    return hi << 32 | lo;
+}
+
+// Kernels for the native-order formats the capture usually runs in. Each
+// returns the peak in its own units and adds the sum of squares to *sumsq.
+
+static double stats_f32(const float* x, int64_t n, double* sumsq) {
+    int64_t i = 0;
+    float peak = 0;
+    double sum = 0;
+#if LEVELS_SSE2
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 vpeak = _mm_setzero_ps();
+    while (i + 4 <= n) {
+        int64_t end = (i + LEVELS_CHUNK < n) ? i + LEVELS_CHUNK : n;
+        __m128 vsum = _mm_setzero_ps();
+        for (; i + 4 <= end; i += 4) {
+            __m128 v = _mm_loadu_ps(x + i);
+            vpeak = _mm_max_ps(vpeak, _mm_and_ps(v, abs_mask));
+            vsum = _mm_add_ps(vsum, _mm_mul_ps(v, v));
+        }
+        float t[4];
+        _mm_storeu_ps(t, vsum);
+        sum += (double)t[0] + t[1] + t[2] + t[3];
+    }
+    float p[4];
+    _mm_storeu_ps(p, vpeak);
+    peak = fmaxf(fmaxf(p[0], p[1]), fmaxf(p[2], p[3]));
+#elif LEVELS_NEON
+    float32x4_t vpeak = vdupq_n_f32(0);
+    while (i + 4 <= n) {
+        int64_t end = (i + LEVELS_CHUNK < n) ? i + LEVELS_CHUNK : n;
+        float32x4_t vsum = vdupq_n_f32(0);
+        for (; i + 4 <= end; i += 4) {
+            float32x4_t v = vld1q_f32(x + i);
+            vpeak = vmaxq_f32(vpeak, vabsq_f32(v));
+            vsum = vmlaq_f32(vsum, v, v);
+        }
+        float t[4];
+        vst1q_f32(t, vsum);
+        sum += (double)t[0] + t[1] + t[2] + t[3];
+    }
+    float p[4];
+    vst1q_f32(p, vpeak);
+    peak = fmaxf(fmaxf(p[0], p[1]), fmaxf(p[2], p[3]));
+#endif
+    for (; i < n; i += 1) {
+        float v = x[i];
+        peak = fmaxf(peak, fabsf(v));
+        sum += (double)v * v;
+    }
+    *sumsq += sum;
+    return peak;
+}
+
+static double stats_s16(const int16_t* x, int64_t n, double* sumsq) {
+    int64_t i = 0;
+    int32_t hi = 0, lo = 0;
+    uint64_t sum = 0;
+#if LEVELS_SSE2
+    __m128i vmax = _mm_setzero_si128();
+    __m128i vmin = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(x + i));
+        vmax = _mm_max_epi16(vmax, v);
+        vmin = _mm_min_epi16(vmin, v);
+        // pairwise x*x sums reach 2^31, so widen them as unsigned
+        __m128i sq = _mm_madd_epi16(v, v);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+    }
+    int16_t mx[8], mn[8];
+    uint64_t a[2];
+    _mm_storeu_si128((__m128i*)mx, vmax);
+    _mm_storeu_si128((__m128i*)mn, vmin);
+    _mm_storeu_si128((__m128i*)a, acc);
+    for (int k = 0; k < 8; k += 1) {
+        hi = mx[k] > hi ? mx[k] : hi;
+        lo = mn[k] < lo ? mn[k] : lo;
+    }
+    sum = a[0] + a[1];
+#elif LEVELS_NEON
+    int16x8_t vmax = vdupq_n_s16(0);
+    int16x8_t vmin = vdupq_n_s16(0);
+    int64x2_t acc = vdupq_n_s64(0);
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(x + i);
+        vmax = vmaxq_s16(vmax, v);
+        vmin = vminq_s16(vmin, v);
+        acc = vpadalq_s32(acc, vmull_s16(vget_low_s16(v), vget_low_s16(v)));
+        acc = vpadalq_s32(acc, vmull_s16(vget_high_s16(v), vget_high_s16(v)));
+    }
+    int16_t mx[8], mn[8];
+    vst1q_s16(mx, vmax);
+    vst1q_s16(mn, vmin);
+    for (int k = 0; k < 8; k += 1) {
+        hi = mx[k] > hi ? mx[k] : hi;
+        lo = mn[k] < lo ? mn[k] : lo;
+    }
+    sum = (uint64_t)(vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1));
+#endif
+    for (; i < n; i += 1) {
+        int32_t v = x[i];
+        hi = v > hi ? v : hi;
+        lo = v < lo ? v : lo;
+        sum += (uint64_t)(v * v);
+    }
+    *sumsq += (double)sum;
+    return (double)(hi > -lo ? hi : -lo);
+}
+
+// 24 bit samples in the low three bytes of a native 32 bit word
+static double stats_s24(const int32_t* x, int64_t n, double* sumsq) {
+    int64_t i = 0;
+    int32_t peak = 0;
+    double sum = 0;
+#if LEVELS_SSE2
+    __m128i vpeak = _mm_setzero_si128();
+    while (i + 4 <= n) {
+        int64_t end = (i + LEVELS_CHUNK < n) ? i + LEVELS_CHUNK : n;
+        __m128 vsum = _mm_setzero_ps();
+        for (; i + 4 <= end; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(x + i));
+            v = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+            __m128i sign = _mm_srai_epi32(v, 31);
+            __m128i mag = _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+            // no _mm_max_epi32 before SSE4.1
+            __m128i gt = _mm_cmpgt_epi32(mag, vpeak);
+            vpeak = _mm_or_si128(_mm_and_si128(gt, mag), _mm_andnot_si128(gt, vpeak));
+            __m128 f = _mm_cvtepi32_ps(v);
+            vsum = _mm_add_ps(vsum, _mm_mul_ps(f, f));
+        }
+        float t[4];
+        _mm_storeu_ps(t, vsum);
+        sum += (double)t[0] + t[1] + t[2] + t[3];
+    }
+    int32_t p[4];
+    _mm_storeu_si128((__m128i*)p, vpeak);
+    for (int k = 0; k < 4; k += 1)
+        peak = p[k] > peak ? p[k] : peak;
+#elif LEVELS_NEON
+    int32x4_t vpeak = vdupq_n_s32(0);
+    while (i + 4 <= n) {
+        int64_t end = (i + LEVELS_CHUNK < n) ? i + LEVELS_CHUNK : n;
+        float32x4_t vsum = vdupq_n_f32(0);
+        for (; i + 4 <= end; i += 4) {
+            int32x4_t v = vshrq_n_s32(vshlq_n_s32(vld1q_s32(x + i), 8), 8);
+            vpeak = vmaxq_s32(vpeak, vabsq_s32(v));
+            float32x4_t f = vcvtq_f32_s32(v);
+            vsum = vmlaq_f32(vsum, f, f);
+        }
+        float t[4];
+        vst1q_f32(t, vsum);
+        sum += (double)t[0] + t[1] + t[2] + t[3];
+    }
+    int32_t p[4];
+    vst1q_s32(p, vpeak);
+    for (int k = 0; k < 4; k += 1)
+        peak = p[k] > peak ? p[k] : peak;
+#endif
+    for (; i < n; i += 1) {
+        int32_t v = (int32_t)((uint32_t)x[i] << 8) >> 8;
+        int32_t m = v < 0 ? -v : v;
+        peak = m > peak ? m : peak;
+        sum += (double)v * v;
+    }
+    *sumsq += sum;
+    return (double)peak;
+}
+
+// Scalar fallback for every other layout, measured in integer steps of `Load`
+template <class Load>
+static double stats_int(const uint8_t* p, int64_t samples, int step, Load load, double* sumsq) {
+    int64_t peak = 0;
+    double sum = 0;
+    for (int64_t i = 0; i < samples; i += 1, p += step) {
+        int64_t v = load(p);
+        sum += (double)v * (double)v;
+        if (v < 0)
+            v = -v;
+        if (v > peak)
+            peak = v;
+    }
+    *sumsq += sum;
+    return (double)peak;
+}
+
+template <class Load>
+static double stats_float(const uint8_t* p, int64_t samples, int step, Load load, double* sumsq) {
+    double peak = 0;
+    double sum = 0;
+    for (int64_t i = 0; i < samples; i += 1, p += step) {
+        double v = load(p);
+        sum += v * v;
+        peak = fmax(peak, fabs(v));
+    }
+    *sumsq += sum;
+    return peak;
+}
+
+static bool is_big_endian_format(enum SoundIoFormat fmt) {
+    switch (fmt) {
+        case SoundIoFormatS16BE: case SoundIoFormatU16BE: case SoundIoFormatS24BE:
+        case SoundIoFormatU24BE: case SoundIoFormatS32BE: case SoundIoFormatU32BE:
+        case SoundIoFormatFloat32BE: case SoundIoFormatFloat64BE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void block_stats(const char* buf, int64_t samples, enum SoundIoFormat fmt, BlockStats* out) {
+    const uint8_t* p = (const uint8_t*)buf;
+    bool be = is_big_endian_format(fmt);
+    double sumsq = 0;
+    double peak = 0;
+    double scale = 1.0;
+
+    out->peak = 0;
+    out->rms = 0;
+    if (samples <= 0)
+        return;
+
+    if (fmt == SoundIoFormatFloat32NE) {
+        peak = stats_f32((const float*)buf, samples, &sumsq);
+    } else if (fmt == SoundIoFormatS16NE) {
+        peak = stats_s16((const int16_t*)buf, samples, &sumsq);
+        scale = 32768.0;
+    } else if (fmt == SoundIoFormatS24NE) {
+        peak = stats_s24((const int32_t*)buf, samples, &sumsq);
+        scale = 8388608.0;
+    } else {
+        switch (fmt) {
+            case SoundIoFormatS8:
+                peak = stats_int(p, samples, 1, [](const uint8_t* q) {
+                    return (int64_t)(int8_t)q[0]; }, &sumsq);
+                scale = 128.0;
+                break;
+            case SoundIoFormatU8:
+                peak = stats_int(p, samples, 1, [](const uint8_t* q) {
+                    return (int64_t)q[0] - 128; }, &sumsq);
+                scale = 128.0;
+                break;
+            case SoundIoFormatS16LE: case SoundIoFormatS16BE:
+                peak = stats_int(p, samples, 2, [be](const uint8_t* q) {
+                    return (int64_t)(int16_t)load_u16(q, be); }, &sumsq);
+                scale = 32768.0;
+                break;
+            case SoundIoFormatU16LE: case SoundIoFormatU16BE:
+                peak = stats_int(p, samples, 2, [be](const uint8_t* q) {
+                    return (int64_t)load_u16(q, be) - 32768; }, &sumsq);
+                scale = 32768.0;
+                break;
+            case SoundIoFormatS24LE: case SoundIoFormatS24BE:
+                peak = stats_int(p, samples, 4, [be](const uint8_t* q) {
+                    return (int64_t)((int32_t)(load_u24(q, be) << 8) >> 8); }, &sumsq);
+                scale = 8388608.0;
+                break;
+            case SoundIoFormatU24LE: case SoundIoFormatU24BE:
+                peak = stats_int(p, samples, 4, [be](const uint8_t* q) {
+                    return (int64_t)load_u24(q, be) - 8388608; }, &sumsq);
+                scale = 8388608.0;
+                break;
+            case SoundIoFormatS32LE: case SoundIoFormatS32BE:
+                peak = stats_int(p, samples, 4, [be](const uint8_t* q) {
+                    return (int64_t)(int32_t)load_u32(q, be); }, &sumsq);
+                scale = 2147483648.0;
+                break;
+            case SoundIoFormatU32LE: case SoundIoFormatU32BE:
+                peak = stats_int(p, samples, 4, [be](const uint8_t* q) {
+                    return (int64_t)load_u32(q, be) - 2147483648LL; }, &sumsq);
+                scale = 2147483648.0;
+                break;
+            case SoundIoFormatFloat32LE: case SoundIoFormatFloat32BE:
+                peak = stats_float(p, samples, 4, [be](const uint8_t* q) {
+                    uint32_t u = load_u32(q, be);
+                    float v;
+                    memcpy(&v, &u, sizeof(v));
+                    return (double)v; }, &sumsq);
+                break;
+            case SoundIoFormatFloat64LE: case SoundIoFormatFloat64BE:
+                peak = stats_float(p, samples, 8, [be](const uint8_t* q) {
+                    uint64_t u = load_u64(q, be);
+                    double v;
+                    memcpy(&v, &u, sizeof(v));
+                    return v; }, &sumsq);
+                break;
+            default:
+                return;
+        }
+    }
+
+    out->peak = peak / scale;
+    out->rms = sqrt(sumsq / (double)samples) / scale;
+}
+
+double block_peak(const char* buf, int64_t samples, enum SoundIoFormat fmt) {
+    BlockStats stats;
+    block_stats(buf, samples, fmt, &stats);
+    return stats.peak;
+}
+
+double dbfs_to_linear(double dbfs) {
+    return pow(10.0, dbfs / 20.0);
+}
+
+double linear_to_dbfs(double linear) {
+    if (linear <= 0)
+        return -INFINITY;
+    return 20.0 * log10(linear);
+}
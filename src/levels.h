@@ -0,0 +1,25 @@
+#ifndef AUDIOCAPTURE_LEVELS_H
+#define AUDIOCAPTURE_LEVELS_H
+
+#include "soundio/soundio.h"
+
+#include <stdint.h>
+
+struct BlockStats {
+    double peak = 0;   // largest |x|, fraction of full scale
+    double rms = 0;    // root mean square, fraction of full scale
+};
+
+// Peak and RMS of `samples` interleaved samples in the capture's native
+// format. Works directly on the ring buffer bytes, so the writer can watch
+// levels without converting. Float32, S16 and S24 in native byte order run
+// SSE2 or NEON kernels; every other format takes a scalar path.
+void block_stats(const char* buf, int64_t samples, enum SoundIoFormat fmt, BlockStats* out);
+
+// Peak magnitude only, as a fraction of full scale (0..1)
+double block_peak(const char* buf, int64_t samples, enum SoundIoFormat fmt);
+
+double dbfs_to_linear(double dbfs);
+double linear_to_dbfs(double linear);
+
+#endif
@@ -0,0 +1,239 @@
+#include "load_shedder.h"
+
+#include <iostream>
+#include <algorithm>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+static const struct { const char* name; ShedStep step; } step_names[] = {
+    {"drop-oldest", ShedDropOldest},
+    {"channels", ShedDropChannels},
+    {"s16", ShedNarrowFormat},
+    {"rate", ShedLowerRate},
+    {"spill", ShedSpill},
+};
+
+const char* shed_step_name(ShedStep step) {
+    for (auto& n : step_names) {
+        if (n.step == step)
+            return n.name;
+    }
+    return "?";
+}
+
+int parse_shed_ladder(const char* list, vector<ShedStep>* ladder) {
+    ladder->clear();
+    string rest = list;
+    while (!rest.empty()) {
+        size_t comma = rest.find(',');
+        string name = rest.substr(0, comma);
+        rest = comma == string::npos ? string() : rest.substr(comma + 1);
+        bool found = false;
+        for (auto& n : step_names) {
+            if (name == n.name) {
+                if (find(ladder->begin(), ladder->end(), n.step) != ladder->end())
+                    return -1;
+                ladder->push_back(n.step);
+                found = true;
+            }
+        }
+        if (!found)
+            return -1;
+    }
+    return ladder->empty() ? -1 : 0;
+}
+
+static bool is_reduction(ShedStep step) {
+    return step == ShedDropChannels || step == ShedNarrowFormat || step == ShedLowerRate;
+}
+
+LoadShedder::LoadShedder(const ShedConfig& config)
+: m_config(config), m_last_step_ns(INT64_MIN / 2) {
+    if (m_config.keep_channels.empty())
+        m_config.keep_channels.push_back(0);
+}
+
+LoadShedder::~LoadShedder() {
+    if (m_log)
+        fclose(m_log);
+}
+
+int LoadShedder::open_log(const string& path) {
+    m_log = fopen(path.c_str(), "w");
+    if (!m_log) {
+        cerr << "unable to open " << path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    fprintf(m_log, "# capture_frame realtime_ns level direction step ring_fill\n");
+    fflush(m_log);
+    return 0;
+}
+
+int LoadShedder::update(double fill, int64_t frame, int64_t now_ns) {
+    int64_t hold_ns = (int64_t)(m_config.hold_seconds * 1e9);
+    int64_t recover_ns = (int64_t)(m_config.recover_seconds * 1e9);
+    int direction = 0;
+    if (fill >= m_config.high_water) {
+        m_low_since_ns = -1;
+        if (m_level < (int)m_config.ladder.size() && now_ns - m_last_step_ns >= hold_ns)
+            direction = 1;
+    } else if (fill <= m_config.low_water) {
+        if (m_low_since_ns < 0)
+            m_low_since_ns = now_ns;
+        if (m_level > 0 && now_ns - m_low_since_ns >= recover_ns)
+            direction = -1;
+    } else {
+        m_low_since_ns = -1;
+    }
+    if (!direction)
+        return 0;
+
+    ShedStep step = m_config.ladder[direction > 0 ? m_level : m_level - 1];
+    m_level += direction;
+    m_last_step_ns = now_ns;
+    if (direction > 0) {
+        m_steps_up += 1;
+        m_max_level = max(m_max_level, m_level);
+    } else {
+        // every further step down waits a whole recovery period again
+        m_low_since_ns = now_ns;
+        m_steps_down += 1;
+    }
+    if (m_log) {
+        fprintf(m_log, "%lld %lld %d %s %s %.3f\n", (long long)frame, (long long)realtime_ns(),
+                m_level, direction > 0 ? "up" : "down", shed_step_name(step), fill);
+        fflush(m_log);
+    }
+    return direction;
+}
+
+bool LoadShedder::active(ShedStep step) const {
+    for (int i = 0; i < m_level; i += 1) {
+        if (m_config.ladder[i] == step)
+            return true;
+    }
+    return false;
+}
+
+int LoadShedder::reductions(int level) const {
+    int count = 0;
+    for (int i = 0; i < level && i < (int)m_config.ladder.size(); i += 1) {
+        if (is_reduction(m_config.ladder[i]))
+            count += 1;
+    }
+    return count;
+}
+
+ShedReduction LoadShedder::reduction(int reductions) const {
+    ShedReduction out;
+    for (size_t i = 0; i < m_config.ladder.size() && reductions > 0; i += 1) {
+        ShedStep step = m_config.ladder[i];
+        if (!is_reduction(step))
+            continue;
+        if (step == ShedDropChannels)
+            out.channels = m_config.keep_channels;
+        else if (step == ShedNarrowFormat)
+            out.narrow = true;
+        else
+            out.rate = m_config.lower_rate;
+        reductions -= 1;
+    }
+    return out;
+}
+
+ShedSeries::ShedSeries(const SegmentConfig& native, SoundIoFormat format, SoundIoFormat file_format,
+                       int channels, const ShedReduction& reduction, int n, Dither* dither)
+: m_in_format(format), m_in_channels(channels), m_in_sample_bytes(sample_format_bytes(format)),
+  m_keep(reduction.channels), m_rate(0), m_dither(dither) {
+    m_out_format = reduction.narrow && sample_format_bytes(file_format) > 2 ?
+        SoundIoFormatS16LE : file_format;
+    int out_channels = m_keep.empty() ? channels : (int)m_keep.size();
+    m_out_frame_bytes = sample_format_bytes(m_out_format) * out_channels;
+    if (reduction.rate > 0 && reduction.rate < native.sample_rate)
+        m_rate = reduction.rate;
+
+    SegmentConfig config = native;
+    config.base_path = native.base_path + ".shed" + to_string(n);
+    config.bytes_per_frame = m_out_frame_bytes;
+    if (config.container == ContainerWav)
+        wav_format_from_soundio(m_out_format, out_channels, native.sample_rate, &config.wav_format);
+    if (m_rate)
+        m_rates = new RateSplitWriter(config, m_out_format, out_channels, vector<int>(1, m_rate), dither);
+    else
+        m_writer = new SegmentWriter(config);
+}
+
+ShedSeries::~ShedSeries() {
+    delete m_writer;
+    delete m_rates;
+}
+
+int ShedSeries::open(int64_t capture_start_ns, int64_t frames_before) {
+    int ret = m_rates ? m_rates->open(capture_start_ns) : m_writer->open(capture_start_ns);
+    if (ret)
+        return ret;
+    m_open = true;
+    return skip(frames_before, true);
+}
+
+int ShedSeries::write(const char* buf, int64_t bytes) {
+    int64_t frames = bytes / (m_in_sample_bytes * m_in_channels);
+    if (!m_keep.empty()) {
+        int out_channels = (int)m_keep.size();
+        m_picked.resize((size_t)(frames * out_channels * m_in_sample_bytes));
+        char* dst = m_picked.data();
+        for (int64_t i = 0; i < frames; i += 1) {
+            const char* frame = buf + i * m_in_channels * m_in_sample_bytes;
+            for (int ch : m_keep) {
+                memcpy(dst, frame + ch * m_in_sample_bytes, m_in_sample_bytes);
+                dst += m_in_sample_bytes;
+            }
+        }
+        buf = m_picked.data();
+    }
+    if (m_out_format != m_in_format) {
+        int channels = m_keep.empty() ? m_in_channels : (int)m_keep.size();
+        m_converted.resize((size_t)(frames * m_out_frame_bytes));
+        samples_convert(buf, m_in_format, frames * channels, m_converted.data(), m_out_format,
+                        m_dither);
+        buf = m_converted.data();
+    }
+    bytes = frames * m_out_frame_bytes;
+    return m_rates ? m_rates->write(buf, bytes) : m_writer->write(buf, bytes);
+}
+
+int ShedSeries::skip(int64_t frames, bool new_segment) {
+    return m_rates ? m_rates->skip(frames, new_segment) : m_writer->skip(frames, new_segment);
+}
+
+int ShedSeries::spill(const string& dir) {
+    return m_rates ? m_rates->spill(dir) : m_writer->spill(dir);
+}
+
+int ShedSeries::close() {
+    if (!m_open)
+        return 0;
+    m_open = false;
+    return m_rates ? m_rates->close() : m_writer->close();
+}
+
+int64_t ShedSeries::frames_written() const {
+    return m_rates ? m_rates->frames_written(0) : m_writer->frames_written();
+}
+
+string ShedSeries::describe() const {
+    string out;
+    if (!m_keep.empty()) {
+        out = "channels ";
+        for (size_t i = 0; i < m_keep.size(); i += 1)
+            out += (i ? "," : "") + to_string(m_keep[i]);
+        out += ", ";
+    }
+    out += soundio_format_string(m_out_format);
+    if (m_rate)
+        out += ", " + to_string(m_rate) + " Hz";
+    return out;
+}
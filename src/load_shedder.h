@@ -0,0 +1,149 @@
+#ifndef AUDIOCAPTURE_LOAD_SHEDDER_H
+#define AUDIOCAPTURE_LOAD_SHEDDER_H
+
+#include "segment_writer.h"
+#include "rate_split_writer.h"
+#include "dsp/convert.h++"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// What the writer gives up, one step at a time, when the disk cannot keep
+// up with the capture.
+enum ShedStep {
+    ShedDropOldest,     // skip the oldest backlog down to the low-water mark
+    ShedDropChannels,   // write only ShedConfig::keep_channels
+    ShedNarrowFormat,   // write 16 bit samples
+    ShedLowerRate,      // write at ShedConfig::lower_rate
+    ShedSpill,          // open new segments in ShedConfig::spill_dir
+};
+
+struct ShedConfig {
+    std::vector<ShedStep> ladder;       // taken in this order; empty = never shed
+    double high_water = 0.5;            // ring fill that takes the next step
+    double low_water = 0.1;             // ring fill that counts as caught up
+    double hold_seconds = 2;            // between steps up, to see the last one work
+    double recover_seconds = 30;        // caught up this long before each step down
+    std::vector<int> keep_channels;     // for ShedDropChannels; empty = channel 0
+    int lower_rate = 16000;
+    std::string spill_dir;
+};
+
+// The channel, format and rate steps up to some level, added up
+struct ShedReduction {
+    std::vector<int> channels;          // kept, in this order; empty = all
+    bool narrow = false;
+    int rate = 0;                       // 0 = the capture rate
+};
+
+// The policy: looks at how full the capture ring is once per drain pass
+// and moves up the ladder while the backlog stays above the high-water
+// mark, and back down after it has stayed below the low-water mark for
+// recover_seconds. Level n means the first n steps of the ladder are in
+// force. The writer carries the steps out (drain_shedding in
+// audiocapture.cpp); every change of level is logged to
+//
+//   <capture frame> <realtime ns> <level> up|down <step> <ring fill>
+//
+// in the file given to open_log(), normally <base_path>.shed.
+class LoadShedder
+{
+public:
+    explicit LoadShedder(const ShedConfig& config);
+    ~LoadShedder();
+
+    LoadShedder(const LoadShedder&) = delete;
+    LoadShedder& operator=(const LoadShedder&) = delete;
+
+    int open_log(const std::string& path);
+
+    // `fill` is the ring's fill as a fraction of its capacity and `frame`
+    // the capture frame at the head of the backlog. Takes at most one step
+    // and returns +1 (up), -1 (down) or 0.
+    int update(double fill, int64_t frame, int64_t now_ns);
+
+    const ShedConfig& config() const { return m_config; }
+    int level() const { return m_level; }
+    bool active(ShedStep step) const;
+
+    // channel/format/rate steps among the first `level` steps; each count
+    // from 1 up is one ShedSeries
+    int reductions(int level) const;
+    ShedReduction reduction(int reductions) const;
+
+    void count_dropped(int64_t frames) { m_frames_dropped += frames; }
+
+    uint64_t steps_up() const { return m_steps_up; }
+    uint64_t steps_down() const { return m_steps_down; }
+    int max_level() const { return m_max_level; }
+    int64_t frames_dropped() const { return m_frames_dropped; }
+
+private:
+    ShedConfig m_config;
+    int m_level = 0;
+    int64_t m_last_step_ns;
+    int64_t m_low_since_ns = -1;
+    FILE* m_log = nullptr;
+
+    uint64_t m_steps_up = 0;
+    uint64_t m_steps_down = 0;
+    int m_max_level = 0;
+    int64_t m_frames_dropped = 0;
+};
+
+// What the capture is written as while a shed level with channel, format
+// or rate steps is in force: `<base_path>.shed<n>` (with a `.<rate>hz`
+// suffix when the rate is lowered), where n counts those steps. The native
+// files log the same frames as gaps, and a series logs everything outside
+// its own levels as gaps, so every file set keeps the capture timeline.
+//
+// Frames come in as the device delivers them; raw and WAV containers only.
+class ShedSeries
+{
+public:
+    ShedSeries(const SegmentConfig& native, SoundIoFormat format, SoundIoFormat file_format,
+               int channels, const ShedReduction& reduction, int n, Dither* dither);
+    ~ShedSeries();
+
+    ShedSeries(const ShedSeries&) = delete;
+    ShedSeries& operator=(const ShedSeries&) = delete;
+
+    // Opened on first use; `frames_before` capture frames went elsewhere.
+    int open(int64_t capture_start_ns, int64_t frames_before);
+    bool is_open() const { return m_open; }
+
+    // whole interleaved frames in the capture's format and channels
+    int write(const char* buf, int64_t bytes);
+    int skip(int64_t frames, bool new_segment);
+    int spill(const std::string& dir);
+    int close();
+
+    int64_t frames_written() const;
+    // e.g. "channels 0, s16le, 16000 Hz"
+    std::string describe() const;
+
+private:
+    SoundIoFormat m_in_format;
+    SoundIoFormat m_out_format;
+    int m_in_channels;
+    int m_in_sample_bytes;
+    int m_out_frame_bytes;
+    std::vector<int> m_keep;        // empty = all channels
+    int m_rate;
+    Dither* m_dither;
+    bool m_open = false;
+
+    SegmentWriter* m_writer = nullptr;
+    RateSplitWriter* m_rates = nullptr;
+    std::vector<char> m_picked;
+    std::vector<char> m_converted;
+};
+
+const char* shed_step_name(ShedStep step);
+
+// "drop-oldest,s16,spill"; returns 0, or -1 on an unknown or repeated step
+int parse_shed_ladder(const char* list, std::vector<ShedStep>* ladder);
+
+#endif
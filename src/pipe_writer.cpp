@@ -0,0 +1,226 @@
+#include "pipe_writer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+using namespace std;
+
+bool is_stream_path(const string& path) {
+    if (path == "-")
+        return true;
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+PipeWriter::PipeWriter() : m_bytes_written(0) {
+}
+
+PipeWriter::~PipeWriter() {
+    close();
+}
+
+int PipeWriter::open(const string& path, int bytes_per_frame, int pipe_bytes) {
+    if (path == "-") {
+        m_fd = STDOUT_FILENO;
+        m_owns_fd = false;
+    } else {
+        // blocks until a reader opens the FIFO, like any shell pipeline
+        m_fd = ::open(path.c_str(), O_WRONLY);
+        if (m_fd < 0) {
+            cerr << "unable to open " << path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        m_owns_fd = true;
+    }
+    m_bytes_per_frame = bytes_per_frame;
+
+    // O_NONBLOCK belongs to the open file description, which for stdout is
+    // shared with the shell and the rest of the pipeline and would stay
+    // set if we died before close(); only a FIFO we opened ourselves gets
+    // it, stdout is written blocking from write_loop()
+    m_nonblocking = m_owns_fd;
+    if (m_nonblocking) {
+        int flags = fcntl(m_fd, F_GETFL);
+        if (flags == -1 || fcntl(m_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+            cerr << "unable to make output non-blocking: " << strerror(errno) << endl;
+            return 1;
+        }
+    }
+
+    m_pipe_bytes = 65536;   // the common default when it cannot be queried
+#if defined(F_SETPIPE_SZ) && defined(F_GETPIPE_SZ)
+    // grows up to /proc/sys/fs/pipe-max-size for unprivileged users
+    fcntl(m_fd, F_SETPIPE_SZ, pipe_bytes);
+    int size = fcntl(m_fd, F_GETPIPE_SZ);
+    if (size > 0)
+        m_pipe_bytes = size;
+#else
+    (void)pipe_bytes;
+#endif
+
+    if (!m_nonblocking) {
+        m_stop = false;
+        m_failed = false;
+        m_thread = thread(&PipeWriter::write_loop, this);
+    }
+    return 0;
+}
+
+int64_t PipeWriter::write(const char* buf, int64_t bytes) {
+    if (m_fd < 0)
+        return -1;
+    if (!m_nonblocking)
+        return queue(buf, bytes);
+    int64_t accepted = 0;
+    for (;;) {
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if (!m_carry.empty()) {
+            iov[iovcnt].iov_base = m_carry.data();
+            iov[iovcnt].iov_len = m_carry.size();
+            iovcnt += 1;
+        }
+        if (accepted < bytes) {
+            iov[iovcnt].iov_base = (void*)(buf + accepted);
+            iov[iovcnt].iov_len = (size_t)(bytes - accepted);
+            iovcnt += 1;
+        }
+        if (iovcnt == 0)
+            break;
+        ssize_t n = writev(m_fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno != EPIPE)
+                cerr << "output write error: " << strerror(errno) << endl;
+            return -1;
+        }
+        m_bytes_written += n;
+        if (!m_carry.empty()) {
+            size_t from_carry = min((size_t)n, m_carry.size());
+            m_carry.erase(m_carry.begin(), m_carry.begin() + from_carry);
+            n -= from_carry;
+        }
+        accepted += n;
+        m_frame_offset = (m_frame_offset + n) % m_bytes_per_frame;
+        if (n == 0 && !m_carry.empty())
+            break;
+    }
+    return accepted;
+}
+
+// stdout: whole frames for the writer thread, at most one pipe buffer
+// waiting besides the batch it is writing
+int64_t PipeWriter::queue(const char* buf, int64_t bytes) {
+    lock_guard<mutex> lock(m_mutex);
+    if (m_failed)
+        return -1;
+    int64_t room = (int64_t)m_pipe_bytes - (int64_t)m_queued.size();
+    int64_t take = min(bytes, room) / m_bytes_per_frame * m_bytes_per_frame;
+    if (take > 0) {
+        m_queued.insert(m_queued.end(), buf, buf + take);
+        m_wake.notify_one();
+    }
+    return take;
+}
+
+void PipeWriter::write_loop() {
+    vector<char> batch;
+    unique_lock<mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_stop || !m_queued.empty(); });
+        if (m_queued.empty())
+            return;
+        batch.swap(m_queued);
+        m_queued.clear();
+        lock.unlock();
+
+        // blocking, at the reader's pace; the drain loop never waits here
+        size_t done = 0;
+        bool failed = false;
+        while (done < batch.size()) {
+            ssize_t n = ::write(m_fd, batch.data() + done, batch.size() - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                if (errno != EPIPE)
+                    cerr << "output write error: " << strerror(errno) << endl;
+                failed = true;
+                break;
+            }
+            m_bytes_written += n;
+            done += n;
+        }
+
+        lock.lock();
+        if (failed) {
+            m_failed = true;
+            m_queued.clear();
+            return;
+        }
+    }
+}
+
+int64_t PipeWriter::drop(const char* buf, int64_t bytes) {
+    if (bytes <= 0)
+        return 0;
+    int64_t consumed = 0;
+    if (m_frame_offset != 0) {
+        // keep the tail of the frame the pipe already has a piece of
+        int64_t tail = min((int64_t)(m_bytes_per_frame - m_frame_offset), bytes);
+        m_carry.insert(m_carry.end(), buf, buf + tail);
+        m_frame_offset = (m_frame_offset + tail) % m_bytes_per_frame;
+        consumed = tail;
+    }
+    int64_t frames = (bytes - consumed) / m_bytes_per_frame;
+    if (frames > 0) {
+        m_frames_dropped += frames;
+        m_drop_events += 1;
+    }
+    return consumed + frames * m_bytes_per_frame;
+}
+
+void PipeWriter::close(const char* tail, int64_t tail_bytes) {
+    if (m_fd < 0)
+        return;
+    if (!m_nonblocking) {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if (!m_failed && tail_bytes > 0)
+                m_queued.insert(m_queued.end(), tail, tail + tail_bytes);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+        m_fd = -1;
+        return;
+    }
+    if (m_nonblocking) {
+        int flags = fcntl(m_fd, F_GETFL);
+        if (flags != -1)
+            fcntl(m_fd, F_SETFL, flags & ~O_NONBLOCK);
+    }
+    m_carry.insert(m_carry.end(), tail, tail + max(tail_bytes, (int64_t)0));
+    size_t done = 0;
+    while (done < m_carry.size()) {
+        ssize_t n = ::write(m_fd, m_carry.data() + done, m_carry.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        m_bytes_written += n;
+        done += n;
+    }
+    m_carry.clear();
+    if (m_owns_fd)
+        ::close(m_fd);
+    m_fd = -1;
+}
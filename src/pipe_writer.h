@@ -0,0 +1,83 @@
+#ifndef AUDIOCAPTURE_PIPE_WRITER_H
+#define AUDIOCAPTURE_PIPE_WRITER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams interleaved frames to stdout or a FIFO without ever blocking the
+// drain loop.
+//
+// Where the platform allows, the pipe buffer is grown with F_SETPIPE_SZ so
+// one batch fits. A FIFO is opened non-blocking and write() hands it as
+// much as it takes right now in a single writev. stdout stays blocking,
+// since its flags are shared with the rest of the pipeline and would
+// outlive a crash; there write() queues up to one pipe buffer of frames
+// for a writer thread, which writes each batch whole. Either way write()
+// reports how much was accepted; the caller leaves the rest in its ring
+// buffer and offers it again, so short stalls of the reader cost nothing. Only when the backlog grows past what the
+// caller is willing to hold does it drop() the oldest frames, which are
+// counted instead of written.
+//
+// The stream stays frame aligned: if the pipe accepted part of a frame the
+// rest of that frame is kept here and written ahead of the next batch.
+class PipeWriter
+{
+public:
+    PipeWriter();
+    ~PipeWriter();
+
+    PipeWriter(const PipeWriter&) = delete;
+    PipeWriter& operator=(const PipeWriter&) = delete;
+
+    // "-" is stdout; anything else is opened for writing (normally a FIFO)
+    int open(const std::string& path, int bytes_per_frame, int pipe_bytes);
+
+    // Returns the bytes of `buf` accepted, or -1 when the reader is gone.
+    int64_t write(const char* buf, int64_t bytes);
+
+    // Discard whole frames from the head of `buf`, at most `bytes`.
+    // Returns the bytes the caller should consume.
+    int64_t drop(const char* buf, int64_t bytes);
+
+    // Write whatever is held back plus `tail` (the caller's unwritten
+    // frames), blocking this time, then close.
+    void close(const char* tail = nullptr, int64_t tail_bytes = 0);
+
+    // pipe buffer size in effect (a good batch size)
+    int pipe_bytes() const { return m_pipe_bytes; }
+    uint64_t bytes_written() const { return m_bytes_written; }
+    uint64_t frames_dropped() const { return m_frames_dropped; }
+    uint64_t drop_events() const { return m_drop_events; }
+
+private:
+    int64_t queue(const char* buf, int64_t bytes);
+    void write_loop();
+
+    int m_fd = -1;
+    bool m_owns_fd = false;
+    bool m_nonblocking = false;    // O_NONBLOCK set on m_fd by open(); else threaded
+    int m_bytes_per_frame = 0;
+    int m_pipe_bytes = 0;
+    int64_t m_frame_offset = 0;    // bytes of the current frame already written
+    std::vector<char> m_carry;     // rest of a partly written frame
+    std::atomic<uint64_t> m_bytes_written;
+
+    // stdout: frames waiting for write_loop()
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<char> m_queued;
+    bool m_stop = false;
+    bool m_failed = false;         // the reader went away
+    uint64_t m_frames_dropped = 0;
+    uint64_t m_drop_events = 0;
+};
+
+bool is_stream_path(const std::string& path);
+
+#endif
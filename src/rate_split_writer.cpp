@@ -0,0 +1,141 @@
+#include "rate_split_writer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+#define RATE_SPLIT_CHUNK 1024
+
+RateSplitWriter::RateSplitWriter(const SegmentConfig& native, SoundIoFormat format, int channels,
+                                 const vector<int>& rates, Dither* dither)
+: m_format(format), m_channels(channels), m_sample_rate(native.sample_rate),
+  m_frame_bytes(sample_format_bytes(format) * channels), m_dither(dither), m_rates(rates),
+  m_capture_frames(0), m_running(false) {
+    int K = (int)m_rates.size();
+    int lowest = m_sample_rate;
+    for (int rate : m_rates) {
+        SegmentConfig config = native;
+        config.base_path = native.base_path + "." + to_string(rate) + "hz";
+        config.sample_rate = rate;
+        config.bytes_per_frame = m_frame_bytes;
+        if (config.container == ContainerWav)
+            wav_format_from_soundio(format, channels, rate, &config.wav_format);
+        m_writers.push_back(new SegmentWriter(config));
+        lowest = min(lowest, rate);
+    }
+
+    m_trim.resize(K);
+    m_accounted.assign(K, 0);
+    m_interleaved.resize((size_t)RATE_SPLIT_CHUNK * channels);
+    m_out.resize(K);
+    size_t most = 0;
+    for (int k = 0; k < K; k += 1) {
+        // the transition band is a tenth of the lowest rate: 16k keeps
+        // 7.2k, 8k keeps 3.2k
+        MultiResampler* resampler = new MultiResampler(m_sample_rate, m_rates[k], lowest / 10.0, channels);
+        m_resamplers.push_back(resampler);
+        m_trim[k] = llround(resampler->latency());
+        size_t size = (size_t)max(resampler->max_output() * RATE_SPLIT_CHUNK, resampler->max_flush());
+        m_out[k].resize(size * channels);
+        most = max(most, size);
+    }
+    m_bytes.resize(most * m_frame_bytes);
+}
+
+RateSplitWriter::~RateSplitWriter() {
+    for (SegmentWriter* writer : m_writers)
+        delete writer;
+    for (MultiResampler* resampler : m_resamplers)
+        delete resampler;
+}
+
+int RateSplitWriter::open(int64_t capture_start_ns) {
+    for (SegmentWriter* writer : m_writers) {
+        if (writer->open(capture_start_ns))
+            return 1;
+    }
+    return 0;
+}
+
+// Drop what is still filter latency from one rate's output and write
+// the rest.
+int RateSplitWriter::emit(int k, int count) {
+    int drop = (int)min<int64_t>(m_trim[k], count);
+    m_trim[k] -= drop;
+    int frames = count - drop;
+    if (frames <= 0)
+        return 0;
+    samples_from_double(m_out[k].data() + (size_t)drop * m_channels, (int64_t)frames * m_channels,
+                        m_format, m_bytes.data(), m_dither);
+    m_accounted[k] += frames;
+    return m_writers[k]->write(m_bytes.data(), (int64_t)frames * m_frame_bytes);
+}
+
+// `frames` of m_interleaved through every rate's resampler, or their flush
+int RateSplitWriter::run(int frames, bool flush) {
+    if (flush && !m_running)
+        return 0;
+    m_running = !flush;
+    for (size_t k = 0; k < m_rates.size(); k += 1) {
+        MultiResampler* resampler = m_resamplers[k];
+        int count = flush ? resampler->flush(m_out[k].data())
+                          : resampler->process(m_interleaved.data(), frames, m_out[k].data());
+        if (emit((int)k, count))
+            return 1;
+    }
+    return 0;
+}
+
+int RateSplitWriter::write(const char* buf, int64_t bytes) {
+    int64_t frames = bytes / m_frame_bytes;
+    m_capture_frames += frames;
+    while (frames > 0) {
+        int n = (int)min<int64_t>(frames, RATE_SPLIT_CHUNK);
+        samples_to_double(buf, m_format, (int64_t)n * m_channels, m_interleaved.data());
+        if (run(n, false))
+            return 1;
+        buf += (int64_t)n * m_frame_bytes;
+        frames -= n;
+    }
+    return 0;
+}
+
+int RateSplitWriter::skip(int64_t frames, bool new_segment) {
+    if (m_running) {
+        // finish the run before the gap, then start the filters afresh
+        // after it; back to back skips find them fresh already
+        if (run(0, true))
+            return 1;
+        for (size_t k = 0; k < m_rates.size(); k += 1) {
+            m_resamplers[k]->reset();
+            m_trim[k] = llround(m_resamplers[k]->latency());
+        }
+    }
+    m_capture_frames += frames;
+    for (size_t k = 0; k < m_rates.size(); k += 1) {
+        int64_t target = m_capture_frames * m_rates[k] / m_sample_rate;
+        int64_t skipped = max<int64_t>(0, target - m_accounted[k]);
+        if (m_writers[k]->skip(skipped, new_segment))
+            return 1;
+        m_accounted[k] += skipped;
+    }
+    return 0;
+}
+
+int RateSplitWriter::spill(const string& dir) {
+    for (SegmentWriter* writer : m_writers) {
+        if (writer->spill(dir))
+            return 1;
+    }
+    return 0;
+}
+
+int RateSplitWriter::close() {
+    int ret = run(0, true);
+    for (SegmentWriter* writer : m_writers) {
+        if (writer->close())
+            ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,66 @@
+#ifndef AUDIOCAPTURE_RATE_SPLIT_WRITER_H
+#define AUDIOCAPTURE_RATE_SPLIT_WRITER_H
+
+#include "segment_writer.h"
+#include "dsp/convert.h++"
+#include "dsp/multiresampler.h++"
+
+#include <stdint.h>
+#include <vector>
+
+// Extra copies of the capture at other sample rates: one SegmentWriter
+// per rate, written under `<base_path>.<rate>hz`. Each rate has one
+// MultiResampler that takes the capture's interleaved frames as they are
+// and runs every channel through each filter tap at once.
+//
+// Frames come in and go out in one PCM sample format (raw and WAV
+// containers only). Every rate is trimmed by its filter latency so it
+// lines up with the native file. A skip() ends a run: the filters are
+// flushed and restarted, and each rate skips the frames that bring it
+// back in step with the capture timeline.
+class RateSplitWriter
+{
+public:
+    // `native` describes the capture's own files; only its base path,
+    // container and segment limits carry over.
+    RateSplitWriter(const SegmentConfig& native, SoundIoFormat format, int channels,
+                    const std::vector<int>& rates, Dither* dither);
+    ~RateSplitWriter();
+
+    int open(int64_t capture_start_ns);
+
+    // whole interleaved frames
+    int write(const char* buf, int64_t bytes);
+    int skip(int64_t frames, bool new_segment);
+    int close();
+
+    // SegmentWriter::spill for every rate
+    int spill(const std::string& dir);
+
+    int rate_count() const { return (int)m_rates.size(); }
+    int rate(int i) const { return m_rates[i]; }
+    int64_t frames_written(int i) const { return m_writers[i]->frames_written(); }
+
+private:
+    int run(int frames, bool flush);
+    int emit(int k, int count);
+
+    SoundIoFormat m_format;
+    int m_channels;
+    int m_sample_rate;
+    int m_frame_bytes;
+    Dither* m_dither;
+    std::vector<int> m_rates;
+    std::vector<SegmentWriter*> m_writers;     // [rate]
+    std::vector<MultiResampler*> m_resamplers; // [rate]
+    std::vector<int64_t> m_trim;               // [rate] outputs still to drop
+    std::vector<int64_t> m_accounted;          // [rate] frames written + skipped
+    int64_t m_capture_frames;
+    bool m_running;                            // input since the last flush
+
+    std::vector<double> m_interleaved;         // CHUNK frames of input
+    std::vector<std::vector<double>> m_out;    // [rate], interleaved frames
+    std::vector<char> m_bytes;
+};
+
+#endif
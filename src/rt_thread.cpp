@@ -0,0 +1,151 @@
+#include "rt_thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+using namespace std;
+
+static int pin_this_thread(const vector<int>& cpus) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+            return EINVAL;
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    // macOS only takes affinity tags as hints; nothing to pin with
+    (void)cpus;
+    return ENOTSUP;
+#endif
+}
+
+static int schedule_this_thread(int policy, int priority) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    return pthread_setschedparam(pthread_self(), policy, &param);
+}
+
+ThreadTuningResult tune_this_thread(const ThreadTuning& tuning) {
+    ThreadTuningResult result;
+    int err;
+
+    if (!tuning.cpus.empty()) {
+        result.affinity_error = pin_this_thread(tuning.cpus);
+        result.pinned = result.affinity_error == 0;
+    }
+
+    if (tuning.policy != SCHED_OTHER) {
+        int priority = tuning.priority;
+        int lo = sched_get_priority_min(tuning.policy);
+        int hi = sched_get_priority_max(tuning.policy);
+        if (priority < lo)
+            priority = lo;
+        if (priority > hi)
+            priority = hi;
+        err = schedule_this_thread(tuning.policy, priority);
+#ifdef RLIMIT_RTPRIO
+        struct rlimit limit;
+        if (err == EPERM && getrlimit(RLIMIT_RTPRIO, &limit) == 0 &&
+            limit.rlim_cur != RLIM_INFINITY && (int)limit.rlim_cur >= lo &&
+            (int)limit.rlim_cur < priority) {
+            // an unprivileged user may still go up to the limit
+            result.sched_error = err;
+            priority = (int)limit.rlim_cur;
+            err = schedule_this_thread(tuning.policy, priority);
+        }
+#endif
+        if (err == 0) {
+            result.policy = tuning.policy;
+            result.priority = priority;
+        } else {
+            result.sched_error = err;
+        }
+    }
+    return result;
+}
+
+static const char* policy_name(int policy) {
+    switch (policy) {
+        case SCHED_FIFO: return "SCHED_FIFO";
+        case SCHED_RR:   return "SCHED_RR";
+    }
+    return "SCHED_OTHER";
+}
+
+string describe_tuning(const ThreadTuning& tuning, const ThreadTuningResult& result) {
+    string out;
+    char buf[128];
+    if (!tuning.cpus.empty()) {
+        out = "cpus ";
+        for (size_t i = 0; i < tuning.cpus.size(); i += 1) {
+            snprintf(buf, sizeof(buf), i ? ",%d" : "%d", tuning.cpus[i]);
+            out += buf;
+        }
+        if (!result.pinned) {
+            snprintf(buf, sizeof(buf), " refused (%s)", strerror(result.affinity_error));
+            out += buf;
+        }
+    }
+    if (tuning.policy != SCHED_OTHER) {
+        if (!out.empty())
+            out += ", ";
+        if (result.policy != tuning.policy || result.priority != tuning.priority) {
+            snprintf(buf, sizeof(buf), "%s %d refused (%s), ", policy_name(tuning.policy),
+                     tuning.priority, strerror(result.sched_error));
+            out += buf;
+        }
+        snprintf(buf, sizeof(buf), "%s", policy_name(result.policy));
+        out += buf;
+        if (result.policy != SCHED_OTHER) {
+            snprintf(buf, sizeof(buf), " %d", result.priority);
+            out += buf;
+        }
+    }
+    return out;
+}
+
+int parse_cpu_list(const char* list, vector<int>* cpus) {
+    cpus->clear();
+    for (const char* p = list; *p; ) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0)
+            return -1;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu += 1)
+            cpus->push_back((int)cpu);
+        if (*end && *end != ',')
+            return -1;
+        p = *end ? end + 1 : end;
+    }
+    return cpus->empty() ? -1 : 0;
+}
+
+int lock_memory(void* p, size_t bytes) {
+    if (bytes == 0)
+        return 0;
+    long page = sysconf(_SC_PAGESIZE);
+    volatile char* c = (volatile char*)p;
+    for (size_t i = 0; i < bytes; i += (size_t)page)
+        c[i] = c[i];
+    c[bytes - 1] = c[bytes - 1];
+    if (mlock(p, bytes) != 0)
+        return errno;
+    return 0;
+}
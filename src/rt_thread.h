@@ -0,0 +1,46 @@
+#ifndef AUDIOCAPTURE_RT_THREAD_H
+#define AUDIOCAPTURE_RT_THREAD_H
+
+#include <sched.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// CPU placement and scheduling for one of the capture threads: the event
+// loop (DeviceSupervisor), libsoundio's callback thread and the writer
+// (record_in's drain loop). Nothing here is fatal: what the system refuses
+// is reported and the thread carries on as it was.
+struct ThreadTuning {
+    std::vector<int> cpus;        // pin to these cores; empty = leave as is
+    int policy = SCHED_OTHER;     // SCHED_FIFO or SCHED_RR for realtime
+    int priority = 0;             // 1..99 with a realtime policy
+
+    bool requested() const { return !cpus.empty() || policy != SCHED_OTHER; }
+};
+
+// What the thread ended up with
+struct ThreadTuningResult {
+    bool pinned = false;
+    int affinity_error = 0;       // errno, ENOTSUP where there is no affinity API
+    int policy = SCHED_OTHER;
+    int priority = 0;
+    int sched_error = 0;          // errno of the last refused request
+};
+
+// Apply `tuning` to the calling thread. A realtime priority above
+// RLIMIT_RTPRIO is lowered to the limit before giving up on realtime.
+ThreadTuningResult tune_this_thread(const ThreadTuning& tuning);
+
+// e.g. "cpus 2,3, SCHED_FIFO 70" or "SCHED_FIFO 70 refused (Operation
+// not permitted), SCHED_OTHER"
+std::string describe_tuning(const ThreadTuning& tuning, const ThreadTuningResult& result);
+
+// "2,3" or "0-3,8"; returns 0, or -1 on a malformed list
+int parse_cpu_list(const char* list, std::vector<int>* cpus);
+
+// Fault in every page of [p, p + bytes) without changing its contents and
+// mlock it, so a realtime thread never waits for the pager. Returns 0 or
+// an errno (usually ENOMEM or EPERM from RLIMIT_MEMLOCK).
+int lock_memory(void* p, size_t bytes);
+
+#endif
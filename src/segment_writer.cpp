@@ -0,0 +1,429 @@
+#include "segment_writer.h"
+
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+using namespace std;
+
+int preallocate_file(int fd, int64_t length) {
+    if (length <= 0)
+        return 0;
+#if defined(__APPLE__)
+    // try for a contiguous extent first, then settle for any extents
+    fstore_t store = {F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t)length, 0};
+    if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(fd, F_PREALLOCATE, &store) == -1)
+            return -1;
+    }
+    return 0;
+#elif defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)length);
+#else
+    (void)fd;
+    return -1;
+#endif
+}
+
+int64_t realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int write_all(int fd, const char* buf, int64_t bytes) {
+    int64_t done = 0;
+    while (done < bytes) {
+        ssize_t amt = ::write(fd, buf + done, (size_t)(bytes - done));
+        if (amt < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += amt;
+    }
+    return 0;
+}
+
+// runs on the helper thread; returns the new fd or -errno
+static int open_segment_file(string path, int64_t prealloc_bytes, string header) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -errno;
+    if (preallocate_file(fd, prealloc_bytes + (int64_t)header.size()) != 0) {
+        // not fatal; the segment just grows on demand like before
+    }
+    if (!header.empty() && write_all(fd, header.data(), header.size()) != 0) {
+        int err = errno;
+        ::close(fd);
+        return -err;
+    }
+    return fd;
+}
+
+SegmentWriter::SegmentWriter(const SegmentConfig& config)
+: m_config(config) {
+
+    int bpf = m_config.bytes_per_frame;
+    int64_t limit = 0;
+    if (m_config.segment_seconds > 0) {
+        m_frame_limit = (int64_t)(m_config.segment_seconds * m_config.sample_rate + 0.5);
+        limit = m_frame_limit * bpf;
+    }
+    if (m_config.segment_bytes > 0) {
+        int64_t by_size = (m_config.segment_bytes / bpf) * bpf;
+        if (by_size < bpf)
+            by_size = bpf;
+        if (limit == 0 || by_size < limit)
+            limit = by_size;
+    }
+    m_segment_limit = limit;
+
+    if (m_config.container != ContainerRaw) {
+        char header[WAV_MAX_HEADER_SIZE];
+        m_header_size = build_header(header);
+        m_placeholder_header.assign(header, m_header_size);
+        m_patch_interval = (int64_t)(m_config.header_patch_seconds * m_config.sample_rate);
+    }
+}
+
+SegmentWriter::~SegmentWriter() {
+    close();
+}
+
+string SegmentWriter::segment_path(int segment) const {
+    if (!segmented())
+        return m_config.base_path + m_config.extension;
+    char num[16];
+    snprintf(num, sizeof(num), ".%06d", segment);
+    const string& base = m_spill_base.empty() ? m_config.base_path : m_spill_base;
+    return base + num + m_config.extension;
+}
+
+void SegmentWriter::open_next_async() {
+    m_next_path = segment_path(m_segment + 1);
+    m_next_fd = async(launch::async, open_segment_file,
+                      m_next_path, m_segment_limit, m_placeholder_header);
+}
+
+int SegmentWriter::open(int64_t capture_start_ns) {
+    m_capture_start_ns = capture_start_ns;
+    m_segment = 0;
+    m_segment_written = 0;
+    m_segment_frames = 0;
+    m_last_patch = 0;
+    m_segment_start_frame = 0;
+    m_frames_written = 0;
+    m_capture_frames = 0;
+    m_bytes_written = 0;
+
+    m_path = segment_path(0);
+    m_fd = open_segment_file(m_path, m_segment_limit, m_placeholder_header);
+    if (m_fd < 0) {
+        cerr << "unable to open file " << m_path << ": " << strerror(-m_fd) << endl;
+        m_fd = -1;
+        return 1;
+    }
+
+    if (segmented()) {
+        string index_path = m_config.base_path + ".index";
+        m_index = fopen(index_path.c_str(), "w");
+        if (!m_index) {
+            cerr << "unable to open index " << index_path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        fprintf(m_index, "# segment start_frame frame_count start_time_ns path\n");
+        fflush(m_index);
+        open_next_async();
+    }
+    return 0;
+}
+
+int SegmentWriter::build_header(char* out) const {
+    if (m_config.container == ContainerFlac) {
+        FlacStreamInfo info = m_config.flac_info;
+        info.total_samples = (uint64_t)m_segment_frames;
+        info.min_frame_size = m_min_frame_size;
+        info.min_block_size = m_min_block_size;
+        info.max_frame_size = m_max_frame_size;
+        return flac_build_header(info, out);
+    }
+    return wav_build_header(m_config.wav_format, (uint64_t)m_segment_written, out);
+}
+
+int SegmentWriter::patch_header() {
+    if (m_config.container == ContainerRaw || m_fd < 0)
+        return 0;
+    char header[WAV_MAX_HEADER_SIZE];
+    int size = build_header(header);
+    if (pwrite(m_fd, header, size, 0) != size) {
+        cerr << "header write error: " << strerror(errno) << endl;
+        return 1;
+    }
+    m_last_patch = m_segment_frames;
+    return 0;
+}
+
+int SegmentWriter::finish_segment() {
+    if (m_fd < 0)
+        return 0;
+
+    // drop any preallocated tail beyond what was written
+    if (ftruncate(m_fd, (off_t)(m_header_size + m_segment_written)) != 0) {
+        cerr << "truncate error: " << strerror(errno) << endl;
+    }
+    patch_header();
+    ::close(m_fd);
+    m_fd = -1;
+
+    if (m_index) {
+        int64_t start_ns = m_capture_start_ns +
+            (int64_t)((double)m_segment_start_frame * 1e9 / m_config.sample_rate);
+        fprintf(m_index, "%d %lld %lld %lld %s\n", m_segment,
+                (long long)m_segment_start_frame, (long long)m_segment_frames,
+                (long long)start_ns, m_path.c_str());
+        fflush(m_index);
+    }
+    return 0;
+}
+
+int SegmentWriter::rotate() {
+    finish_segment();
+
+    // normally finished long ago; only blocks if the disk is stalled
+    int fd = m_next_fd.get();
+    m_segment += 1;
+    m_segment_written = 0;
+    m_segment_frames = 0;
+    m_min_frame_size = m_max_frame_size = 0;
+    m_min_block_size = m_last_block_size = 0;
+    m_last_patch = 0;
+    m_segment_start_frame = m_capture_frames;
+    m_path = m_next_path;
+    if (fd < 0) {
+        cerr << "unable to open file " << m_path << ": " << strerror(-fd) << endl;
+        return 1;
+    }
+    m_fd = fd;
+    open_next_async();
+    return 0;
+}
+
+int SegmentWriter::spill(const string& dir) {
+    if (!segmented() || m_fd < 0)
+        return 1;
+    string base;
+    if (!dir.empty()) {
+        size_t slash = m_config.base_path.rfind('/');
+        base = dir + "/" + (slash == string::npos ? m_config.base_path : m_config.base_path.substr(slash + 1));
+    }
+    if (base == m_spill_base)
+        return 0;
+    m_spill_base = base;
+
+    // the next segment is already open in the old directory
+    int fd = m_next_fd.get();
+    if (fd >= 0) {
+        ::close(fd);
+        unlink(m_next_path.c_str());
+    }
+    if (m_segment_written > 0) {
+        open_next_async();
+        return rotate();
+    }
+
+    // nothing in the current segment yet: open it again over there
+    ::close(m_fd);
+    unlink(m_path.c_str());
+    m_path = segment_path(m_segment);
+    m_fd = open_segment_file(m_path, m_segment_limit, m_placeholder_header);
+    if (m_fd < 0) {
+        cerr << "unable to open file " << m_path << ": " << strerror(-m_fd) << endl;
+        m_fd = -1;
+        return 1;
+    }
+    open_next_async();
+    return 0;
+}
+
+void SegmentWriter::account(int64_t bytes, int64_t frames) {
+    m_segment_written += bytes;
+    m_segment_frames += frames;
+    m_bytes_written += bytes;
+    m_frames_written += frames;
+    m_capture_frames += frames;
+}
+
+int SegmentWriter::skip(int64_t frames, bool new_segment) {
+    if (frames <= 0)
+        return 0;
+    if (segmented() && new_segment) {
+        m_capture_frames += frames;
+        if (m_segment_frames == 0) {
+            // nothing written to this segment yet; just move its start
+            m_segment_start_frame = m_capture_frames;
+            return 0;
+        }
+        return rotate();
+    }
+
+    // skips with nothing written in between are one gap, logged once the
+    // next frames (or close) show where it ends
+    if (m_gap_frames == 0)
+        m_gap_capture_frame = m_capture_frames;
+    m_gap_frames += frames;
+    m_capture_frames += frames;
+    return 0;
+}
+
+int SegmentWriter::log_gap() {
+    if (m_gap_frames == 0)
+        return 0;
+    if (!m_gaps) {
+        string gaps_path = m_config.base_path + ".gaps";
+        m_gaps = fopen(gaps_path.c_str(), "w");
+        if (!m_gaps) {
+            cerr << "unable to open " << gaps_path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        fprintf(m_gaps, "# output_frame capture_frame skipped_frames\n");
+    }
+    fprintf(m_gaps, "%lld %lld %lld\n", (long long)m_frames_written,
+            (long long)m_gap_capture_frame, (long long)m_gap_frames);
+    fflush(m_gaps);
+    m_gap_frames = 0;
+    return 0;
+}
+
+int SegmentWriter::write(const char* buf, int64_t bytes) {
+    if (bytes > 0 && log_gap())
+        return 1;
+    while (bytes > 0) {
+        if (m_fd < 0)
+            return 1;
+
+        int64_t chunk = bytes;
+        if (segmented() && m_segment_written + chunk > m_segment_limit) {
+            chunk = m_segment_limit - m_segment_written;
+        }
+
+        if (write_all(m_fd, buf, chunk) != 0) {
+            cerr << "write error: " << strerror(errno) << endl;
+            return 1;
+        }
+
+        buf += chunk;
+        bytes -= chunk;
+        account(chunk, chunk / m_config.bytes_per_frame);
+
+        if (m_config.container != ContainerRaw &&
+            m_segment_frames - m_last_patch >= m_patch_interval) {
+            if (patch_header())
+                return 1;
+        }
+
+        if (segmented() && m_segment_written >= m_segment_limit) {
+            if (rotate())
+                return 1;
+        }
+    }
+    return 0;
+}
+
+int SegmentWriter::write_flac_frame(const uint8_t* body, size_t size, int frames,
+                                    int channel_assignment) {
+    if (m_fd < 0 || log_gap())
+        return 1;
+
+    // sample numbers restart in every segment, each one is a complete stream
+    uint8_t header[FLAC_MAX_FRAME_HEADER_SIZE];
+    int header_size = flac_frame_header(m_config.flac_info, frames, channel_assignment,
+                                        (uint64_t)m_segment_frames, header);
+    uint16_t crc = flac_crc16(header, header_size, 0);
+    crc = flac_crc16(body, size, crc);
+    uint8_t footer[2] = { (uint8_t)(crc >> 8), (uint8_t)crc };
+
+    struct iovec iov[3] = {
+        { header, (size_t)header_size },
+        { (void*)body, size },
+        { footer, sizeof(footer) },
+    };
+    size_t total = header_size + size + sizeof(footer);
+    size_t done = 0;
+    int first = 0;
+    while (done < total) {
+        ssize_t amt = writev(m_fd, iov + first, 3 - first);
+        if (amt < 0) {
+            if (errno == EINTR)
+                continue;
+            cerr << "write error: " << strerror(errno) << endl;
+            return 1;
+        }
+        done += amt;
+        // step over whatever a short write consumed
+        while (first < 3 && (size_t)amt >= iov[first].iov_len) {
+            amt -= iov[first].iov_len;
+            first += 1;
+        }
+        if (first < 3) {
+            iov[first].iov_base = (char*)iov[first].iov_base + amt;
+            iov[first].iov_len -= amt;
+        }
+    }
+
+    uint32_t frame_size = (uint32_t)total;
+    if (m_min_frame_size == 0 || frame_size < m_min_frame_size)
+        m_min_frame_size = frame_size;
+    if (frame_size > m_max_frame_size)
+        m_max_frame_size = frame_size;
+    // the last frame may be short without lowering the minimum, so each
+    // frame only counts once another one follows it
+    if (m_last_block_size > 0 && (m_min_block_size == 0 || m_last_block_size < m_min_block_size))
+        m_min_block_size = m_last_block_size;
+    m_last_block_size = frames;
+    account((int64_t)total, frames);
+
+    if (m_segment_frames - m_last_patch >= m_patch_interval) {
+        if (patch_header())
+            return 1;
+    }
+
+    bool full = (m_frame_limit > 0 && m_segment_frames >= m_frame_limit) ||
+                (m_config.segment_bytes > 0 && m_segment_written >= m_config.segment_bytes);
+    if (full)
+        return rotate();
+    return 0;
+}
+
+int SegmentWriter::close() {
+    log_gap();
+    if (m_fd >= 0 && segmented() && m_segment_written == 0 && m_segment > 0) {
+        // rotation left an empty segment behind; don't index it
+        ::close(m_fd);
+        m_fd = -1;
+        unlink(m_path.c_str());
+    }
+    finish_segment();
+    if (m_next_fd.valid()) {
+        int fd = m_next_fd.get();
+        if (fd >= 0) {
+            ::close(fd);
+            unlink(m_next_path.c_str());
+        }
+    }
+    if (m_index) {
+        fclose(m_index);
+        m_index = nullptr;
+    }
+    if (m_gaps) {
+        fclose(m_gaps);
+        m_gaps = nullptr;
+    }
+    return 0;
+}
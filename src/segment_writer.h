@@ -0,0 +1,154 @@
+#ifndef AUDIOCAPTURE_SEGMENT_WRITER_H
+#define AUDIOCAPTURE_SEGMENT_WRITER_H
+
+#include "flac_encoder.h"
+#include "wav_header.h"
+
+#include <stdint.h>
+#include <future>
+#include <string>
+
+enum OutputContainer {
+    ContainerRaw,
+    ContainerWav,
+    ContainerFlac,
+};
+
+// Segment rotation settings. With both limits at zero a single unbounded
+// file named `base_path + extension` is written, which is the historical
+// behaviour of record_in.
+struct SegmentConfig {
+    std::string base_path;        // e.g. "/tmp/recordconv-<device name>"
+    std::string extension;        // e.g. ".raw"
+    double segment_seconds = 0;   // rotate after this much audio (0 = off)
+    int64_t segment_bytes = 0;    // rotate after this many bytes (0 = off)
+    int bytes_per_frame = 0;
+    int sample_rate = 0;
+
+    // WAV and FLAC segments start with a header. It is written with zero
+    // sizes when the segment is opened and back-patched in place every
+    // `header_patch_seconds` of audio and when the segment is closed.
+    OutputContainer container = ContainerRaw;
+    WavFormat wav_format;
+    FlacStreamInfo flac_info;
+    double header_patch_seconds = 5;
+};
+
+// Writes interleaved frames to a sequence of segment files
+//
+//   <base_path>.000000<extension>, <base_path>.000001<extension>, ...
+//
+// Each segment is preallocated to its full size so it does not fragment
+// while it grows, and the next segment is opened and preallocated on a
+// helper thread while the current one is being filled, so rotating never
+// stalls the drain loop on open()/fallocate().
+//
+// When a segment is finished a line is appended to `<base_path>.index`:
+//
+//   <segment> <start frame> <frame count> <start time ns> <path>
+//
+// where the start frame counts capture frames (including any skipped ones)
+// and the start time is CLOCK_REALTIME of the first frame, derived from
+// the capture start time and the frame position. Only finished segments
+// are listed, so downstream jobs may process every indexed file while
+// capture continues.
+//
+// Frames that were captured but deliberately not written are reported with
+// skip(). A skip either starts a new segment (when segmenting and asked to)
+// or is logged to `<base_path>.gaps` as
+//
+//   <output frame> <capture frame> <skipped frames>
+//
+// so the capture timeline can be rebuilt from the written frames. Skips
+// with nothing written between them are logged as one gap.
+class SegmentWriter
+{
+public:
+    explicit SegmentWriter(const SegmentConfig& config);
+    ~SegmentWriter();
+
+    // capture_start_ns is the realtime clock at frame zero
+    int open(int64_t capture_start_ns);
+
+    // raw and WAV containers: interleaved PCM, split across segments on
+    // frame boundaries
+    int write(const char* buf, int64_t bytes);
+
+    // FLAC container: one encoded frame body from FlacEncoderPool. Frames
+    // are never split; a segment is rotated after the frame that reaches
+    // its limit.
+    int write_flac_frame(const uint8_t* body, size_t size, int frames, int channel_assignment);
+
+    // `frames` capture frames were dropped before the next write. With
+    // `new_segment` the next write starts a new segment instead of logging
+    // a gap; use it for long, rare gaps (pre-roll events), not for gated
+    // pauses between words.
+    int skip(int64_t frames, bool new_segment);
+
+    // Segments from now on are written to directory `dir` under the same
+    // names (a second disk for when this one cannot keep up), or back next
+    // to base_path for an empty `dir`. The current segment is finished
+    // first so the switch is immediate; the index keeps each segment's
+    // real path. Segmented output only.
+    int spill(const std::string& dir);
+
+    int close();
+
+    int64_t frames_written() const { return m_frames_written; }
+    int64_t frames_skipped() const { return m_capture_frames - m_frames_written; }
+    int64_t bytes_written() const { return m_bytes_written; }
+    int segment_count() const { return m_segment + 1; }
+
+private:
+    bool segmented() const { return m_segment_limit > 0; }
+    std::string segment_path(int segment) const;   // under the current directory
+    int build_header(char* out) const;
+    int rotate();
+    int finish_segment();
+    void open_next_async();
+    int patch_header();
+    int log_gap();
+    void account(int64_t bytes, int64_t frames);
+
+    SegmentConfig m_config;
+    int64_t m_segment_limit = 0;   // PCM bytes per segment, whole frames
+    int64_t m_frame_limit = 0;     // frames per segment (0 = no time limit)
+    int m_header_size = 0;
+    std::string m_placeholder_header;
+    int64_t m_patch_interval = 0;  // frames between header patches
+    int64_t m_last_patch = 0;
+    int64_t m_capture_start_ns = 0;
+
+    std::string m_spill_base;      // base_path moved to the spill directory, or empty
+    std::string m_path;            // the open segment
+    std::string m_next_path;       // the one opening on the helper thread
+
+    int m_fd = -1;
+    int m_segment = 0;
+    int64_t m_segment_written = 0; // payload bytes after the header
+    int64_t m_segment_frames = 0;
+    int64_t m_segment_start_frame = 0;
+    int64_t m_frames_written = 0;
+    int64_t m_capture_frames = 0;  // written + skipped
+    int64_t m_bytes_written = 0;
+    uint32_t m_min_frame_size = 0;
+    uint32_t m_max_frame_size = 0;
+    int m_min_block_size = 0;      // of all FLAC frames but the last
+    int m_last_block_size = 0;
+    FILE* m_index = nullptr;
+    FILE* m_gaps = nullptr;
+    int64_t m_gap_frames = 0;      // skipped since the last write, not yet logged
+    int64_t m_gap_capture_frame = 0;
+
+    std::future<int> m_next_fd;
+};
+
+// Reserve `length` bytes of disk for fd without changing the file size.
+// Returns 0 on success and -1 if the platform or filesystem cannot do it;
+// callers treat failure as a hint, not an error.
+int preallocate_file(int fd, int64_t length);
+
+// CLOCK_REALTIME in nanoseconds
+int64_t realtime_ns();
+
+#endif
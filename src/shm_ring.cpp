@@ -0,0 +1,298 @@
+#include "shm_ring.h"
+#include "rt_thread.h"
+
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static size_t page_size() {
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// Map `header_bytes + capacity` bytes of `fd` followed by a second mapping
+// of the data area, so data[capacity + i] aliases data[i]. Returns the base
+// address or nullptr.
+static char* map_mirrored(int fd, size_t header_bytes, size_t capacity) {
+    int prot = PROT_READ | PROT_WRITE;
+    size_t total = header_bytes + 2 * capacity;
+    void* reserve = mmap(nullptr, total, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (reserve == MAP_FAILED)
+        return nullptr;
+    char* base = (char*)reserve;
+    if (mmap(base, header_bytes + capacity, prot, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(base + header_bytes + capacity, capacity, prot, MAP_SHARED | MAP_FIXED,
+             fd, (off_t)header_bytes) == MAP_FAILED) {
+        munmap(reserve, total);
+        return nullptr;
+    }
+    return base;
+}
+
+static bool process_alive(uint32_t pid) {
+    return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+}
+
+ShmRingWriter::ShmRingWriter() {
+}
+
+ShmRingWriter::~ShmRingWriter() {
+    close();
+}
+
+int ShmRingWriter::create(const string& name, int64_t capacity, int sample_rate,
+                          int channels, int format, int bytes_per_frame) {
+    size_t page = page_size();
+    size_t header_bytes = page;
+    if (sizeof(ShmRingHeader) > header_bytes || capacity <= 0 || bytes_per_frame <= 0) {
+        cerr << "invalid shared memory ring size" << endl;
+        return 1;
+    }
+    // whole pages for the mirror, whole frames so skipping keeps alignment
+    size_t unit = page;
+    while (unit % bytes_per_frame)
+        unit += page;
+    size_t data_bytes = ((size_t)capacity + unit - 1) / unit * unit;
+
+    // a stale ring from a crashed writer would keep readers on dead data
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0) {
+        cerr << "unable to create shared memory " << name << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    if (ftruncate(fd, (off_t)(header_bytes + data_bytes)) != 0) {
+        cerr << "unable to size shared memory " << name << ": " << strerror(errno) << endl;
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return 1;
+    }
+    char* base = map_mirrored(fd, header_bytes, data_bytes);
+    ::close(fd);
+    if (!base) {
+        cerr << "unable to map shared memory " << name << ": " << strerror(errno) << endl;
+        shm_unlink(name.c_str());
+        return 1;
+    }
+
+    m_name = name;
+    m_map_bytes = header_bytes + 2 * data_bytes;
+    m_header = (ShmRingHeader*)base;
+    m_data = base + header_bytes;
+
+    // the segment is zero filled, which is a valid state for every atomic
+    m_header->version = SHM_RING_VERSION;
+    m_header->header_bytes = (uint32_t)header_bytes;
+    m_header->sample_rate = sample_rate;
+    m_header->channels = channels;
+    m_header->format = format;
+    m_header->bytes_per_frame = bytes_per_frame;
+    m_header->writer_pid = (uint32_t)getpid();
+    m_header->capacity = data_bytes;
+    m_header->magic.store(SHM_RING_MAGIC, memory_order_release);
+    return 0;
+}
+
+void ShmRingWriter::close() {
+    if (!m_header)
+        return;
+    m_header->closed.store(1, memory_order_release);
+    munmap(m_header, m_map_bytes);
+    // attached readers keep their mappings and drain what is left
+    shm_unlink(m_name.c_str());
+    m_header = nullptr;
+    m_data = nullptr;
+}
+
+int ShmRingWriter::lock_memory() {
+    if (!m_header)
+        return EINVAL;
+    return ::lock_memory(m_header, m_map_bytes);
+}
+
+void ShmRingWriter::write(const char* buf, int64_t bytes) {
+    if (!m_header || bytes <= 0)
+        return;
+    uint64_t pos = m_header->write_pos.load(memory_order_relaxed);
+    if ((uint64_t)bytes > m_header->capacity) {
+        // only the newest `capacity` bytes could ever be read
+        uint64_t drop = (uint64_t)bytes - m_header->capacity;
+        pos += drop;
+        buf += drop;
+        bytes = (int64_t)m_header->capacity;
+    }
+    uint64_t end = pos + (uint64_t)bytes;
+    m_header->write_claim.store(end, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(m_data + pos % m_header->capacity, buf, (size_t)bytes);
+    m_header->write_pos.store(end, memory_order_release);
+}
+
+int ShmRingWriter::readers() const {
+    int count = 0;
+    for (int i = 0; m_header && i < SHM_RING_MAX_READERS; i += 1) {
+        if (m_header->readers[i].pid.load(memory_order_relaxed))
+            count += 1;
+    }
+    return count;
+}
+
+uint64_t ShmRingWriter::max_lag_bytes() const {
+    uint64_t lag = 0;
+    if (!m_header)
+        return lag;
+    uint64_t pos = m_header->write_pos.load(memory_order_relaxed);
+    for (int i = 0; i < SHM_RING_MAX_READERS; i += 1) {
+        const ShmReaderSlot& slot = m_header->readers[i];
+        if (!slot.pid.load(memory_order_relaxed))
+            continue;
+        uint64_t read_pos = slot.read_pos.load(memory_order_relaxed);
+        if (pos > read_pos && pos - read_pos > lag)
+            lag = pos - read_pos;
+    }
+    return lag;
+}
+
+uint64_t ShmRingWriter::reader_overruns() const {
+    uint64_t overruns = 0;
+    for (int i = 0; m_header && i < SHM_RING_MAX_READERS; i += 1) {
+        const ShmReaderSlot& slot = m_header->readers[i];
+        if (slot.pid.load(memory_order_relaxed))
+            overruns += slot.overruns.load(memory_order_relaxed);
+    }
+    return overruns;
+}
+
+uint64_t ShmRingWriter::bytes_written() const {
+    return m_header ? m_header->write_pos.load(memory_order_relaxed) : 0;
+}
+
+ShmRingReader::ShmRingReader() {
+}
+
+ShmRingReader::~ShmRingReader() {
+    detach();
+}
+
+int ShmRingReader::attach(const string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        cerr << "unable to open shared memory " << name << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    // read the geometry from the header page before mapping the mirror
+    size_t page = page_size();
+    struct stat st;
+    ShmRingHeader* probe = nullptr;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size > page) {
+        void* p = mmap(nullptr, page, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+            probe = (ShmRingHeader*)p;
+    }
+    if (!probe || probe->magic.load(memory_order_acquire) != SHM_RING_MAGIC ||
+        probe->version != SHM_RING_VERSION ||
+        probe->header_bytes + probe->capacity != (uint64_t)st.st_size) {
+        cerr << "shared memory " << name << " is not an audiocapture ring" << endl;
+        if (probe)
+            munmap(probe, page);
+        ::close(fd);
+        return 1;
+    }
+    size_t header_bytes = probe->header_bytes;
+    size_t capacity = (size_t)probe->capacity;
+    munmap(probe, page);
+
+    // readers write their cursor into the header, so the mapping is shared
+    // read-write; the data area is never written by a reader
+    char* base = map_mirrored(fd, header_bytes, capacity);
+    ::close(fd);
+    if (!base) {
+        cerr << "unable to map shared memory " << name << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    m_map_bytes = header_bytes + 2 * capacity;
+    m_header = (ShmRingHeader*)base;
+    m_data = base + header_bytes;
+
+    uint32_t self = (uint32_t)getpid();
+    for (int i = 0; i < SHM_RING_MAX_READERS && !m_slot; i += 1) {
+        ShmReaderSlot& slot = m_header->readers[i];
+        uint32_t pid = slot.pid.load(memory_order_relaxed);
+        if (pid != 0 && process_alive(pid))
+            continue;
+        if (slot.pid.compare_exchange_strong(pid, self))
+            m_slot = &slot;
+    }
+    if (!m_slot) {
+        cerr << "shared memory " << name << " has no free reader slot" << endl;
+        detach();
+        return 1;
+    }
+    m_read_pos = m_header->write_pos.load(memory_order_acquire);
+    m_slot->overruns.store(0, memory_order_relaxed);
+    m_slot->read_pos.store(m_read_pos, memory_order_relaxed);
+    return 0;
+}
+
+void ShmRingReader::detach() {
+    if (!m_header)
+        return;
+    if (m_slot)
+        m_slot->pid.store(0, memory_order_release);
+    munmap(m_header, m_map_bytes);
+    m_header = nullptr;
+    m_slot = nullptr;
+    m_data = nullptr;
+}
+
+bool ShmRingReader::peek(const char** data, int64_t* bytes) {
+    uint64_t capacity = m_header->capacity;
+    uint64_t pos = m_header->write_pos.load(memory_order_acquire);
+    uint64_t claim = m_header->write_claim.load(memory_order_relaxed);
+    if (claim > m_read_pos + capacity) {
+        // lapped: resume half a ring behind the writer so the next few
+        // writes do not overrun us again straight away
+        uint64_t bpf = m_header->bytes_per_frame;
+        uint64_t back = capacity / 2 / bpf * bpf;
+        m_read_pos = pos > back ? pos - back : 0;
+        m_slot->overruns.fetch_add(1, memory_order_relaxed);
+        m_slot->read_pos.store(m_read_pos, memory_order_relaxed);
+    }
+    if (pos <= m_read_pos)
+        return false;
+    *data = m_data + m_read_pos % capacity;
+    *bytes = (int64_t)(pos - m_read_pos);
+    return true;
+}
+
+bool ShmRingReader::consume(int64_t bytes) {
+    // order the caller's reads of the span before the claim check
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t claim = m_header->write_claim.load(memory_order_relaxed);
+    bool intact = claim <= m_read_pos + m_header->capacity;
+    m_read_pos += (uint64_t)bytes;
+    m_slot->read_pos.store(m_read_pos, memory_order_relaxed);
+    if (!intact)
+        m_slot->overruns.fetch_add(1, memory_order_relaxed);
+    return intact;
+}
+
+bool ShmRingReader::finished() const {
+    return m_header->closed.load(memory_order_acquire) &&
+           m_read_pos >= m_header->write_pos.load(memory_order_acquire);
+}
+
+uint64_t ShmRingReader::overruns() const {
+    return m_slot ? m_slot->overruns.load(memory_order_relaxed) : 0;
+}
+
+uint64_t ShmRingReader::lag_bytes() const {
+    return m_header->write_pos.load(memory_order_relaxed) - m_read_pos;
+}
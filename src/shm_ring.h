@@ -0,0 +1,143 @@
+#ifndef AUDIOCAPTURE_SHM_RING_H
+#define AUDIOCAPTURE_SHM_RING_H
+
+// Client header for the shared-memory fan-out ring. A consumer process only
+// needs this header and shm_ring.cpp (or libaudiocapture):
+//
+//     ShmRingReader reader;
+//     if (reader.attach("/audiocapture-mic"))
+//         return 1;
+//     const char* data;
+//     int64_t bytes;
+//     while (!reader.finished()) {
+//         if (!reader.peek(&data, &bytes)) {
+//             usleep(10000);
+//             continue;
+//         }
+//         copy(data, bytes);
+//         if (reader.consume(bytes))
+//             process_copy();       // else the writer lapped us while copying
+//     }
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#define SHM_RING_MAGIC 0x52534341u   // "ACSR"
+#define SHM_RING_VERSION 1
+#define SHM_RING_MAX_READERS 16
+
+#if ATOMIC_LLONG_LOCK_FREE != 2 || ATOMIC_INT_LOCK_FREE != 2
+#error "shared memory ring needs lock-free 32 and 64 bit atomics"
+#endif
+
+struct ShmReaderSlot {
+    std::atomic<uint32_t> pid;         // 0 = free
+    std::atomic<uint64_t> read_pos;    // absolute byte position
+    std::atomic<uint64_t> overruns;
+};
+
+// Lives in the first page of the segment; the data area follows it and is
+// mapped twice back to back, like SoundIoRingBuffer, so every readable span
+// is contiguous. Positions are absolute byte counts that never wrap.
+struct ShmRingHeader {
+    std::atomic<uint32_t> magic;       // stored last by the writer
+    uint32_t version;
+    uint32_t header_bytes;             // offset of the data area (one page)
+    uint32_t sample_rate;
+    uint32_t channels;
+    int32_t format;                    // enum SoundIoFormat
+    uint32_t bytes_per_frame;
+    uint32_t writer_pid;
+    uint64_t capacity;                 // data area bytes, whole pages and frames
+
+    // The writer bumps write_claim before touching the data and write_pos
+    // after; a reader whose span fell below write_claim - capacity while it
+    // was reading knows the bytes were overwritten under it.
+    std::atomic<uint64_t> write_claim;
+    std::atomic<uint64_t> write_pos;
+    std::atomic<uint32_t> closed;      // writer has gone away
+
+    ShmReaderSlot readers[SHM_RING_MAX_READERS];
+};
+
+// Publishes captured frames. write() does no system calls and takes no
+// locks, so it may be called from the realtime read callback. The writer
+// never waits for readers: a reader that falls more than `capacity` behind
+// is overrun and skips ahead.
+class ShmRingWriter
+{
+public:
+    ShmRingWriter();
+    ~ShmRingWriter();
+
+    ShmRingWriter(const ShmRingWriter&) = delete;
+    ShmRingWriter& operator=(const ShmRingWriter&) = delete;
+
+    // Create (replacing any stale segment of the same name) and map the
+    // ring. `capacity` is rounded up to whole pages and frames.
+    int create(const std::string& name, int64_t capacity, int sample_rate,
+               int channels, int format, int bytes_per_frame);
+    void close();
+
+    // Whole frames; a block larger than the ring keeps only its tail
+    void write(const char* buf, int64_t bytes);
+
+    // Fault in and mlock both views of the ring so write() never page
+    // faults in the read callback. Returns 0 or an errno.
+    int lock_memory();
+
+    int readers() const;
+    uint64_t max_lag_bytes() const;    // furthest behind attached reader
+    uint64_t reader_overruns() const;  // summed over attached readers
+    uint64_t bytes_written() const;
+
+private:
+    std::string m_name;
+    ShmRingHeader* m_header = nullptr;
+    char* m_data = nullptr;
+    size_t m_map_bytes = 0;
+};
+
+class ShmRingReader
+{
+public:
+    ShmRingReader();
+    ~ShmRingReader();
+
+    ShmRingReader(const ShmRingReader&) = delete;
+    ShmRingReader& operator=(const ShmRingReader&) = delete;
+
+    // Map an existing ring and claim a reader slot; reading starts at the
+    // live edge. Slots left behind by dead processes are reclaimed.
+    int attach(const std::string& name);
+    void detach();
+
+    // Readable bytes at the cursor (whole frames). Skips ahead and counts an
+    // overrun when the writer has lapped the cursor. Returns false when
+    // there is nothing to read.
+    bool peek(const char** data, int64_t* bytes);
+
+    // Advance past `bytes` returned by peek(). Returns false if the writer
+    // overwrote part of them before the call, i.e. they must be discarded.
+    bool consume(int64_t bytes);
+
+    // writer closed and everything it wrote has been read
+    bool finished() const;
+
+    int sample_rate() const { return m_header->sample_rate; }
+    int channels() const { return m_header->channels; }
+    int format() const { return m_header->format; }
+    int bytes_per_frame() const { return m_header->bytes_per_frame; }
+    uint64_t overruns() const;
+    uint64_t lag_bytes() const;
+
+private:
+    ShmRingHeader* m_header = nullptr;
+    ShmReaderSlot* m_slot = nullptr;
+    char* m_data = nullptr;
+    size_t m_map_bytes = 0;
+    uint64_t m_read_pos = 0;
+};
+
+#endif
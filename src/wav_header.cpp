@@ -0,0 +1,178 @@
+#include "wav_header.h"
+
+#include <string.h>
+
+// KSDATAFORMAT_SUBTYPE_PCM / _IEEE_FLOAT share this GUID tail
+static const unsigned char wav_guid_tail[14] = {
+    0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+};
+
+int wav_format_from_soundio(enum SoundIoFormat fmt, int channels, int sample_rate,
+                            WavFormat* out) {
+    int tag = WAVE_FORMAT_PCM;
+    int bytes = 0;
+    int bits = 0;
+    switch (fmt) {
+        case SoundIoFormatU8:        bytes = 1; bits = 8; break;
+        case SoundIoFormatS16LE:     bytes = 2; bits = 16; break;
+        case SoundIoFormatS32LE:     bytes = 4; bits = 32; break;
+        case SoundIoFormatFloat32LE: bytes = 4; bits = 32; tag = WAVE_FORMAT_IEEE_FLOAT; break;
+        case SoundIoFormatFloat64LE: bytes = 8; bits = 64; tag = WAVE_FORMAT_IEEE_FLOAT; break;
+        default:
+            return -1;
+    }
+    out->format_tag = tag;
+    out->channels = channels;
+    out->sample_rate = sample_rate;
+    out->bytes_per_sample = bytes;
+    out->valid_bits = bits;
+    return 0;
+}
+
+static bool wav_needs_extensible(const WavFormat& wav) {
+    return wav.channels > 2 || wav.valid_bits != wav.bytes_per_sample * 8 ||
+           (wav.format_tag == WAVE_FORMAT_PCM && wav.bytes_per_sample > 2);
+}
+
+int wav_header_size(const WavFormat& wav) {
+    int fmt_size = wav_needs_extensible(wav) ? 40 : 16;
+    return 12 + 36 + (8 + fmt_size) + 8;
+}
+
+static char* put_tag(char* p, const char* tag) {
+    memcpy(p, tag, 4);
+    return p + 4;
+}
+
+static char* put_le(char* p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i += 1) {
+        *p++ = (char)((v >> (8 * i)) & 0xFF);
+    }
+    return p;
+}
+
+int wav_build_header(const WavFormat& wav, uint64_t data_bytes, char* out) {
+    bool extensible = wav_needs_extensible(wav);
+    int fmt_size = extensible ? 40 : 16;
+    int header_size = wav_header_size(wav);
+    int block_align = wav.channels * wav.bytes_per_sample;
+    uint64_t riff_size = data_bytes + header_size - 8;
+    bool rf64 = riff_size > 0xFFFFFFFFull;
+    char* p = out;
+
+    p = put_tag(p, rf64 ? "RF64" : "RIFF");
+    p = put_le(p, rf64 ? 0xFFFFFFFFu : riff_size, 4);
+    p = put_tag(p, "WAVE");
+
+    // 28 byte ds64 body, or the same space held by a JUNK chunk
+    p = put_tag(p, rf64 ? "ds64" : "JUNK");
+    p = put_le(p, 28, 4);
+    if (rf64) {
+        p = put_le(p, riff_size, 8);
+        p = put_le(p, data_bytes, 8);
+        p = put_le(p, block_align ? data_bytes / block_align : 0, 8);
+        p = put_le(p, 0, 4); // no extra chunk sizes in the table
+    } else {
+        memset(p, 0, 28);
+        p += 28;
+    }
+
+    p = put_tag(p, "fmt ");
+    p = put_le(p, fmt_size, 4);
+    p = put_le(p, extensible ? WAVE_FORMAT_EXTENSIBLE : wav.format_tag, 2);
+    p = put_le(p, wav.channels, 2);
+    p = put_le(p, wav.sample_rate, 4);
+    p = put_le(p, (uint64_t)wav.sample_rate * block_align, 4);
+    p = put_le(p, block_align, 2);
+    p = put_le(p, wav.bytes_per_sample * 8, 2);
+    if (extensible) {
+        p = put_le(p, 22, 2);               // cbSize
+        p = put_le(p, wav.valid_bits, 2);
+        p = put_le(p, 0, 4);                // channel mask: unspecified
+        p = put_le(p, wav.format_tag, 2);   // sub format GUID
+        memcpy(p, wav_guid_tail, sizeof(wav_guid_tail));
+        p += sizeof(wav_guid_tail);
+    }
+
+    p = put_tag(p, "data");
+    p = put_le(p, rf64 ? 0xFFFFFFFFu : data_bytes, 4);
+
+    return (int)(p - out);
+}
+
+static uint64_t get_le(const char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i -= 1) {
+        v = (v << 8) | (unsigned char)p[i];
+    }
+    return v;
+}
+
+int wav_parse_header(const char* buf, int size, WavFormat* wav, int64_t* data_offset,
+                     uint64_t* data_bytes) {
+    if (size < 12 || memcmp(buf + 8, "WAVE", 4) != 0)
+        return -1;
+    bool rf64 = memcmp(buf, "RF64", 4) == 0;
+    if (!rf64 && memcmp(buf, "RIFF", 4) != 0)
+        return -1;
+
+    bool have_fmt = false;
+    uint64_t ds64_data = UINT64_MAX;
+    int pos = 12;
+    while (pos + 8 <= size) {
+        const char* chunk = buf + pos;
+        uint64_t chunk_size = get_le(chunk + 4, 4);
+        const char* body = chunk + 8;
+        if (memcmp(chunk, "ds64", 4) == 0 && pos + 8 + 16 <= size) {
+            ds64_data = get_le(body + 8, 8);
+        } else if (memcmp(chunk, "fmt ", 4) == 0 && pos + 8 + 16 <= size) {
+            int tag = (int)get_le(body, 2);
+            wav->channels = (int)get_le(body + 2, 2);
+            wav->sample_rate = (int)get_le(body + 4, 4);
+            int bits = (int)get_le(body + 14, 2);
+            wav->bytes_per_sample = (bits + 7) / 8;
+            wav->valid_bits = bits;
+            if (tag == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 40 && pos + 8 + 40 <= size) {
+                wav->valid_bits = (int)get_le(body + 18, 2);
+                tag = (int)get_le(body + 24, 2);
+            }
+            wav->format_tag = tag;
+            have_fmt = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_fmt)
+                return -1;
+            *data_offset = pos + 8;
+            if (rf64 || chunk_size == 0xFFFFFFFFu) {
+                *data_bytes = ds64_data;
+            } else {
+                *data_bytes = chunk_size;
+            }
+            return 0;
+        }
+        if (chunk_size > (uint64_t)size)
+            break;
+        pos += 8 + (int)((chunk_size + 1) & ~(uint64_t)1);
+    }
+    return -1;
+}
+
+enum SoundIoFormat wav_format_to_soundio(const WavFormat& wav, bool* packed) {
+    *packed = false;
+    if (wav.format_tag == WAVE_FORMAT_IEEE_FLOAT) {
+        if (wav.bytes_per_sample == 4)
+            return SoundIoFormatFloat32LE;
+        if (wav.bytes_per_sample == 8)
+            return SoundIoFormatFloat64LE;
+        return SoundIoFormatInvalid;
+    }
+    if (wav.format_tag != WAVE_FORMAT_PCM)
+        return SoundIoFormatInvalid;
+    switch (wav.bytes_per_sample) {
+        case 1: return SoundIoFormatU8;
+        case 2: return SoundIoFormatS16LE;
+        case 3: *packed = true; return SoundIoFormatS24LE;
+        // a 32 bit word holds its valid bits at the top, whatever their number
+        case 4: return SoundIoFormatS32LE;
+    }
+    return SoundIoFormatInvalid;
+}
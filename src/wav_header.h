@@ -0,0 +1,59 @@
+#ifndef AUDIOCAPTURE_WAV_HEADER_H
+#define AUDIOCAPTURE_WAV_HEADER_H
+
+#include "soundio/soundio.h"
+
+#include <stdint.h>
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+// Largest header wav_build_header can produce:
+// RIFF(12) + JUNK/ds64(36) + extensible fmt(48) + data(8)
+#define WAV_MAX_HEADER_SIZE 104
+
+struct WavFormat {
+    int format_tag = 0;        // WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT
+    int channels = 0;
+    int sample_rate = 0;
+    int bytes_per_sample = 0;  // container size
+    int valid_bits = 0;        // the top bits of the container, e.g. 24 of 32
+};
+
+// Describe a libsoundio stream as a WAV format. Returns 0 on success and
+// -1 if the sample format has no WAV representation (big endian, unsigned
+// wider than 8 bits, signed 8 bit, and S24, whose samples sit in the low
+// three bytes of a 32 bit word where WAV expects them at the top; convert
+// it to S32).
+int wav_format_from_soundio(enum SoundIoFormat fmt, int channels, int sample_rate,
+                            WavFormat* out);
+
+// Size of the header for this format. It does not depend on the data size,
+// so a header written with a placeholder size can later be overwritten in
+// place.
+int wav_header_size(const WavFormat& wav);
+
+// Serialize a header describing `data_bytes` of sample data into `out`
+// (at least WAV_MAX_HEADER_SIZE bytes); returns the number of bytes.
+//
+// A JUNK chunk reserves room for an RF64 ds64 chunk. Once the file no
+// longer fits the 32 bit RIFF sizes the header is rewritten as RF64 with
+// the real sizes in ds64, so long captures stay readable.
+int wav_build_header(const WavFormat& wav, uint64_t data_bytes, char* out);
+
+// Parse the header at the start of a RIFF or RF64 file: `buf` holds its
+// first `size` bytes (WAV_PARSE_BYTES is enough for anything this program
+// writes). Sets the format, the offset of the sample data and the data
+// size the header claims (UINT64_MAX when it defers to the file size, as
+// RF64 and streamed headers may). Returns 0, or -1 if no fmt and data
+// chunk were found.
+#define WAV_PARSE_BYTES 4096
+int wav_parse_header(const char* buf, int size, WavFormat* wav, int64_t* data_offset,
+                     uint64_t* data_bytes);
+
+// The libsoundio format for a parsed header, SoundIoFormatInvalid if none.
+// `packed` is set for 24 bit samples stored in three bytes.
+enum SoundIoFormat wav_format_to_soundio(const WavFormat& wav, bool* packed);
+
+#endif